@@ -3,11 +3,32 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <ctype.h>
 
 #define STRUCTURE_PUSH_START_POSITION_ONE 1
+// Structures up to this size are copied a dword at a time, larger ones with "rep movsd"
+#define STRUCTURE_COPY_UNROLL_LIMIT 64
+// Structures of at least this size are copied 16 bytes at a time with SSE2
+#define STRUCTURE_COPY_SSE_THRESHOLD 512
 
 static struct compile_process *current_process;
 static struct node *current_function;
+// The label placed after the prologue of the current function, self tail calls jump here.
+static int current_function_body_label_id;
+// The switch statements generated so far in the current function, names their profile records.
+static int current_function_switches;
+// Vector of char* code of if statement bodies predicted not to run, generated after the current function.
+static struct vector *current_function_unlikely_paths;
+// Where the next structure returning call should construct its result, set by the receiver of the call.
+static struct codegen_return_slot
+{
+    // Address of the destination i.e "ebp-12", NULL when the call should use a temporary.
+    const char *address;
+    // True if the address holds a pointer to the destination rather than being the destination.
+    bool indirect;
+    // True if the call is an argument of another call, its result is constructed where the argument belongs.
+    bool argument;
+} codegen_return_slot;
 // Returned when we have no expression state.
 static struct expression_state blank_state = {};
 
@@ -21,6 +42,7 @@ void codegen_entity_address(struct generator *generator, struct resolver_entity
 void codegen_end_exp(struct generator *generator);
 void codegen_restore_assignment_right_operand(const char *output_register);
 void asm_push_ins_with_datatype(struct datatype* dtype, const char* fmt, ...);
+int asm_push_ins_pop(const char *fmt, int expecting_stack_entity_type, const char *expecting_stack_entity_name, ...);
 
 
 
@@ -41,6 +63,7 @@ struct generator x86_codegen = {
     .end_exp = codegen_end_exp,
     .entity_address = codegen_entity_address,
     .ret = asm_push_ins_with_datatype,
+    .pop = asm_push_ins_pop,
     .private = &_x86_generator_private};
 
 struct _x86_generator_private *x86_generator_private(struct generator *gen)
@@ -249,6 +272,29 @@ const char *codegen_get_label_for_string(const char *str)
     return result;
 }
 
+/**
+ * Registers the given floating point constant in the read only data and returns its label.
+ * Constants with the same bits share a label
+ */
+const char *codegen_register_floating_constant(double value)
+{
+    struct vector *constants = current_process->generator->floating_constants;
+    for (int i = 0; i < vector_count(constants); i++)
+    {
+        struct floating_constant_element *current = vector_peek_ptr_at(constants, i);
+        if (memcmp(&current->value, &value, sizeof(double)) == 0)
+        {
+            return current->label;
+        }
+    }
+
+    struct floating_constant_element *element = calloc(sizeof(struct floating_constant_element), 1);
+    sprintf((char *)element->label, "float_%i", codegen_label_count());
+    element->value = value;
+    vector_push(constants, &element);
+    return element->label;
+}
+
 static struct history *history_down(struct history *history, int flags)
 {
     struct history *new_history = calloc(sizeof(struct history), 1);
@@ -699,8 +745,91 @@ bool asm_datatype_back(struct datatype *dtype_out)
     return true;
 }
 
+/**
+ * Floating point values are computed with SSE2 as doubles. Float variables are widened as they
+ * are loaded and narrowed again when they are stored. A floating point value on the stack is
+ * a double taking two dwords, both marked with STACK_FRAME_ELEMENT_FLAG_IS_FLOATING.
+ */
+static bool codegen_floating_on_stack()
+{
+    struct stack_frame_element *element = asm_stack_back();
+    return element && element->flags & STACK_FRAME_ELEMENT_FLAG_IS_FLOATING;
+}
+
+/**
+ * Pushes the double in the given XMM register to the stack
+ */
+static void codegen_push_floating(const char *xmm_reg)
+{
+    asm_push("sub esp, %i", DATA_SIZE_DDWORD);
+    asm_push("movsd [esp], %s", xmm_reg);
+    for (int i = 0; i < DATA_SIZE_DDWORD / STACK_PUSH_SIZE; i++)
+    {
+        stackframe_push(current_function, &(struct stack_frame_element){.type = STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, .name = "result_value", .flags = STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE | STACK_FRAME_ELEMENT_FLAG_IS_FLOATING, .data.dtype = datatype_for_double()});
+    }
+}
+
+/**
+ * Pushes the value returned in st0 by a function, cdecl returns floats and doubles on the x87 stack
+ */
+static void codegen_push_floating_from_st0()
+{
+    asm_push("sub esp, %i", DATA_SIZE_DDWORD);
+    asm_push("fstp qword [esp]");
+    for (int i = 0; i < DATA_SIZE_DDWORD / STACK_PUSH_SIZE; i++)
+    {
+        stackframe_push(current_function, &(struct stack_frame_element){.type = STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, .name = "result_value", .flags = STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE | STACK_FRAME_ELEMENT_FLAG_IS_FLOATING, .data.dtype = datatype_for_double()});
+    }
+}
+
+static void codegen_pop_floating(const char *xmm_reg)
+{
+    assert(codegen_floating_on_stack());
+    asm_push("movsd %s, [esp]", xmm_reg);
+    asm_push("add esp, %i", DATA_SIZE_DDWORD);
+    for (int i = 0; i < DATA_SIZE_DDWORD / STACK_PUSH_SIZE; i++)
+    {
+        stackframe_pop_expecting(current_function, STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    }
+}
+
+/**
+ * Converts a floating point value on the stack into the integer an integer receiver expects,
+ * C converts by truncating towards zero.
+ */
+static void codegen_floating_to_integer()
+{
+    if (!codegen_floating_on_stack())
+        return;
+
+    codegen_pop_floating("xmm0");
+    asm_push("cvttsd2si eax, xmm0");
+    asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = datatype_for_numeric()});
+}
+
+/**
+ * Replaces a floating point value on the stack with 1 or 0 for the conditions that test it,
+ * truncating would treat 0.5 as false. NaN compares unordered and is true.
+ */
+static void codegen_floating_to_truth_value()
+{
+    if (!codegen_floating_on_stack())
+        return;
+
+    codegen_pop_floating("xmm0");
+    asm_push("xorpd xmm1, xmm1");
+    asm_push("ucomisd xmm0, xmm1");
+    asm_push("setne al");
+    asm_push("setp cl");
+    asm_push("or al, cl");
+    asm_push("movzx eax, al");
+    asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = datatype_for_numeric()});
+}
+
 int asm_push_ins_pop(const char *fmt, int expecting_stack_entity_type, const char *expecting_stack_entity_name, ...)
 {
+    codegen_floating_to_integer();
+
     char tmp_buf[200];
     sprintf(tmp_buf, "pop %s", fmt);
     va_list args;
@@ -723,6 +852,8 @@ int asm_push_ins_pop_or_ignore(const char *fmt, int expecting_stack_entity_type,
         return STACK_FRAME_ELEMENT_FLAG_ELEMENT_NOT_FOUND;
     }
 
+    codegen_floating_to_integer();
+
     char tmp_buf[200];
     sprintf(tmp_buf, "pop %s", fmt);
     va_list args;
@@ -904,6 +1035,22 @@ void codegen_write_strings()
     }
 }
 
+void codegen_write_floating_constants()
+{
+    struct vector *constants = current_process->generator->floating_constants;
+    if (!vector_count(constants))
+        return;
+
+    asm_push("align 8");
+    for (int i = 0; i < vector_count(constants); i++)
+    {
+        struct floating_constant_element *current = vector_peek_ptr_at(constants, i);
+        unsigned long long bits = 0;
+        memcpy(&bits, &current->value, sizeof(bits));
+        asm_push("%s: dq 0x%016llx", current->label, bits);
+    }
+}
+
 /**
  * Generates the read only data section
  */
@@ -911,10 +1058,15 @@ void codegen_generate_rod()
 {
     asm_push("section .rodata");
     codegen_write_strings();
+    codegen_write_floating_constants();
 }
 
 void codegen_generate_node(struct node *node);
 void codegen_generate_expressionable(struct node *node, struct history *history);
+static bool codegen_floating_type(struct node *node, struct datatype *dtype_out);
+static void codegen_push_integer_as_floating(struct datatype *dtype);
+static void codegen_generate_floating_value(struct node *node, struct history *history);
+static void codegen_store_floating(struct datatype *dtype, const char *address);
 void codegen_generate_new_expressionable(struct node *node, struct history *history)
 {
     codegen_generate_expressionable(node, history);
@@ -939,6 +1091,59 @@ void codegen_entity_address(struct generator *generator, struct resolver_entity
     address_out->offset = data->offset;
 }
 
+/**
+ * Thread local variables have no address of their own, every thread has a copy of them at a fixed
+ * distance from the thread pointer. The thread pointer is read from "gs:0" and the distance from the
+ * GOT entry the linker fills in (the initial-exec model), the address is loaded into the register.
+ */
+static bool codegen_entity_is_thread_local(struct resolver_entity *entity)
+{
+    struct node *var_node = entity ? variable_node(entity->node) : NULL;
+    return var_node && var_node->type == NODE_TYPE_VARIABLE && var_node->var.type.flags & DATATYPE_FLAG_IS_THREAD_LOCAL;
+}
+
+static void codegen_thread_local_address(const char *reg, const char *base_address, int offset, char *address_out)
+{
+    asm_push("mov %s, [gs:0]", reg);
+    asm_push("add %s, [%s wrt ..tlsie]", reg, base_address);
+    if (offset == 0)
+    {
+        sprintf(address_out, "%s", reg);
+        return;
+    }
+
+    sprintf(address_out, "%s+%i", reg, offset);
+}
+
+/**
+ * Returns the address of the entity, for thread local variables the address is first loaded into the register
+ */
+static const char *codegen_entity_address_in(struct resolver_entity *entity, const char *reg, char *address_out)
+{
+    struct resolver_default_entity_data *data = codegen_entity_private(entity);
+    if (!codegen_entity_is_thread_local(entity))
+    {
+        return data->address;
+    }
+
+    codegen_thread_local_address(reg, data->base_address, data->offset, address_out);
+    return address_out;
+}
+
+/**
+ * Returns the address of the root of the result, for thread local variables the address is first loaded into the register
+ */
+static const char *codegen_result_base_address_in(struct resolver_result *result, const char *reg, char *address_out)
+{
+    if (!codegen_entity_is_thread_local(resolver_result_entity_root(result)))
+    {
+        return result->base.address;
+    }
+
+    codegen_thread_local_address(reg, result->base.base_address, result->base.offset, address_out);
+    return address_out;
+}
+
 // Rename this function... terrible name
 // Return result should be used immedeitly and not stored
 // copy only! Temp result!
@@ -1038,6 +1243,29 @@ void codegen_goto_entry_point(struct node *current_node)
     asm_push("jmp .entry_point_%i", entry_point->id);
 }
 
+/**
+ * Aligns the loop that starts here to 16 bytes, the back edge then jumps to the start of a fetch block
+ */
+void codegen_align_loop_head()
+{
+    asm_push("align 16");
+}
+
+/**
+ * Starts a loop that tests its condition at the bottom, the entry point continue jumps to is
+ * placed before the condition with codegen_place_entry_point once the body is generated.
+ */
+void codegen_begin_rotated_loop()
+{
+    codegen_register_entry_point(codegen_label_count());
+    codegen_begin_exit_point();
+}
+
+void codegen_place_entry_point()
+{
+    asm_push(".entry_point_%i:", codegen_current_entry_point()->id);
+}
+
 void codegen_begin_entry_exit_point()
 {
     codegen_begin_entry_point();
@@ -1213,6 +1441,58 @@ void codegen_gen_math_for_value(const char *reg, const char *value, int flags, b
     }
 }
 
+/**
+ * Copies "size" bytes, a multiple of a dword, from the source address to the destination address.
+ * Small copies move a dword at a time, medium copies use "rep movsd" and large copies
+ * move 16 bytes at a time with SSE2. Clobbers EAX, ECX and EDX.
+ */
+static void codegen_generate_block_copy(const char *dst_address, const char *src_address, size_t size)
+{
+    if (size <= STRUCTURE_COPY_UNROLL_LIMIT)
+    {
+        for (int i = 0; i < size / DATA_SIZE_DWORD; i++)
+        {
+            char fmt[10];
+            codegen_plus_or_minus_string_for_value(fmt, i * DATA_SIZE_DWORD, sizeof(fmt));
+            asm_push("mov eax, [%s%s]", src_address, fmt);
+            asm_push("mov [%s%s], eax", dst_address, fmt);
+        }
+        return;
+    }
+
+    // Both addresses are taken first as they may be relative to ESP
+    asm_push("lea edx, [%s]", dst_address);
+    asm_push("lea eax, [%s]", src_address);
+    if (size < STRUCTURE_COPY_SSE_THRESHOLD)
+    {
+        // ESI and EDI must be preserved for our caller
+        asm_push("push esi");
+        asm_push("push edi");
+        asm_push("mov esi, eax");
+        asm_push("mov edi, edx");
+        asm_push("mov ecx, %i", (int)(size / DATA_SIZE_DWORD));
+        asm_push("rep movsd");
+        asm_push("pop edi");
+        asm_push("pop esi");
+        return;
+    }
+
+    int block_copy_id = codegen_label_count();
+    asm_push("mov ecx, %i", (int)(size / 16));
+    asm_push(".block_copy_%i:", block_copy_id);
+    asm_push("movdqu xmm0, [eax]");
+    asm_push("movdqu [edx], xmm0");
+    asm_push("add eax, 16");
+    asm_push("add edx, 16");
+    asm_push("dec ecx");
+    asm_push("jnz .block_copy_%i", block_copy_id);
+    for (int i = 0; i < (size % 16) / DATA_SIZE_DWORD; i++)
+    {
+        asm_push("mov ecx, [eax+%i]", i * DATA_SIZE_DWORD);
+        asm_push("mov [edx+%i], ecx", i * DATA_SIZE_DWORD);
+    }
+}
+
 /**
  * @brief Generates a structure to value operation. Pushing an entire structures memory
  * to the stack. Useful for passing structures to functions....
@@ -1227,12 +1507,28 @@ void codegen_generate_structure_push(struct resolver_entity *entity, struct hist
     size_t structure_size = align_value(entity->dtype.size, DATA_SIZE_DWORD);
     int pushes = structure_size / DATA_SIZE_DWORD;
 
-    for (int i = pushes - 1; i >= start_pos; i--)
+    if ((pushes - start_pos) * DATA_SIZE_DWORD > STRUCTURE_COPY_UNROLL_LIMIT)
     {
-        char fmt[10];
-        int chunk_offset = (i * DATA_SIZE_DWORD);
-        codegen_plus_or_minus_string_for_value(fmt, chunk_offset, sizeof(fmt));
-        asm_push_ins_push_with_data("dword [%s%s]", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype}, "ebx", fmt);
+        // Make the room in one go and copy the structure into it
+        for (int i = pushes - 1; i >= start_pos; i--)
+        {
+            stackframe_push(current_function, &(struct stack_frame_element){.type = STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, .name = "result_value", .flags = STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE, .data.dtype = entity->dtype});
+        }
+        asm_push("sub esp, %i", (pushes - start_pos) * DATA_SIZE_DWORD);
+
+        char src_address[20];
+        sprintf(src_address, "ebx+%i", start_pos * DATA_SIZE_DWORD);
+        codegen_generate_block_copy("esp", src_address, (pushes - start_pos) * DATA_SIZE_DWORD);
+    }
+    else
+    {
+        for (int i = pushes - 1; i >= start_pos; i--)
+        {
+            char fmt[10];
+            int chunk_offset = (i * DATA_SIZE_DWORD);
+            codegen_plus_or_minus_string_for_value(fmt, chunk_offset, sizeof(fmt));
+            asm_push_ins_push_with_data("dword [%s%s]", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype}, "ebx", fmt);
+        }
     }
     asm_push("; END STRUCTURE PUSH");
 
@@ -1243,6 +1539,18 @@ void codegen_generate_move_struct(struct datatype *dtype, const char *base_addre
 {
     size_t structure_size = align_value(datatype_size(dtype), DATA_SIZE_DWORD);
     int pops = structure_size / DATA_SIZE_DWORD;
+    if (structure_size > STRUCTURE_COPY_UNROLL_LIMIT)
+    {
+        // Copy the structure off the stack in one go and drop it
+        char fmt[10];
+        char dst_address[64];
+        codegen_plus_or_minus_string_for_value(fmt, offset, sizeof(fmt));
+        snprintf(dst_address, sizeof(dst_address), "%s%s", base_address, fmt);
+        codegen_generate_block_copy(dst_address, "esp", structure_size);
+        codegen_stack_add(structure_size);
+        return;
+    }
+
     for (int i = 0; i < pops; i++)
     {
         asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
@@ -1253,6 +1561,14 @@ void codegen_generate_move_struct(struct datatype *dtype, const char *base_addre
     }
 }
 
+/**
+ * Copies a structure from one address to another without going through the stack, clobbers EAX, ECX and EDX
+ */
+void codegen_generate_copy_struct(struct datatype *dtype, const char *dst_address, const char *src_address)
+{
+    codegen_generate_block_copy(dst_address, src_address, align_value(datatype_size(dtype), DATA_SIZE_DWORD));
+}
+
 void codegen_generate_structure_push_or_return(struct resolver_entity *entity, struct history *history, int start_pos)
 {
     codegen_generate_structure_push(entity, history, start_pos);
@@ -1277,7 +1593,8 @@ static void codegen_gen_mov_or_math(const char *reg, struct node *value_node, in
 
 static void codegen_gen_mem_access_get_address(struct node *value_node, int flags, struct resolver_entity *entity)
 {
-    asm_push("lea ebx, [%s]", codegen_entity_private(entity)->address);
+    char address[60];
+    asm_push("lea ebx, [%s]", codegen_entity_address_in(entity, "ebx", address));
     asm_push_ins_push_with_flags("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", STACK_FRAME_ELEMENT_FLAG_IS_PUSHED_ADDRESS);
 }
 
@@ -1324,7 +1641,8 @@ static void codegen_gen_mem_access(struct node *value_node, int flags, struct re
     }
     else if (datatype_element_size(&entity->dtype) != DATA_SIZE_DWORD)
     {
-        asm_push("mov eax, [%s]", codegen_entity_private(entity)->address);
+        char address[60];
+        asm_push("mov eax, [%s]", codegen_entity_address_in(entity, "eax", address));
         codegen_reduce_register("eax", datatype_element_size(&entity->dtype), entity->dtype.flags & DATATYPE_FLAG_IS_SIGNED);
         asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
     }
@@ -1332,7 +1650,8 @@ static void codegen_gen_mem_access(struct node *value_node, int flags, struct re
     {
         // This can be pushed straight to the stack? i.e 4 bytes in size..
         // Then don't waste instructions
-        asm_push_ins_push_with_data("dword [%s]", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype}, codegen_entity_private(entity)->address);
+        char address[60];
+        asm_push_ins_push_with_data("dword [%s]", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype}, codegen_entity_address_in(entity, "eax", address));
     }
 }
 /**
@@ -1519,6 +1838,160 @@ void codegen_generate_entity_access_for_variable_or_general(struct resolver_resu
     asm_push_ins_push_with_data("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
 }
 
+/**
+ * Returns the function call entity if the given expression is a direct call of a function
+ * by its name i.e "abc(50)" otherwise NULL is returned.
+ */
+static struct resolver_entity *codegen_direct_call_entity(struct node *exp_node)
+{
+    if (!is_parentheses_node(exp_node) || exp_node->exp.left->type != NODE_TYPE_IDENTIFIER)
+    {
+        return NULL;
+    }
+
+    struct resolver_result *result = resolver_follow(current_process->resolver, exp_node);
+    if (!resolver_result_ok(result))
+    {
+        return NULL;
+    }
+
+    struct resolver_entity *root_entity = resolver_result_entity_root(result);
+    struct resolver_entity *func_call_entity = resolver_result_entity_next(root_entity);
+    if (root_entity->type != RESOLVER_ENTITY_TYPE_FUNCTION || !func_call_entity ||
+        func_call_entity->type != RESOLVER_ENTITY_TYPE_FUNCTION_CALL || func_call_entity != result->last_entity)
+    {
+        return NULL;
+    }
+
+    return func_call_entity;
+}
+
+/**
+ * Generates a structure returning call that constructs its result directly at the given address
+ * rather than in a temporary that is then copied. The address of the result is pushed to the stack.
+ *
+ * @param exp_node The call expression, must be a direct call returning a structure or union
+ * @param address The address of the destination i.e "ebp-12"
+ * @param indirect True if the address holds a pointer to the destination instead
+ */
+static void codegen_generate_call_into(struct node *exp_node, const char *address, bool indirect)
+{
+    codegen_return_slot.address = address;
+    codegen_return_slot.indirect = indirect;
+
+    struct history history;
+    codegen_generate_expressionable(exp_node, history_begin(&history, 0));
+    assert(!codegen_return_slot.address);
+}
+
+/**
+ * Returns the address of the given expression if it is a structure or union variable
+ * accessed directly i.e "ebp-12", otherwise NULL is returned.
+ */
+static const char *codegen_struct_variable_address(struct node *exp_node)
+{
+    if (exp_node->type != NODE_TYPE_IDENTIFIER)
+    {
+        return NULL;
+    }
+
+    struct resolver_result *result = resolver_follow(current_process->resolver, exp_node);
+    if (!resolver_result_ok(result) || resolver_result_entity_next(resolver_result_entity_root(result)) ||
+        result->last_entity->type != RESOLVER_ENTITY_TYPE_VARIABLE ||
+        !datatype_is_struct_or_union_non_pointer(&result->last_entity->dtype) ||
+        codegen_entity_is_thread_local(result->last_entity))
+    {
+        return NULL;
+    }
+
+    return result->base.address;
+}
+
+/**
+ * Returns true if the expression is a direct call returning a structure or union
+ * that can construct its result in place.
+ */
+static bool codegen_can_call_into(struct node *exp_node)
+{
+    struct resolver_entity *func_call_entity = codegen_direct_call_entity(exp_node);
+    return func_call_entity && datatype_is_struct_or_union_non_pointer(&func_call_entity->dtype);
+}
+
+/**
+ * Returns the parameter type for the argument at the given index if the called function is known
+ */
+static bool codegen_function_call_parameter_type(struct resolver_entity *entity, int index, struct datatype *dtype_out)
+{
+    struct resolver_entity *func_entity = entity->prev;
+    if (!func_entity || func_entity->type != RESOLVER_ENTITY_TYPE_FUNCTION || !func_entity->node || index < 0)
+        return false;
+
+    struct vector *parameters = function_node_argument_vec(func_entity->node);
+    if (index >= vector_count(parameters))
+        return false;
+
+    struct node *parameter = variable_node(vector_peek_ptr_at(parameters, index));
+    if (!parameter || parameter->type != NODE_TYPE_VARIABLE)
+        return false;
+
+    *dtype_out = parameter->var.type;
+    return true;
+}
+
+/**
+ * Returns the amount of leading arguments of the call that are passed in registers
+ */
+static int codegen_function_call_register_arguments(struct resolver_entity *entity)
+{
+    struct resolver_entity *func_entity = entity->prev;
+    if (!func_entity || func_entity->type != RESOLVER_ENTITY_TYPE_FUNCTION || !func_entity->node)
+        return 0;
+
+    int total_registers = function_node_register_arguments(func_entity->node);
+    int total_arguments = vector_count(entity->func_call_data.arguments);
+    return total_arguments < total_registers ? total_arguments : total_registers;
+}
+
+/**
+ * Converts the argument on the stack to the type of its parameter. Floats are passed as floats,
+ * doubles as doubles, arguments to variadic or unknown parameters stay doubles.
+ */
+static void codegen_convert_function_call_argument(struct resolver_entity *entity, int index)
+{
+    struct datatype parameter_dtype;
+    if (!codegen_function_call_parameter_type(entity, index, &parameter_dtype) ||
+        datatype_is_struct_or_union_non_pointer(&parameter_dtype))
+        return;
+
+    bool parameter_is_floating = datatype_is_floating(&parameter_dtype);
+    if (!parameter_is_floating)
+    {
+        if (codegen_floating_on_stack())
+        {
+            asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+            asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = datatype_for_numeric()});
+        }
+        return;
+    }
+
+    if (!codegen_floating_on_stack())
+    {
+        struct datatype dtype = datatype_for_numeric();
+        asm_datatype_back(&dtype);
+        asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        codegen_push_integer_as_floating(&dtype);
+    }
+
+    if (parameter_dtype.type == DATA_TYPE_FLOAT)
+    {
+        codegen_pop_floating("xmm0");
+        asm_push("cvtsd2ss xmm0, xmm0");
+        asm_push("sub esp, %i", DATA_SIZE_DWORD);
+        asm_push("movss [esp], xmm0");
+        stackframe_push(current_function, &(struct stack_frame_element){.type = STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, .name = "result_value", .flags = STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE, .data.dtype = parameter_dtype});
+    }
+}
+
 void codegen_generate_entity_access_for_function_call(struct resolver_result *result, struct resolver_entity *entity)
 {
 
@@ -1534,45 +2007,94 @@ void codegen_generate_entity_access_for_function_call(struct resolver_result *re
     asm_push("mov dword [function_call_%i], ebx", function_call_label_id);
 
     // Is this a structure return type?
-    if (datatype_is_struct_or_union_non_pointer(&entity->dtype))
+    bool returns_structure = datatype_is_struct_or_union_non_pointer(&entity->dtype);
+    struct codegen_return_slot return_slot = {};
+    if (returns_structure)
     {
-        struct history history = {};
+        // The receiver may have given us its destination, arguments must not construct into it
+        return_slot = codegen_return_slot;
+        memset(&codegen_return_slot, 0, sizeof(codegen_return_slot));
+    }
 
+    if (returns_structure && !return_slot.address)
+    {
         asm_push("; SUBTRACT ROOM FOR RETURNED STRUCTURE/UNION DATATYPE ");
         // Make room for the returned structure
         codegen_stack_sub_with_name(align_value(datatype_size(&entity->dtype), DATA_SIZE_DWORD), "result_value");
-
-        // Now we must pass a pointer to the data we just created
-        // which will be the current stack pointer
-        asm_push_ins_push("esp", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
     }
-    // If we have a structure return type then we need to push the address of the left operand.
+
+    // Doubles take more room than the resolver expects so the pushed arguments are measured
+    int argument_index = vector_count(entity->func_call_data.arguments) - 1;
+    size_t total_elements_before_arguments = vector_count(current_function->func.frame.elements);
     while (node)
     {
         struct history history;
+        codegen_return_slot.argument = codegen_can_call_into(node);
         codegen_generate_expressionable(node, history_begin(&history, EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS));
+        codegen_convert_function_call_argument(entity, argument_index);
+        argument_index--;
         node = vector_peek_ptr(entity->func_call_data.arguments);
     }
 
-    // Call the function, address is in EBX
-    asm_push("call [function_call_%i]", function_call_label_id);
-    size_t stack_size = entity->func_call_data.stack_size;
-    if (datatype_is_struct_or_union_non_pointer(&entity->dtype))
+    size_t stack_size = (vector_count(current_function->func.frame.elements) - total_elements_before_arguments) * STACK_PUSH_SIZE;
+
+    // The first argument was pushed last
+    int total_registers = codegen_function_call_register_arguments(entity);
+    for (int i = 0; i < total_registers; i++)
     {
-        // We returned a datatype? Then we need to account for
-        // "push esp" where we passed the pointer to the structure data
+        asm_push("pop %s", function_node_argument_register(i));
+        stackframe_pop(current_function);
+    }
+    stack_size -= total_registers * DATA_SIZE_DWORD;
+
+    if (returns_structure)
+    {
+        // The pointer to the returned structure is the first argument so it is pushed last.
+        if (!return_slot.address)
+        {
+            asm_push("lea eax, [esp+%i]", (int)stack_size);
+        }
+        else
+        {
+            asm_push("%s eax, [%s]", return_slot.indirect ? "mov" : "lea", return_slot.address);
+        }
+        asm_push_ins_push("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
         stack_size += DATA_SIZE_DWORD;
     }
+
+    // Call the function, address is in EBX
+    asm_push("call [function_call_%i]", function_call_label_id);
     codegen_stack_add(stack_size);
 
+    if (return_slot.address)
+    {
+        // The result was constructed in place, only its address is handed back
+        asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
+        return;
+    }
+
+    if (return_slot.argument)
+    {
+        // The room we made for the result is already where the argument belongs
+        struct stack_frame_element *element = stackframe_back(current_function);
+        element->flags |= STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE;
+        element->data.dtype = entity->dtype;
+        codegen_response_acknowledge(RESPONSE_SET(.flags = RESPONSE_FLAG_PUSHED_STRUCTURE));
+        return;
+    }
+
     // We have to put EAX back to the stack for receivers of this function
-    if (datatype_is_struct_or_union_non_pointer(&entity->dtype))
+    if (returns_structure)
     {
         // This is a structure/union return type, therefore push all to the stack
         struct history history = {};
         asm_push("mov ebx, eax");
         codegen_generate_structure_push(entity, &history, 0);
     }
+    else if (datatype_is_floating(&entity->dtype))
+    {
+        codegen_push_floating_from_st0();
+    }
     else
     {
         asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
@@ -1796,16 +2318,16 @@ void codegen_generate_code_for_result_base(struct resolver_result *result, struc
 {
     // Do we have to load the address of EBX or are we going to push the value directly.
     // Assignments need this to happen and would have set the EXPRESSION_GET_ADDRESS flag
-
+    char address[60];
     if (history->flags & EXPRESSION_GET_ADDRESS ||
         result->flags & RESOLVER_RESULT_FLAG_FIRST_ENTITY_LOAD_TO_EBX)
     {
-        asm_push("lea ebx, [%s]", result->base.address);
+        asm_push("lea ebx, [%s]", codegen_result_base_address_in(result, "ebx", address));
         asm_push_ins_push_with_data("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
     }
     else if (result->flags & RESOLVER_RESULT_FLAG_FIRST_ENTITY_PUSH_VALUE)
     {
-        asm_push_ins_push_with_data("dword [%s]", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype}, result->base.address);
+        asm_push_ins_push_with_data("dword [%s]", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype}, codegen_result_base_address_in(result, "ebx", address));
     }
     else
     {
@@ -1839,6 +2361,7 @@ void codegen_generate_entity_access_for_entity_new(struct resolver_result *resul
 
 void codegen_generate_entity_access_start(struct resolver_result *result, struct resolver_entity *root_assignment_entity, struct history *history)
 {
+    char address[60];
     if (root_assignment_entity->type == RESOLVER_ENTITY_TYPE_UNSUPPORTED)
     {
         // Unsupported entity then generate it
@@ -1846,17 +2369,17 @@ void codegen_generate_entity_access_start(struct resolver_result *result, struct
     }
     else if (result->flags & RESOLVER_RESULT_FLAG_FIRST_ENTITY_PUSH_VALUE)
     {
-        asm_push_ins_push_with_data("dword [%s]", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = root_assignment_entity->dtype}, result->base.address);
+        asm_push_ins_push_with_data("dword [%s]", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = root_assignment_entity->dtype}, codegen_result_base_address_in(result, "ebx", address));
     }
     else if (result->flags & RESOLVER_RESULT_FLAG_FIRST_ENTITY_LOAD_TO_EBX)
     {
         if (root_assignment_entity->next && root_assignment_entity->next->flags & RESOLVER_ENTITY_FLAG_IS_POINTER_ARRAY_ENTITY)
         {
-            asm_push("mov ebx, [%s]", result->base.address);
+            asm_push("mov ebx, [%s]", codegen_result_base_address_in(result, "ebx", address));
         }
         else
         {
-            asm_push("lea ebx, [%s]", result->base.address);
+            asm_push("lea ebx, [%s]", codegen_result_base_address_in(result, "ebx", address));
         }
         asm_push_ins_push_with_data("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = root_assignment_entity->dtype});
     }
@@ -1939,16 +2462,17 @@ void codegen_generate_assignment_part(struct node *node, const char *op, struct
     struct resolver_entity *next_entity = resolver_result_entity_next(root_assignment_entity);
     if (!next_entity)
     {
+        char address[60];
         if (datatype_is_struct_or_union_non_pointer(&result->last_entity->dtype))
         {
-            codegen_generate_move_struct(&result->last_entity->dtype, result->base.address, 0);
+            codegen_generate_move_struct(&result->last_entity->dtype, codegen_result_base_address_in(result, "ebx", address), 0);
         }
         else
         {
             asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
 
             // No further entities then set the value..
-            codegen_generate_assignment_instruction_for_operator(mov_type, result->base.address, reg_to_use, op, result->last_entity->dtype.flags & DATATYPE_FLAG_IS_SIGNED);
+            codegen_generate_assignment_instruction_for_operator(mov_type, codegen_result_base_address_in(result, "ebx", address), reg_to_use, op, result->last_entity->dtype.flags & DATATYPE_FLAG_IS_SIGNED);
         }
     }
     else
@@ -1967,12 +2491,51 @@ void codegen_generate_assignment_part(struct node *node, const char *op, struct
 
     codegen_response_acknowledge((&(struct response){.flags = RESPONSE_FLAG_RESOLVED_ENTITY, .data.resolved_entity = result->last_entity}));
 }
-void codegen_generate_assignment_expression(struct node *node, struct history *history)
+/**
+ * Generates "a = make();" and "a = b;" where "a" is a structure variable without a temporary,
+ * the call constructs its result in "a" and "b" is copied straight across.
+ * Returns false if the assignment cannot be done in place.
+ */
+static bool codegen_generate_assignment_in_place(struct node *node)
 {
-    // Left node = to assign
-    // Right node = value
-    codegen_generate_expressionable(node->exp.right, history_down(history, EXPRESSION_IS_ASSIGNMENT | IS_RIGHT_OPERAND_OF_ASSIGNMENT));
-
+    const char *src_address = codegen_struct_variable_address(node->exp.right);
+    if (!S_EQ(node->exp.op, "=") || (!src_address && !codegen_can_call_into(node->exp.right)))
+    {
+        return false;
+    }
+
+    struct resolver_result *result = resolver_follow(current_process->resolver, node->exp.left);
+    if (!resolver_result_ok(result) || resolver_result_entity_next(resolver_result_entity_root(result)) ||
+        !datatype_is_struct_or_union_non_pointer(&result->last_entity->dtype) ||
+        codegen_entity_is_thread_local(result->last_entity))
+    {
+        return false;
+    }
+
+    if (src_address)
+    {
+        codegen_generate_copy_struct(&result->last_entity->dtype, result->base.address, src_address);
+    }
+    else
+    {
+        codegen_generate_call_into(node->exp.right, result->base.address, false);
+        asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    }
+    codegen_response_acknowledge((&(struct response){.flags = RESPONSE_FLAG_RESOLVED_ENTITY, .data.resolved_entity = result->last_entity}));
+    return true;
+}
+
+void codegen_generate_assignment_expression(struct node *node, struct history *history)
+{
+    if (codegen_generate_assignment_in_place(node))
+    {
+        return;
+    }
+
+    // Left node = to assign
+    // Right node = value
+    codegen_generate_expressionable(node->exp.right, history_down(history, EXPRESSION_IS_ASSIGNMENT | IS_RIGHT_OPERAND_OF_ASSIGNMENT));
+
     codegen_generate_assignment_part(node->exp.left, node->exp.op, history);
 
     // codegen_generate_assignment_expression_move_value(left_entity);
@@ -2170,6 +2733,7 @@ void codegen_generate_exp_node_for_logical_arithmetic(struct node *node, struct
     }
 
     codegen_generate_expressionable(node->exp.left, history_down(history, history->flags | EXPRESSION_IN_LOGICAL_EXPRESSION));
+    codegen_floating_to_truth_value();
     asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
     codegen_generate_logical_cmp(node->exp.op, history->exp.logical_end_label, history->exp.logical_end_label_positive);
     register_unset_flag(REGISTER_EAX_IS_USED);
@@ -2177,6 +2741,7 @@ void codegen_generate_exp_node_for_logical_arithmetic(struct node *node, struct
     register_unset_flag(REGISTER_EAX_IS_USED);
     if (!is_logical_node(node->exp.right))
     {
+        codegen_floating_to_truth_value();
         asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
         codegen_generate_logical_cmp(node->exp.op, history->exp.logical_end_label, history->exp.logical_end_label_positive);
         codegen_generate_end_labels_for_logical_expression(node->exp.op, history->exp.logical_end_label, history->exp.logical_end_label_positive);
@@ -2317,6 +2882,10 @@ bool codegen_resolve_node_for_value(struct node *node, struct history *history)
     {
         codegen_generate_structure_push(result->last_entity, history, 0);
     }
+    else if (codegen_floating_on_stack())
+    {
+        // A call returning a floating point value, it was pushed from st0
+    }
     else if (!(dtype.flags & DATATYPE_FLAG_IS_POINTER))
     {
 
@@ -2610,6 +3179,7 @@ void codegen_generate_tenary(struct node *node, struct history *history)
     assert(asm_datatype_back(&last_dtype));
 
     // Pop off the result for the tenary
+    codegen_floating_to_truth_value();
     asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
 
     // Condition node would have already been generated as tenaries are
@@ -2633,6 +3203,411 @@ void codegen_generate_tenary(struct node *node, struct history *history)
     asm_push(".tenary_end_%i:", tenary_end_label_id);
 }
 
+static bool codegen_floating_type_for_resolved(struct node *node, struct datatype *dtype_out)
+{
+    struct resolver_result *result = resolver_follow(current_process->resolver, node);
+    if (!resolver_result_ok(result) || !result->last_entity)
+        return false;
+
+    *dtype_out = result->last_entity->dtype;
+    if (dtype_out->flags & DATATYPE_FLAG_IS_ARRAY)
+    {
+        int total_brackets = 0;
+        for (struct node *current = node; is_array_node(current); current = current->exp.left)
+        {
+            total_brackets++;
+        }
+
+        if (total_brackets >= array_brackets_count(dtype_out))
+        {
+            // Every bracket has been indexed, this is an element
+            dtype_out->flags &= ~DATATYPE_FLAG_IS_ARRAY;
+        }
+    }
+    return true;
+}
+
+/**
+ * Returns true if the given expression has a floating point type, the type is written to dtype_out.
+ * Arithmetic with a floating point operand is a double as every value is computed as a double.
+ */
+static bool codegen_floating_type(struct node *node, struct datatype *dtype_out)
+{
+    struct datatype dtype = {};
+    switch (node->type)
+    {
+    case NODE_TYPE_NUMBER:
+        if (node->num.type != NUMBER_TYPE_FLOAT && node->num.type != NUMBER_TYPE_DOUBLE)
+            return false;
+
+        dtype = datatype_for_double();
+        break;
+
+    case NODE_TYPE_CAST:
+        dtype = node->cast.dtype;
+        break;
+
+    case NODE_TYPE_EXPRESSION_PARENTHESIS:
+        return codegen_floating_type(node->parenthesis.exp, dtype_out);
+
+    case NODE_TYPE_UNARY:
+        if (S_EQ(node->unary.op, "-"))
+            return codegen_floating_type(node->unary.operand, dtype_out);
+
+        if (!op_is_indirection(node->unary.op) || !codegen_floating_type_for_resolved(node, &dtype))
+            return false;
+        break;
+
+    case NODE_TYPE_IDENTIFIER:
+        if (!codegen_floating_type_for_resolved(node, &dtype))
+            return false;
+        break;
+
+    case NODE_TYPE_EXPRESSION:
+        if (is_node_assignment(node))
+            return codegen_floating_type(node->exp.left, dtype_out);
+
+        if (is_access_node(node) || is_array_node(node) || is_parentheses_node(node))
+        {
+            if (!codegen_floating_type_for_resolved(node, &dtype))
+                return false;
+            break;
+        }
+
+        if (!S_EQ(node->exp.op, "+") && !S_EQ(node->exp.op, "-") && !S_EQ(node->exp.op, "*") && !S_EQ(node->exp.op, "/"))
+            return false;
+
+        if (!codegen_floating_type(node->exp.left, &dtype) && !codegen_floating_type(node->exp.right, &dtype))
+            return false;
+
+        dtype = datatype_for_double();
+        break;
+
+    default:
+        return false;
+    }
+
+    if (!datatype_is_floating(&dtype) || dtype.flags & DATATYPE_FLAG_IS_ARRAY)
+        return false;
+
+    *dtype_out = dtype;
+    return true;
+}
+
+static void codegen_load_floating(struct datatype *dtype, const char *address)
+{
+    if (dtype->type == DATA_TYPE_FLOAT)
+    {
+        asm_push("cvtss2sd xmm0, dword [%s]", address);
+    }
+    else
+    {
+        asm_push("movsd xmm0, qword [%s]", address);
+    }
+    codegen_push_floating("xmm0");
+}
+
+/**
+ * Stores the double in XMM0 to the given address, narrowing it for a float
+ */
+static void codegen_store_floating(struct datatype *dtype, const char *address)
+{
+    if (dtype->type == DATA_TYPE_FLOAT)
+    {
+        asm_push("cvtsd2ss xmm0, xmm0");
+        asm_push("movss dword [%s], xmm0", address);
+    }
+    else
+    {
+        asm_push("movsd qword [%s], xmm0", address);
+    }
+}
+
+/**
+ * Converts the integer in EAX of the given type to a double and pushes it
+ */
+static void codegen_push_integer_as_floating(struct datatype *dtype)
+{
+    asm_push("cvtsi2sd xmm0, eax");
+    bool is_unsigned_dword = !(dtype->flags & (DATATYPE_FLAG_IS_SIGNED | DATATYPE_FLAG_IS_LITERAL | DATATYPE_FLAG_IS_POINTER)) &&
+                             datatype_size(dtype) == DATA_SIZE_DWORD;
+    if (is_unsigned_dword)
+    {
+        // cvtsi2sd is signed, values with the top bit set are 2^32 too small
+        int label_id = codegen_label_count();
+        asm_push("test eax, eax");
+        asm_push("jns .unsigned_converted_%i", label_id);
+        asm_push("movsd xmm1, [%s]", codegen_register_floating_constant(4294967296.0));
+        asm_push("addsd xmm0, xmm1");
+        asm_push(".unsigned_converted_%i:", label_id);
+    }
+    codegen_push_floating("xmm0");
+}
+
+static bool codegen_generate_floating_expressionable(struct node *node, struct history *history);
+
+/**
+ * Generates the given expression and leaves its value on the stack as a double
+ * converting it if it is an integer
+ */
+static void codegen_generate_floating_value(struct node *node, struct history *history)
+{
+    struct history *value_history = history_down(history, codegen_remove_uninheritable_flags(history->flags) | EXPRESSION_IS_NOT_ROOT_NODE);
+    if (codegen_generate_floating_expressionable(node, value_history))
+        return;
+
+    codegen_generate_expressionable(node, value_history);
+    if (codegen_floating_on_stack())
+        return;
+
+    struct datatype dtype = datatype_for_numeric();
+    asm_datatype_back(&dtype);
+    asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    codegen_push_integer_as_floating(&dtype);
+}
+
+/**
+ * Generates the address of the given floating point lvalue into EBX
+ */
+static void codegen_generate_floating_address(struct node *node, struct history *history)
+{
+    // Generated as "&node" so the resolver computes the address for us
+    struct node *address_node = calloc(1, sizeof(struct node));
+    address_node->type = NODE_TYPE_UNARY;
+    address_node->pos = node->pos;
+    address_node->binded = node->binded;
+    address_node->unary.op = "&";
+    address_node->unary.operand = node;
+
+    codegen_generate_expressionable(address_node, history_down(history, codegen_remove_uninheritable_flags(history->flags) | EXPRESSION_IS_NOT_ROOT_NODE));
+    asm_push_ins_pop("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+}
+
+static const char *codegen_floating_instruction_for_op(const char *op)
+{
+    if (S_EQ(op, "+") || S_EQ(op, "+="))
+        return "addsd";
+    else if (S_EQ(op, "-") || S_EQ(op, "-="))
+        return "subsd";
+    else if (S_EQ(op, "*") || S_EQ(op, "*="))
+        return "mulsd";
+    else if (S_EQ(op, "/") || S_EQ(op, "/="))
+        return "divsd";
+
+    return NULL;
+}
+
+static void codegen_generate_floating_assignment(struct node *node, struct datatype *dtype, struct history *history)
+{
+    codegen_generate_floating_value(node->exp.right, history);
+    if (!S_EQ(node->exp.op, "="))
+    {
+        const char *instruction = codegen_floating_instruction_for_op(node->exp.op);
+        if (!instruction)
+        {
+            compiler_error(current_process, "The operator %s cannot be used on floating point values", node->exp.op);
+        }
+
+        codegen_generate_floating_value(node->exp.left, history);
+        codegen_pop_floating("xmm0");
+        codegen_pop_floating("xmm1");
+        asm_push("%s xmm0, xmm1", instruction);
+        codegen_push_floating("xmm0");
+    }
+
+    codegen_generate_floating_address(node->exp.left, history);
+    codegen_pop_floating("xmm0");
+    codegen_store_floating(dtype, "ebx");
+}
+
+/**
+ * Compares two floating point operands, ucomisd sets the flags of an unsigned compare
+ * and sets the parity flag when either operand is NaN
+ */
+static bool codegen_generate_floating_comparison(struct node *node, struct history *history)
+{
+    const char *op = node->exp.op;
+    bool swap = S_EQ(op, "<") || S_EQ(op, "<=");
+    const char *set_ins = NULL;
+    if (S_EQ(op, ">") || S_EQ(op, "<"))
+        set_ins = "seta";
+    else if (S_EQ(op, ">=") || S_EQ(op, "<="))
+        set_ins = "setae";
+    else if (!S_EQ(op, "==") && !S_EQ(op, "!="))
+        return false;
+
+    struct datatype dtype;
+    if (!codegen_floating_type(node->exp.left, &dtype) && !codegen_floating_type(node->exp.right, &dtype))
+        return false;
+
+    codegen_generate_floating_value(node->exp.left, history);
+    codegen_generate_floating_value(node->exp.right, history);
+    codegen_pop_floating("xmm1");
+    codegen_pop_floating("xmm0");
+    asm_push(swap ? "ucomisd xmm1, xmm0" : "ucomisd xmm0, xmm1");
+    if (S_EQ(op, "=="))
+    {
+        asm_push("sete al");
+        asm_push("setnp cl");
+        asm_push("and al, cl");
+    }
+    else if (S_EQ(op, "!="))
+    {
+        asm_push("setne al");
+        asm_push("setp cl");
+        asm_push("or al, cl");
+    }
+    else
+    {
+        asm_push("%s al", set_ins);
+    }
+    asm_push("movzx eax, al");
+    asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = datatype_for_numeric()});
+    return true;
+}
+
+static void codegen_generate_floating_cast(struct node *node, struct datatype *dtype, struct history *history)
+{
+    codegen_generate_floating_value(node->cast.operand, history);
+    if (dtype->type == DATA_TYPE_FLOAT)
+    {
+        // Round to float precision
+        codegen_pop_floating("xmm0");
+        asm_push("cvtsd2ss xmm0, xmm0");
+        asm_push("cvtss2sd xmm0, xmm0");
+        codegen_push_floating("xmm0");
+    }
+}
+
+/**
+ * Generates the floating point forms of the given expression. Returns false if the expression
+ * is not one, then it is generated as normal and integer receivers convert anything floating it produces.
+ */
+static bool codegen_generate_floating_expressionable(struct node *node, struct history *history)
+{
+    if (history->flags & EXPRESSION_GET_ADDRESS)
+        return false;
+
+    struct datatype dtype;
+    bool is_floating = codegen_floating_type(node, &dtype);
+    switch (node->type)
+    {
+    case NODE_TYPE_NUMBER:
+        if (!is_floating)
+            return false;
+
+        asm_push("movsd xmm0, [%s]", codegen_register_floating_constant(node->num.type == NUMBER_TYPE_FLOAT ? (float)node->dnum : node->dnum));
+        codegen_push_floating("xmm0");
+        return true;
+
+    case NODE_TYPE_EXPRESSION_PARENTHESIS:
+        if (!is_floating)
+            return false;
+
+        codegen_generate_floating_value(node->parenthesis.exp, history);
+        return true;
+
+    case NODE_TYPE_CAST:
+        if (is_floating)
+        {
+            codegen_generate_floating_cast(node, &dtype, history);
+            return true;
+        }
+
+        if (node->cast.dtype.flags & DATATYPE_FLAG_IS_POINTER || !codegen_floating_type(node->cast.operand, &dtype))
+            return false;
+
+        codegen_generate_floating_value(node->cast.operand, history);
+        codegen_pop_floating("xmm0");
+        asm_push("cvttsd2si eax, xmm0");
+        codegen_reduce_register("eax", datatype_size(&node->cast.dtype), node->cast.dtype.flags & DATATYPE_FLAG_IS_SIGNED);
+        asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = node->cast.dtype});
+        return true;
+
+    case NODE_TYPE_UNARY:
+        if (S_EQ(node->unary.op, "!") && codegen_floating_type(node->unary.operand, &dtype))
+        {
+            codegen_generate_floating_value(node->unary.operand, history);
+            codegen_pop_floating("xmm0");
+            asm_push("xorpd xmm1, xmm1");
+            asm_push("ucomisd xmm0, xmm1");
+            asm_push("sete al");
+            asm_push("setnp cl");
+            asm_push("and al, cl");
+            asm_push("movzx eax, al");
+            asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = datatype_for_numeric()});
+            return true;
+        }
+
+        if ((S_EQ(node->unary.op, "++") || S_EQ(node->unary.op, "--")) && codegen_floating_type(node->unary.operand, &dtype))
+        {
+            compiler_error(current_process, "The operator %s is not supported on floating point values", node->unary.op);
+        }
+
+        if (!is_floating)
+            return false;
+
+        if (S_EQ(node->unary.op, "-"))
+        {
+            // Flip the sign bit
+            codegen_generate_floating_value(node->unary.operand, history);
+            codegen_pop_floating("xmm0");
+            asm_push("movsd xmm1, [%s]", codegen_register_floating_constant(-0.0));
+            asm_push("xorpd xmm0, xmm1");
+            codegen_push_floating("xmm0");
+            return true;
+        }
+
+        codegen_generate_floating_address(node, history);
+        codegen_load_floating(&dtype, "ebx");
+        return true;
+
+    case NODE_TYPE_IDENTIFIER:
+        if (!is_floating)
+            return false;
+
+        codegen_generate_floating_address(node, history);
+        codegen_load_floating(&dtype, "ebx");
+        return true;
+
+    case NODE_TYPE_EXPRESSION:
+        if (is_node_assignment(node))
+        {
+            if (!is_floating)
+                return false;
+
+            codegen_generate_floating_assignment(node, &dtype, history);
+            return true;
+        }
+
+        if (!is_floating)
+            return codegen_generate_floating_comparison(node, history);
+
+        if (is_parentheses_node(node))
+        {
+            // Function calls return their value in st0 which the call pushes for us
+            return false;
+        }
+
+        if (is_access_node(node) || is_array_node(node))
+        {
+            codegen_generate_floating_address(node, history);
+            codegen_load_floating(&dtype, "ebx");
+            return true;
+        }
+
+        codegen_generate_floating_value(node->exp.left, history);
+        codegen_generate_floating_value(node->exp.right, history);
+        codegen_pop_floating("xmm1");
+        codegen_pop_floating("xmm0");
+        asm_push("%s xmm0, xmm1", codegen_floating_instruction_for_op(node->exp.op));
+        codegen_push_floating("xmm0");
+        return true;
+    }
+
+    return false;
+}
+
 void codegen_generate_expressionable(struct node *node, struct history *history)
 {
     bool is_root = codegen_is_exp_root(history);
@@ -2642,6 +3617,11 @@ void codegen_generate_expressionable(struct node *node, struct history *history)
         history->flags |= EXPRESSION_IS_NOT_ROOT_NODE;
     }
 
+    if (codegen_generate_floating_expressionable(node, history))
+    {
+        return;
+    }
+
     switch (node->type)
     {
     case NODE_TYPE_NUMBER:
@@ -2737,13 +3717,53 @@ static void codegen_generate_global_variable_for_union(struct node *node)
     char tmp_buf[256];
     asm_push("%s: %s 0", node->var.name, asm_keyword_for_size(variable_size(node), tmp_buf));
 }
-void codegen_generate_global_variable(struct node *node)
+static void codegen_generate_global_variable_for_floating(struct node *node)
+{
+    struct node *val_node = node->var.val;
+    bool negate = false;
+    if (val_node && val_node->type == NODE_TYPE_UNARY && S_EQ(val_node->unary.op, "-"))
+    {
+        negate = true;
+        val_node = val_node->unary.operand;
+    }
+
+    double value = 0;
+    if (val_node)
+    {
+        if (val_node->type != NODE_TYPE_NUMBER)
+        {
+            codegen_err("Floating point global variables can only be initialized with a number");
+            return;
+        }
+
+        bool is_floating_literal = val_node->num.type == NUMBER_TYPE_FLOAT || val_node->num.type == NUMBER_TYPE_DOUBLE;
+        value = is_floating_literal ? val_node->dnum : (double)val_node->llnum;
+    }
+
+    if (negate)
+    {
+        value = -value;
+    }
+
+    if (node->var.type.type == DATA_TYPE_FLOAT)
+    {
+        float float_value = value;
+        unsigned int bits = 0;
+        memcpy(&bits, &float_value, sizeof(bits));
+        asm_push("%s: dd 0x%08x", node->var.name, bits);
+        return;
+    }
+
+    unsigned long long bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    asm_push("%s: dq 0x%016llx", node->var.name, bits);
+}
+
+static void codegen_generate_global_variable_data(struct node *node)
 {
-    asm_push("; %s %s", node->var.type.type_str, node->var.name);
     if (node->var.type.flags & DATATYPE_FLAG_IS_ARRAY)
     {
         codegen_generate_variable_for_array(node);
-        codegen_new_scope_entity(node, 0, 0);
         return;
     }
 
@@ -2757,11 +3777,13 @@ void codegen_generate_global_variable(struct node *node)
         codegen_generate_global_variable_for_primitive(node);
         break;
     case DATA_TYPE_DOUBLE:
-        codegen_err("Doubles are not yet supported for global variable values.");
-
-        break;
     case DATA_TYPE_FLOAT:
-        codegen_err("Floats are not yet supported for global variable values.");
+        if (node->var.type.flags & DATATYPE_FLAG_IS_POINTER)
+        {
+            codegen_generate_global_variable_for_primitive(node);
+            break;
+        }
+        codegen_generate_global_variable_for_floating(node);
         break;
 
     case DATA_TYPE_STRUCT:
@@ -2775,8 +3797,40 @@ void codegen_generate_global_variable(struct node *node)
     default:
         codegen_err("Not sure how to generate value for global variable.. Problem!");
     }
-    assert(node->type == NODE_TYPE_VARIABLE);
-    codegen_new_scope_entity(node, 0, 0);
+}
+
+/**
+ * Thread local variables go in the TLS sections, every thread starts with a copy of them.
+ * Variables without a value take no space in the file.
+ */
+static void codegen_generate_global_variable_thread_local(struct node *node)
+{
+    if (node->var.val)
+    {
+        asm_push("section .tdata progbits alloc noexec write tls align=8");
+        codegen_generate_global_variable_data(node);
+    }
+    else
+    {
+        asm_push("section .tbss nobits alloc noexec write tls align=8");
+        asm_push("%s: resb %i", node->var.name, (int)variable_size(node));
+    }
+    asm_push("section .data");
+}
+
+void codegen_generate_global_variable(struct node *node)
+{
+    asm_push("; %s %s", node->var.type.type_str, node->var.name);
+    if (node->var.type.flags & DATATYPE_FLAG_IS_THREAD_LOCAL)
+    {
+        codegen_generate_global_variable_thread_local(node);
+    }
+    else
+    {
+        codegen_generate_global_variable_data(node);
+    }
+    assert(node->type == NODE_TYPE_VARIABLE);
+    codegen_new_scope_entity(node, 0, 0);
 }
 
 void codegen_generate_global_variable_list(struct node *var_list_node)
@@ -2839,11 +3893,43 @@ void codegen_generate_body(struct node *node, struct history *history)
 }
 void codegen_generate_scope_variable(struct node *node)
 {
+    if (node->var.type.flags & DATATYPE_FLAG_IS_THREAD_LOCAL)
+    {
+        compiler_error(current_process, "Only global variables can be thread local");
+    }
+
     // Register the variable to the scope.
     struct resolver_entity *entity = codegen_new_scope_entity(node, node->var.aoffset, RESOLVER_DEFAULT_ENTITY_FLAG_IS_LOCAL_STACK);
 
     // Scope variables have values, lets compute that
-    if (node->var.val)
+    if (node->var.val && datatype_is_struct_or_union_non_pointer(&entity->dtype))
+    {
+        if (codegen_can_call_into(node->var.val))
+        {
+            codegen_generate_call_into(node->var.val, codegen_entity_private(entity)->address, false);
+            asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+            return;
+        }
+
+        const char *src_address = codegen_struct_variable_address(node->var.val);
+        if (src_address)
+        {
+            codegen_generate_copy_struct(&entity->dtype, codegen_entity_private(entity)->address, src_address);
+            return;
+        }
+
+        struct history history;
+        codegen_generate_expressionable(node->var.val, history_begin(&history, EXPRESSION_IS_ASSIGNMENT | IS_RIGHT_OPERAND_OF_ASSIGNMENT));
+        codegen_generate_move_struct(&entity->dtype, codegen_entity_private(entity)->address, 0);
+    }
+    else if (node->var.val && datatype_is_floating(&entity->dtype))
+    {
+        struct history history;
+        codegen_generate_floating_value(node->var.val, history_begin(&history, EXPRESSION_IS_ASSIGNMENT | IS_RIGHT_OPERAND_OF_ASSIGNMENT));
+        codegen_pop_floating("xmm0");
+        codegen_store_floating(&entity->dtype, codegen_entity_private(entity)->address);
+    }
+    else if (node->var.val)
     {
         struct history history;
         codegen_generate_expressionable(node->var.val, history_down(&history, EXPRESSION_IS_ASSIGNMENT | IS_RIGHT_OPERAND_OF_ASSIGNMENT));
@@ -2866,9 +3952,185 @@ void codegen_generate_scope_variable_for_list(struct node *var_list_node)
     }
 }
 
+/**
+ * Returns true if the call returns a floating point value or takes a floating point argument
+ */
+static bool codegen_function_call_has_floating(struct resolver_entity *func_call_entity)
+{
+    if (datatype_is_floating(&func_call_entity->dtype))
+        return true;
+
+    struct vector *arguments = func_call_entity->func_call_data.arguments;
+    for (int i = 0; i < vector_count(arguments); i++)
+    {
+        struct datatype dtype;
+        if (codegen_floating_type(vector_peek_ptr_at(arguments, i), &dtype) ||
+            (codegen_function_call_parameter_type(func_call_entity, i, &dtype) && datatype_is_floating(&dtype)))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Returns the function call entity if the given return expression is a direct call
+ * that can reuse the stack frame of the current function i.e "return abc(50);"
+ * Otherwise NULL is returned.
+ */
+static struct resolver_entity *codegen_tail_call_entity(struct node *exp_node)
+{
+    if (current_function->func.flags & (FUNCTION_NODE_FLAG_IS_VARIADIC | FUNCTION_NODE_FLAG_ADDRESS_TAKEN))
+    {
+        // Our arguments or locals may still be referenced by the callee.
+        return NULL;
+    }
+
+    if (datatype_is_struct_or_union_non_pointer(&current_function->func.rtype))
+    {
+        // The invisible structure pointer argument must be preserved.
+        return NULL;
+    }
+
+    struct resolver_entity *func_call_entity = codegen_direct_call_entity(exp_node);
+    if (!func_call_entity || datatype_is_struct_or_union_non_pointer(&func_call_entity->dtype))
+    {
+        return NULL;
+    }
+
+    if (datatype_is_floating(&current_function->func.rtype) || codegen_function_call_has_floating(func_call_entity))
+    {
+        // Floating point values change the size of the arguments and how the result is returned
+        return NULL;
+    }
+
+    // The arguments must fit in the argument area our caller pushed for us
+    // as the caller will be the one to clean it up.
+    size_t register_size = codegen_function_call_register_arguments(func_call_entity) * DATA_SIZE_DWORD;
+    if (func_call_entity->func_call_data.stack_size - register_size > function_node_argument_stack_size(current_function))
+    {
+        return NULL;
+    }
+
+    return func_call_entity;
+}
+
+/**
+ * Generates "return abc(50);" as a jump that reuses the current stack frame.
+ * Self recursion jumps back to the function body, sibling calls tear down
+ * our frame and jump to the function leaving the return address in place.
+ */
+static void codegen_generate_tail_call(struct node *exp_node, struct resolver_entity *func_call_entity)
+{
+    const char *function_name = exp_node->exp.left->sval;
+    size_t stack_size = func_call_entity->func_call_data.stack_size;
+    asm_push("; TAIL CALL %s", function_name);
+
+    // All arguments must be computed before we overwrite our own arguments
+    // as they may depend on them i.e "return abc(b, a);"
+    vector_set_flag(func_call_entity->func_call_data.arguments, VECTOR_FLAG_PEEK_DECREMENT);
+    vector_set_peek_pointer_end(func_call_entity->func_call_data.arguments);
+    struct node *node = vector_peek_ptr(func_call_entity->func_call_data.arguments);
+    while (node)
+    {
+        struct history history;
+        codegen_generate_expressionable(node, history_begin(&history, EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS));
+        node = vector_peek_ptr(func_call_entity->func_call_data.arguments);
+    }
+
+    // Move the new arguments over our own arguments
+    size_t register_size = codegen_function_call_register_arguments(func_call_entity) * DATA_SIZE_DWORD;
+    size_t argument_offset = function_node_argument_stack_addition(current_function);
+    for (size_t i = register_size; i < stack_size; i += DATA_SIZE_DWORD)
+    {
+        asm_push("mov eax, [esp+%i]", (int)i);
+        asm_push("mov dword [ebp+%i], eax", (int)(argument_offset + i - register_size));
+    }
+
+    // Register arguments are loaded, calling ourselves they go straight to where we stored ours
+    bool self = S_EQ(function_name, current_function->func.name);
+    struct vector *arguments = function_node_argument_vec(current_function);
+    for (size_t i = 0; i < register_size / DATA_SIZE_DWORD; i++)
+    {
+        const char *reg = self ? "eax" : function_node_argument_register(i);
+        asm_push("mov %s, [esp+%i]", reg, (int)(i * DATA_SIZE_DWORD));
+        if (self)
+        {
+            asm_push("mov dword [ebp%i], eax", variable_node(vector_peek_ptr_at(arguments, i))->var.aoffset);
+        }
+    }
+    codegen_stack_add(stack_size);
+
+    if (self)
+    {
+        asm_push("jmp function_body_%i", current_function_body_label_id);
+        return;
+    }
+
+    codegen_stack_add_no_compile_time_stack_frame_restore(C_ALIGN(function_node_stack_size(current_function)));
+    asm_pop_ebp_no_stack_frame_restore();
+    asm_push("jmp %s", function_name);
+}
+
+/**
+ * Generates the return of a structure without a temporary, returns false if it needs one.
+ * A returned call constructs straight into the destination our caller gave us
+ * and a returned variable is copied to it directly.
+ */
+static bool codegen_generate_statement_return_struct(struct node *exp_node)
+{
+    if (!datatype_is_struct_or_union_non_pointer(&current_function->func.rtype))
+    {
+        return false;
+    }
+
+    if (codegen_can_call_into(exp_node))
+    {
+        codegen_generate_call_into(exp_node, "ebp+8", true);
+        asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        return true;
+    }
+
+    const char *address = codegen_struct_variable_address(exp_node);
+    if (!address)
+    {
+        return false;
+    }
+
+    asm_push("mov edx, [ebp+8]");
+    codegen_generate_copy_struct(&current_function->func.rtype, "edx", address);
+    asm_push("mov eax, [ebp+8]");
+    return true;
+}
+
 void codegen_generate_statement_return_exp(struct node *node)
 {
+    if (codegen_generate_statement_return_struct(node->stmt.ret.exp))
+    {
+        return;
+    }
+
     struct history history;
+    if (datatype_is_floating(&current_function->func.rtype))
+    {
+        // Floating point values are returned in st0
+        codegen_generate_floating_value(node->stmt.ret.exp, history_begin(&history, IS_STATEMENT_RETURN));
+        if (current_function->func.rtype.type == DATA_TYPE_FLOAT)
+        {
+            asm_push("movsd xmm0, [esp]");
+            asm_push("cvtsd2ss xmm0, xmm0");
+            asm_push("movss [esp], xmm0");
+            asm_push("fld dword [esp]");
+        }
+        else
+        {
+            asm_push("fld qword [esp]");
+        }
+        codegen_stack_add(DATA_SIZE_DDWORD);
+        return;
+    }
+
     codegen_response_expect();
     // Let's generate the expression of the return statement
     codegen_generate_expressionable(node->stmt.ret.exp, history_begin(&history, IS_STATEMENT_RETURN));
@@ -2898,6 +4160,13 @@ void codegen_generate_statement_return(struct node *node)
 {
     if (node->stmt.ret.exp)
     {
+        struct resolver_entity *tail_call_entity = codegen_tail_call_entity(node->stmt.ret.exp);
+        if (tail_call_entity)
+        {
+            codegen_generate_tail_call(node->stmt.ret.exp, tail_call_entity);
+            return;
+        }
+
         codegen_generate_statement_return_exp(node);
     }
     // Generate the stack subtraction.
@@ -2908,6 +4177,95 @@ void codegen_generate_statement_return(struct node *node)
     asm_push("ret");
 }
 
+bool codegen_statement_has_jump_target(struct node *node);
+bool codegen_statements_have_jump_target(struct vector *statements)
+{
+    for (int i = 0; i < vector_count(statements); i++)
+    {
+        if (codegen_statement_has_jump_target(vector_peek_ptr_at(statements, i)))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * Returns true if a label, case or default lives somewhere inside the statement.
+ * Code that can be jumped into is never treated as dead.
+ */
+bool codegen_statement_has_jump_target(struct node *node)
+{
+    if (!node)
+        return false;
+
+    switch (node->type)
+    {
+    case NODE_TYPE_LABEL:
+    case NODE_TYPE_STATEMENT_CASE:
+    case NODE_TYPE_STATEMENT_DEFAULT:
+        return true;
+
+    case NODE_TYPE_BODY:
+        return codegen_statements_have_jump_target(node->body.statements);
+
+    case NODE_TYPE_STATEMENT_IF:
+        return codegen_statement_has_jump_target(node->stmt._if.body_node) ||
+               codegen_statement_has_jump_target(node->stmt._if.next);
+
+    case NODE_TYPE_STATEMENT_ELSE:
+        return codegen_statement_has_jump_target(node->stmt._else.body_node);
+
+    case NODE_TYPE_STATEMENT_WHILE:
+        return codegen_statement_has_jump_target(node->stmt._while.body);
+
+    case NODE_TYPE_STATEMENT_DO_WHILE:
+        return codegen_statement_has_jump_target(node->stmt._do_while.body);
+
+    case NODE_TYPE_STATEMENT_FOR:
+        return codegen_statement_has_jump_target(node->stmt._for.body);
+
+    case NODE_TYPE_STATEMENT_SWITCH:
+        return codegen_statement_has_jump_target(node->stmt._switch.body);
+    }
+
+    return false;
+}
+
+/**
+ * Returns true if control never continues past this statement i.e "return" or "break"
+ */
+bool codegen_statement_leaves_scope(struct node *node)
+{
+    return node->type == NODE_TYPE_STATEMENT_RETURN ||
+           node->type == NODE_TYPE_STATEMENT_BREAK ||
+           node->type == NODE_TYPE_STATEMENT_CONTINUE ||
+           node->type == NODE_TYPE_STATEMENT_GOTO;
+}
+
+/**
+ * Returns true if the condition is a number known at compile time such as "if (0)"
+ * the truth of the condition is written to "value_out"
+ */
+bool codegen_condition_is_constant(struct node *node, bool *value_out)
+{
+    while (node->type == NODE_TYPE_EXPRESSION_PARENTHESIS)
+    {
+        node = node->parenthesis.exp;
+    }
+
+    if (node->type != NODE_TYPE_NUMBER)
+        return false;
+
+    if (node->num.type == NUMBER_TYPE_FLOAT || node->num.type == NUMBER_TYPE_DOUBLE)
+    {
+        *value_out = node->dnum != 0;
+        return true;
+    }
+
+    *value_out = node->llnum != 0;
+    return true;
+}
+
 void _codegen_generate_if_stmt(struct node *node, int end_label_id);
 void codegen_generate_else_stmt(struct node *node)
 {
@@ -2930,13 +4288,123 @@ void codegen_generate_else_or_else_if(struct node *node, int end_label_id)
     }
 }
 
+/**
+ * Generates only the arm of the if statement that can run. Returns false if the other arm
+ * can be jumped into, in which case the whole statement must be generated as normal.
+ */
+bool codegen_generate_constant_if_stmt(struct node *node, bool value, int end_label_id)
+{
+    struct history history;
+    struct node *dead_arm = value ? node->stmt._if.next : node->stmt._if.body_node;
+    if (codegen_statement_has_jump_target(dead_arm))
+        return false;
+
+    current_process->statistics.folded_branches++;
+    if (dead_arm)
+    {
+        current_process->statistics.removed_nodes++;
+    }
+
+    if (value)
+    {
+        codegen_generate_body(node->stmt._if.body_node, history_begin(&history, IS_ALONE_STATEMENT));
+    }
+    else if (node->stmt._if.next)
+    {
+        codegen_generate_else_or_else_if(node->stmt._if.next, end_label_id);
+    }
+
+    return true;
+}
+
+/**
+ * Returns true if the node is a pointer compared with zero i.e "ptr == NULL"
+ */
+static bool codegen_is_null_pointer_check(struct node *cond)
+{
+    struct node *operand = predict_null_check_operand(cond);
+    if (!operand || (operand->type != NODE_TYPE_IDENTIFIER && !is_access_node(operand)))
+        return false;
+
+    struct resolver_result *result = resolver_follow(current_process->resolver, operand);
+    if (!resolver_result_ok(result) || !result->last_entity)
+        return false;
+
+    return result->last_entity->dtype.flags & DATATYPE_FLAG_IS_POINTER && !(result->last_entity->dtype.flags & DATATYPE_FLAG_IS_ARRAY);
+}
+
+static bool codegen_if_body_is_unlikely(struct node *node)
+{
+    int prediction = predict_if_stmt(node);
+    if (prediction != PREDICT_UNKNOWN)
+        return prediction == PREDICT_NOT_TAKEN;
+
+    return codegen_is_null_pointer_check(node->stmt._if.cond_node);
+}
+
+/**
+ * Generates the body of an if statement that is predicted not to run after the function,
+ * the likely code then falls through the condition without a taken branch.
+ */
+static void codegen_generate_unlikely_if_body(struct node *node, int if_label_id, int end_label_id)
+{
+    struct history history;
+    FILE *ofile = current_process->ofile;
+    char *code = NULL;
+    size_t code_size = 0;
+    current_process->ofile = open_memstream(&code, &code_size);
+
+    asm_push(".if_unlikely_%i:", if_label_id);
+    codegen_generate_body(node->stmt._if.body_node, history_begin(&history, IS_ALONE_STATEMENT));
+    asm_push("jmp .if_end_%i", end_label_id);
+
+    fclose(current_process->ofile);
+    current_process->ofile = ofile;
+    vector_push(current_function_unlikely_paths, &code);
+    current_process->statistics.unlikely_paths++;
+}
+
+static void codegen_generate_unlikely_paths()
+{
+    for (int i = 0; i < vector_count(current_function_unlikely_paths); i++)
+    {
+        char *code = vector_peek_ptr_at(current_function_unlikely_paths, i);
+        if (current_process->ofile)
+        {
+            fputs(code, current_process->ofile);
+        }
+        free(code);
+    }
+
+    vector_clear(current_function_unlikely_paths);
+}
+
 void _codegen_generate_if_stmt(struct node *node, int end_label_id)
 {
     struct history history;
+    bool cond_value = false;
+    if (codegen_condition_is_constant(node->stmt._if.cond_node, &cond_value) &&
+        codegen_generate_constant_if_stmt(node, cond_value, end_label_id))
+        return;
+
     int if_label_id = codegen_label_count();
     codegen_generate_brand_new_expression(node->stmt._if.cond_node, history_begin(&history, 0));
+    codegen_floating_to_truth_value();
     asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
     asm_push("cmp eax, 0");
+    if (codegen_if_body_is_unlikely(node))
+    {
+        asm_push("jne .if_unlikely_%i", if_label_id);
+        register_unset_flag(REGISTER_EAX_IS_USED);
+        codegen_generate_unlikely_if_body(node, if_label_id, end_label_id);
+        asm_push(".if_%i:", if_label_id);
+        if (node->stmt._if.next)
+        {
+            codegen_generate_else_or_else_if(node->stmt._if.next, end_label_id);
+        }
+        return;
+    }
+
     asm_push("je .if_%i", if_label_id);
     // Unset the EAX register flag we are not using it now
     register_unset_flag(REGISTER_EAX_IS_USED);
@@ -2961,32 +4429,72 @@ void codegen_generate_if_stmt(struct node *node)
 void codegen_generate_while_stmt(struct node *node)
 {
     struct history history;
-    codegen_begin_entry_exit_point();
+    bool cond_value = true;
+    if (codegen_condition_is_constant(node->stmt._while.cond, &cond_value) && !cond_value &&
+        !codegen_statement_has_jump_target(node->stmt._while.body))
+    {
+        // The loop can never run
+        current_process->statistics.folded_branches++;
+        current_process->statistics.removed_nodes++;
+        return;
+    }
+
+    // The condition is tested at the bottom so the back edge is the branch taken, the loop
+    // is entered by jumping to the condition.
+    codegen_begin_rotated_loop();
     int while_start_id = codegen_label_count();
-    int while_end_id = codegen_label_count();
+    bool always_true = codegen_condition_is_constant(node->stmt._while.cond, &cond_value) && cond_value;
+    if (!always_true)
+    {
+        codegen_goto_entry_point(node);
+    }
+    codegen_align_loop_head();
     asm_push(".while_start_%i:", while_start_id);
+    codegen_generate_body(node->stmt._while.body, history_begin(&history, IS_ALONE_STATEMENT));
+
+    codegen_place_entry_point();
+    if (always_true)
+    {
+        current_process->statistics.folded_branches++;
+        asm_push("jmp .while_start_%i", while_start_id);
+        codegen_end_entry_exit_point();
+        return;
+    }
 
     // Generate the expressionable condition
     codegen_generate_brand_new_expression(node->stmt._while.cond, history_begin(&history, 0));
+    codegen_floating_to_truth_value();
     asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
 
     asm_push("cmp eax, 0");
-    asm_push("je .while_end_%i", while_end_id);
-    // Okay, let us now generate the body
-    codegen_generate_body(node->stmt._while.body, history_begin(&history, IS_ALONE_STATEMENT));
-    asm_push("jmp .while_start_%i", while_start_id);
-    asm_push(".while_end_%i:", while_end_id);
+    asm_push("jne .while_start_%i", while_start_id);
     codegen_end_entry_exit_point();
 }
 
 void codegen_generate_do_while_stmt(struct node *node)
 {
     struct history history;
+    codegen_align_loop_head();
     codegen_begin_entry_exit_point();
     int do_while_start_id = codegen_label_count();
     asm_push(".do_while_start_%i:", do_while_start_id);
     codegen_generate_body(node->stmt._do_while.body, history_begin(&history, IS_ALONE_STATEMENT));
+
+    bool cond_value = false;
+    if (codegen_condition_is_constant(node->stmt._do_while.cond, &cond_value))
+    {
+        // i.e "do { } while(0)" from macros, no need to test the condition
+        current_process->statistics.folded_branches++;
+        if (cond_value)
+        {
+            asm_push("jmp .do_while_start_%i", do_while_start_id);
+        }
+        codegen_end_entry_exit_point();
+        return;
+    }
+
     codegen_generate_brand_new_expression(node->stmt._do_while.cond, history_begin(&history, 0));
+    codegen_floating_to_truth_value();
     asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
 
     asm_push("cmp eax, 0");
@@ -2998,7 +4506,7 @@ void codegen_generate_for_stmt(struct node *node)
 {
     struct for_stmt *for_stmt = &node->stmt._for;
     int for_loop_start_id = codegen_label_count();
-    int for_loop_end_id = codegen_label_count();
+    int for_loop_body_id = codegen_label_count();
     struct history history;
 
     if (for_stmt->init)
@@ -3008,8 +4516,21 @@ void codegen_generate_for_stmt(struct node *node)
         asm_push_ins_pop_or_ignore("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
     }
 
-    asm_push("jmp .for_loop%i", for_loop_start_id);
-    codegen_begin_entry_exit_point();
+    // Like while loops the condition is tested at the bottom, continue goes to the loop expression before it.
+    codegen_begin_rotated_loop();
+    if (for_stmt->cond)
+    {
+        asm_push("jmp .for_loop%i", for_loop_start_id);
+    }
+    // Only the back edge reaches the body, the padding is never executed
+    codegen_align_loop_head();
+    asm_push(".for_loop_body%i:", for_loop_body_id);
+    if (for_stmt->body)
+    {
+        codegen_generate_body(for_stmt->body, history_begin(&history, IS_ALONE_STATEMENT));
+    }
+
+    codegen_place_entry_point();
     if (for_stmt->loop)
     {
         codegen_generate_brand_new_expression(for_stmt->loop, history_begin(&history, 0));
@@ -3020,24 +4541,16 @@ void codegen_generate_for_stmt(struct node *node)
     {
         // We have our FOR loop condition, lets condition it.
         codegen_generate_brand_new_expression(for_stmt->cond, history_begin(&history, 0));
+        codegen_floating_to_truth_value();
         asm_push_ins_pop_or_ignore("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
 
         asm_push("cmp eax, 0");
-        asm_push("je .for_loop_end%i", for_loop_end_id);
-    }
-
-    if (for_stmt->body)
-    {
-        codegen_generate_body(for_stmt->body, history_begin(&history, IS_ALONE_STATEMENT));
+        asm_push("jne .for_loop_body%i", for_loop_body_id);
     }
-
-    if (for_stmt->loop)
+    else
     {
-        codegen_generate_brand_new_expression(for_stmt->loop, history_begin(&history, 0));
-        asm_push_ins_pop_or_ignore("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        asm_push("jmp .for_loop_body%i", for_loop_body_id);
     }
-    asm_push("jmp .for_loop%i", for_loop_start_id);
-    asm_push(".for_loop_end%i:", for_loop_end_id);
     codegen_end_entry_exit_point();
 }
 
@@ -3062,27 +4575,86 @@ void codegen_generate_switch_default_stmt(struct node *node)
     asm_push(".switch_stmt_%i_case_default:", switch_stmt_data->current.id);
 }
 
+/**
+ * Orders the cases of the switch statement so the ones the profile saw most often are compared first,
+ * "order" holds the positions of the cases in the statement.
+ */
+static void codegen_switch_cases_by_count(int *order, int total_cases, struct profile_record *record)
+{
+    for (int i = 1; i < total_cases; i++)
+    {
+        int position = order[i];
+        int b = i;
+        while (b > 0 && record->counts[order[b - 1]] < record->counts[position])
+        {
+            order[b] = order[b - 1];
+            b--;
+        }
+        order[b] = position;
+    }
+}
+
 void codegen_generate_switch_stmt_case_jumps(struct node *node)
 {
-    vector_set_peek_pointer(node->stmt._switch.cases, 0);
-    struct parsed_switch_case *switch_case = vector_peek(node->stmt._switch.cases);
-    while (switch_case)
+    struct vector *cases = node->stmt._switch.cases;
+    int total_cases = vector_count(cases);
+    int *order = calloc(total_cases + 1, sizeof(int));
+    for (int i = 0; i < total_cases; i++)
+    {
+        order[i] = i;
+    }
+
+    // Every case has a counter, the last counter is for values that match no case
+    char name[256];
+    snprintf(name, sizeof(name), "%s/switch%i", current_function->func.name, current_function_switches++);
+    struct profile_record *record = NULL;
+    if (current_process->flags & COMPILE_PROCESS_PROFILE_GENERATE)
+    {
+        record = profile_record_create(current_process, strdup(name), total_cases + 1);
+    }
+    else if (current_process->flags & COMPILE_PROCESS_PROFILE_USE)
     {
+        struct profile_record *profile = profile_record_find(current_process, name, total_cases + 1);
+        if (profile)
+        {
+            codegen_switch_cases_by_count(order, total_cases, profile);
+        }
+    }
+
+    for (int i = 0; i < total_cases; i++)
+    {
+        struct parsed_switch_case *switch_case = vector_at(cases, order[i]);
         asm_push("cmp eax, %i", switch_case->index);
-        asm_push("je .switch_stmt_%i_case_%i", codegen_switch_id(), switch_case->index);
-        switch_case = vector_peek(node->stmt._switch.cases);
+        asm_push("je .switch_stmt_%i_%s_%i", codegen_switch_id(), record ? "count" : "case", switch_case->index);
+    }
+
+    if (record)
+    {
+        asm_push("inc dword [__profile_counters_%i+%i]", record->id, total_cases * DATA_SIZE_DWORD);
     }
 
     // Do we have a default case in the switch statement?
     // Then lets jump to the default label
     if (node->stmt._switch.has_default_case)
     {
-        asm_push("jmp .switch_stmt_%i_case_default", codegen_switch_id());
-        return;
+        asm_push("jmp .switch_stmt_%i_case_default", codegen_switch_id());
+    }
+    else
+    {
+        // Not equal to any case? Then go to the exit point, no need to restore
+        // any stack of any kind as we have not even gone into the body of the switch
+        codegen_goto_exit_point_maintain_stack(node);
+    }
+
+    // The counters of the cases, a matching case is counted before jumping to it
+    for (int i = 0; record && i < total_cases; i++)
+    {
+        struct parsed_switch_case *switch_case = vector_at(cases, i);
+        asm_push(".switch_stmt_%i_count_%i:", codegen_switch_id(), switch_case->index);
+        asm_push("inc dword [__profile_counters_%i+%i]", record->id, i * DATA_SIZE_DWORD);
+        asm_push("jmp .switch_stmt_%i_case_%i", codegen_switch_id(), switch_case->index);
     }
-    // Not equal to any case? Then go to the exit point, no need to restore
-    // any stack of any kind as we have not even gone into the body of the switch
-    codegen_goto_exit_point_maintain_stack(node);
+    free(order);
 }
 void codegen_generate_switch_stmt(struct node *node)
 {
@@ -3124,6 +4696,346 @@ void codegen_generate_goto_stmt(struct node *node)
     asm_push("jmp label_%s", node->stmt._goto.label->sval);
 }
 
+/**
+ * Inline assembly statements. The template is written in the same syntax as the generated code,
+ * "%0", "%1" and so on are replaced with the operands numbered outputs first. Operands are given
+ * a register i.e "r", "a", "b", "c", "d", "S", "D", a memory address "m", an integer "i" or the
+ * register of an output for inputs i.e "0". Outputs start with "=" or with "+" if they are also read.
+ *
+ * Registers the statement uses that must survive it are saved around it, these are ESI and EDI
+ * which we preserve for the caller and any register currently marked in use.
+ */
+#define CODEGEN_ASM_TOTAL_REGISTERS 6
+// The first registers have byte sized parts i.e "al"
+#define CODEGEN_ASM_TOTAL_BYTE_REGISTERS 4
+
+static const char *codegen_asm_registers[CODEGEN_ASM_TOTAL_REGISTERS] = {"eax", "ecx", "edx", "ebx", "esi", "edi"};
+
+struct codegen_asm_operand
+{
+    struct asm_operand *operand;
+    bool is_output;
+    // Index into codegen_asm_registers or -1 if the operand is not in a register
+    int reg;
+    char text[64];
+};
+
+static int codegen_asm_register_index(const char *name)
+{
+    if (*name == '%')
+    {
+        name++;
+    }
+
+    for (int i = 0; i < CODEGEN_ASM_TOTAL_REGISTERS; i++)
+    {
+        if (S_EQ(name, codegen_asm_registers[i]))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int codegen_asm_constraint_register(char constraint)
+{
+    switch (constraint)
+    {
+    case 'a':
+        return codegen_asm_register_index("eax");
+    case 'b':
+        return codegen_asm_register_index("ebx");
+    case 'c':
+        return codegen_asm_register_index("ecx");
+    case 'd':
+        return codegen_asm_register_index("edx");
+    case 'S':
+        return codegen_asm_register_index("esi");
+    case 'D':
+        return codegen_asm_register_index("edi");
+    }
+
+    return -1;
+}
+
+/**
+ * Returns the constraint letter without the "=", "+" and "&" modifiers
+ */
+static char codegen_asm_constraint(struct asm_operand *operand)
+{
+    const char *constraint = operand->constraint;
+    while (*constraint == '=' || *constraint == '+' || *constraint == '&')
+    {
+        constraint++;
+    }
+
+    return *constraint;
+}
+
+static bool codegen_asm_operand_is_read(struct codegen_asm_operand *operand)
+{
+    return !operand->is_output || strchr(operand->operand->constraint, '+');
+}
+
+/**
+ * Returns a bitmask of the registers the clobbers name, "memory" and "cc" need nothing from us
+ * as no values are kept in registers or flags between statements.
+ */
+static int codegen_asm_clobbered_registers(struct vector *clobbers)
+{
+    int clobbered = 0;
+    for (int i = 0; i < vector_count(clobbers); i++)
+    {
+        const char *clobber = *(const char **)vector_at(clobbers, i);
+        if (S_EQ(clobber, "memory") || S_EQ(clobber, "cc"))
+        {
+            continue;
+        }
+
+        int reg = codegen_asm_register_index(clobber);
+        if (reg == -1)
+        {
+            compiler_error(current_process, "The asm statement cannot clobber \"%s\"", clobber);
+        }
+        clobbered |= 1 << reg;
+    }
+
+    return clobbered;
+}
+
+static int codegen_asm_free_register(int taken, int total_registers)
+{
+    for (int i = 0; i < total_registers; i++)
+    {
+        if (!(taken & (1 << i)))
+        {
+            return i;
+        }
+    }
+
+    compiler_error(current_process, "The asm statement needs more registers than are available");
+    return -1;
+}
+
+static void codegen_asm_memory_operand(struct codegen_asm_operand *operand)
+{
+    struct resolver_result *result = resolver_follow(current_process->resolver, operand->operand->exp);
+    if (!resolver_result_ok(result) || resolver_result_entity_next(resolver_result_entity_root(result)) ||
+        result->last_entity->type != RESOLVER_ENTITY_TYPE_VARIABLE)
+    {
+        compiler_error(current_process, "The \"m\" asm operand must be a variable");
+    }
+
+    if (codegen_entity_is_thread_local(result->last_entity))
+    {
+        compiler_error(current_process, "Thread local variables have no fixed address to use as an \"m\" asm operand");
+    }
+
+    size_t size = datatype_element_size(&result->last_entity->dtype);
+    if (size > DATA_SIZE_DWORD)
+    {
+        snprintf(operand->text, sizeof(operand->text), "[%s]", result->base.address);
+        return;
+    }
+
+    const char *reg = "eax";
+    snprintf(operand->text, sizeof(operand->text), "%s [%s]", codegen_byte_word_or_dword_or_ddword(size, &reg), result->base.address);
+}
+
+/**
+ * Binds every operand to a register, an address or an integer.
+ * Returns the registers used by the operands and the clobbers.
+ */
+static int codegen_asm_bind_operands(struct codegen_asm_operand *operands, int total_operands, int total_outputs, int clobbered)
+{
+    int taken = clobbered;
+    // Registers named by the constraints are bound first so "r" can pick from the rest
+    for (int i = 0; i < total_operands; i++)
+    {
+        operands[i].reg = codegen_asm_constraint_register(codegen_asm_constraint(operands[i].operand));
+        if (operands[i].reg == -1)
+        {
+            continue;
+        }
+
+        if (taken & (1 << operands[i].reg))
+        {
+            compiler_error(current_process, "The asm statement uses \"%s\" more than once", codegen_asm_registers[operands[i].reg]);
+        }
+        taken |= 1 << operands[i].reg;
+    }
+
+    for (int i = 0; i < total_operands; i++)
+    {
+        struct codegen_asm_operand *operand = &operands[i];
+        char constraint = codegen_asm_constraint(operand->operand);
+        if (constraint == 'r' || constraint == 'q')
+        {
+            operand->reg = codegen_asm_free_register(taken, constraint == 'q' ? CODEGEN_ASM_TOTAL_BYTE_REGISTERS : CODEGEN_ASM_TOTAL_REGISTERS);
+            taken |= 1 << operand->reg;
+        }
+        else if (isdigit(constraint) && !operand->is_output)
+        {
+            int output = constraint - '0';
+            if (output >= total_outputs || operands[output].reg == -1)
+            {
+                compiler_error(current_process, "The asm input \"%s\" must name an output in a register", operand->operand->constraint);
+            }
+            operand->reg = operands[output].reg;
+        }
+        else if (constraint == 'm')
+        {
+            codegen_asm_memory_operand(operand);
+        }
+        else if (constraint == 'i' || constraint == 'n')
+        {
+            if (operand->is_output || operand->operand->exp->type != NODE_TYPE_NUMBER)
+            {
+                compiler_error(current_process, "The \"%c\" asm operand must be a number", constraint);
+            }
+            snprintf(operand->text, sizeof(operand->text), "%lld", operand->operand->exp->llnum);
+        }
+        else if (operand->reg == -1)
+        {
+            compiler_error(current_process, "Unsupported asm constraint \"%s\"", operand->operand->constraint);
+        }
+
+        if (operand->reg != -1)
+        {
+            snprintf(operand->text, sizeof(operand->text), "%s", codegen_asm_registers[operand->reg]);
+        }
+    }
+
+    return taken;
+}
+
+/**
+ * Writes the template with the operands substituted, one instruction per line or semicolon
+ */
+static void codegen_asm_generate_template(const char *template, struct codegen_asm_operand *operands, int total_operands)
+{
+    struct buffer *buffer = buffer_create();
+    for (const char *c = template; *c; c++)
+    {
+        if (*c != '%')
+        {
+            buffer_write(buffer, *c);
+            continue;
+        }
+
+        c++;
+        if (*c == '%')
+        {
+            buffer_write(buffer, '%');
+            continue;
+        }
+
+        char *end = NULL;
+        long index = strtol(c, &end, 10);
+        if (end == c || index >= total_operands)
+        {
+            compiler_error(current_process, "The asm statement refers to an operand that does not exist");
+        }
+        for (const char *text = operands[index].text; *text; text++)
+        {
+            buffer_write(buffer, *text);
+        }
+        c = end - 1;
+    }
+    buffer_write(buffer, 0x00);
+
+    for (char *line = strtok(buffer_ptr(buffer), "\n;"); line; line = strtok(NULL, "\n;"))
+    {
+        while (isspace(*line))
+        {
+            line++;
+        }
+
+        if (*line)
+        {
+            asm_push("%s", line);
+        }
+    }
+    buffer_free(buffer);
+}
+
+void codegen_generate_asm_stmt(struct node *node)
+{
+    struct asm_stmt *stmt = &node->stmt._asm;
+    int total_outputs = vector_count(stmt->outputs);
+    int total_operands = total_outputs + vector_count(stmt->inputs);
+    struct codegen_asm_operand *operands = calloc(total_operands + 1, sizeof(struct codegen_asm_operand));
+    for (int i = 0; i < total_operands; i++)
+    {
+        operands[i].is_output = i < total_outputs;
+        operands[i].operand = operands[i].is_output ? vector_at(stmt->outputs, i) : vector_at(stmt->inputs, i - total_outputs);
+
+        struct datatype dtype;
+        if (codegen_floating_type(operands[i].operand->exp, &dtype))
+        {
+            compiler_error(current_process, "Floating point asm operands are not supported");
+        }
+    }
+
+    int used = codegen_asm_bind_operands(operands, total_operands, total_outputs, codegen_asm_clobbered_registers(stmt->clobbers));
+    int saved = 0;
+    for (int i = 0; i < CODEGEN_ASM_TOTAL_REGISTERS; i++)
+    {
+        const char *reg = codegen_asm_registers[i];
+        if (used & (1 << i) && (S_EQ(reg, "esi") || S_EQ(reg, "edi") || register_is_used(reg)))
+        {
+            asm_push_ins_push("%s", STACK_FRAME_ELEMENT_TYPE_SAVED_REGISTER, "asm_saved_register", reg);
+            saved |= 1 << i;
+        }
+    }
+
+    struct history history;
+    for (int i = 0; i < total_operands; i++)
+    {
+        if (operands[i].reg != -1 && codegen_asm_operand_is_read(&operands[i]))
+        {
+            codegen_generate_expressionable(operands[i].operand->exp, history_begin(&history, 0));
+        }
+    }
+
+    for (int i = total_operands - 1; i >= 0; i--)
+    {
+        if (operands[i].reg != -1 && codegen_asm_operand_is_read(&operands[i]))
+        {
+            asm_push_ins_pop(operands[i].text, STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        }
+    }
+
+    codegen_asm_generate_template(stmt->template, operands, total_operands);
+
+    // Every output register is pushed before any is stored as storing uses the registers
+    for (int i = 0; i < total_outputs; i++)
+    {
+        if (operands[i].reg != -1)
+        {
+            asm_push_ins_push("%s", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", operands[i].text);
+        }
+    }
+
+    for (int i = total_outputs - 1; i >= 0; i--)
+    {
+        if (operands[i].reg != -1)
+        {
+            codegen_generate_assignment_part(operands[i].operand->exp, "=", history_begin(&history, 0));
+        }
+    }
+
+    for (int i = CODEGEN_ASM_TOTAL_REGISTERS - 1; i >= 0; i--)
+    {
+        if (saved & (1 << i))
+        {
+            asm_push_ins_pop(codegen_asm_registers[i], STACK_FRAME_ELEMENT_TYPE_SAVED_REGISTER, "asm_saved_register");
+        }
+    }
+    free(operands);
+}
+
 void codegen_discard_unused_stack()
 {
     asm_stack_peek_start();
@@ -3146,11 +5058,17 @@ void codegen_generate_statement(struct node *node, struct history *history)
     {
 
     case NODE_TYPE_EXPRESSION:
-        codegen_generate_exp_node(node, history_begin(history, history->flags));
+        if (!codegen_generate_floating_expressionable(node, history_begin(history, history->flags)))
+        {
+            codegen_generate_exp_node(node, history_begin(history, history->flags));
+        }
         break;
 
     case NODE_TYPE_UNARY:
-        codegen_generate_unary(node, history_begin(history, history->flags));
+        if (!codegen_generate_floating_expressionable(node, history_begin(history, history->flags)))
+        {
+            codegen_generate_unary(node, history_begin(history, history->flags));
+        }
         break;
 
     case NODE_TYPE_VARIABLE:
@@ -3205,6 +5123,10 @@ void codegen_generate_statement(struct node *node, struct history *history)
         codegen_generate_goto_stmt(node);
         break;
 
+    case NODE_TYPE_STATEMENT_ASM:
+        codegen_generate_asm_stmt(node);
+        break;
+
     case NODE_TYPE_LABEL:
         codegen_generate_label(node);
         break;
@@ -3213,13 +5135,54 @@ void codegen_generate_statement(struct node *node, struct history *history)
     codegen_discard_unused_stack();
 }
 
+/**
+ * Statements that can never run are not generated, variables are still registered
+ * as a label further down the scope may use them.
+ */
+void codegen_generate_dead_statement(struct node *node)
+{
+    switch (node->type)
+    {
+    case NODE_TYPE_VARIABLE:
+        codegen_new_scope_entity(node, node->var.aoffset, RESOLVER_DEFAULT_ENTITY_FLAG_IS_LOCAL_STACK);
+        break;
+
+    case NODE_TYPE_VARIABLE_LIST:
+        for (int i = 0; i < vector_count(node->var_list.list); i++)
+        {
+            struct node *var_node = vector_peek_ptr_at(node->var_list.list, i);
+            codegen_new_scope_entity(var_node, var_node->var.aoffset, RESOLVER_DEFAULT_ENTITY_FLAG_IS_LOCAL_STACK);
+        }
+        break;
+
+    default:
+        current_process->statistics.removed_nodes++;
+        break;
+    }
+}
+
 void codegen_generate_scope_no_new_scope(struct vector *statements, struct history *history)
 {
+    // Code after a return, break, continue or goto is unreachable until the next label
+    bool reachable = true;
     vector_set_peek_pointer(statements, 0);
     struct node *statement_node = vector_peek_ptr(statements);
     while (statement_node)
     {
-        codegen_generate_statement(statement_node, history);
+        if (!reachable && codegen_statement_has_jump_target(statement_node))
+        {
+            reachable = true;
+        }
+
+        if (reachable)
+        {
+            codegen_generate_statement(statement_node, history);
+            reachable = !codegen_statement_leaves_scope(statement_node);
+        }
+        else
+        {
+            codegen_generate_dead_statement(statement_node);
+        }
         statement_node = vector_peek_ptr(statements);
     }
 }
@@ -3235,28 +5198,109 @@ void codegen_generate_function_arguments(struct vector *argument_vector)
     }
 }
 
+void codegen_store_register_arguments(struct node *func_node)
+{
+    struct vector *arguments = function_node_argument_vec(func_node);
+    for (int i = 0; i < function_node_register_arguments(func_node); i++)
+    {
+        struct node *var_node = variable_node(vector_peek_ptr_at(arguments, i));
+        asm_push("mov dword [ebp%i], %s", var_node->var.aoffset, function_node_argument_register(i));
+    }
+}
+
 void codegen_generate_function_prototype(struct node *node)
 {
-    // We must register this function prototype
-    codegen_register_function(node, 0);
+    // We must register this function prototype, unless its a builtin that calls must still reach
+    if (!(node->func.flags & FUNCTION_NODE_FLAG_IS_NATIVE))
+    {
+        codegen_register_function(node, 0);
+    }
     asm_push("extern %s", node->func.name);
 
     // Since its a prototype no code needs to be generated, just its presence must be registered
     // and it marked as external
 }
 
+/**
+ * Generates the function through the intermediate representation
+ * returns false if the function cannot be lowered, the AST generator should then be used.
+ */
+bool codegen_generate_function_with_ir(struct node *node)
+{
+    int flags = current_process->flags;
+    if (!(flags & (COMPILE_PROCESS_USE_IR | COMPILE_PROCESS_DUMP_IR | COMPILE_PROCESS_DUMP_CFG)))
+        return false;
+
+    struct ir_function *function = ir_lower_function(current_process, node);
+    if (!function)
+    {
+        // The AST generator only produces 32 bit code
+        if (flags & COMPILE_PROCESS_TARGET_X86_64)
+        {
+            compiler_error(current_process, "The function %s is not supported by the x86-64 backend", node->func.name);
+        }
+        return false;
+    }
+
+    // Counters are added before optimizing so the blocks match the ones the profile is used with
+    if (flags & COMPILE_PROCESS_USE_IR && flags & COMPILE_PROCESS_PROFILE_GENERATE)
+    {
+        ir_profile_instrument(current_process, function);
+    }
+    else
+    {
+        // Exact counts from an instrumented run are preferred over samples
+        bool profiled = flags & COMPILE_PROCESS_PROFILE_USE && ir_profile_annotate(current_process, function);
+        if (!profiled && flags & COMPILE_PROCESS_PROFILE_SAMPLE_USE)
+        {
+            ir_profile_annotate_samples(current_process, function);
+        }
+    }
+
+    ir_optimize_function(current_process, function);
+
+    if (flags & COMPILE_PROCESS_DUMP_IR && current_process->ir_file)
+    {
+        ir_dump_function(current_process->ir_file, function);
+    }
+
+    if (flags & COMPILE_PROCESS_DUMP_CFG && current_process->cfg_file)
+    {
+        ir_dump_function_dot(current_process->cfg_file, function);
+    }
+
+    if (!(flags & COMPILE_PROCESS_USE_IR))
+        return false;
+
+    if (flags & COMPILE_PROCESS_TARGET_X86_64)
+    {
+        ir_codegen_function_x86_64(current_process, function);
+        return true;
+    }
+
+    ir_codegen_function(current_process, function);
+    return true;
+}
+
 void codegen_generate_function_with_body(struct node *node)
 {
     // We must register this function
     codegen_register_function(node, 0);
+    if (codegen_generate_function_with_ir(node))
+        return;
+
     asm_push("global %s", node->func.name);
     asm_push("; %s function", node->func.name);
+    asm_push("align 16");
     asm_push("%s:", node->func.name);
 
     // We have to create a stack frame ;)
     asm_push_ebp();
     asm_push("mov ebp, esp");
     codegen_stack_sub(C_ALIGN(function_node_stack_size(node)));
+    codegen_store_register_arguments(node);
+    current_function_body_label_id = codegen_label_count();
+    asm_push("function_body_%i:", current_function_body_label_id);
     // Generate scope for function arguments
     codegen_new_scope(RESOLVER_DEFAULT_ENTITY_FLAG_IS_LOCAL_STACK);
 
@@ -3277,10 +5321,12 @@ void codegen_generate_function_with_body(struct node *node)
     stackframe_assert_empty(current_function);
 
     asm_push("ret");
+    codegen_generate_unlikely_paths();
 }
 void codegen_generate_function(struct node *node)
 {
     current_function = node;
+    current_function_switches = 0;
     if (function_node_is_prototype(node))
     {
         codegen_generate_function_prototype(node);
@@ -3394,6 +5440,11 @@ int codegen(struct compile_process *process)
 {
     current_process = process;
     x86_codegen.compiler = current_process;
+    current_function_unlikely_paths = vector_create(sizeof(char *));
+    if (process->flags & COMPILE_PROCESS_TARGET_X86_64)
+    {
+        asm_push("bits 64");
+    }
 
     // Create the root scope for this process
     scope_create_root(process);
@@ -3412,6 +5463,8 @@ int codegen(struct compile_process *process)
     // Finally generate read only data
     codegen_generate_rod();
 
+    profile_generate(process);
+
     return 0;
 }
 
@@ -3420,6 +5473,7 @@ struct code_generator *codegenerator_new(struct compile_process *process)
     struct code_generator *generator = calloc(sizeof(struct code_generator), 1);
     generator->states.expr = vector_create(sizeof(struct expression_state *));
     generator->string_table = vector_create(sizeof(struct string_table_element *));
+    generator->floating_constants = vector_create(sizeof(struct floating_constant_element *));
     generator->exit_points = vector_create(sizeof(struct exit_point *));
     generator->entry_points = vector_create(sizeof(struct entry_point *));
     generator->responses = vector_create(sizeof(struct response *));
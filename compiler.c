@@ -146,12 +146,15 @@ struct compile_process *compile_include(const char *filename, struct compile_pro
     return new_process;
 }
 
-int compile_file(const char *filename, const char *out_filename, int flags)
+int compile_file(const char *filename, const char *out_filename, int flags, struct compile_options *options)
 {
     struct compile_process *process = compile_process_create(filename, out_filename, flags, NULL);
     if (!process)
         return COMPILER_FAILED_WITH_ERRORS;
 
+    process->options = *options;
+    datatype_set_pointer_size(flags & COMPILE_PROCESS_TARGET_X86_64 ? DATA_SIZE_DDWORD : DATA_SIZE_DWORD);
+
     struct lex_process *lex_process = lex_process_create(process, &compiler_lex_functions, NULL);
     if (!lex_process)
     {
@@ -171,11 +174,31 @@ int compile_file(const char *filename, const char *out_filename, int flags)
     if (parse(process) != PARSE_ALL_OK)
         return COMPILER_FAILED_WITH_ERRORS;
 
+    native_create_library_functions(process);
+
     // We must validate the tree to ensure people aren't setting variables that dont exist
     // ect..
     if (validate(process) != VALIDATION_ALL_OK)
         return COMPILER_FAILED_WITH_ERRORS;
 
+    reachability_remove_unused_definitions(process);
+
+    // The x86-64 backend already passes arguments in registers
+    if (!(flags & COMPILE_PROCESS_TARGET_X86_64))
+    {
+        reachability_assign_register_arguments(process);
+    }
+
+    if (flags & COMPILE_PROCESS_PROFILE_USE)
+    {
+        profile_load(process);
+    }
+
+    if (flags & COMPILE_PROCESS_PROFILE_SAMPLE_USE)
+    {
+        profile_load_samples(process);
+    }
+
     for (int i = 0; i < vector_count(process->node_tree_vec); i++)
     {
         struct node *ptr;
@@ -188,6 +211,11 @@ int compile_file(const char *filename, const char *out_filename, int flags)
     if (codegen(process) != CODEGEN_ALL_OK)
         return COMPILER_FAILED_WITH_ERRORS;
 
+    if (flags & COMPILE_PROCESS_PRINT_STATISTICS)
+    {
+        compile_process_print_statistics(process);
+    }
+
     compile_process_destroy(process);
     return COMPILER_FILE_COMPILED_OK;
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <memory.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <assert.h>
 #include <string.h>
 #include <linux/limits.h>
@@ -21,6 +22,10 @@
 // when accessing function arguments passed to us and looking up the stack
 #define C_OFFSET_FROM_FIRST_FUNCTION_ARGUMENT 8
 
+// Static functions whose address never escapes take this many leading arguments
+// in EAX, EDX and ECX rather than on the stack
+#define C_TOTAL_REGISTER_ARGUMENTS 3
+
 // Magic number for an infinite depth for iterating through expressions
 // and grabbing information from operands.
 #define DEPTH_INFINITE 0xffff
@@ -353,6 +358,13 @@ struct preprocessor
     struct vector *includes;
 };
 
+struct floating_constant_element
+{
+    double value;
+    // The code generator label that represents this constant in memory
+    const char label[50];
+};
+
 struct string_table_element
 {
     // The string in question
@@ -403,6 +415,9 @@ struct code_generator
     // Vector of struct string_table_element*
     struct vector *string_table;
 
+    // Vector of struct floating_constant_element*, doubles written to the read only data section
+    struct vector *floating_constants;
+
     // A vector/stack of struct codegen_exit_point
     // In the event of a "break" we must go to the current exit point.
     // i.e .exit_point_%i where %i is stored in this exit_points vector;
@@ -425,7 +440,47 @@ enum
     COMPILE_PROCESS_EXPORT_AS_OBJECT = 0b00000001,
     // If this flag is set NASM will be used after compliation, to assemble
     // the file.
-    COMPILE_PROCESS_EXECUTE_NASM = 0b00000010
+    COMPILE_PROCESS_EXECUTE_NASM = 0b00000010,
+    // Functions are lowered into the intermediate representation before code generation
+    COMPILE_PROCESS_USE_IR = 0b00000100,
+    // The intermediate representation of every function is written to "output.ir"
+    COMPILE_PROCESS_DUMP_IR = 0b00001000,
+    // The control flow graph of every function is written to "output.dot"
+    COMPILE_PROCESS_DUMP_CFG = 0b00010000,
+    // Optimization statistics are printed once compilation has finished
+    COMPILE_PROCESS_PRINT_STATISTICS = 0b00100000,
+    // Loops in the intermediate representation are unrolled
+    COMPILE_PROCESS_UNROLL_LOOPS = 0b01000000,
+    // Generate 64 bit code for the System V x86-64 ABI, functions are generated through the IR.
+    COMPILE_PROCESS_TARGET_X86_64 = 0b10000000,
+    // Loops over arrays in the intermediate representation are vectorized with SSE2
+    COMPILE_PROCESS_VECTORIZE_LOOPS = 0b100000000,
+    // Counters are added to the generated code and written to the profile file when the program exits
+    COMPILE_PROCESS_PROFILE_GENERATE = 0b1000000000,
+    // The counters in the profile file guide block layout, loop unrolling and switch statements
+    COMPILE_PROCESS_PROFILE_USE = 0b10000000000,
+    // The samples in the sample profile guide block layout and which blocks are moved out of line
+    COMPILE_PROCESS_PROFILE_SAMPLE_USE = 0b100000000000,
+    // The target has the "popcnt" instruction, baseline i686 and x86-64 do not
+    COMPILE_PROCESS_TARGET_POPCNT = 0b1000000000000
+};
+
+#define COMPILE_OPTIONS_DEFAULT_UNROLL_FACTOR 4
+#define COMPILE_OPTIONS_DEFAULT_UNROLL_BUDGET 256
+
+/**
+ * Options that take a value rather than being a simple flag
+ */
+struct compile_options
+{
+    // The times the body of a counted loop is repeated when it is partially unrolled
+    int unroll_factor;
+    // The most IR instructions the body of an unrolled loop may grow to
+    int unroll_budget;
+    // The profile file written or read, NULL to use the input file path with ".profile" appended
+    const char *profile_path;
+    // The sample profile read with COMPILE_PROCESS_PROFILE_SAMPLE_USE
+    const char *sample_profile_path;
 };
 
 struct compile_process;
@@ -475,6 +530,9 @@ struct compile_process
     // The flags in regards to how this file should be compiled
     int flags;
 
+    // Options with values, only set for the file passed to compile_file
+    struct compile_options options;
+
     // The current file being compiled
     struct compile_process_input_file
     {
@@ -486,6 +544,22 @@ struct compile_process
     // The output file to compile to. NULL if this is a sub-file included with "include"
     FILE *ofile;
 
+    // The file the intermediate representation is dumped to.
+    // NULL unless the COMPILE_PROCESS_DUMP_IR flag is set.
+    FILE *ir_file;
+
+    // Vector of struct profile_record*, the counters added to this file with COMPILE_PROCESS_PROFILE_GENERATE
+    // or the counters read from the profile file with COMPILE_PROCESS_PROFILE_USE.
+    struct vector *profile_records;
+
+    // Vector of struct profile_record*, the samples read from the sample profile with
+    // COMPILE_PROCESS_PROFILE_SAMPLE_USE. The counts of a record are indexed by source line.
+    struct vector *sample_records;
+
+    // The file the control flow graphs are dumped to.
+    // NULL unless the COMPILE_PROCESS_DUMP_CFG flag is set.
+    FILE *cfg_file;
+
     // Current line position information.
     struct pos pos;
 
@@ -537,6 +611,37 @@ struct compile_process
 
     // The code generator
     struct code_generator *generator;
+
+    // Counters for the work done by the optimizer, printed with COMPILE_PROCESS_PRINT_STATISTICS
+    struct compile_process_statistics
+    {
+        // Statements and if/else arms that were never generated because they can never run
+        int removed_nodes;
+        // Static functions and variables removed because nothing uses them
+        int removed_functions;
+        int removed_globals;
+        // IR instructions and blocks removed by dead code elimination
+        int removed_instructions;
+        int removed_blocks;
+        // Branches on constant conditions replaced with a jump
+        int folded_branches;
+        // Computations and loads replaced with an earlier identical value
+        int eliminated_expressions;
+        // Loop invariant computations moved into a loop preheader
+        int hoisted_instructions;
+        // Loops that were fully or partially unrolled
+        int unrolled_loops;
+        // Loops given a vector loop that runs most of their iterations
+        int vectorized_loops;
+        // Addresses computed from a loop counter that became pointer induction variables
+        int reduced_induction_variables;
+        // IR blocks moved to the unlikely executed text section
+        int cold_blocks;
+        // If statement bodies predicted not to run that were moved after the likely code
+        int unlikely_paths;
+        // Static functions whose first arguments are passed in registers
+        int register_argument_functions;
+    } statistics;
 };
 
 struct datatype
@@ -992,6 +1097,7 @@ typedef void (*GENERATOR_GENERATE_EXPRESSION)(struct generator *generator, struc
 typedef void (*GENERATOR_ENTITY_ADDRESS)(struct generator *generator, struct resolver_entity *entity, struct generator_entity_address *address_out);
 typedef void (*GENERATOR_END_EXPRESSION)(struct generator *generator);
 typedef void (*GENERATOR_FUNCTION_RETURN)(struct datatype* dtype, const char* fmt, ...);
+typedef int (*GENERATOR_POP)(const char *fmt, int expecting_stack_entity_type, const char *expecting_stack_entity_name, ...);
 
 struct generator
 {
@@ -1000,6 +1106,8 @@ struct generator
     GENERATOR_END_EXPRESSION end_exp;
     GENERATOR_ENTITY_ADDRESS entity_address;
     GENERATOR_FUNCTION_RETURN ret;
+    // Pops a value generated with gen_exp into a register
+    GENERATOR_POP pop;
 
     struct compile_process *compiler;
 
@@ -1020,6 +1128,38 @@ struct native_function
 struct symbol *native_create_function(struct compile_process *compiler, const char *name, struct native_function_callbacks *callbacks);
 struct native_function* native_function_get(struct compile_process* compiler, const char* name);
 
+/**
+ * Creates the native functions every file can call without including anything i.e __builtin_expect
+ */
+void native_create_builtin_functions(struct compile_process *compiler);
+
+/**
+ * Creates the native functions for the C library functions that are expanded inline i.e memcpy.
+ * Called after parsing, a name the file defines a function body for is left to that function.
+ */
+void native_create_library_functions(struct compile_process *compiler);
+
+// The memory orders of the __atomic builtins, the preprocessor defines them as __ATOMIC_RELAXED and so on
+enum
+{
+    NATIVE_ATOMIC_RELAXED,
+    NATIVE_ATOMIC_CONSUME,
+    NATIVE_ATOMIC_ACQUIRE,
+    NATIVE_ATOMIC_RELEASE,
+    NATIVE_ATOMIC_ACQ_REL,
+    NATIVE_ATOMIC_SEQ_CST
+};
+
+/**
+ * Returns the IR operation of a bit manipulation builtin i.e IR_OP_POPCOUNT for "__builtin_popcount",
+ * -1 if the name is not one.
+ */
+int native_bit_builtin_op(const char *name);
+
+// memcpy, memset and memcmp of a constant size up to this many bytes are expanded inline,
+// larger constant copies and fills use "rep movsd" and "rep stosd"
+#define NATIVE_MEMORY_UNROLL_LIMIT 64
+
 enum
 {
     PARSE_ALL_OK,
@@ -1051,7 +1191,9 @@ enum
     DATATYPE_FLAG_IGNORE_TYPE_CHECKING = 0b10000000,
     DATATYPE_FLAG_SECONDARY = 0b100000000,
     DATATYPE_FLAG_STRUCT_UNION_NO_NAME = 0b1000000000,
-    DATATYPE_FLAG_IS_LITERAL = 0b10000000000
+    DATATYPE_FLAG_IS_LITERAL = 0b10000000000,
+    // "__thread" or "_Thread_local", every thread has its own copy of the variable
+    DATATYPE_FLAG_IS_THREAD_LOCAL = 0b100000000000
 };
 
 enum
@@ -1136,6 +1278,7 @@ enum
     NODE_TYPE_STATEMENT_CASE,
     NODE_TYPE_STATEMENT_DEFAULT,
     NODE_TYPE_STATEMENT_GOTO,
+    NODE_TYPE_STATEMENT_ASM, // Inline assembly i.e asm volatile("pause");
     NODE_TYPE_TENARY,
 
     // A label node i.e "testing:"
@@ -1183,7 +1326,16 @@ enum
 {
     // Bit is set if this is a native function who has a routine
     // that should be called. Rather than generating a function call.
-    FUNCTION_NODE_FLAG_IS_NATIVE = 0b00000001
+    FUNCTION_NODE_FLAG_IS_NATIVE = 0b00000001,
+    // Bit is set if this function accepts infinite arguments i.e "int abc(int a, ...)"
+    FUNCTION_NODE_FLAG_IS_VARIADIC = 0b00000010,
+    // Bit is set if the address of a local variable or argument may escape this function
+    // i.e "&a" is used or an array/structure lives on the stack of this function.
+    // When set the stack frame of the function cannot be reused for tail calls.
+    FUNCTION_NODE_FLAG_ADDRESS_TAKEN = 0b00000100,
+    // Bit is set if the function is only ever called directly by name from this file
+    // so its first arguments are passed in registers, see C_TOTAL_REGISTER_ARGUMENTS
+    FUNCTION_NODE_FLAG_REGISTER_ARGUMENTS = 0b00001000
 };
 
 enum
@@ -1226,7 +1378,9 @@ enum
     STACK_FRAME_ELEMENT_FLAG_IS_PUSHED_ADDRESS = 0b00000001,
     STACK_FRAME_ELEMENT_FLAG_ELEMENT_NOT_FOUND = 0b00000010,
     STACK_FRAME_ELEMENT_FLAG_IS_NUMERICAL = 0b00000100,
-    STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE = 0b00001000
+    STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE = 0b00001000,
+    // The element is one half of a double pushed as a floating point value
+    STACK_FRAME_ELEMENT_FLAG_IS_FLOATING = 0b00010000
 
 };
 
@@ -1274,6 +1428,16 @@ void stackframe_add(struct node *func_node, size_t amount);
 void stackframe_peek_start(struct node* func_node);
 struct stack_frame_element* stackframe_peek(struct node* func_node);
 
+/**
+ * An operand of an inline assembly statement i.e "=r"(x)
+ */
+struct asm_operand
+{
+    // The constraint i.e "r", "=a" or "m"
+    const char *constraint;
+    struct node *exp;
+};
+
 struct node
 {
     int type;
@@ -1518,6 +1682,19 @@ struct node
                 struct node *label;
             } _goto;
 
+            struct asm_stmt
+            {
+                // The instructions to generate i.e "mov %0, eax", operands are numbered
+                // in order starting with the outputs.
+                const char *template;
+                // Vector of struct asm_operand written by the instructions
+                struct vector *outputs;
+                // Vector of struct asm_operand read by the instructions
+                struct vector *inputs;
+                // Vector of const char* registers the instructions overwrite i.e "ecx", "memory" and "cc" are also allowed
+                struct vector *clobbers;
+            } _asm;
+
         } stmt;
 
         struct node_label
@@ -1555,7 +1732,14 @@ struct node
         unsigned int inum;
         unsigned long lnum;
         unsigned long long llnum;
+        double dnum;
     };
+
+    // Information for the given number node, if this node is of type NODE_TYPE_NUMBER
+    struct node_number
+    {
+        int type;
+    } num;
 };
 
 enum
@@ -1567,6 +1751,22 @@ enum
 size_t function_node_argument_stack_addition(struct node *node);
 struct vector *function_node_argument_vec(struct node *node);
 
+/**
+ * Returns the amount of bytes the caller pushes for the arguments of this function.
+ * Each argument consumes at least a DWORD on the stack, arguments passed in registers none.
+ */
+size_t function_node_argument_stack_size(struct node *node);
+
+/**
+ * Returns the amount of leading arguments of this function that are passed in registers
+ */
+int function_node_register_arguments(struct node *node);
+
+/**
+ * Returns the register the argument at the given index is passed in i.e "edx" for the second
+ */
+const char *function_node_argument_register(int index);
+
 /**
  * Returns true if this node can be used in an expression
  */
@@ -1609,7 +1809,7 @@ const char *compiler_include_dir_next(struct compile_process *process);
 /**
  * Compiles the file
  */
-int compile_file(const char *filename, const char *out_filename, int flags);
+int compile_file(const char *filename, const char *out_filename, int flags, struct compile_options *options);
 
 /**
  * Includes a file to be compiled, returns a new compile process that represents the file
@@ -1652,6 +1852,49 @@ int parse(struct compile_process *process);
  */
 int validate(struct compile_process* process);
 
+/**
+ * Removes static functions and variables that nothing outside of them refers to,
+ * non static definitions and main are always kept.
+ */
+void reachability_remove_unused_definitions(struct compile_process *process);
+
+/**
+ * Passes the first arguments of static functions that are only ever called directly in registers.
+ * Their arguments are moved into their own stack frame which the function stores them to on entry.
+ */
+void reachability_assign_register_arguments(struct compile_process *process);
+
+/**
+ * Static branch prediction
+ */
+#define PREDICT_EXPECT_FUNCTION "__builtin_expect"
+
+enum
+{
+    PREDICT_UNKNOWN,
+    // The body of the if statement is expected to run
+    PREDICT_TAKEN,
+    PREDICT_NOT_TAKEN
+};
+
+bool predict_function_is_noreturn(const char *name);
+
+/**
+ * Returns true if the node is a call to __builtin_expect, the value tested is returned in "value_out"
+ * and the value it is expected to have in "expected_out".
+ */
+bool predict_expect_call(struct node *node, struct node **value_out, long *expected_out);
+
+/**
+ * Predicts whether the body of the if statement runs from __builtin_expect and the code in the body
+ */
+int predict_if_stmt(struct node *if_node);
+
+/**
+ * Returns the operand compared with zero if the condition is "x == 0", the caller decides if it is a pointer.
+ */
+struct node *predict_null_check_operand(struct node *cond);
+
 /**
  * Generates the assembly output for the given AST
  */
@@ -1673,6 +1916,11 @@ struct compile_process *compile_process_create(const char *filename, const char
  */
 void compile_process_destroy(struct compile_process *process);
 
+/**
+ * Prints the counters in process->statistics to stdout
+ */
+void compile_process_print_statistics(struct compile_process *process);
+
 /**
  * Returns the current file thats being processed
  */
@@ -1904,6 +2152,7 @@ void make_default_node();
 void make_switch_node(struct node *exp_node, struct node *body_node, struct vector *cases, bool has_default_case);
 void make_label_node(struct node *label_name_node);
 void make_goto_node(struct node *label_node);
+void make_asm_node(const char *template, struct vector *outputs, struct vector *inputs, struct vector *clobbers);
 
 void make_tenary_node(struct node *true_result_node, struct node *false_result_node);
 void make_exp_node(struct node *node_left, struct node *node_right, const char *op);
@@ -2035,6 +2284,11 @@ bool datatype_is_primitive_for_string(const char *type);
 bool datatype_is_primitive(struct datatype *dtype);
 bool datatype_is_primitive_non_pointer(struct datatype *dtype);
 bool datatype_is_struct_or_union_non_pointer(struct datatype *dtype);
+
+/**
+ * Returns true if the datatype is a float or double that is not a pointer
+ */
+bool datatype_is_floating(struct datatype *dtype);
 /**
  * @brief Returns a numerical datatype for the default datatype of "int" for numerical numbers.
  * 
@@ -2044,6 +2298,11 @@ struct datatype datatype_for_numeric();
 
 struct datatype datatype_for_string();
 
+/**
+ * Returns the "double" datatype, floating point expressions are computed as doubles.
+ */
+struct datatype datatype_for_double();
+
 /**
  * @brief Decrements the pointer of this datatype for example "int*" would become "int"
  * 
@@ -2126,6 +2385,13 @@ size_t array_brackets_calculate_size_from_index(struct datatype* type, struct ar
 size_t variable_size(struct node *var_node);
 size_t variable_size_for_list(struct node *var_list_node);
 
+/**
+ * Sets the size of pointers on the target being compiled for, DATA_SIZE_DWORD unless
+ * compiling for x86-64.
+ */
+void datatype_set_pointer_size(size_t size);
+size_t datatype_pointer_size();
+
 size_t datatype_size(struct datatype *datatype);
 size_t datatype_size_for_array_access(struct datatype *datatype);
 
@@ -2610,8 +2876,667 @@ bool fixup_resolve(struct fixup *fixup);
 void *fixup_private(struct fixup *fixup);
 bool fixups_resolve(struct fixup_system *system);
 
+/**
+ * Profile guided optimization
+ *
+ * An instrumented program counts how often each part of it runs and writes the counters to the
+ * profile file as it exits. The file holds a record of counters for every function block and
+ * switch statement, a record is found again by its name when the program is compiled with the profile.
+ */
+
+#define PROFILE_FILE_MAGIC "DPRF"
+#define PROFILE_FILE_VERSION 1
+
+struct profile_record
+{
+    // i.e "main" for the blocks of main, "main/switch0" for its first switch statement
+    const char *name;
+    int total_counters;
+
+    // The label of the counters in the generated code, only used when generating the profile
+    int id;
+
+    // The counts read from the profile file, only used when using the profile
+    long *counts;
+};
+
+/**
+ * Loads the profile file of the process, returns false with a warning if it cannot be read
+ */
+bool profile_load(struct compile_process *process);
+
+/**
+ * Adds a record of counters to the generated code, they start at the label "__profile_counters_<id>"
+ */
+struct profile_record *profile_record_create(struct compile_process *process, const char *name, int total_counters);
+
+/**
+ * Returns the record with the given name and total counters from the loaded profile,
+ * NULL if the profile has no such record or it does not match i.e the source changed since.
+ */
+struct profile_record *profile_record_find(struct compile_process *process, const char *name, int total_counters);
+
+/**
+ * Generates the counters added to the program and the code that writes them to the profile file at exit
+ */
+void profile_generate(struct compile_process *process);
+
+/**
+ * Loads the sample profile of the process, a text file where every line is "function:line count"
+ * i.e converted from the output of perf script. Returns false with a warning if it cannot be read.
+ */
+bool profile_load_samples(struct compile_process *process);
+
+/**
+ * Returns the samples of the function with its counts indexed by source line, NULL if it has none
+ */
+struct profile_record *profile_samples_find(struct compile_process *process, const char *name);
+
+/**
+ * Intermediate representation
+ *
+ * Functions can be lowered from the AST into a three address SSA form before
+ * code generation. Every instruction that produces a value is its own virtual register
+ * and local variables that never have their address taken are promoted into virtual registers
+ * joined together with phi instructions.
+ */
+
+// The types of virtual registers, all registers are 32 bits wide in the IR
+// I8 and I16 are only used to describe memory accesses and extensions.
+// V128 registers hold 16 bytes of lanes whose type is the mem_type of the instruction.
+enum
+{
+    IR_TYPE_VOID,
+    IR_TYPE_I8,
+    IR_TYPE_I16,
+    IR_TYPE_I32,
+    IR_TYPE_PTR,
+    IR_TYPE_V128
+};
+
+enum
+{
+    // %r = const value
+    IR_OP_CONST,
+    // %r = undef, value of a variable read before it was ever written to
+    IR_OP_UNDEF,
+    // %r = param slot, reads the function argument passed to us
+    IR_OP_PARAM,
+    // %r = frame slot, the address of a local variable that lives in memory
+    IR_OP_FRAME_ADDRESS,
+    // %r = global symbol, the address of a global variable, function or string
+    IR_OP_GLOBAL_ADDRESS,
+    // %r = load mem_type [address]
+    IR_OP_LOAD,
+    // store mem_type [address], value
+    IR_OP_STORE,
+
+    IR_OP_ADD,
+    IR_OP_SUB,
+    IR_OP_MUL,
+    IR_OP_SDIV,
+    IR_OP_UDIV,
+    IR_OP_SREM,
+    IR_OP_UREM,
+    IR_OP_AND,
+    IR_OP_OR,
+    IR_OP_XOR,
+    IR_OP_SHL,
+    IR_OP_SAR,
+    IR_OP_SHR,
+    IR_OP_ROTL,
+    IR_OP_ROTR,
+
+    IR_OP_NEG,
+    IR_OP_NOT,
+    // Bit counts, the leading and trailing zero counts of zero are undefined
+    IR_OP_POPCOUNT,
+    IR_OP_CLZ,
+    IR_OP_CTZ,
+    IR_OP_BSWAP,
+
+    // Comparisons produce 1 or 0
+    IR_OP_EQ,
+    IR_OP_NE,
+    IR_OP_SLT,
+    IR_OP_SLE,
+    IR_OP_SGT,
+    IR_OP_SGE,
+    IR_OP_ULT,
+    IR_OP_ULE,
+    IR_OP_UGT,
+    IR_OP_UGE,
+
+    // Sign or zero extends the low mem_type bits of the operand
+    IR_OP_SEXT,
+    IR_OP_ZEXT,
+
+    // %r = call target, arguments...
+    IR_OP_CALL,
+    // %r = phi [value, block]...
+    IR_OP_PHI,
+    // %r = copy value
+    IR_OP_COPY,
+    // %r = atomic kind [address], values... see IR_ATOMIC_*, always volatile
+    IR_OP_ATOMIC,
+
+    // Terminators
+    IR_OP_JUMP,
+    IR_OP_BRANCH,
+    IR_OP_RETURN,
+
+    // Vector instructions, add, sub, and, or, xor and eq also work on V128 values lane by lane
+    // with eq setting every bit of the lanes that are equal.
+    // %r = vload mem_type [address], 16 bytes from an address that need not be aligned
+    IR_OP_VECTOR_LOAD,
+    // vstore mem_type [address], value
+    IR_OP_VECTOR_STORE,
+    // %r = splat mem_type value, every lane set to the low bits of the scalar
+    IR_OP_VECTOR_SPLAT,
+    // %r = mask value, the top bit of every byte of the vector as a 16 bit scalar
+    IR_OP_VECTOR_MASK,
+    // %r = reduce mem_type value, the lanes combined with the binary operation in "value"
+    IR_OP_VECTOR_REDUCE,
+};
+
+// The kind of an IR_OP_ATOMIC instruction, held in its value. Atomic loads and weaker
+// stores are volatile loads and stores.
+enum
+{
+    // %r = atomic exchange [address], value
+    IR_ATOMIC_EXCHANGE,
+    // %r = atomic fetch_add [address], value
+    IR_ATOMIC_FETCH_ADD,
+    // %r = atomic compare_exchange [address], expected, desired; the value found at the address
+    IR_ATOMIC_COMPARE_EXCHANGE,
+    // atomic fence, no later load may pass an earlier store
+    IR_ATOMIC_FENCE,
+    // atomic barrier, memory accesses are not moved across it but no instruction is needed
+    IR_ATOMIC_BARRIER
+};
+
+enum
+{
+    // Memory accesses and extensions treat the value as signed
+    IR_INSTRUCTION_FLAG_SIGNED = 0b00000001,
+    // The instruction has side effects and must never be removed
+    IR_INSTRUCTION_FLAG_VOLATILE = 0b00000010
+};
+
+enum
+{
+    // The block is rarely executed and is laid out in the unlikely executed text section
+    IR_BLOCK_FLAG_COLD = 0b00000001,
+    // The block is the header of a loop, its code is aligned to 16 bytes
+    IR_BLOCK_FLAG_LOOP_HEADER = 0b00000010,
+    // The block is predicted not to run, it never falls through from a block that may go elsewhere
+    IR_BLOCK_FLAG_UNLIKELY = 0b00000100
+};
+
+enum
+{
+    // This frame slot is a function argument pushed by the caller
+    IR_FRAME_SLOT_FLAG_IS_ARGUMENT = 0b00000001
+};
+
+/**
+ * Memory on the stack frame for variables that cannot live in virtual registers.
+ * i.e arrays, structures and variables that have their address taken.
+ */
+struct ir_frame_slot
+{
+    int id;
+    int flags;
+    const char *name;
+    size_t size;
+
+    // Offset from EBP, arguments are positive, locals are negative.
+    int offset;
+};
+
+struct ir_block;
+struct ir_instruction
+{
+    int op;
+    // IR_TYPE_VOID if this instruction produces no value.
+    int type;
+    // The virtual register number for the value of this instruction
+    int id;
+    int flags;
+
+    // Vector of struct ir_instruction* operands
+    struct vector *operands;
+
+    // Vector of struct ir_block* jump targets for terminators
+    // for phi instructions these are the incoming blocks for each operand.
+    struct vector *blocks;
+
+    // The block this instruction is apart of
+    struct ir_block *block;
+
+    // IR_OP_CONST value
+    long value;
+    // IR_OP_GLOBAL_ADDRESS symbol name
+    const char *symbol;
+    // IR_OP_PARAM and IR_OP_FRAME_ADDRESS slot
+    struct ir_frame_slot *slot;
+    // The memory type of IR_OP_LOAD, IR_OP_STORE, IR_OP_PARAM and extensions
+    int mem_type;
+
+    // The AST node this instruction was lowered from, may be NULL
+    struct node *node;
+};
+
+struct ir_block
+{
+    int id;
+    int flags;
+
+    // The position of the block within the function, assigned by ir_function_number_blocks
+    int index;
+
+    // Vector of struct ir_instruction*, the last instruction is always a terminator
+    struct vector *instructions;
+
+    // Vector of struct ir_block*
+    struct vector *predecessors;
+
+    struct ir_function *function;
+
+    // The times the block ran in the profile, only meaningful if the function is profiled
+    long count;
+
+    // Vector of int, the source lines of the code lowered into the block
+    struct vector *lines;
+
+    // SSA construction state used whilst lowering the AST
+    struct ir_block_ssa
+    {
+        // True once all predecessors of this block are known
+        bool sealed;
+        // Vector of struct ir_variable_definition
+        struct vector *definitions;
+        // Vector of struct ir_variable_definition, phis waiting for the block to be sealed
+        struct vector *incomplete_phis;
+    } ssa;
+};
+
+struct ir_variable_definition
+{
+    // The variable node being defined
+    struct node *var_node;
+    struct ir_instruction *value;
+};
+
+struct ir_function
+{
+    // The function node this IR was lowered from.
+    struct node *node;
+    const char *name;
+
+    // Vector of struct ir_block*, the first block is the entry block
+    struct vector *blocks;
+
+    // Vector of struct ir_frame_slot*
+    struct vector *slots;
+
+    // The total virtual registers created for this function.
+    int total_registers;
+    int total_blocks;
+
+    // The block counts come from the profile file
+    bool profiled;
+    // The block counts are samples, they only tell how hot a block is compared to the others
+    bool sampled;
+};
+
+struct ir_function *ir_function_create(struct node *func_node);
+struct ir_block *ir_block_create(struct ir_function *function);
+struct ir_frame_slot *ir_frame_slot_create(struct ir_function *function, const char *name, size_t size, int offset, int flags);
+struct ir_instruction *ir_instruction_create(struct ir_function *function, int op, int type);
+void ir_instruction_add_operand(struct ir_instruction *instruction, struct ir_instruction *operand);
+struct ir_instruction *ir_instruction_operand(struct ir_instruction *instruction, int index);
+int ir_instruction_total_operands(struct ir_instruction *instruction);
+struct ir_block *ir_instruction_target(struct ir_instruction *instruction, int index);
+void ir_block_append(struct ir_block *block, struct ir_instruction *instruction);
+void ir_block_prepend(struct ir_block *block, struct ir_instruction *instruction);
+void ir_block_remove_instruction(struct ir_block *block, struct ir_instruction *instruction);
+void ir_block_insert_before_terminator(struct ir_block *block, struct ir_instruction *instruction);
+void ir_block_add_predecessor(struct ir_block *block, struct ir_block *predecessor);
+void ir_block_add_line(struct ir_block *block, int line);
+
+/**
+ * Retargets the edges from the block to "old_successor" so they go to "new_successor" instead,
+ * the predecessors of both are updated. Phis in either block are left for the caller.
+ */
+void ir_block_replace_successor(struct ir_block *block, struct ir_block *old_successor, struct ir_block *new_successor);
+
+/**
+ * Moves the block so it is laid out directly before the "before" block
+ */
+void ir_function_move_block_before(struct ir_function *function, struct ir_block *block, struct ir_block *before);
+struct ir_instruction *ir_block_terminator(struct ir_block *block);
+bool ir_op_is_terminator(int op);
+bool ir_op_is_binary(int op);
+bool ir_op_is_bit_operation(int op);
+bool ir_op_is_compare(int op);
+
+/**
+ * Returns the comparison that is true exactly when the given one is false i.e "slt" for "sge"
+ */
+int ir_op_inverse_compare(int op);
+bool ir_instruction_has_side_effects(struct ir_instruction *instruction);
+
+/**
+ * Computes the 32 bit result of the binary or compare operation on two constants.
+ * Returns false if the operation cannot be folded i.e division by zero.
+ */
+bool ir_fold_constant(int op, long left, long right, long *result_out);
+
+/**
+ * Computes the 32 bit result of a bit count or byte swap of a constant,
+ * the zero counts of zero fold to 32.
+ */
+long ir_fold_bit_operation(int op, long value);
+
+/**
+ * Generates the instructions for the bit count or byte swap of EAX into EAX, ECX is clobbered.
+ * Without COMPILE_PROCESS_TARGET_POPCNT the population count is computed without "popcnt".
+ */
+void ir_x86_bit_operation(struct compile_process *process, int op);
+void ir_instruction_replace_uses(struct ir_function *function, struct ir_instruction *old_value, struct ir_instruction *new_value);
+void ir_phi_add_incoming(struct ir_instruction *phi, struct ir_instruction *value, struct ir_block *block);
+struct ir_instruction *ir_phi_incoming_for_block(struct ir_instruction *phi, struct ir_block *block);
+void ir_phi_remove_incoming(struct ir_instruction *phi, struct ir_block *block);
+
+/**
+ * Removes the predecessor from the block along with the matching phi operands
+ */
+void ir_block_remove_predecessor(struct ir_block *block, struct ir_block *predecessor);
+
+/**
+ * Removes blocks that cannot be reached from the entry block, phi operands
+ * coming from the removed blocks are dropped.
+ */
+void ir_function_remove_unreachable_blocks(struct ir_function *function);
+
+/**
+ * Removes phi instructions whose operands are all the same value (or the phi its self)
+ * uses of the phi are replaced with that value.
+ */
+void ir_function_remove_trivial_phis(struct ir_function *function);
+const char *ir_op_name(int op);
+const char *ir_type_name(int type);
+
+/**
+ * Writes a textual representation of the function to the given file
+ */
+void ir_dump_function(FILE *fp, struct ir_function *function);
+void ir_dump_instruction(FILE *fp, struct ir_instruction *instruction);
+
+enum
+{
+    IR_VERIFY_ALL_OK,
+    IR_VERIFY_FAILED
+};
+
+/**
+ * Verifies the IR is well formed, problems are written to stderr.
+ * Returns IR_VERIFY_ALL_OK if the function is valid.
+ */
+int ir_verify_function(struct ir_function *function);
+
+/**
+ * Lowers the function node into SSA form. Returns NULL if the function uses something
+ * the IR does not support, in this case the caller should use the AST code generator.
+ */
+struct ir_function *ir_lower_function(struct compile_process *process, struct node *func_node);
+
+/**
+ * Generates x86 assembly for the IR function
+ */
+void ir_codegen_function(struct compile_process *process, struct ir_function *function);
+
+/**
+ * Generates x86-64 System V assembly for the IR function
+ */
+void ir_codegen_function_x86_64(struct compile_process *process, struct ir_function *function);
+
+/**
+ * A fixed size set of bits, used for the dataflow analysis.
+ */
+struct ir_bitset
+{
+    int total_bits;
+    uint32_t *words;
+};
+
+struct ir_bitset *ir_bitset_create(int total_bits);
+void ir_bitset_free(struct ir_bitset *set);
+void ir_bitset_set(struct ir_bitset *set, int bit);
+void ir_bitset_unset(struct ir_bitset *set, int bit);
+bool ir_bitset_test(struct ir_bitset *set, int bit);
+void ir_bitset_fill(struct ir_bitset *set);
+void ir_bitset_clear(struct ir_bitset *set);
+void ir_bitset_copy(struct ir_bitset *dst, struct ir_bitset *src);
+bool ir_bitset_equals(struct ir_bitset *a, struct ir_bitset *b);
+void ir_bitset_union(struct ir_bitset *dst, struct ir_bitset *src);
+void ir_bitset_intersect(struct ir_bitset *dst, struct ir_bitset *src);
+void ir_bitset_subtract(struct ir_bitset *dst, struct ir_bitset *src);
+int ir_bitset_count(struct ir_bitset *set);
+
+/**
+ * Assigns every block of the function its index, must be called again
+ * whenever blocks are added or removed.
+ */
+void ir_function_number_blocks(struct ir_function *function);
+int ir_block_total_successors(struct ir_block *block);
+struct ir_block *ir_block_successor(struct ir_block *block, int index);
+
+/**
+ * Returns a vector of struct ir_block* for every block reachable from the entry block
+ * in reverse post order, i.e a block comes before its successors unless the edge is a loop back edge.
+ */
+struct vector *ir_function_reverse_post_order(struct ir_function *function);
+
+/**
+ * Writes the control flow graph of the function as a graphviz DOT subgraph.
+ */
+void ir_dump_function_dot(FILE *fp, struct ir_function *function);
+
+enum
+{
+    IR_DATAFLOW_DIRECTION_FORWARD,
+    IR_DATAFLOW_DIRECTION_BACKWARD
+};
+
+enum
+{
+    IR_DATAFLOW_MEET_UNION,
+    IR_DATAFLOW_MEET_INTERSECTION
+};
+
+/**
+ * A gen/kill dataflow problem over the blocks of a function, solved with a worklist.
+ *
+ * Forward problems: in = meet(out of predecessors) U extra, out = gen U (in - kill)
+ * Backward problems: out = meet(in of successors) U extra, in = gen U (out - kill)
+ *
+ * All of the bitset arrays are indexed by the block index.
+ */
+struct ir_dataflow
+{
+    struct ir_function *function;
+    int direction;
+    int meet;
+    int total_bits;
+    int total_blocks;
+
+    struct ir_bitset **gen;
+    struct ir_bitset **kill;
+
+    // Merged into the meet of each block, NULL if unused.
+    // i.e phi operands are live out of the predecessor they come from.
+    struct ir_bitset **extra;
+
+    // The value flowing into the entry block for forward problems
+    // or out of the returning blocks for backward problems.
+    struct ir_bitset *boundary;
+
+    struct ir_bitset **in;
+    struct ir_bitset **out;
+
+    // Total times a transfer function was applied to reach the fixed point
+    int iterations;
+};
+
+struct ir_dataflow *ir_dataflow_create(struct ir_function *function, int direction, int meet, int total_bits);
+void ir_dataflow_solve(struct ir_dataflow *dataflow);
+void ir_dataflow_free(struct ir_dataflow *dataflow);
+
+/**
+ * Computes the virtual registers live on entry and exit of each block, bits are register ids.
+ */
+struct ir_dataflow *ir_liveness(struct ir_function *function);
+
+/**
+ * Gives every virtual register that needs one a stack home, registers that are never live
+ * at the same time share a home. "homes" is indexed by register id and set to -1 for registers
+ * without a home. Homes are "home_size" bytes, V128 registers take as many consecutive homes
+ * as they need starting from the one they are given. Returns the total homes used.
+ */
+int ir_assign_homes(struct ir_function *function, int *homes, int home_size);
+
+/**
+ * Computes the stores to the stack frame that may reach the entry and exit of each block.
+ * Bits index the vector of struct ir_instruction* stores returned in "stores_out"
+ */
+struct ir_dataflow *ir_reaching_stores(struct ir_function *function, struct vector **stores_out);
+
+struct ir_dominators
+{
+    struct ir_dataflow *dataflow;
+
+    // The immediate dominator of each block indexed by the block index, NULL for the entry block
+    // and unreachable blocks
+    struct ir_block **idom;
+};
+
+struct ir_dominators *ir_dominators(struct ir_function *function);
+bool ir_block_dominates(struct ir_dominators *dominators, struct ir_block *dominator, struct ir_block *block);
+void ir_dominators_free(struct ir_dominators *dominators);
+
+/**
+ * Folds constant expressions and branches on constant conditions, then removes unreachable blocks,
+ * stores to stack frame slots that are never read and instructions whose values are never used.
+ * Returns true if anything was removed.
+ */
+bool ir_eliminate_dead_code(struct compile_process *process, struct ir_function *function);
+
+/**
+ * Replaces computations and loads with an identical value computed in a dominating block.
+ * Returns the total instructions eliminated.
+ */
+int ir_eliminate_common_subexpressions(struct compile_process *process, struct ir_function *function);
+
+/**
+ * A natural loop, the header dominates every block in the loop
+ */
+struct ir_loop
+{
+    struct ir_block *header;
+
+    // Vector of struct ir_block* including the header
+    struct vector *blocks;
+
+    // Loop membership indexed by block index
+    bool *contains;
+};
+
+/**
+ * Returns a vector of struct ir_loop*, inner loops come before the loops that contain them
+ */
+struct vector *ir_find_loops(struct ir_function *function, struct ir_dominators *dominators);
+void ir_free_loops(struct vector *loops);
+
+/**
+ * Returns the preheader of the loop, the only block outside the loop that jumps to the header.
+ * NULL if the loop has none.
+ */
+struct ir_block *ir_loop_preheader(struct ir_loop *loop);
+
+/**
+ * Returns the loops of the function like ir_find_loops, every loop is given a preheader first.
+ * The dominators used are returned in "dominators_out" and must be freed by the caller.
+ */
+struct vector *ir_function_loops(struct ir_function *function, struct ir_dominators **dominators_out);
+
+/**
+ * Moves computations that give the same value on every iteration of a loop into the loop preheader.
+ * Returns the total instructions hoisted.
+ */
+int ir_hoist_loop_invariants(struct compile_process *process, struct ir_function *function);
+
+/**
+ * Fully unrolls loops with a small constant trip count and partially unrolls counted loops
+ * by process->options.unroll_factor leaving the original loop to run the remaining iterations.
+ * Returns the total loops unrolled.
+ */
+int ir_unroll_loops(struct compile_process *process, struct ir_function *function);
+
+/**
+ * Puts an SSE2 vector loop in front of counted loops over int, short and char arrays, the original
+ * loop runs the iterations that do not fill a vector. Returns the total loops vectorized.
+ */
+int ir_vectorize_loops(struct compile_process *process, struct ir_function *function);
+
+/**
+ * Replaces array addresses computed from loop counters with pointers bumped every iteration,
+ * the loop test compares the pointer instead when nothing else needs the counter.
+ * Returns the total addresses replaced.
+ */
+int ir_reduce_induction_variables(struct compile_process *process, struct ir_function *function);
+
+/**
+ * Orders the blocks for code generation, the likely successor of each block follows it so the branch
+ * falls through. Blocks that end up calling exit or abort, or that are marked cold, move to the end
+ * and loop headers are marked for alignment. Returns the total cold blocks.
+ */
+int ir_layout_blocks(struct compile_process *process, struct ir_function *function);
+
+/**
+ * Adds a counter to every block that is incremented each time the block runs
+ */
+void ir_profile_instrument(struct compile_process *process, struct ir_function *function);
+
+/**
+ * Sets the counts of the blocks from the profile file, blocks that never ran are marked cold.
+ * Returns false if the profile has no counts for the function.
+ */
+bool ir_profile_annotate(struct compile_process *process, struct ir_function *function);
+
+/**
+ * Sets the counts of the blocks from the samples taken on their source lines, blocks that were
+ * never sampled are marked cold. Returns false if the sample profile has no samples for the function.
+ */
+bool ir_profile_annotate_samples(struct compile_process *process, struct ir_function *function);
+
+/**
+ * Runs the optimization passes over the function
+ */
+void ir_optimize_function(struct compile_process *process, struct ir_function *function);
+
 // codegen
+void asm_push(const char *ins, ...);
+void codegen_stack_add(size_t stack_size);
+int codegen_label_count();
+const char *codegen_register_string(const char *str);
 void register_set_flag(int flag);
 void register_unset_flag(int flag);
 
+/**
+ * Stores the arguments the function takes in registers to their place in its stack frame
+ */
+void codegen_store_register_arguments(struct node *func_node);
+
 #endif
\ No newline at end of file
@@ -12,6 +12,35 @@ void compile_process_destroy(struct compile_process *process)
     {
         fclose(process->ofile);
     }
+    if (process->ir_file)
+    {
+        fclose(process->ir_file);
+    }
+    if (process->cfg_file)
+    {
+        fprintf(process->cfg_file, "}\n");
+        fclose(process->cfg_file);
+    }
+}
+
+void compile_process_print_statistics(struct compile_process *process)
+{
+    struct compile_process_statistics *statistics = &process->statistics;
+    printf("Optimization statistics for %s\n", process->cfile.abs_path);
+    printf("    dead statements removed: %i\n", statistics->removed_nodes);
+    printf("    unused static functions removed: %i\n", statistics->removed_functions);
+    printf("    unused static variables removed: %i\n", statistics->removed_globals);
+    printf("    branches folded: %i\n", statistics->folded_branches);
+    printf("    IR blocks removed: %i\n", statistics->removed_blocks);
+    printf("    IR instructions removed: %i\n", statistics->removed_instructions);
+    printf("    common subexpressions eliminated: %i\n", statistics->eliminated_expressions);
+    printf("    loop invariants hoisted: %i\n", statistics->hoisted_instructions);
+    printf("    loops unrolled: %i\n", statistics->unrolled_loops);
+    printf("    loops vectorized: %i\n", statistics->vectorized_loops);
+    printf("    induction variables strength reduced: %i\n", statistics->reduced_induction_variables);
+    printf("    cold blocks moved out of line: %i\n", statistics->cold_blocks);
+    printf("    unlikely paths moved out of line: %i\n", statistics->unlikely_paths);
+    printf("    functions taking arguments in registers: %i\n", statistics->register_argument_functions);
 }
 
 const char *compiler_include_dir_begin(struct compile_process *process)
@@ -61,6 +90,19 @@ struct compile_process *compile_process_create(const char *filename, const char
 
     process->cfile.fp = file;
     process->ofile = out_file;
+    if (out_filename && flags & COMPILE_PROCESS_DUMP_IR)
+    {
+        char ir_filename[512];
+        snprintf(ir_filename, sizeof(ir_filename), "%s.ir", out_filename);
+        process->ir_file = fopen(ir_filename, "w");
+    }
+    if (out_filename && flags & COMPILE_PROCESS_DUMP_CFG)
+    {
+        char cfg_filename[512];
+        snprintf(cfg_filename, sizeof(cfg_filename), "%s.dot", out_filename);
+        process->cfg_file = fopen(cfg_filename, "w");
+        fprintf(process->cfg_file, "digraph \"%s\" {\n", filename);
+    }
     process->token_vec = vector_create(sizeof(struct token));
     process->token_vec_original = vector_create(sizeof(struct token));
     process->node_vec = vector_create(sizeof(struct node *));
@@ -74,6 +116,7 @@ struct compile_process *compile_process_create(const char *filename, const char
     // Create a new symbol table for the compiler to use throughout its entire
     // duration.
     symresolver_new_table(process);
+    native_create_builtin_functions(process);
 
 
 
@@ -668,6 +668,11 @@ bool datatype_is_struct_or_union_non_pointer(struct datatype *dtype)
     return dtype->type != DATA_TYPE_UNKNOWN && !datatype_is_primitive(dtype) && !(dtype->flags & DATATYPE_FLAG_IS_POINTER);
 }
 
+bool datatype_is_floating(struct datatype *dtype)
+{
+    return !(dtype->flags & DATATYPE_FLAG_IS_POINTER) && (dtype->type == DATA_TYPE_FLOAT || dtype->type == DATA_TYPE_DOUBLE);
+}
+
 bool datatype_is_primitive(struct datatype *dtype)
 {
     return datatype_is_primitive_for_string(dtype->type_str);
@@ -820,10 +825,22 @@ off_t datatype_offset(struct compile_process* compiler, struct datatype* datatyp
     return aligned_offset;
 }
 
+static size_t pointer_size = DATA_SIZE_DWORD;
+
+void datatype_set_pointer_size(size_t size)
+{
+    pointer_size = size;
+}
+
+size_t datatype_pointer_size()
+{
+    return pointer_size;
+}
+
 size_t datatype_size(struct datatype *datatype)
 {
     if (datatype->flags & DATATYPE_FLAG_IS_POINTER && datatype->pointer_depth > 0)
-        return DATA_SIZE_DWORD;
+        return pointer_size;
 
     if (datatype->flags & DATATYPE_FLAG_IS_ARRAY)
         return datatype->array.size;
@@ -833,7 +850,7 @@ size_t datatype_size(struct datatype *datatype)
 size_t datatype_element_size(struct datatype *datatype)
 {
     if (datatype->flags & DATATYPE_FLAG_IS_POINTER)
-        return DATA_SIZE_DWORD;
+        return pointer_size;
 
     return datatype->size;
 }
@@ -853,6 +870,16 @@ struct datatype datatype_for_numeric()
     return dtype;
 }
 
+struct datatype datatype_for_double()
+{
+    struct datatype dtype = {};
+    dtype.flags |= DATATYPE_FLAG_IS_SIGNED;
+    dtype.type = DATA_TYPE_DOUBLE;
+    dtype.type_str = "double";
+    dtype.size = DATA_SIZE_DDWORD;
+    return dtype;
+}
+
 struct datatype *datatype_thats_a_pointer(struct datatype *d1, struct datatype *d2)
 {
     if (d1->flags & DATATYPE_FLAG_IS_POINTER)
@@ -0,0 +1,103 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+/**
+ * The control flow graph of the IR is the blocks of a function, edges are the jump targets
+ * of each terminator. Lowering already deals with if/else, loops, switch fallthrough,
+ * break, continue, goto and early returns so everything here works on the blocks alone.
+ */
+
+void ir_function_number_blocks(struct ir_function *function)
+{
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        block->index = i;
+    }
+}
+
+int ir_block_total_successors(struct ir_block *block)
+{
+    struct ir_instruction *terminator = ir_block_terminator(block);
+    if (!terminator)
+        return 0;
+
+    return vector_count(terminator->blocks);
+}
+
+struct ir_block *ir_block_successor(struct ir_block *block, int index)
+{
+    return ir_instruction_target(ir_block_terminator(block), index);
+}
+
+static void ir_post_order(struct ir_block *block, bool *visited, struct vector *order)
+{
+    visited[block->index] = true;
+    for (int i = 0; i < ir_block_total_successors(block); i++)
+    {
+        struct ir_block *successor = ir_block_successor(block, i);
+        if (!visited[successor->index])
+        {
+            ir_post_order(successor, visited, order);
+        }
+    }
+
+    vector_push(order, &block);
+}
+
+struct vector *ir_function_reverse_post_order(struct ir_function *function)
+{
+    ir_function_number_blocks(function);
+    struct vector *order = vector_create(sizeof(struct ir_block *));
+    if (vector_count(function->blocks) == 0)
+        return order;
+
+    bool *visited = calloc(vector_count(function->blocks), sizeof(bool));
+    ir_post_order(vector_peek_ptr_at(function->blocks, 0), visited, order);
+    free(visited);
+
+    // Reverse the post order in place
+    int total = vector_count(order);
+    for (int i = 0; i < total / 2; i++)
+    {
+        struct ir_block **a = vector_at(order, i);
+        struct ir_block **b = vector_at(order, total - i - 1);
+        struct ir_block *tmp = *a;
+        *a = *b;
+        *b = tmp;
+    }
+
+    return order;
+}
+
+void ir_dump_function_dot(FILE *fp, struct ir_function *function)
+{
+    fprintf(fp, "subgraph \"cluster_%s\" {\n", function->name);
+    fprintf(fp, "    label=\"%s\";\n", function->name);
+    fprintf(fp, "    node [shape=box fontname=\"monospace\"];\n");
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        fprintf(fp, "    \"%s_block%i\" [label=\"block%i:\\l", function->name, block->id, block->id);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            ir_dump_instruction(fp, vector_peek_ptr_at(block->instructions, b));
+            fprintf(fp, "\\l");
+        }
+        fprintf(fp, "\"];\n");
+
+        struct ir_instruction *terminator = ir_block_terminator(block);
+        for (int b = 0; b < ir_block_total_successors(block); b++)
+        {
+            struct ir_block *successor = ir_block_successor(block, b);
+            fprintf(fp, "    \"%s_block%i\" -> \"%s_block%i\"", function->name, block->id, function->name, successor->id);
+            if (terminator->op == IR_OP_BRANCH)
+            {
+                fprintf(fp, " [label=\"%s\"]", b == 0 ? "true" : "false");
+            }
+            fprintf(fp, ";\n");
+        }
+    }
+    fprintf(fp, "}\n");
+}
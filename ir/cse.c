@@ -0,0 +1,229 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+/**
+ * Common subexpression elimination using value numbering over the dominator tree.
+ * A value computed in a block can replace the same computation in any block it dominates.
+ *
+ * Loads are only reused while memory is known to be unchanged, every store, call or volatile
+ * access starts a new memory epoch. Memory at the start of a block is only the same as the end
+ * of its immediate dominator when the dominator is the only way in, otherwise a new epoch begins.
+ */
+
+struct ir_cse_entry
+{
+    // The instruction that computed the value, for stores the value stored can be forwarded to loads
+    struct ir_instruction *instruction;
+    // The memory epoch the load or store happened in, -1 for values that do not read memory
+    int epoch;
+};
+
+struct ir_cse
+{
+    struct ir_function *function;
+    struct ir_dominators *dominators;
+
+    // Vector of struct ir_block* children for each block in the dominator tree, indexed by block index
+    struct vector **children;
+
+    // Vector of struct ir_cse_entry, the values available in the current block
+    struct vector *available;
+    int total_epochs;
+    int total_eliminated;
+};
+
+static bool ir_op_is_commutative(int op)
+{
+    return op == IR_OP_ADD || op == IR_OP_MUL || op == IR_OP_AND || op == IR_OP_OR ||
+           op == IR_OP_XOR || op == IR_OP_EQ || op == IR_OP_NE;
+}
+
+static bool ir_op_is_rematerialized(int op)
+{
+    return op == IR_OP_CONST || op == IR_OP_GLOBAL_ADDRESS || op == IR_OP_FRAME_ADDRESS;
+}
+
+/**
+ * Returns true if both instructions compute the same value ignoring their operands
+ */
+static bool ir_cse_same_attributes(struct ir_instruction *a, struct ir_instruction *b)
+{
+    return a->op == b->op && a->type == b->type && a->mem_type == b->mem_type && a->flags == b->flags &&
+           a->value == b->value && a->slot == b->slot &&
+           (a->symbol == b->symbol || (a->symbol && b->symbol && S_EQ(a->symbol, b->symbol)));
+}
+
+static bool ir_cse_same_operand(struct ir_instruction *a, struct ir_instruction *b)
+{
+    if (a == b)
+        return true;
+
+    // Constants and addresses are rebuilt wherever they are used, so equal ones are interchangeable
+    return ir_op_is_rematerialized(a->op) && ir_cse_same_attributes(a, b);
+}
+
+static bool ir_cse_same_operands(struct ir_instruction *a, struct ir_instruction *b)
+{
+    int total = ir_instruction_total_operands(a);
+    if (total != ir_instruction_total_operands(b))
+        return false;
+
+    bool same = true;
+    for (int i = 0; i < total && same; i++)
+    {
+        same = ir_cse_same_operand(ir_instruction_operand(a, i), ir_instruction_operand(b, i));
+    }
+
+    if (!same && total == 2 && ir_op_is_commutative(a->op))
+    {
+        same = ir_cse_same_operand(ir_instruction_operand(a, 0), ir_instruction_operand(b, 1)) &&
+               ir_cse_same_operand(ir_instruction_operand(a, 1), ir_instruction_operand(b, 0));
+    }
+
+    return same;
+}
+
+/**
+ * Returns true if the instruction computes a value from its operands alone
+ */
+static bool ir_cse_is_pure(struct ir_instruction *instruction)
+{
+    if (instruction->flags & IR_INSTRUCTION_FLAG_VOLATILE)
+        return false;
+
+    int op = instruction->op;
+    return ir_op_is_rematerialized(op) || ir_op_is_binary(op) || ir_op_is_compare(op) ||
+           op == IR_OP_NEG || op == IR_OP_NOT || op == IR_OP_SEXT || op == IR_OP_ZEXT || ir_op_is_bit_operation(op);
+}
+
+/**
+ * Returns true if the instruction may write to memory
+ */
+static bool ir_cse_clobbers_memory(struct ir_instruction *instruction)
+{
+    return instruction->op == IR_OP_STORE || instruction->op == IR_OP_VECTOR_STORE || instruction->op == IR_OP_CALL ||
+           instruction->flags & IR_INSTRUCTION_FLAG_VOLATILE;
+}
+
+static struct ir_instruction *ir_cse_find(struct ir_cse *cse, struct ir_instruction *instruction, int epoch)
+{
+    for (int i = vector_count(cse->available) - 1; i >= 0; i--)
+    {
+        struct ir_cse_entry *entry = vector_at(cse->available, i);
+        struct ir_instruction *available = entry->instruction;
+        if (instruction->op == IR_OP_LOAD && available->op == IR_OP_STORE)
+        {
+            // Forward the stored value, narrower memory would need the value truncated
+            if (entry->epoch == epoch && available->mem_type == instruction->mem_type &&
+                (instruction->mem_type == IR_TYPE_I32 || instruction->mem_type == IR_TYPE_PTR) &&
+                ir_cse_same_operand(ir_instruction_operand(available, 0), ir_instruction_operand(instruction, 0)))
+                return ir_instruction_operand(available, 1);
+            continue;
+        }
+
+        if (entry->epoch == epoch && ir_cse_same_attributes(available, instruction) &&
+            ir_cse_same_operands(available, instruction))
+            return available;
+    }
+
+    return NULL;
+}
+
+static void ir_cse_add(struct ir_cse *cse, struct ir_instruction *instruction, int epoch)
+{
+    struct ir_cse_entry entry = {.instruction = instruction, .epoch = epoch};
+    vector_push(cse->available, &entry);
+}
+
+static void ir_cse_block(struct ir_cse *cse, struct ir_block *block, int epoch)
+{
+    int total_available = vector_count(cse->available);
+    struct ir_block *idom = cse->dominators->idom[block->index];
+    if (!idom || vector_count(block->predecessors) != 1 || vector_peek_ptr_at(block->predecessors, 0) != idom)
+    {
+        epoch = cse->total_epochs++;
+    }
+
+    for (int i = 0; i < vector_count(block->instructions); i++)
+    {
+        struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, i);
+        if (ir_cse_clobbers_memory(instruction))
+        {
+            epoch = cse->total_epochs++;
+            if (instruction->op == IR_OP_STORE && !(instruction->flags & IR_INSTRUCTION_FLAG_VOLATILE))
+            {
+                ir_cse_add(cse, instruction, epoch);
+            }
+            continue;
+        }
+
+        bool is_load = instruction->op == IR_OP_LOAD;
+        if (!is_load && !ir_cse_is_pure(instruction))
+            continue;
+
+        int instruction_epoch = is_load ? epoch : -1;
+        struct ir_instruction *existing = ir_cse_find(cse, instruction, instruction_epoch);
+        if (!existing)
+        {
+            ir_cse_add(cse, instruction, instruction_epoch);
+            continue;
+        }
+
+        ir_instruction_replace_uses(cse->function, instruction, existing);
+        ir_block_remove_instruction(block, instruction);
+        cse->total_eliminated++;
+        i--;
+    }
+
+    struct vector *children = cse->children[block->index];
+    for (int i = 0; i < vector_count(children); i++)
+    {
+        ir_cse_block(cse, vector_peek_ptr_at(children, i), epoch);
+    }
+
+    // Values from this block are not available to blocks it does not dominate
+    while (vector_count(cse->available) > total_available)
+    {
+        vector_pop(cse->available);
+    }
+}
+
+int ir_eliminate_common_subexpressions(struct compile_process *process, struct ir_function *function)
+{
+    if (vector_count(function->blocks) == 0)
+        return 0;
+
+    struct ir_cse cse = {.function = function};
+    cse.dominators = ir_dominators(function);
+    int total_blocks = vector_count(function->blocks);
+    cse.children = calloc(total_blocks, sizeof(struct vector *));
+    for (int i = 0; i < total_blocks; i++)
+    {
+        cse.children[i] = vector_create(sizeof(struct ir_block *));
+    }
+
+    for (int i = 0; i < total_blocks; i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        struct ir_block *idom = cse.dominators->idom[block->index];
+        if (idom)
+        {
+            vector_push(cse.children[idom->index], &block);
+        }
+    }
+
+    cse.available = vector_create(sizeof(struct ir_cse_entry));
+    ir_cse_block(&cse, vector_peek_ptr_at(function->blocks, 0), 0);
+
+    for (int i = 0; i < total_blocks; i++)
+    {
+        vector_free(cse.children[i]);
+    }
+    free(cse.children);
+    vector_free(cse.available);
+    ir_dominators_free(cse.dominators);
+
+    process->statistics.eliminated_expressions += cse.total_eliminated;
+    return cse.total_eliminated;
+}
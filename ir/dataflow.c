@@ -0,0 +1,407 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+#define IR_BITSET_WORD_BITS 32
+#define IR_BITSET_TOTAL_WORDS(total_bits) (((total_bits) + IR_BITSET_WORD_BITS - 1) / IR_BITSET_WORD_BITS)
+
+struct ir_bitset *ir_bitset_create(int total_bits)
+{
+    struct ir_bitset *set = calloc(1, sizeof(struct ir_bitset));
+    set->total_bits = total_bits;
+    set->words = calloc(IR_BITSET_TOTAL_WORDS(total_bits) + 1, sizeof(uint32_t));
+    return set;
+}
+
+void ir_bitset_free(struct ir_bitset *set)
+{
+    free(set->words);
+    free(set);
+}
+
+void ir_bitset_set(struct ir_bitset *set, int bit)
+{
+    set->words[bit / IR_BITSET_WORD_BITS] |= 1u << (bit % IR_BITSET_WORD_BITS);
+}
+
+void ir_bitset_unset(struct ir_bitset *set, int bit)
+{
+    set->words[bit / IR_BITSET_WORD_BITS] &= ~(1u << (bit % IR_BITSET_WORD_BITS));
+}
+
+bool ir_bitset_test(struct ir_bitset *set, int bit)
+{
+    return set->words[bit / IR_BITSET_WORD_BITS] & (1u << (bit % IR_BITSET_WORD_BITS));
+}
+
+void ir_bitset_fill(struct ir_bitset *set)
+{
+    for (int i = 0; i < set->total_bits; i++)
+    {
+        ir_bitset_set(set, i);
+    }
+}
+
+void ir_bitset_clear(struct ir_bitset *set)
+{
+    memset(set->words, 0, IR_BITSET_TOTAL_WORDS(set->total_bits) * sizeof(uint32_t));
+}
+
+void ir_bitset_copy(struct ir_bitset *dst, struct ir_bitset *src)
+{
+    memcpy(dst->words, src->words, IR_BITSET_TOTAL_WORDS(src->total_bits) * sizeof(uint32_t));
+}
+
+bool ir_bitset_equals(struct ir_bitset *a, struct ir_bitset *b)
+{
+    return memcmp(a->words, b->words, IR_BITSET_TOTAL_WORDS(a->total_bits) * sizeof(uint32_t)) == 0;
+}
+
+void ir_bitset_union(struct ir_bitset *dst, struct ir_bitset *src)
+{
+    for (int i = 0; i < IR_BITSET_TOTAL_WORDS(dst->total_bits); i++)
+    {
+        dst->words[i] |= src->words[i];
+    }
+}
+
+void ir_bitset_intersect(struct ir_bitset *dst, struct ir_bitset *src)
+{
+    for (int i = 0; i < IR_BITSET_TOTAL_WORDS(dst->total_bits); i++)
+    {
+        dst->words[i] &= src->words[i];
+    }
+}
+
+void ir_bitset_subtract(struct ir_bitset *dst, struct ir_bitset *src)
+{
+    for (int i = 0; i < IR_BITSET_TOTAL_WORDS(dst->total_bits); i++)
+    {
+        dst->words[i] &= ~src->words[i];
+    }
+}
+
+int ir_bitset_count(struct ir_bitset *set)
+{
+    int total = 0;
+    for (int i = 0; i < IR_BITSET_TOTAL_WORDS(set->total_bits); i++)
+    {
+        total += __builtin_popcount(set->words[i]);
+    }
+    return total;
+}
+
+static struct ir_bitset **ir_dataflow_create_sets(int total_blocks, int total_bits)
+{
+    struct ir_bitset **sets = calloc(total_blocks + 1, sizeof(struct ir_bitset *));
+    for (int i = 0; i < total_blocks; i++)
+    {
+        sets[i] = ir_bitset_create(total_bits);
+    }
+    return sets;
+}
+
+static void ir_dataflow_free_sets(struct ir_bitset **sets, int total_blocks)
+{
+    if (!sets)
+        return;
+
+    for (int i = 0; i < total_blocks; i++)
+    {
+        ir_bitset_free(sets[i]);
+    }
+    free(sets);
+}
+
+struct ir_dataflow *ir_dataflow_create(struct ir_function *function, int direction, int meet, int total_bits)
+{
+    ir_function_number_blocks(function);
+    struct ir_dataflow *dataflow = calloc(1, sizeof(struct ir_dataflow));
+    dataflow->function = function;
+    dataflow->direction = direction;
+    dataflow->meet = meet;
+    dataflow->total_bits = total_bits;
+    dataflow->total_blocks = vector_count(function->blocks);
+    dataflow->gen = ir_dataflow_create_sets(dataflow->total_blocks, total_bits);
+    dataflow->kill = ir_dataflow_create_sets(dataflow->total_blocks, total_bits);
+    dataflow->in = ir_dataflow_create_sets(dataflow->total_blocks, total_bits);
+    dataflow->out = ir_dataflow_create_sets(dataflow->total_blocks, total_bits);
+    dataflow->boundary = ir_bitset_create(total_bits);
+    return dataflow;
+}
+
+void ir_dataflow_free(struct ir_dataflow *dataflow)
+{
+    ir_dataflow_free_sets(dataflow->gen, dataflow->total_blocks);
+    ir_dataflow_free_sets(dataflow->kill, dataflow->total_blocks);
+    ir_dataflow_free_sets(dataflow->extra, dataflow->total_blocks);
+    ir_dataflow_free_sets(dataflow->in, dataflow->total_blocks);
+    ir_dataflow_free_sets(dataflow->out, dataflow->total_blocks);
+    ir_bitset_free(dataflow->boundary);
+    free(dataflow);
+}
+
+/**
+ * Computes the meet of the neighbours of the block that feed into it
+ * predecessors for forward problems and successors for backward problems.
+ */
+static void ir_dataflow_meet(struct ir_dataflow *dataflow, struct ir_block *block, struct ir_bitset *result)
+{
+    bool forward = dataflow->direction == IR_DATAFLOW_DIRECTION_FORWARD;
+    int total = forward ? vector_count(block->predecessors) : ir_block_total_successors(block);
+    bool is_boundary = forward ? block->index == 0 : total == 0;
+    if (is_boundary)
+    {
+        ir_bitset_copy(result, dataflow->boundary);
+    }
+    else
+    {
+        if (dataflow->meet == IR_DATAFLOW_MEET_INTERSECTION)
+        {
+            ir_bitset_fill(result);
+        }
+        else
+        {
+            ir_bitset_clear(result);
+        }
+
+        for (int i = 0; i < total; i++)
+        {
+            struct ir_block *neighbour = forward ? vector_peek_ptr_at(block->predecessors, i) : ir_block_successor(block, i);
+            struct ir_bitset *value = forward ? dataflow->out[neighbour->index] : dataflow->in[neighbour->index];
+            if (dataflow->meet == IR_DATAFLOW_MEET_INTERSECTION)
+            {
+                ir_bitset_intersect(result, value);
+            }
+            else
+            {
+                ir_bitset_union(result, value);
+            }
+        }
+    }
+
+    if (dataflow->extra)
+    {
+        ir_bitset_union(result, dataflow->extra[block->index]);
+    }
+}
+
+void ir_dataflow_solve(struct ir_dataflow *dataflow)
+{
+    struct ir_function *function = dataflow->function;
+    bool forward = dataflow->direction == IR_DATAFLOW_DIRECTION_FORWARD;
+    int total_blocks = dataflow->total_blocks;
+
+    // Intersection problems start from everything and shrink, union problems grow from nothing
+    for (int i = 0; i < total_blocks; i++)
+    {
+        struct ir_bitset *result = forward ? dataflow->out[i] : dataflow->in[i];
+        if (dataflow->meet == IR_DATAFLOW_MEET_INTERSECTION)
+        {
+            ir_bitset_fill(result);
+        }
+    }
+
+    // Visiting the blocks in reverse post order (or its reverse for backward problems)
+    // reaches the fixed point in very few passes.
+    struct vector *order = ir_function_reverse_post_order(function);
+    struct ir_block **worklist = calloc(total_blocks + 1, sizeof(struct ir_block *));
+    bool *in_worklist = calloc(total_blocks + 1, sizeof(bool));
+    int head = 0;
+    int total_queued = 0;
+    for (int i = 0; i < vector_count(order); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(order, forward ? i : vector_count(order) - i - 1);
+        worklist[total_queued++] = block;
+        in_worklist[block->index] = true;
+    }
+
+    struct ir_bitset *result = ir_bitset_create(dataflow->total_bits);
+    while (total_queued)
+    {
+        struct ir_block *block = worklist[head];
+        head = (head + 1) % total_blocks;
+        total_queued--;
+        in_worklist[block->index] = false;
+
+        struct ir_bitset *meet_set = forward ? dataflow->in[block->index] : dataflow->out[block->index];
+        struct ir_bitset *result_set = forward ? dataflow->out[block->index] : dataflow->in[block->index];
+        ir_dataflow_meet(dataflow, block, meet_set);
+
+        ir_bitset_copy(result, meet_set);
+        ir_bitset_subtract(result, dataflow->kill[block->index]);
+        ir_bitset_union(result, dataflow->gen[block->index]);
+        dataflow->iterations++;
+        if (ir_bitset_equals(result, result_set))
+            continue;
+
+        ir_bitset_copy(result_set, result);
+        int total = forward ? ir_block_total_successors(block) : vector_count(block->predecessors);
+        for (int i = 0; i < total; i++)
+        {
+            struct ir_block *dependant = forward ? ir_block_successor(block, i) : vector_peek_ptr_at(block->predecessors, i);
+            if (in_worklist[dependant->index])
+                continue;
+
+            worklist[(head + total_queued) % total_blocks] = dependant;
+            total_queued++;
+            in_worklist[dependant->index] = true;
+        }
+    }
+
+    ir_bitset_free(result);
+    free(worklist);
+    free(in_worklist);
+    vector_free(order);
+}
+
+struct ir_dataflow *ir_liveness(struct ir_function *function)
+{
+    struct ir_dataflow *dataflow = ir_dataflow_create(function, IR_DATAFLOW_DIRECTION_BACKWARD, IR_DATAFLOW_MEET_UNION, function->total_registers);
+    dataflow->extra = ir_dataflow_create_sets(dataflow->total_blocks, function->total_registers);
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        struct ir_bitset *gen = dataflow->gen[i];
+        struct ir_bitset *kill = dataflow->kill[i];
+        for (int b = vector_count(block->instructions) - 1; b >= 0; b--)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            if (instruction->id >= 0)
+            {
+                ir_bitset_unset(gen, instruction->id);
+                ir_bitset_set(kill, instruction->id);
+            }
+
+            if (instruction->op == IR_OP_PHI)
+            {
+                // Phi operands are used at the end of the block they come from
+                for (int c = 0; c < ir_instruction_total_operands(instruction); c++)
+                {
+                    struct ir_instruction *operand = ir_instruction_operand(instruction, c);
+                    struct ir_block *pred = ir_instruction_target(instruction, c);
+                    if (operand->id >= 0)
+                    {
+                        ir_bitset_set(dataflow->extra[pred->index], operand->id);
+                    }
+                }
+                continue;
+            }
+
+            for (int c = 0; c < ir_instruction_total_operands(instruction); c++)
+            {
+                struct ir_instruction *operand = ir_instruction_operand(instruction, c);
+                if (operand->id >= 0)
+                {
+                    ir_bitset_set(gen, operand->id);
+                }
+            }
+        }
+    }
+
+    ir_dataflow_solve(dataflow);
+    return dataflow;
+}
+
+static bool ir_store_is_to_frame(struct ir_instruction *instruction)
+{
+    return instruction->op == IR_OP_STORE && ir_instruction_operand(instruction, 0)->op == IR_OP_FRAME_ADDRESS;
+}
+
+/**
+ * Returns true if both stores write exactly the same bytes of the same frame slot
+ */
+static bool ir_stores_overwrite(struct ir_instruction *a, struct ir_instruction *b)
+{
+    struct ir_instruction *a_address = ir_instruction_operand(a, 0);
+    struct ir_instruction *b_address = ir_instruction_operand(b, 0);
+    return a_address->slot == b_address->slot && a_address->value == b_address->value && a->mem_type == b->mem_type;
+}
+
+struct ir_dataflow *ir_reaching_stores(struct ir_function *function, struct vector **stores_out)
+{
+    struct vector *stores = vector_create(sizeof(struct ir_instruction *));
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            if (ir_store_is_to_frame(instruction))
+            {
+                vector_push(stores, &instruction);
+            }
+        }
+    }
+
+    // Stores through unknown pointers never kill anything, they may not write to the slot at all.
+    struct ir_dataflow *dataflow = ir_dataflow_create(function, IR_DATAFLOW_DIRECTION_FORWARD, IR_DATAFLOW_MEET_UNION, vector_count(stores));
+    for (int i = 0; i < vector_count(stores); i++)
+    {
+        struct ir_instruction *store = vector_peek_ptr_at(stores, i);
+        int block_index = store->block->index;
+        for (int b = 0; b < vector_count(stores); b++)
+        {
+            struct ir_instruction *other = vector_peek_ptr_at(stores, b);
+            if (other != store && ir_stores_overwrite(store, other))
+            {
+                ir_bitset_set(dataflow->kill[block_index], b);
+                ir_bitset_unset(dataflow->gen[block_index], b);
+            }
+        }
+
+        // Stores are visited in block order, so the last store to the same bytes wins
+        ir_bitset_set(dataflow->gen[block_index], i);
+    }
+
+    ir_dataflow_solve(dataflow);
+    *stores_out = stores;
+    return dataflow;
+}
+
+struct ir_dominators *ir_dominators(struct ir_function *function)
+{
+    int total_blocks = vector_count(function->blocks);
+    struct ir_dominators *dominators = calloc(1, sizeof(struct ir_dominators));
+    struct ir_dataflow *dataflow = ir_dataflow_create(function, IR_DATAFLOW_DIRECTION_FORWARD, IR_DATAFLOW_MEET_INTERSECTION, total_blocks);
+    for (int i = 0; i < total_blocks; i++)
+    {
+        ir_bitset_set(dataflow->gen[i], i);
+    }
+    ir_dataflow_solve(dataflow);
+    dominators->dataflow = dataflow;
+
+    // The immediate dominator is the strict dominator that is dominated by all the others
+    // it has exactly one less dominator than the block its self.
+    dominators->idom = calloc(total_blocks + 1, sizeof(struct ir_block *));
+    struct vector *order = ir_function_reverse_post_order(function);
+    for (int i = 1; i < vector_count(order); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(order, i);
+        struct ir_bitset *dom = dataflow->out[block->index];
+        int total = ir_bitset_count(dom);
+        for (int b = 0; b < total_blocks; b++)
+        {
+            if (b != block->index && ir_bitset_test(dom, b) && ir_bitset_count(dataflow->out[b]) == total - 1)
+            {
+                dominators->idom[block->index] = vector_peek_ptr_at(function->blocks, b);
+                break;
+            }
+        }
+    }
+    vector_free(order);
+
+    return dominators;
+}
+
+bool ir_block_dominates(struct ir_dominators *dominators, struct ir_block *dominator, struct ir_block *block)
+{
+    return ir_bitset_test(dominators->dataflow->out[block->index], dominator->index);
+}
+
+void ir_dominators_free(struct ir_dominators *dominators)
+{
+    ir_dataflow_free(dominators->dataflow);
+    free(dominators->idom);
+    free(dominators);
+}
@@ -0,0 +1,356 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+/**
+ * Dead code elimination over the IR. Lowering already leaves code after a return, break,
+ * continue or goto in blocks that nothing jumps to, so removing unreachable blocks takes care
+ * of that. Branches on constant conditions become jumps which then makes the untaken arm unreachable.
+ */
+
+static void ir_instruction_make_const(struct ir_instruction *instruction, long value)
+{
+    instruction->op = IR_OP_CONST;
+    instruction->value = value;
+    vector_clear(instruction->operands);
+}
+
+static bool ir_fold_instruction(struct ir_instruction *instruction)
+{
+    if (ir_instruction_total_operands(instruction) == 0 || instruction->type != IR_TYPE_I32)
+        return false;
+
+    struct ir_instruction *left = ir_instruction_operand(instruction, 0);
+    if (left->op != IR_OP_CONST)
+        return false;
+
+    long result = 0;
+    switch (instruction->op)
+    {
+    case IR_OP_NEG:
+        result = (int32_t)(-(uint32_t)left->value);
+        break;
+
+    case IR_OP_NOT:
+        result = ~(int32_t)left->value;
+        break;
+
+    case IR_OP_POPCOUNT:
+    case IR_OP_CLZ:
+    case IR_OP_CTZ:
+    case IR_OP_BSWAP:
+        result = ir_fold_bit_operation(instruction->op, left->value);
+        break;
+
+    case IR_OP_SEXT:
+        result = instruction->mem_type == IR_TYPE_I8 ? (long)(int8_t)left->value : (long)(int16_t)left->value;
+        break;
+
+    case IR_OP_ZEXT:
+        result = instruction->mem_type == IR_TYPE_I8 ? (long)(uint8_t)left->value : (long)(uint16_t)left->value;
+        break;
+
+    default:
+        if (!ir_op_is_binary(instruction->op) && !ir_op_is_compare(instruction->op))
+            return false;
+
+        struct ir_instruction *right = ir_instruction_operand(instruction, 1);
+        if (right->op != IR_OP_CONST || !ir_fold_constant(instruction->op, left->value, right->value, &result))
+            return false;
+        break;
+    }
+
+    ir_instruction_make_const(instruction, result);
+    return true;
+}
+
+static bool ir_fold_constants(struct ir_function *function)
+{
+    bool changed = false;
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            if (ir_fold_instruction(instruction))
+            {
+                changed = true;
+            }
+        }
+    }
+
+    return changed;
+}
+
+static int ir_fold_branches(struct ir_function *function)
+{
+    int total_folded = 0;
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        struct ir_instruction *terminator = ir_block_terminator(block);
+        if (terminator->op != IR_OP_BRANCH || ir_instruction_operand(terminator, 0)->op != IR_OP_CONST)
+            continue;
+
+        bool taken = ir_instruction_operand(terminator, 0)->value != 0;
+        struct ir_block *target = ir_instruction_target(terminator, taken ? 0 : 1);
+        struct ir_block *untaken = ir_instruction_target(terminator, taken ? 1 : 0);
+        if (untaken != target)
+        {
+            ir_block_remove_predecessor(untaken, block);
+        }
+
+        terminator->op = IR_OP_JUMP;
+        vector_clear(terminator->operands);
+        vector_clear(terminator->blocks);
+        vector_push(terminator->blocks, &target);
+        total_folded++;
+    }
+
+    return total_folded;
+}
+
+/**
+ * Returns the frame slot the address points into, NULL if the address does not
+ * come from the stack frame.
+ */
+static struct ir_frame_slot *ir_address_frame_slot(struct ir_instruction *address)
+{
+    while ((address->op == IR_OP_ADD || address->op == IR_OP_SUB) && address->type == IR_TYPE_PTR)
+    {
+        address = ir_instruction_operand(address, 0);
+    }
+
+    if (address->op != IR_OP_FRAME_ADDRESS)
+        return NULL;
+
+    return address->slot;
+}
+
+/**
+ * A frame slot escapes when its address is used for anything other than loading, storing
+ * or computing another address into the same slot. Memory we cannot see through could read it.
+ */
+static void ir_find_escaped_and_read_slots(struct ir_function *function, bool *escaped, bool *read)
+{
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            for (int c = 0; c < ir_instruction_total_operands(instruction); c++)
+            {
+                struct ir_frame_slot *slot = ir_address_frame_slot(ir_instruction_operand(instruction, c));
+                if (!slot)
+                    continue;
+
+                if ((instruction->op == IR_OP_LOAD || instruction->op == IR_OP_VECTOR_LOAD) && c == 0)
+                {
+                    read[slot->id] = true;
+                    continue;
+                }
+
+                bool is_address_use = c == 0 && (instruction->op == IR_OP_STORE || instruction->op == IR_OP_VECTOR_STORE ||
+                                                 (instruction->type == IR_TYPE_PTR && (instruction->op == IR_OP_ADD || instruction->op == IR_OP_SUB)));
+                if (!is_address_use)
+                {
+                    escaped[slot->id] = true;
+                }
+            }
+        }
+    }
+}
+
+static bool ir_store_is_removable(struct ir_instruction *store, bool *escaped)
+{
+    if (store->op != IR_OP_STORE || store->flags & IR_INSTRUCTION_FLAG_VOLATILE)
+        return false;
+
+    struct ir_frame_slot *slot = ir_address_frame_slot(ir_instruction_operand(store, 0));
+    return slot && !escaped[slot->id];
+}
+
+/**
+ * Returns true if the store writes to exactly the same bytes as the earlier store
+ */
+static bool ir_store_overwrites(struct ir_instruction *store, struct ir_instruction *earlier)
+{
+    struct ir_instruction *address = ir_instruction_operand(store, 0);
+    struct ir_instruction *earlier_address = ir_instruction_operand(earlier, 0);
+    return address->op == IR_OP_FRAME_ADDRESS && earlier_address->op == IR_OP_FRAME_ADDRESS &&
+           address->slot == earlier_address->slot && address->value == earlier_address->value &&
+           store->mem_type == earlier->mem_type;
+}
+
+static int ir_remove_dead_stores_in_block(struct ir_block *block, bool *escaped, bool *read)
+{
+    int total_removed = 0;
+    struct vector *pending = vector_create(sizeof(struct ir_instruction *));
+    for (int i = 0; i < vector_count(block->instructions); i++)
+    {
+        struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, i);
+        if (instruction->op == IR_OP_LOAD || instruction->op == IR_OP_VECTOR_LOAD)
+        {
+            // The load may read any of the pending stores to its slot
+            struct ir_frame_slot *slot = ir_address_frame_slot(ir_instruction_operand(instruction, 0));
+            for (int b = vector_count(pending) - 1; slot && b >= 0; b--)
+            {
+                struct ir_instruction *store = vector_peek_ptr_at(pending, b);
+                if (ir_address_frame_slot(ir_instruction_operand(store, 0)) == slot)
+                {
+                    vector_pop_at(pending, b);
+                }
+            }
+            continue;
+        }
+
+        if (!ir_store_is_removable(instruction, escaped))
+            continue;
+
+        // Nobody ever reads the slot so the store can go
+        if (!read[ir_address_frame_slot(ir_instruction_operand(instruction, 0))->id])
+        {
+            ir_block_remove_instruction(block, instruction);
+            total_removed++;
+            i--;
+            continue;
+        }
+
+        for (int b = 0; b < vector_count(pending); b++)
+        {
+            struct ir_instruction *earlier = vector_peek_ptr_at(pending, b);
+            if (ir_store_overwrites(instruction, earlier))
+            {
+                // The earlier store was never read before being overwritten
+                ir_block_remove_instruction(block, earlier);
+                vector_pop_at(pending, b);
+                total_removed++;
+                i--;
+                break;
+            }
+        }
+        vector_push(pending, &instruction);
+    }
+
+    vector_free(pending);
+    return total_removed;
+}
+
+static int ir_remove_dead_stores(struct ir_function *function)
+{
+    int total_slots = vector_count(function->slots);
+    bool *escaped = calloc(total_slots + 1, sizeof(bool));
+    bool *read = calloc(total_slots + 1, sizeof(bool));
+    ir_find_escaped_and_read_slots(function, escaped, read);
+
+    int total_removed = 0;
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        total_removed += ir_remove_dead_stores_in_block(vector_peek_ptr_at(function->blocks, i), escaped, read);
+    }
+
+    free(escaped);
+    free(read);
+    return total_removed;
+}
+
+static void ir_mark_live(struct ir_instruction *instruction, bool *live)
+{
+    if (instruction->id >= 0)
+    {
+        if (live[instruction->id])
+            return;
+
+        live[instruction->id] = true;
+    }
+
+    for (int i = 0; i < ir_instruction_total_operands(instruction); i++)
+    {
+        ir_mark_live(ir_instruction_operand(instruction, i), live);
+    }
+}
+
+/**
+ * Mark and sweep, instructions with side effects are live and so is everything they use.
+ * Unlike counting uses this also removes cycles of phis that only feed each other.
+ */
+static int ir_remove_dead_instructions(struct ir_function *function)
+{
+    bool *live = calloc(function->total_registers + 1, sizeof(bool));
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            if (ir_instruction_has_side_effects(instruction))
+            {
+                ir_mark_live(instruction, live);
+            }
+        }
+    }
+
+    int total_removed = 0;
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            if (instruction->id < 0 || live[instruction->id] || ir_instruction_has_side_effects(instruction))
+                continue;
+
+            ir_block_remove_instruction(block, instruction);
+            total_removed++;
+            b--;
+        }
+    }
+
+    free(live);
+    return total_removed;
+}
+
+static int ir_function_total_instructions(struct ir_function *function)
+{
+    int total = 0;
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        total += vector_count(block->instructions);
+    }
+
+    return total;
+}
+
+bool ir_eliminate_dead_code(struct compile_process *process, struct ir_function *function)
+{
+    struct compile_process_statistics *statistics = &process->statistics;
+    int total_instructions = ir_function_total_instructions(function);
+    int total_blocks = vector_count(function->blocks);
+    bool changed = true;
+    while (changed)
+    {
+        changed = ir_fold_constants(function);
+
+        int total_folded = ir_fold_branches(function);
+        if (total_folded)
+        {
+            ir_function_remove_unreachable_blocks(function);
+            ir_function_remove_trivial_phis(function);
+            statistics->folded_branches += total_folded;
+            changed = true;
+        }
+
+        if (ir_remove_dead_stores(function) + ir_remove_dead_instructions(function))
+        {
+            changed = true;
+        }
+    }
+
+    int total_removed = total_instructions - ir_function_total_instructions(function);
+    statistics->removed_instructions += total_removed;
+    statistics->removed_blocks += total_blocks - vector_count(function->blocks);
+    return total_removed != 0;
+}
@@ -0,0 +1,193 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Stack homes for virtual registers. Two values that are never live at the same time can
+ * share a home, so the homes are assigned by colouring the interference graph built from liveness.
+ *
+ * A value interferes with everything live right after it is defined. Phis are written on the
+ * edges into their block, they interfere with everything live into the block and with each other.
+ */
+
+static bool ir_value_needs_home(struct ir_instruction *value)
+{
+    switch (value->op)
+    {
+    case IR_OP_CONST:
+    case IR_OP_UNDEF:
+    case IR_OP_GLOBAL_ADDRESS:
+    case IR_OP_FRAME_ADDRESS:
+        return false;
+    }
+
+    return value->id >= 0 && value->type != IR_TYPE_VOID;
+}
+
+static int ir_value_home_width(struct ir_instruction *value, int home_size)
+{
+    return value->type == IR_TYPE_V128 ? 16 / home_size : 1;
+}
+
+static bool ir_homes_are_free(bool *taken, int home, int width)
+{
+    for (int i = 0; i < width; i++)
+    {
+        if (taken[home + i])
+            return false;
+    }
+
+    return true;
+}
+
+static void ir_interfere(struct ir_bitset **interference, int a, int b)
+{
+    if (a == b)
+        return;
+
+    ir_bitset_set(interference[a], b);
+    ir_bitset_set(interference[b], a);
+}
+
+static void ir_interfere_with_live(struct ir_bitset **interference, struct ir_bitset *live, int value, int total_registers)
+{
+    for (int i = 0; i < total_registers; i++)
+    {
+        if (ir_bitset_test(live, i))
+        {
+            ir_interfere(interference, value, i);
+        }
+    }
+}
+
+static void ir_block_interference(struct ir_block *block, struct ir_dataflow *liveness, struct ir_bitset **interference, int total_registers)
+{
+    struct ir_bitset *live = ir_bitset_create(total_registers);
+    ir_bitset_copy(live, liveness->out[block->index]);
+
+    int total_phis = 0;
+    while (total_phis < vector_count(block->instructions) &&
+           ((struct ir_instruction *)vector_peek_ptr_at(block->instructions, total_phis))->op == IR_OP_PHI)
+    {
+        total_phis++;
+    }
+
+    for (int i = vector_count(block->instructions) - 1; i >= total_phis; i--)
+    {
+        struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, i);
+        if (ir_value_needs_home(instruction))
+        {
+            ir_interfere_with_live(interference, live, instruction->id, total_registers);
+            ir_bitset_unset(live, instruction->id);
+        }
+
+        for (int b = 0; b < ir_instruction_total_operands(instruction); b++)
+        {
+            struct ir_instruction *operand = ir_instruction_operand(instruction, b);
+            if (ir_value_needs_home(operand))
+            {
+                ir_bitset_set(live, operand->id);
+            }
+        }
+    }
+
+    for (int i = 0; i < total_phis; i++)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(block->instructions, i);
+        ir_interfere_with_live(interference, live, phi->id, total_registers);
+        for (int b = 0; b < total_phis; b++)
+        {
+            ir_interfere(interference, phi->id, ((struct ir_instruction *)vector_peek_ptr_at(block->instructions, b))->id);
+        }
+    }
+
+    ir_bitset_free(live);
+}
+
+int ir_assign_homes(struct ir_function *function, int *homes, int home_size)
+{
+    int total_registers = function->total_registers;
+    for (int i = 0; i < total_registers; i++)
+    {
+        homes[i] = -1;
+    }
+
+    if (vector_count(function->blocks) == 0)
+        return 0;
+
+    struct ir_dataflow *liveness = ir_liveness(function);
+    struct ir_bitset **interference = calloc(total_registers + 1, sizeof(struct ir_bitset *));
+    for (int i = 0; i < total_registers; i++)
+    {
+        interference[i] = ir_bitset_create(total_registers);
+    }
+
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        ir_block_interference(vector_peek_ptr_at(function->blocks, i), liveness, interference, total_registers);
+    }
+
+    // Greedy colouring in the order the values are defined
+    int total_homes = 0;
+    int *widths = calloc(total_registers + 1, sizeof(int));
+    int total_taken = 1;
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *value = vector_peek_ptr_at(block->instructions, b);
+            if (value->id >= 0)
+            {
+                widths[value->id] = ir_value_home_width(value, home_size);
+                total_taken += widths[value->id];
+            }
+        }
+    }
+    bool *taken = calloc(total_taken, sizeof(bool));
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *value = vector_peek_ptr_at(block->instructions, b);
+            if (!ir_value_needs_home(value))
+                continue;
+
+            memset(taken, 0, total_taken * sizeof(bool));
+            for (int c = 0; c < total_registers; c++)
+            {
+                if (homes[c] == -1 || !ir_bitset_test(interference[value->id], c))
+                    continue;
+
+                for (int w = 0; w < widths[c]; w++)
+                {
+                    taken[homes[c] + w] = true;
+                }
+            }
+
+            int width = widths[value->id];
+            int home = 0;
+            while (!ir_homes_are_free(taken, home, width))
+            {
+                home++;
+            }
+            homes[value->id] = home;
+            if (home + width > total_homes)
+            {
+                total_homes = home + width;
+            }
+        }
+    }
+
+    free(taken);
+    free(widths);
+    for (int i = 0; i < total_registers; i++)
+    {
+        ir_bitset_free(interference[i]);
+    }
+    free(interference);
+    ir_dataflow_free(liveness);
+    return total_homes;
+}
@@ -0,0 +1,866 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <assert.h>
+#include <stdlib.h>
+
+static const char *ir_op_names[] = {
+    [IR_OP_CONST] = "const",
+    [IR_OP_UNDEF] = "undef",
+    [IR_OP_PARAM] = "param",
+    [IR_OP_FRAME_ADDRESS] = "frame",
+    [IR_OP_GLOBAL_ADDRESS] = "global",
+    [IR_OP_LOAD] = "load",
+    [IR_OP_STORE] = "store",
+    [IR_OP_ADD] = "add",
+    [IR_OP_SUB] = "sub",
+    [IR_OP_MUL] = "mul",
+    [IR_OP_SDIV] = "sdiv",
+    [IR_OP_UDIV] = "udiv",
+    [IR_OP_SREM] = "srem",
+    [IR_OP_UREM] = "urem",
+    [IR_OP_AND] = "and",
+    [IR_OP_OR] = "or",
+    [IR_OP_XOR] = "xor",
+    [IR_OP_SHL] = "shl",
+    [IR_OP_SAR] = "sar",
+    [IR_OP_SHR] = "shr",
+    [IR_OP_ROTL] = "rotl",
+    [IR_OP_ROTR] = "rotr",
+    [IR_OP_NEG] = "neg",
+    [IR_OP_NOT] = "not",
+    [IR_OP_POPCOUNT] = "popcount",
+    [IR_OP_CLZ] = "clz",
+    [IR_OP_CTZ] = "ctz",
+    [IR_OP_BSWAP] = "bswap",
+    [IR_OP_EQ] = "eq",
+    [IR_OP_NE] = "ne",
+    [IR_OP_SLT] = "slt",
+    [IR_OP_SLE] = "sle",
+    [IR_OP_SGT] = "sgt",
+    [IR_OP_SGE] = "sge",
+    [IR_OP_ULT] = "ult",
+    [IR_OP_ULE] = "ule",
+    [IR_OP_UGT] = "ugt",
+    [IR_OP_UGE] = "uge",
+    [IR_OP_SEXT] = "sext",
+    [IR_OP_ZEXT] = "zext",
+    [IR_OP_CALL] = "call",
+    [IR_OP_PHI] = "phi",
+    [IR_OP_COPY] = "copy",
+    [IR_OP_ATOMIC] = "atomic",
+    [IR_OP_JUMP] = "jmp",
+    [IR_OP_BRANCH] = "br",
+    [IR_OP_RETURN] = "ret",
+    [IR_OP_VECTOR_LOAD] = "vload",
+    [IR_OP_VECTOR_STORE] = "vstore",
+    [IR_OP_VECTOR_SPLAT] = "splat",
+    [IR_OP_VECTOR_MASK] = "mask",
+    [IR_OP_VECTOR_REDUCE] = "reduce",
+};
+
+static const char *ir_atomic_names[] = {
+    [IR_ATOMIC_EXCHANGE] = "exchange",
+    [IR_ATOMIC_FETCH_ADD] = "fetch_add",
+    [IR_ATOMIC_COMPARE_EXCHANGE] = "compare_exchange",
+    [IR_ATOMIC_FENCE] = "fence",
+    [IR_ATOMIC_BARRIER] = "barrier",
+};
+
+static const char *ir_type_names[] = {
+    [IR_TYPE_VOID] = "void",
+    [IR_TYPE_I8] = "i8",
+    [IR_TYPE_I16] = "i16",
+    [IR_TYPE_I32] = "i32",
+    [IR_TYPE_PTR] = "ptr",
+    [IR_TYPE_V128] = "v128",
+};
+
+const char *ir_op_name(int op)
+{
+    return ir_op_names[op];
+}
+
+const char *ir_type_name(int type)
+{
+    return ir_type_names[type];
+}
+
+struct ir_function *ir_function_create(struct node *func_node)
+{
+    struct ir_function *function = calloc(1, sizeof(struct ir_function));
+    function->node = func_node;
+    function->name = func_node->func.name;
+    function->blocks = vector_create(sizeof(struct ir_block *));
+    function->slots = vector_create(sizeof(struct ir_frame_slot *));
+    return function;
+}
+
+struct ir_block *ir_block_create(struct ir_function *function)
+{
+    struct ir_block *block = calloc(1, sizeof(struct ir_block));
+    block->id = function->total_blocks++;
+    block->function = function;
+    block->instructions = vector_create(sizeof(struct ir_instruction *));
+    block->predecessors = vector_create(sizeof(struct ir_block *));
+    block->lines = vector_create(sizeof(int));
+    block->ssa.definitions = vector_create(sizeof(struct ir_variable_definition));
+    block->ssa.incomplete_phis = vector_create(sizeof(struct ir_variable_definition));
+    vector_push(function->blocks, &block);
+    return block;
+}
+
+struct ir_frame_slot *ir_frame_slot_create(struct ir_function *function, const char *name, size_t size, int offset, int flags)
+{
+    struct ir_frame_slot *slot = calloc(1, sizeof(struct ir_frame_slot));
+    slot->id = vector_count(function->slots);
+    slot->name = name;
+    slot->size = size;
+    slot->offset = offset;
+    slot->flags = flags;
+    vector_push(function->slots, &slot);
+    return slot;
+}
+
+struct ir_instruction *ir_instruction_create(struct ir_function *function, int op, int type)
+{
+    struct ir_instruction *instruction = calloc(1, sizeof(struct ir_instruction));
+    instruction->op = op;
+    instruction->type = type;
+    instruction->id = -1;
+    if (type != IR_TYPE_VOID)
+    {
+        instruction->id = function->total_registers++;
+    }
+    instruction->mem_type = IR_TYPE_I32;
+    instruction->operands = vector_create(sizeof(struct ir_instruction *));
+    instruction->blocks = vector_create(sizeof(struct ir_block *));
+    return instruction;
+}
+
+void ir_instruction_add_operand(struct ir_instruction *instruction, struct ir_instruction *operand)
+{
+    vector_push(instruction->operands, &operand);
+}
+
+struct ir_instruction *ir_instruction_operand(struct ir_instruction *instruction, int index)
+{
+    return vector_peek_ptr_at(instruction->operands, index);
+}
+
+int ir_instruction_total_operands(struct ir_instruction *instruction)
+{
+    return vector_count(instruction->operands);
+}
+
+struct ir_block *ir_instruction_target(struct ir_instruction *instruction, int index)
+{
+    return vector_peek_ptr_at(instruction->blocks, index);
+}
+
+static void ir_vector_insert_ptr(struct vector *vec, int index, void *ptr)
+{
+    vector_push(vec, &ptr);
+    for (int i = vector_count(vec) - 1; i > index; i--)
+    {
+        *(void **)vector_at(vec, i) = *(void **)vector_at(vec, i - 1);
+    }
+    *(void **)vector_at(vec, index) = ptr;
+}
+
+static void ir_vector_remove_ptr_at(struct vector *vec, int index)
+{
+    int total = vector_count(vec);
+    for (int i = index; i < total - 1; i++)
+    {
+        *(void **)vector_at(vec, i) = *(void **)vector_at(vec, i + 1);
+    }
+    vector_pop(vec);
+}
+
+static int ir_vector_index_of_ptr(struct vector *vec, void *ptr)
+{
+    for (int i = 0; i < vector_count(vec); i++)
+    {
+        if (vector_peek_ptr_at(vec, i) == ptr)
+            return i;
+    }
+
+    return -1;
+}
+
+bool ir_op_is_terminator(int op)
+{
+    return op == IR_OP_JUMP || op == IR_OP_BRANCH || op == IR_OP_RETURN;
+}
+
+bool ir_op_is_binary(int op)
+{
+    return op >= IR_OP_ADD && op <= IR_OP_ROTR;
+}
+
+bool ir_op_is_bit_operation(int op)
+{
+    return op >= IR_OP_POPCOUNT && op <= IR_OP_BSWAP;
+}
+
+bool ir_op_is_compare(int op)
+{
+    return op >= IR_OP_EQ && op <= IR_OP_UGE;
+}
+
+int ir_op_inverse_compare(int op)
+{
+    switch (op)
+    {
+    case IR_OP_EQ: return IR_OP_NE;
+    case IR_OP_NE: return IR_OP_EQ;
+    case IR_OP_SLT: return IR_OP_SGE;
+    case IR_OP_SLE: return IR_OP_SGT;
+    case IR_OP_SGT: return IR_OP_SLE;
+    case IR_OP_SGE: return IR_OP_SLT;
+    case IR_OP_ULT: return IR_OP_UGE;
+    case IR_OP_ULE: return IR_OP_UGT;
+    case IR_OP_UGT: return IR_OP_ULE;
+    case IR_OP_UGE: return IR_OP_ULT;
+    }
+
+    assert(0 && "Not a comparison");
+    return op;
+}
+
+bool ir_fold_constant(int op, long left, long right, long *result_out)
+{
+    int32_t l = left;
+    int32_t r = right;
+    uint32_t ul = left;
+    uint32_t ur = right;
+    long result = 0;
+    switch (op)
+    {
+    case IR_OP_ADD: result = (int32_t)(ul + ur); break;
+    case IR_OP_SUB: result = (int32_t)(ul - ur); break;
+    case IR_OP_MUL: result = (int32_t)(ul * ur); break;
+    case IR_OP_AND: result = l & r; break;
+    case IR_OP_OR: result = l | r; break;
+    case IR_OP_XOR: result = l ^ r; break;
+    case IR_OP_SHL: result = (int32_t)(ul << (ur & 31)); break;
+    case IR_OP_SAR: result = l >> (ur & 31); break;
+    case IR_OP_SHR: result = (int32_t)(ul >> (ur & 31)); break;
+    case IR_OP_ROTL: result = (int32_t)(ul << (ur & 31) | ul >> ((32 - (ur & 31)) & 31)); break;
+    case IR_OP_ROTR: result = (int32_t)(ul >> (ur & 31) | ul << ((32 - (ur & 31)) & 31)); break;
+    case IR_OP_EQ: result = l == r; break;
+    case IR_OP_NE: result = l != r; break;
+    case IR_OP_SLT: result = l < r; break;
+    case IR_OP_SLE: result = l <= r; break;
+    case IR_OP_SGT: result = l > r; break;
+    case IR_OP_SGE: result = l >= r; break;
+    case IR_OP_ULT: result = ul < ur; break;
+    case IR_OP_ULE: result = ul <= ur; break;
+    case IR_OP_UGT: result = ul > ur; break;
+    case IR_OP_UGE: result = ul >= ur; break;
+    case IR_OP_SDIV:
+    case IR_OP_SREM:
+        if (r == 0 || (l == INT32_MIN && r == -1))
+            return false;
+        result = op == IR_OP_SDIV ? l / r : l % r;
+        break;
+    case IR_OP_UDIV:
+    case IR_OP_UREM:
+        if (ur == 0)
+            return false;
+        result = (int32_t)(op == IR_OP_UDIV ? ul / ur : ul % ur);
+        break;
+    default:
+        return false;
+    }
+
+    *result_out = result;
+    return true;
+}
+
+long ir_fold_bit_operation(int op, long value)
+{
+    uint32_t v = value;
+    int count = 0;
+    switch (op)
+    {
+    case IR_OP_POPCOUNT:
+        for (; v; v &= v - 1)
+        {
+            count++;
+        }
+        return count;
+
+    case IR_OP_CLZ:
+        for (; count < 32 && !(v & 0x80000000); v <<= 1)
+        {
+            count++;
+        }
+        return count;
+
+    case IR_OP_CTZ:
+        for (; count < 32 && !(v & 1); v >>= 1)
+        {
+            count++;
+        }
+        return count;
+
+    case IR_OP_BSWAP:
+        return (int32_t)(v >> 24 | (v >> 8 & 0xff00) | (v << 8 & 0xff0000) | v << 24);
+    }
+
+    assert(0 && "Not a bit operation");
+    return value;
+}
+
+bool ir_instruction_has_side_effects(struct ir_instruction *instruction)
+{
+    switch (instruction->op)
+    {
+    case IR_OP_STORE:
+    case IR_OP_VECTOR_STORE:
+    case IR_OP_CALL:
+    case IR_OP_JUMP:
+    case IR_OP_BRANCH:
+    case IR_OP_RETURN:
+        return true;
+
+    case IR_OP_SDIV:
+    case IR_OP_UDIV:
+    case IR_OP_SREM:
+    case IR_OP_UREM:
+        // Division by zero traps, we cannot assume its safe to remove or move.
+        return true;
+    }
+
+    return instruction->flags & IR_INSTRUCTION_FLAG_VOLATILE;
+}
+
+void ir_block_append(struct ir_block *block, struct ir_instruction *instruction)
+{
+    instruction->block = block;
+    vector_push(block->instructions, &instruction);
+}
+
+void ir_block_prepend(struct ir_block *block, struct ir_instruction *instruction)
+{
+    // Phi instructions must always come first in the block, so insert after them.
+    int index = 0;
+    while (index < vector_count(block->instructions))
+    {
+        struct ir_instruction *current = vector_peek_ptr_at(block->instructions, index);
+        if (current->op != IR_OP_PHI)
+            break;
+        index++;
+    }
+
+    instruction->block = block;
+    ir_vector_insert_ptr(block->instructions, index, instruction);
+}
+
+void ir_block_insert_before_terminator(struct ir_block *block, struct ir_instruction *instruction)
+{
+    int index = vector_count(block->instructions);
+    if (ir_block_terminator(block))
+    {
+        index--;
+    }
+
+    instruction->block = block;
+    ir_vector_insert_ptr(block->instructions, index, instruction);
+}
+
+void ir_block_remove_instruction(struct ir_block *block, struct ir_instruction *instruction)
+{
+    int index = ir_vector_index_of_ptr(block->instructions, instruction);
+    assert(index != -1);
+    ir_vector_remove_ptr_at(block->instructions, index);
+    instruction->block = NULL;
+}
+
+void ir_block_add_predecessor(struct ir_block *block, struct ir_block *predecessor)
+{
+    vector_push(block->predecessors, &predecessor);
+}
+
+void ir_block_add_line(struct ir_block *block, int line)
+{
+    for (int i = 0; i < vector_count(block->lines); i++)
+    {
+        if (*(int *)vector_at(block->lines, i) == line)
+            return;
+    }
+
+    vector_push(block->lines, &line);
+}
+
+void ir_block_replace_successor(struct ir_block *block, struct ir_block *old_successor, struct ir_block *new_successor)
+{
+    struct ir_instruction *terminator = ir_block_terminator(block);
+    for (int i = 0; i < vector_count(terminator->blocks); i++)
+    {
+        if (ir_instruction_target(terminator, i) != old_successor)
+            continue;
+
+        *(struct ir_block **)vector_at(terminator->blocks, i) = new_successor;
+        ir_vector_remove_ptr_at(old_successor->predecessors, ir_vector_index_of_ptr(old_successor->predecessors, block));
+        ir_block_add_predecessor(new_successor, block);
+    }
+}
+
+void ir_function_move_block_before(struct ir_function *function, struct ir_block *block, struct ir_block *before)
+{
+    ir_vector_remove_ptr_at(function->blocks, ir_vector_index_of_ptr(function->blocks, block));
+    ir_vector_insert_ptr(function->blocks, ir_vector_index_of_ptr(function->blocks, before), block);
+}
+
+struct ir_instruction *ir_block_terminator(struct ir_block *block)
+{
+    struct ir_instruction *last = vector_back_ptr_or_null(block->instructions);
+    if (!last || !ir_op_is_terminator(last->op))
+        return NULL;
+
+    return last;
+}
+
+void ir_phi_add_incoming(struct ir_instruction *phi, struct ir_instruction *value, struct ir_block *block)
+{
+    assert(phi->op == IR_OP_PHI);
+    ir_instruction_add_operand(phi, value);
+    vector_push(phi->blocks, &block);
+}
+
+struct ir_instruction *ir_phi_incoming_for_block(struct ir_instruction *phi, struct ir_block *block)
+{
+    int index = ir_vector_index_of_ptr(phi->blocks, block);
+    if (index == -1)
+        return NULL;
+
+    return ir_instruction_operand(phi, index);
+}
+
+void ir_instruction_replace_uses(struct ir_function *function, struct ir_instruction *old_value, struct ir_instruction *new_value)
+{
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            for (int c = 0; c < ir_instruction_total_operands(instruction); c++)
+            {
+                if (ir_instruction_operand(instruction, c) == old_value)
+                {
+                    *(struct ir_instruction **)vector_at(instruction->operands, c) = new_value;
+                }
+            }
+        }
+    }
+}
+
+static void ir_mark_reachable(struct ir_block *block, bool *reachable)
+{
+    if (reachable[block->id])
+        return;
+
+    reachable[block->id] = true;
+    struct ir_instruction *terminator = ir_block_terminator(block);
+    if (!terminator)
+        return;
+
+    for (int i = 0; i < vector_count(terminator->blocks); i++)
+    {
+        ir_mark_reachable(ir_instruction_target(terminator, i), reachable);
+    }
+}
+
+static void ir_phi_remove_incoming_at(struct ir_instruction *phi, int index)
+{
+    ir_vector_remove_ptr_at(phi->operands, index);
+    ir_vector_remove_ptr_at(phi->blocks, index);
+}
+
+void ir_phi_remove_incoming(struct ir_instruction *phi, struct ir_block *block)
+{
+    int index = ir_vector_index_of_ptr(phi->blocks, block);
+    if (index != -1)
+    {
+        ir_phi_remove_incoming_at(phi, index);
+    }
+}
+
+void ir_block_remove_predecessor(struct ir_block *block, struct ir_block *predecessor)
+{
+    int pred_index = ir_vector_index_of_ptr(block->predecessors, predecessor);
+    if (pred_index != -1)
+    {
+        ir_vector_remove_ptr_at(block->predecessors, pred_index);
+    }
+
+    for (int i = 0; i < vector_count(block->instructions); i++)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(block->instructions, i);
+        if (phi->op != IR_OP_PHI)
+            break;
+
+        int index = ir_vector_index_of_ptr(phi->blocks, predecessor);
+        if (index != -1)
+        {
+            ir_phi_remove_incoming_at(phi, index);
+        }
+    }
+}
+
+void ir_function_remove_unreachable_blocks(struct ir_function *function)
+{
+    if (vector_count(function->blocks) == 0)
+        return;
+
+    bool *reachable = calloc(function->total_blocks, sizeof(bool));
+    ir_mark_reachable(vector_peek_ptr_at(function->blocks, 0), reachable);
+
+    struct vector *remaining_blocks = vector_create(sizeof(struct ir_block *));
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        if (reachable[block->id])
+        {
+            vector_push(remaining_blocks, &block);
+            continue;
+        }
+
+        // This block is going away, its successors can no longer be reached from it.
+        struct ir_instruction *terminator = ir_block_terminator(block);
+        for (int b = 0; terminator && b < vector_count(terminator->blocks); b++)
+        {
+            ir_block_remove_predecessor(ir_instruction_target(terminator, b), block);
+        }
+    }
+
+    vector_free(function->blocks);
+    function->blocks = remaining_blocks;
+    free(reachable);
+}
+
+static struct ir_instruction *ir_phi_trivial_value(struct ir_instruction *phi)
+{
+    struct ir_instruction *same = NULL;
+    for (int i = 0; i < ir_instruction_total_operands(phi); i++)
+    {
+        struct ir_instruction *operand = ir_instruction_operand(phi, i);
+        if (operand == same || operand == phi)
+            continue;
+
+        if (same)
+        {
+            // The phi merges at least two values, not trivial.
+            return NULL;
+        }
+        same = operand;
+    }
+
+    return same;
+}
+
+void ir_function_remove_trivial_phis(struct ir_function *function)
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 0; i < vector_count(function->blocks); i++)
+        {
+            struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+            for (int b = 0; b < vector_count(block->instructions); b++)
+            {
+                struct ir_instruction *phi = vector_peek_ptr_at(block->instructions, b);
+                if (phi->op != IR_OP_PHI)
+                    break;
+
+                struct ir_instruction *value = ir_phi_trivial_value(phi);
+                if (!value)
+                {
+                    if (ir_instruction_total_operands(phi) > 0)
+                        continue;
+
+                    // A phi with no operands lives in a block that cannot be reached
+                    // it can be replaced with an undefined value.
+                    value = ir_instruction_create(function, IR_OP_UNDEF, phi->type);
+                    ir_block_prepend(block, value);
+                }
+
+                ir_instruction_replace_uses(function, phi, value);
+                ir_block_remove_instruction(block, phi);
+                changed = true;
+                break;
+            }
+        }
+    }
+}
+
+static void ir_dump_value(FILE *fp, struct ir_instruction *value)
+{
+    if (value->op == IR_OP_CONST)
+    {
+        fprintf(fp, "%li", value->value);
+        return;
+    }
+
+    fprintf(fp, "%%%i", value->id);
+}
+
+void ir_dump_instruction(FILE *fp, struct ir_instruction *instruction)
+{
+    if (instruction->type != IR_TYPE_VOID)
+    {
+        fprintf(fp, "%%%i = ", instruction->id);
+    }
+
+    fprintf(fp, "%s", ir_op_name(instruction->op));
+    if (instruction->type != IR_TYPE_VOID)
+    {
+        fprintf(fp, " %s", ir_type_name(instruction->type));
+    }
+
+    if (instruction->type == IR_TYPE_V128 && (ir_op_is_binary(instruction->op) || ir_op_is_compare(instruction->op)))
+    {
+        // The lanes the operation works on
+        fprintf(fp, " %s", ir_type_name(instruction->mem_type));
+    }
+
+    switch (instruction->op)
+    {
+    case IR_OP_CONST:
+        fprintf(fp, " %li", instruction->value);
+        return;
+
+    case IR_OP_GLOBAL_ADDRESS:
+        fprintf(fp, " @%s", instruction->symbol);
+        if (instruction->value)
+        {
+            fprintf(fp, "%+li", instruction->value);
+        }
+        return;
+
+    case IR_OP_FRAME_ADDRESS:
+    case IR_OP_PARAM:
+        fprintf(fp, " $%i", instruction->slot->id);
+        if (instruction->value)
+        {
+            fprintf(fp, "%+li", instruction->value);
+        }
+        if (instruction->op == IR_OP_PARAM)
+        {
+            fprintf(fp, " %s%s", instruction->flags & IR_INSTRUCTION_FLAG_SIGNED ? "s" : "u", ir_type_name(instruction->mem_type));
+        }
+        return;
+
+    case IR_OP_LOAD:
+    case IR_OP_STORE:
+    case IR_OP_SEXT:
+    case IR_OP_ZEXT:
+    case IR_OP_VECTOR_LOAD:
+    case IR_OP_VECTOR_STORE:
+    case IR_OP_VECTOR_SPLAT:
+        fprintf(fp, " %s", ir_type_name(instruction->mem_type));
+        break;
+
+    case IR_OP_ATOMIC:
+        fprintf(fp, " %s", ir_atomic_names[instruction->value]);
+        break;
+
+    case IR_OP_VECTOR_REDUCE:
+        fprintf(fp, " %s %s", ir_type_name(instruction->mem_type), ir_op_name(instruction->value));
+        break;
+
+    case IR_OP_PHI:
+        for (int i = 0; i < ir_instruction_total_operands(instruction); i++)
+        {
+            fprintf(fp, "%s [", i == 0 ? "" : ",");
+            ir_dump_value(fp, ir_instruction_operand(instruction, i));
+            fprintf(fp, ", block%i]", ir_instruction_target(instruction, i)->id);
+        }
+        return;
+    }
+
+    for (int i = 0; i < ir_instruction_total_operands(instruction); i++)
+    {
+        fprintf(fp, "%s ", i == 0 ? "" : ",");
+        ir_dump_value(fp, ir_instruction_operand(instruction, i));
+    }
+
+    for (int i = 0; i < vector_count(instruction->blocks); i++)
+    {
+        fprintf(fp, "%s block%i", i == 0 && ir_instruction_total_operands(instruction) == 0 ? "" : ",", ir_instruction_target(instruction, i)->id);
+    }
+}
+
+void ir_dump_function(FILE *fp, struct ir_function *function)
+{
+    fprintf(fp, "function %s\n", function->name);
+    for (int i = 0; i < vector_count(function->slots); i++)
+    {
+        struct ir_frame_slot *slot = vector_peek_ptr_at(function->slots, i);
+        fprintf(fp, "  $%i %s size %i offset %i%s\n", slot->id, slot->name, (int)slot->size, slot->offset, slot->flags & IR_FRAME_SLOT_FLAG_IS_ARGUMENT ? " argument" : "");
+    }
+
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        fprintf(fp, "block%i:", block->id);
+        if (vector_count(block->predecessors))
+        {
+            fprintf(fp, " ; preds");
+            for (int b = 0; b < vector_count(block->predecessors); b++)
+            {
+                struct ir_block *pred = vector_peek_ptr_at(block->predecessors, b);
+                fprintf(fp, " block%i", pred->id);
+            }
+        }
+        if (vector_count(block->lines))
+        {
+            fprintf(fp, " ; lines");
+            for (int b = 0; b < vector_count(block->lines); b++)
+            {
+                fprintf(fp, " %i", *(int *)vector_at(block->lines, b));
+            }
+        }
+        if (block->flags & IR_BLOCK_FLAG_COLD)
+        {
+            fprintf(fp, " ; cold");
+        }
+        fprintf(fp, "\n");
+
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            fprintf(fp, "    ");
+            ir_dump_instruction(fp, vector_peek_ptr_at(block->instructions, b));
+            fprintf(fp, "\n");
+        }
+    }
+    fprintf(fp, "\n");
+}
+
+static int ir_verify_error(struct ir_function *function, struct ir_block *block, const char *msg)
+{
+    fprintf(stderr, "IR verification failed in function %s block%i: %s\n", function->name, block->id, msg);
+    return IR_VERIFY_FAILED;
+}
+
+static bool ir_verify_block_in_function(struct ir_function *function, struct ir_block *block)
+{
+    return block && ir_vector_index_of_ptr(function->blocks, block) != -1;
+}
+
+/**
+ * Every value must be defined in a block that dominates its use, for phis the use
+ * happens at the end of the incoming block.
+ */
+static int ir_verify_dominance(struct ir_function *function)
+{
+    int res = IR_VERIFY_ALL_OK;
+    struct ir_dominators *dominators = ir_dominators(function);
+    for (int i = 0; i < vector_count(function->blocks) && res == IR_VERIFY_ALL_OK; i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        for (int b = 0; b < vector_count(block->instructions) && res == IR_VERIFY_ALL_OK; b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            for (int c = 0; c < ir_instruction_total_operands(instruction); c++)
+            {
+                struct ir_instruction *operand = ir_instruction_operand(instruction, c);
+                struct ir_block *use_block = instruction->op == IR_OP_PHI ? ir_instruction_target(instruction, c) : block;
+                if (!ir_block_dominates(dominators, operand->block, use_block))
+                {
+                    res = ir_verify_error(function, block, "operand does not dominate its use");
+                    break;
+                }
+            }
+        }
+    }
+
+    ir_dominators_free(dominators);
+    return res;
+}
+
+int ir_verify_function(struct ir_function *function)
+{
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        int total = vector_count(block->instructions);
+        if (total == 0 || !ir_block_terminator(block))
+            return ir_verify_error(function, block, "block is not terminated");
+
+        bool phis_allowed = true;
+        for (int b = 0; b < total; b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            if (instruction->block != block)
+                return ir_verify_error(function, block, "instruction does not know its block");
+
+            if (ir_op_is_terminator(instruction->op) && b != total - 1)
+                return ir_verify_error(function, block, "terminator in the middle of a block");
+
+            if (instruction->op == IR_OP_PHI)
+            {
+                if (!phis_allowed)
+                    return ir_verify_error(function, block, "phi after a non phi instruction");
+
+                if (ir_instruction_total_operands(instruction) != vector_count(block->predecessors))
+                    return ir_verify_error(function, block, "phi operands do not match the predecessors");
+
+                for (int c = 0; c < vector_count(instruction->blocks); c++)
+                {
+                    if (ir_vector_index_of_ptr(block->predecessors, ir_instruction_target(instruction, c)) == -1)
+                        return ir_verify_error(function, block, "phi incoming block is not a predecessor");
+                }
+            }
+            else
+            {
+                phis_allowed = false;
+            }
+
+            for (int c = 0; c < ir_instruction_total_operands(instruction); c++)
+            {
+                struct ir_instruction *operand = ir_instruction_operand(instruction, c);
+                if (!operand || operand->type == IR_TYPE_VOID)
+                    return ir_verify_error(function, block, "operand does not produce a value");
+
+                if (!ir_verify_block_in_function(function, operand->block))
+                    return ir_verify_error(function, block, "operand is not defined in this function");
+
+                // Values from the same block must be defined before they are used.
+                if (instruction->op != IR_OP_PHI && operand->block == block &&
+                    ir_vector_index_of_ptr(block->instructions, operand) > b)
+                    return ir_verify_error(function, block, "operand used before its definition");
+            }
+
+            if (ir_op_is_terminator(instruction->op))
+            {
+                for (int c = 0; c < vector_count(instruction->blocks); c++)
+                {
+                    struct ir_block *target = ir_instruction_target(instruction, c);
+                    if (!ir_verify_block_in_function(function, target))
+                        return ir_verify_error(function, block, "jump to a block outside of the function");
+
+                    if (ir_vector_index_of_ptr(target->predecessors, block) == -1)
+                        return ir_verify_error(function, block, "successor does not list this block as a predecessor");
+                }
+            }
+        }
+
+        for (int b = 0; b < vector_count(block->predecessors); b++)
+        {
+            struct ir_block *pred = vector_peek_ptr_at(block->predecessors, b);
+            if (!ir_verify_block_in_function(function, pred))
+                return ir_verify_error(function, block, "predecessor is not in this function");
+
+            struct ir_instruction *terminator = ir_block_terminator(pred);
+            if (ir_vector_index_of_ptr(terminator->blocks, block) == -1)
+                return ir_verify_error(function, block, "predecessor does not jump to this block");
+        }
+    }
+
+    return ir_verify_dominance(function);
+}
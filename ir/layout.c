@@ -0,0 +1,253 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Block layout, the order the blocks are generated in. A branch to the block that follows it
+ * costs nothing, so blocks are chained starting from the entry block by always placing the
+ * likely successor of the last block next. With a profile the successor that ran most often is
+ * likely, otherwise branches that stay inside the innermost loop are assumed to be taken over
+ * branches that leave it.
+ *
+ * Blocks that can only end in a call to a function that never returns are cold, they are placed
+ * after everything else and generated in the unlikely executed text section so the hot code stays
+ * together in the instruction cache. Blocks predicted not to run i.e error paths never fall through
+ * from a branch, they are placed after the likely blocks.
+ */
+
+static bool ir_layout_is_noreturn_call(struct ir_instruction *instruction)
+{
+    if (instruction->op != IR_OP_CALL)
+        return false;
+
+    struct ir_instruction *callee = ir_instruction_operand(instruction, 0);
+    return callee->op == IR_OP_GLOBAL_ADDRESS && callee->value == 0 && predict_function_is_noreturn(callee->symbol);
+}
+
+static bool ir_layout_calls_noreturn(struct ir_block *block)
+{
+    for (int i = 0; i < vector_count(block->instructions); i++)
+    {
+        if (ir_layout_is_noreturn_call(vector_peek_ptr_at(block->instructions, i)))
+            return true;
+    }
+
+    return false;
+}
+
+static bool ir_layout_successors_are_cold(struct ir_block *block)
+{
+    int total_successors = ir_block_total_successors(block);
+    for (int i = 0; i < total_successors; i++)
+    {
+        if (!(ir_block_successor(block, i)->flags & IR_BLOCK_FLAG_COLD))
+            return false;
+    }
+
+    return total_successors != 0;
+}
+
+/**
+ * Marks the blocks that call a function that never returns and the blocks that can only reach them
+ */
+static void ir_layout_mark_cold(struct ir_function *function)
+{
+    struct ir_block *entry = vector_peek_ptr_at(function->blocks, 0);
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        if (block != entry && ir_layout_calls_noreturn(block))
+        {
+            block->flags |= IR_BLOCK_FLAG_COLD;
+        }
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = vector_count(function->blocks) - 1; i >= 1; i--)
+        {
+            struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+            if (!(block->flags & IR_BLOCK_FLAG_COLD) && ir_layout_successors_are_cold(block))
+            {
+                block->flags |= IR_BLOCK_FLAG_COLD;
+                changed = true;
+            }
+        }
+    }
+}
+
+/**
+ * Blocks only reached from unlikely blocks are unlikely as well
+ */
+static void ir_layout_mark_unlikely(struct ir_function *function)
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 1; i < vector_count(function->blocks); i++)
+        {
+            struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+            if (block->flags & IR_BLOCK_FLAG_UNLIKELY || vector_count(block->predecessors) == 0)
+                continue;
+
+            bool unlikely = true;
+            for (int p = 0; p < vector_count(block->predecessors) && unlikely; p++)
+            {
+                struct ir_block *predecessor = vector_peek_ptr_at(block->predecessors, p);
+                unlikely = predecessor->flags & (IR_BLOCK_FLAG_UNLIKELY | IR_BLOCK_FLAG_COLD);
+            }
+
+            if (unlikely)
+            {
+                block->flags |= IR_BLOCK_FLAG_UNLIKELY;
+                changed = true;
+            }
+        }
+    }
+}
+
+/**
+ * Returns the innermost loop of every block indexed by block index, NULL for blocks outside of loops
+ */
+static struct ir_loop **ir_layout_innermost_loops(struct ir_function *function, struct vector *loops)
+{
+    struct ir_loop **innermost = calloc(vector_count(function->blocks) + 1, sizeof(struct ir_loop *));
+    for (int i = 0; i < vector_count(loops); i++)
+    {
+        struct ir_loop *loop = vector_peek_ptr_at(loops, i);
+        loop->header->flags |= IR_BLOCK_FLAG_LOOP_HEADER;
+        for (int b = 0; b < vector_count(loop->blocks); b++)
+        {
+            struct ir_block *block = vector_peek_ptr_at(loop->blocks, b);
+            // Inner loops come first
+            if (!innermost[block->index])
+            {
+                innermost[block->index] = loop;
+            }
+        }
+    }
+
+    return innermost;
+}
+
+static bool ir_layout_is_more_likely(struct ir_block *successor, bool stays, struct ir_block *best, bool best_stays)
+{
+    if (!best)
+        return true;
+
+    // The counts of a profiled function decide before any guess
+    if (successor->function->profiled && successor->count != best->count)
+        return successor->count > best->count;
+
+    if (stays != best_stays)
+        return stays;
+
+    return successor->index < best->index;
+}
+
+/**
+ * Returns the successor that should follow the block, NULL if every successor is placed or cold
+ */
+static struct ir_block *ir_layout_likely_successor(struct ir_block *block, struct ir_loop **innermost, bool *placed)
+{
+    struct ir_loop *loop = innermost[block->index];
+    struct ir_block *best = NULL;
+    bool best_stays = false;
+    for (int i = 0; i < ir_block_total_successors(block); i++)
+    {
+        struct ir_block *successor = ir_block_successor(block, i);
+        if (placed[successor->index] || successor->flags & IR_BLOCK_FLAG_COLD)
+            continue;
+
+        // A branch to an unlikely block is kept taken, it only follows a block that always goes there
+        if (successor->flags & IR_BLOCK_FLAG_UNLIKELY && !(block->flags & IR_BLOCK_FLAG_UNLIKELY) && ir_block_total_successors(block) > 1)
+            continue;
+
+        bool stays = loop && loop->contains[successor->index];
+        if (ir_layout_is_more_likely(successor, stays, best, best_stays))
+        {
+            best = successor;
+            best_stays = stays;
+        }
+    }
+
+    return best;
+}
+
+static struct ir_block *ir_layout_next_unplaced(struct ir_function *function, bool *placed, int skip_flags)
+{
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        if (!placed[block->index] && !(block->flags & skip_flags))
+            return block;
+    }
+
+    return NULL;
+}
+
+int ir_layout_blocks(struct compile_process *process, struct ir_function *function)
+{
+    if (vector_count(function->blocks) == 0)
+        return 0;
+
+    ir_function_number_blocks(function);
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        block->flags &= ~IR_BLOCK_FLAG_LOOP_HEADER;
+    }
+
+    ir_layout_mark_cold(function);
+    ir_layout_mark_unlikely(function);
+    struct ir_dominators *dominators = ir_dominators(function);
+    struct vector *loops = ir_find_loops(function, dominators);
+    struct ir_loop **innermost = ir_layout_innermost_loops(function, loops);
+
+    struct vector *order = vector_create(sizeof(struct ir_block *));
+    bool *placed = calloc(vector_count(function->blocks), sizeof(bool));
+    int total_unlikely = 0;
+    struct ir_block *block = vector_peek_ptr_at(function->blocks, 0);
+    while (block)
+    {
+        placed[block->index] = true;
+        vector_push(order, &block);
+        block = ir_layout_likely_successor(block, innermost, placed);
+        if (!block)
+        {
+            block = ir_layout_next_unplaced(function, placed, IR_BLOCK_FLAG_COLD | IR_BLOCK_FLAG_UNLIKELY);
+        }
+        if (!block)
+        {
+            block = ir_layout_next_unplaced(function, placed, IR_BLOCK_FLAG_COLD);
+            total_unlikely += block != NULL;
+        }
+    }
+
+    int total_cold = 0;
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *cold = vector_peek_ptr_at(function->blocks, i);
+        if (!placed[cold->index])
+        {
+            vector_push(order, &cold);
+            total_cold++;
+        }
+    }
+
+    vector_free(function->blocks);
+    function->blocks = order;
+    ir_function_number_blocks(function);
+
+    free(placed);
+    free(innermost);
+    ir_free_loops(loops);
+    ir_dominators_free(dominators);
+    process->statistics.cold_blocks += total_cold;
+    process->statistics.unlikely_paths += total_unlikely;
+    return total_cold;
+}
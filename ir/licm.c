@@ -0,0 +1,125 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+/**
+ * Loop invariant code motion. Every loop is given a preheader, a block that is the only way
+ * into the loop from outside, and computations that give the same value on every iteration
+ * are moved into it.
+ */
+
+static bool ir_loop_clobbers_memory(struct ir_loop *loop)
+{
+    for (int i = 0; i < vector_count(loop->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(loop->blocks, i);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            if (instruction->op == IR_OP_STORE || instruction->op == IR_OP_VECTOR_STORE || instruction->op == IR_OP_CALL ||
+                instruction->flags & IR_INSTRUCTION_FLAG_VOLATILE)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Returns true if the block runs on every iteration that leaves the loop
+ */
+static bool ir_loop_block_always_runs(struct ir_loop *loop, struct ir_dominators *dominators, struct ir_block *block)
+{
+    for (int i = 0; i < vector_count(loop->blocks); i++)
+    {
+        struct ir_block *exiting = vector_peek_ptr_at(loop->blocks, i);
+        for (int b = 0; b < ir_block_total_successors(exiting); b++)
+        {
+            if (!loop->contains[ir_block_successor(exiting, b)->index] && !ir_block_dominates(dominators, block, exiting))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static bool ir_loop_is_invariant(struct ir_loop *loop, struct ir_dominators *dominators, struct ir_instruction *instruction, bool clobbers_memory)
+{
+    if (instruction->op == IR_OP_PHI || instruction->type == IR_TYPE_VOID || ir_instruction_has_side_effects(instruction))
+        return false;
+
+    for (int i = 0; i < ir_instruction_total_operands(instruction); i++)
+    {
+        if (loop->contains[ir_instruction_operand(instruction, i)->block->index])
+            return false;
+    }
+
+    if (instruction->op != IR_OP_LOAD && instruction->op != IR_OP_VECTOR_LOAD)
+        return true;
+
+    if (clobbers_memory)
+        return false;
+
+    // Global and frame addresses are always valid, other loads could fault if the loop would not have reached them
+    int address_op = ir_instruction_operand(instruction, 0)->op;
+    return address_op == IR_OP_GLOBAL_ADDRESS || address_op == IR_OP_FRAME_ADDRESS ||
+           ir_loop_block_always_runs(loop, dominators, instruction->block);
+}
+
+static int ir_loop_hoist(struct compile_process *process, struct ir_function *function, struct ir_loop *loop, struct ir_dominators *dominators)
+{
+    struct ir_block *preheader = ir_loop_preheader(loop);
+    bool clobbers_memory = ir_loop_clobbers_memory(loop);
+    int total_hoisted = 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 0; i < vector_count(loop->blocks); i++)
+        {
+            struct ir_block *block = vector_peek_ptr_at(loop->blocks, i);
+            for (int b = 0; b < vector_count(block->instructions); b++)
+            {
+                struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+                if (!ir_loop_is_invariant(loop, dominators, instruction, clobbers_memory))
+                    continue;
+
+                ir_block_remove_instruction(block, instruction);
+                ir_block_insert_before_terminator(preheader, instruction);
+                b--;
+                changed = true;
+
+                // Constants and addresses are free to rebuild, moving them is not worth reporting
+                if (instruction->op == IR_OP_CONST || instruction->op == IR_OP_GLOBAL_ADDRESS || instruction->op == IR_OP_FRAME_ADDRESS)
+                    continue;
+
+                total_hoisted++;
+                if (process->flags & COMPILE_PROCESS_PRINT_STATISTICS)
+                {
+                    printf("%s: hoisted %%%i = %s out of the loop at block%i\n", function->name, instruction->id, ir_op_name(instruction->op), loop->header->id);
+                }
+            }
+        }
+    }
+
+    return total_hoisted;
+}
+
+int ir_hoist_loop_invariants(struct compile_process *process, struct ir_function *function)
+{
+    if (vector_count(function->blocks) == 0)
+        return 0;
+
+    struct ir_dominators *dominators = NULL;
+    struct vector *loops = ir_function_loops(function, &dominators);
+    int total_hoisted = 0;
+    for (int i = 0; i < vector_count(loops); i++)
+    {
+        total_hoisted += ir_loop_hoist(process, function, vector_peek_ptr_at(loops, i), dominators);
+    }
+
+    ir_free_loops(loops);
+    ir_dominators_free(dominators);
+    process->statistics.hoisted_instructions += total_hoisted;
+    return total_hoisted;
+}
@@ -0,0 +1,204 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+/**
+ * Natural loops of the IR. Loops are found from their back edges, an edge to a block that
+ * dominates the block the edge comes from.
+ */
+
+
+static void ir_loop_add_block(struct ir_loop *loop, struct ir_block *block)
+{
+    if (loop->contains[block->index])
+        return;
+
+    loop->contains[block->index] = true;
+    vector_push(loop->blocks, &block);
+
+    // Walk backwards from the latch, everything that reaches it without passing through the header is in the loop
+    for (int i = 0; i < vector_count(block->predecessors); i++)
+    {
+        ir_loop_add_block(loop, vector_peek_ptr_at(block->predecessors, i));
+    }
+}
+
+static struct ir_loop *ir_loop_for_header(struct vector *loops, struct ir_function *function, struct ir_block *header)
+{
+    for (int i = 0; i < vector_count(loops); i++)
+    {
+        struct ir_loop *loop = vector_peek_ptr_at(loops, i);
+        if (loop->header == header)
+            return loop;
+    }
+
+    struct ir_loop *loop = calloc(1, sizeof(struct ir_loop));
+    loop->header = header;
+    loop->blocks = vector_create(sizeof(struct ir_block *));
+    loop->contains = calloc(vector_count(function->blocks), sizeof(bool));
+    loop->contains[header->index] = true;
+    vector_push(loop->blocks, &header);
+    vector_push(loops, &loop);
+    return loop;
+}
+
+struct vector *ir_find_loops(struct ir_function *function, struct ir_dominators *dominators)
+{
+    struct vector *loops = vector_create(sizeof(struct ir_loop *));
+    struct vector *order = ir_function_reverse_post_order(function);
+    for (int i = 0; i < vector_count(order); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(order, i);
+        for (int b = 0; b < ir_block_total_successors(block); b++)
+        {
+            struct ir_block *successor = ir_block_successor(block, b);
+            if (!ir_block_dominates(dominators, successor, block))
+                continue;
+
+            ir_loop_add_block(ir_loop_for_header(loops, function, successor), block);
+        }
+    }
+    vector_free(order);
+
+    // An inner loop always has fewer blocks than the loop around it
+    for (int i = 1; i < vector_count(loops); i++)
+    {
+        for (int b = i; b > 0; b--)
+        {
+            struct ir_loop **a = vector_at(loops, b - 1);
+            struct ir_loop **c = vector_at(loops, b);
+            if (vector_count((*a)->blocks) <= vector_count((*c)->blocks))
+                break;
+
+            struct ir_loop *tmp = *a;
+            *a = *c;
+            *c = tmp;
+        }
+    }
+
+    return loops;
+}
+
+void ir_free_loops(struct vector *loops)
+{
+    for (int i = 0; i < vector_count(loops); i++)
+    {
+        struct ir_loop *loop = vector_peek_ptr_at(loops, i);
+        vector_free(loop->blocks);
+        free(loop->contains);
+        free(loop);
+    }
+    vector_free(loops);
+}
+
+struct ir_block *ir_loop_preheader(struct ir_loop *loop)
+{
+    struct ir_block *preheader = NULL;
+    struct vector *predecessors = loop->header->predecessors;
+    for (int i = 0; i < vector_count(predecessors); i++)
+    {
+        struct ir_block *predecessor = vector_peek_ptr_at(predecessors, i);
+        if (loop->contains[predecessor->index])
+            continue;
+
+        if (preheader)
+            return NULL;
+        preheader = predecessor;
+    }
+
+    if (!preheader || ir_block_total_successors(preheader) != 1)
+        return NULL;
+
+    return preheader;
+}
+
+/**
+ * Gives the loop a preheader by sending every edge from outside the loop through a new block.
+ * Phis in the header that merge values from outside the loop are split so the new block merges them.
+ */
+static void ir_loop_create_preheader(struct ir_function *function, struct ir_loop *loop)
+{
+    struct ir_block *header = loop->header;
+    struct vector *outside = vector_create(sizeof(struct ir_block *));
+    for (int i = 0; i < vector_count(header->predecessors); i++)
+    {
+        struct ir_block *predecessor = vector_peek_ptr_at(header->predecessors, i);
+        if (!loop->contains[predecessor->index])
+        {
+            vector_push(outside, &predecessor);
+        }
+    }
+
+    struct ir_block *preheader = ir_block_create(function);
+    ir_function_move_block_before(function, preheader, header);
+    for (int i = 0; i < vector_count(outside); i++)
+    {
+        // A predecessor that branches elsewhere too ran at least as often as it entered the loop
+        struct ir_block *predecessor = vector_peek_ptr_at(outside, i);
+        long entries = predecessor->count;
+        if (ir_block_total_successors(predecessor) > 1 && header->count < entries)
+        {
+            entries = header->count;
+        }
+        preheader->count += entries;
+    }
+
+    for (int i = 0; i < vector_count(header->instructions); i++)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(header->instructions, i);
+        if (phi->op != IR_OP_PHI)
+            break;
+
+        struct ir_instruction *merged = ir_instruction_create(function, IR_OP_PHI, phi->type);
+        for (int b = 0; b < vector_count(outside); b++)
+        {
+            struct ir_block *predecessor = vector_peek_ptr_at(outside, b);
+            ir_phi_add_incoming(merged, ir_phi_incoming_for_block(phi, predecessor), predecessor);
+            ir_phi_remove_incoming(phi, predecessor);
+        }
+        ir_block_append(preheader, merged);
+        ir_phi_add_incoming(phi, merged, preheader);
+    }
+
+    for (int i = 0; i < vector_count(outside); i++)
+    {
+        ir_block_replace_successor(vector_peek_ptr_at(outside, i), header, preheader);
+    }
+
+    struct ir_instruction *jump = ir_instruction_create(function, IR_OP_JUMP, IR_TYPE_VOID);
+    vector_push(jump->blocks, &header);
+    ir_block_append(preheader, jump);
+    ir_block_add_predecessor(header, preheader);
+    vector_free(outside);
+}
+
+struct vector *ir_function_loops(struct ir_function *function, struct ir_dominators **dominators_out)
+{
+    struct ir_dominators *dominators = ir_dominators(function);
+    struct vector *loops = ir_find_loops(function, dominators);
+    bool created_preheaders = false;
+    for (int i = 0; i < vector_count(loops); i++)
+    {
+        struct ir_loop *loop = vector_peek_ptr_at(loops, i);
+        if (!ir_loop_preheader(loop))
+        {
+            ir_loop_create_preheader(function, loop);
+            created_preheaders = true;
+        }
+    }
+
+    if (created_preheaders)
+    {
+        // Header phis with a single value from outside the loop leave trivial phis in the preheader
+        ir_function_remove_trivial_phis(function);
+
+        // The new blocks belong to the loops around them, find everything again
+        ir_free_loops(loops);
+        ir_dominators_free(dominators);
+        dominators = ir_dominators(function);
+        loops = ir_find_loops(function, dominators);
+    }
+
+    *dominators_out = dominators;
+    return loops;
+}
@@ -0,0 +1,2493 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Lowers the AST of a function into the intermediate representation.
+ *
+ * SSA form is constructed whilst lowering using the algorithm described in
+ * "Simple and Efficient Construction of Static Single Assignment Form" (Braun et al).
+ * Every block remembers the current value of each variable written inside of it, reading a variable
+ * walks up the predecessors creating phi instructions where control flow joins. Blocks whose
+ * predecessors are not all known yet (loop headers, labels, switch cases) are "unsealed", phis created
+ * in them are completed once the block is sealed.
+ *
+ * Anything the IR does not support sets the failed flag, the function will then be generated
+ * by the AST code generator instead.
+ */
+
+struct ir_value
+{
+    struct ir_instruction *ins;
+    struct datatype dtype;
+};
+
+enum
+{
+    // The lvalue is a local variable that has been promoted into virtual registers
+    IR_LVALUE_TYPE_VARIABLE,
+    // The lvalue lives in memory at "address"
+    IR_LVALUE_TYPE_MEMORY
+};
+
+struct ir_lvalue
+{
+    int type;
+    struct node *var_node;
+    struct ir_instruction *address;
+    struct datatype dtype;
+
+    // How many array brackets have been indexed so far, i.e int a[5][5]; a[2] has an index of 1
+    int array_index;
+};
+
+struct ir_memory_variable
+{
+    struct node *var_node;
+    struct ir_frame_slot *slot;
+};
+
+struct ir_label
+{
+    const char *name;
+    struct ir_block *block;
+};
+
+struct ir_switch_case
+{
+    long value;
+    struct ir_block *block;
+};
+
+struct ir_access_part
+{
+    // The operator that leads to this part, NULL for the first part
+    const char *op;
+    struct node *node;
+};
+
+static struct ir_lower
+{
+    struct compile_process *process;
+    struct ir_function *function;
+
+    // The block instructions are currently written to, NULL when the current position
+    // cannot be reached i.e after a return statement
+    struct ir_block *block;
+
+    // Vector of struct vector* each holding struct node* variables declared in the scope
+    struct vector *scopes;
+
+    // Vector of struct ir_memory_variable
+    struct vector *memory_variables;
+
+    // Vector of const char*, names of variables that have their address taken.
+    struct vector *address_taken;
+
+    // Vector of struct ir_block* for break and continue statements
+    struct vector *break_blocks;
+    struct vector *continue_blocks;
+
+    // Vector of struct ir_label
+    struct vector *labels;
+
+    // Vector of struct ir_switch_case for the switch statement being lowered, NULL if we are not in a switch
+    struct vector *switch_cases;
+    struct ir_block *switch_default;
+
+    // Vector of struct ir_block* in the order they were started, used for the final block layout
+    struct vector *block_order;
+
+    // Set when an expression is a statement of its own and its result is never used.
+    bool discard_result;
+
+    // The source line of the code being lowered, added to the lines of the blocks it is lowered into
+    int line;
+
+    bool failed;
+} lower;
+
+static struct ir_value lower_rvalue(struct node *node);
+static bool lower_lvalue(struct node *node, struct ir_lvalue *lvalue_out);
+static void lower_statement(struct node *node);
+
+static struct ir_value lower_fail()
+{
+    lower.failed = true;
+    struct ir_value value = {};
+    value.ins = ir_instruction_create(lower.function, IR_OP_UNDEF, IR_TYPE_I32);
+    value.dtype = datatype_for_numeric();
+    return value;
+}
+
+static void lower_set_block(struct ir_block *block)
+{
+    lower.block = block;
+    for (int i = 0; i < vector_count(lower.block_order); i++)
+    {
+        if (vector_peek_ptr_at(lower.block_order, i) == block)
+            return;
+    }
+
+    vector_push(lower.block_order, &block);
+}
+
+static struct ir_block *lower_current_block()
+{
+    if (!lower.block)
+    {
+        // Code after a return, break or goto can never be reached but it still
+        // needs somewhere to live, it will be removed later.
+        struct ir_block *block = ir_block_create(lower.function);
+        block->ssa.sealed = true;
+        lower_set_block(block);
+    }
+
+    return lower.block;
+}
+
+static struct ir_instruction *lower_emit(int op, int type)
+{
+    struct ir_instruction *instruction = ir_instruction_create(lower.function, op, type);
+    ir_block_append(lower_current_block(), instruction);
+    // Jumps and branches belong to the code that chose where to go, not to the line that was lowered last
+    if (lower.line > 0 && op != IR_OP_JUMP && op != IR_OP_BRANCH)
+    {
+        ir_block_add_line(lower.block, lower.line);
+    }
+    return instruction;
+}
+
+static struct ir_instruction *lower_emit_unary(int op, int type, struct ir_instruction *operand)
+{
+    struct ir_instruction *instruction = lower_emit(op, type);
+    ir_instruction_add_operand(instruction, operand);
+    return instruction;
+}
+
+static struct ir_instruction *lower_emit_binary(int op, int type, struct ir_instruction *left, struct ir_instruction *right)
+{
+    struct ir_instruction *instruction = lower_emit(op, type);
+    ir_instruction_add_operand(instruction, left);
+    ir_instruction_add_operand(instruction, right);
+    return instruction;
+}
+
+static struct ir_instruction *lower_const(long value)
+{
+    struct ir_instruction *instruction = lower_emit(IR_OP_CONST, IR_TYPE_I32);
+    instruction->value = value;
+    return instruction;
+}
+
+static void lower_jump(struct ir_block *target)
+{
+    if (!lower.block)
+        return;
+
+    struct ir_instruction *instruction = lower_emit(IR_OP_JUMP, IR_TYPE_VOID);
+    vector_push(instruction->blocks, &target);
+    ir_block_add_predecessor(target, lower.block);
+    lower.block = NULL;
+}
+
+static void lower_branch(struct ir_instruction *cond, struct ir_block *true_block, struct ir_block *false_block)
+{
+    if (true_block == false_block)
+    {
+        lower_jump(true_block);
+        return;
+    }
+
+    struct ir_block *block = lower_current_block();
+    struct ir_instruction *instruction = lower_emit(IR_OP_BRANCH, IR_TYPE_VOID);
+    ir_instruction_add_operand(instruction, cond);
+    vector_push(instruction->blocks, &true_block);
+    vector_push(instruction->blocks, &false_block);
+    ir_block_add_predecessor(true_block, block);
+    ir_block_add_predecessor(false_block, block);
+    lower.block = NULL;
+}
+
+static bool lower_datatype_is_pointer(struct datatype *dtype)
+{
+    return dtype->flags & DATATYPE_FLAG_IS_POINTER && dtype->pointer_depth > 0;
+}
+
+static bool lower_datatype_is_signed(struct datatype *dtype)
+{
+    return !lower_datatype_is_pointer(dtype) && dtype->flags & DATATYPE_FLAG_IS_SIGNED;
+}
+
+static bool lower_datatype_is_array(struct datatype *dtype, int array_index)
+{
+    return dtype->flags & DATATYPE_FLAG_IS_ARRAY && array_index < array_total_indexes(dtype);
+}
+
+static bool lower_datatype_is_struct_value(struct datatype *dtype)
+{
+    return datatype_is_struct_or_union(dtype) && !lower_datatype_is_pointer(dtype);
+}
+
+static bool lower_datatype_is_float(struct datatype *dtype)
+{
+    return !lower_datatype_is_pointer(dtype) && (dtype->type == DATA_TYPE_FLOAT || dtype->type == DATA_TYPE_DOUBLE);
+}
+
+static int lower_value_type(struct datatype *dtype)
+{
+    return lower_datatype_is_pointer(dtype) ? IR_TYPE_PTR : IR_TYPE_I32;
+}
+
+/**
+ * Returns the IR type used to access the datatype in memory, or IR_TYPE_VOID
+ * if the datatype cannot be held in a register.
+ */
+static int lower_mem_type(struct datatype *dtype)
+{
+    if (lower_datatype_is_pointer(dtype))
+        return IR_TYPE_PTR;
+
+    if (lower_datatype_is_struct_value(dtype) || lower_datatype_is_float(dtype))
+        return IR_TYPE_VOID;
+
+    switch (dtype->size)
+    {
+    case DATA_SIZE_BYTE:
+        return IR_TYPE_I8;
+    case DATA_SIZE_WORD:
+        return IR_TYPE_I16;
+    case DATA_SIZE_DWORD:
+        return IR_TYPE_I32;
+    }
+
+    return IR_TYPE_VOID;
+}
+
+static size_t lower_pointee_size(struct datatype *dtype)
+{
+    struct datatype *pointee = datatype_pointer_reduce(dtype, 1);
+    size_t size = datatype_size(pointee);
+    free(pointee);
+
+    // Arithmetic on void pointers moves one byte at a time
+    return size ? size : 1;
+}
+
+static struct datatype lower_datatype_address_of(struct datatype *dtype)
+{
+    struct datatype result = *dtype;
+    result.flags &= ~DATATYPE_FLAG_IS_ARRAY;
+    result.flags |= DATATYPE_FLAG_IS_POINTER;
+    result.pointer_depth++;
+    return result;
+}
+
+static struct datatype lower_datatype_void_pointer()
+{
+    struct datatype dtype = {};
+    datatype_set_void(&dtype);
+    dtype.pointer_depth++;
+    dtype.flags |= DATATYPE_FLAG_IS_POINTER;
+    return dtype;
+}
+
+static struct datatype lower_datatype_array_element(struct datatype *dtype)
+{
+    struct datatype result = *dtype;
+    result.flags &= ~DATATYPE_FLAG_IS_ARRAY;
+    result.array.size = result.size;
+    return result;
+}
+
+static bool lower_array_stride(struct datatype *dtype, int index, size_t *stride_out)
+{
+    size_t stride = (dtype->flags & DATATYPE_FLAG_IS_POINTER) ? datatype_pointer_size() : dtype->size;
+    struct vector *brackets = dtype->array.brackets->n_brackets;
+    for (int i = index + 1; i < vector_count(brackets); i++)
+    {
+        struct node *bracket_node = vector_peek_ptr_at(brackets, i);
+        if (bracket_node->bracket.inner->type != NODE_TYPE_NUMBER)
+            return false;
+
+        stride *= bracket_node->bracket.inner->llnum;
+    }
+
+    *stride_out = stride;
+    return true;
+}
+
+static struct ir_instruction *lower_convert(struct ir_instruction *value, struct datatype *dtype)
+{
+    int mem_type = lower_mem_type(dtype);
+    if (lower_datatype_is_pointer(dtype) || mem_type == IR_TYPE_I32 || mem_type == IR_TYPE_VOID)
+        return value;
+
+    bool is_signed = lower_datatype_is_signed(dtype);
+    if (value->op == IR_OP_CONST)
+    {
+        long result = value->value;
+        if (mem_type == IR_TYPE_I8)
+            result = is_signed ? (long)(signed char)result : (long)(unsigned char)result;
+        else
+            result = is_signed ? (long)(short)result : (long)(unsigned short)result;
+        return lower_const(result);
+    }
+
+    struct ir_instruction *instruction = lower_emit_unary(is_signed ? IR_OP_SEXT : IR_OP_ZEXT, IR_TYPE_I32, value);
+    instruction->mem_type = mem_type;
+    return instruction;
+}
+
+static void lower_write_variable(struct node *var_node, struct ir_block *block, struct ir_instruction *value)
+{
+    for (int i = 0; i < vector_count(block->ssa.definitions); i++)
+    {
+        struct ir_variable_definition *definition = vector_at(block->ssa.definitions, i);
+        if (definition->var_node == var_node)
+        {
+            definition->value = value;
+            return;
+        }
+    }
+
+    struct ir_variable_definition definition = {.var_node = var_node, .value = value};
+    vector_push(block->ssa.definitions, &definition);
+}
+
+static struct ir_instruction *lower_read_variable(struct node *var_node, struct ir_block *block);
+
+static struct ir_instruction *lower_add_phi_operands(struct node *var_node, struct ir_instruction *phi)
+{
+    struct ir_block *block = phi->block;
+    for (int i = 0; i < vector_count(block->predecessors); i++)
+    {
+        struct ir_block *pred = vector_peek_ptr_at(block->predecessors, i);
+        ir_phi_add_incoming(phi, lower_read_variable(var_node, pred), pred);
+    }
+
+    return phi;
+}
+
+static struct ir_instruction *lower_new_phi(struct node *var_node, struct ir_block *block)
+{
+    struct ir_instruction *phi = ir_instruction_create(lower.function, IR_OP_PHI, lower_value_type(&var_node->var.type));
+    phi->node = var_node;
+    ir_block_prepend(block, phi);
+    return phi;
+}
+
+static struct ir_instruction *lower_read_variable_recursive(struct node *var_node, struct ir_block *block)
+{
+    struct ir_instruction *value = NULL;
+    if (!block->ssa.sealed)
+    {
+        // We don't know all the predecessors yet, the phi is completed when the block is sealed
+        value = lower_new_phi(var_node, block);
+        struct ir_variable_definition incomplete = {.var_node = var_node, .value = value};
+        vector_push(block->ssa.incomplete_phis, &incomplete);
+    }
+    else if (vector_count(block->predecessors) == 0)
+    {
+        // Read before ever being written to.
+        value = ir_instruction_create(lower.function, IR_OP_UNDEF, lower_value_type(&var_node->var.type));
+        ir_block_prepend(block, value);
+    }
+    else if (vector_count(block->predecessors) == 1)
+    {
+        value = lower_read_variable(var_node, vector_peek_ptr_at(block->predecessors, 0));
+    }
+    else
+    {
+        // Write the phi first to break cycles through loops
+        value = lower_new_phi(var_node, block);
+        lower_write_variable(var_node, block, value);
+        lower_add_phi_operands(var_node, value);
+    }
+
+    lower_write_variable(var_node, block, value);
+    return value;
+}
+
+static struct ir_instruction *lower_read_variable(struct node *var_node, struct ir_block *block)
+{
+    for (int i = 0; i < vector_count(block->ssa.definitions); i++)
+    {
+        struct ir_variable_definition *definition = vector_at(block->ssa.definitions, i);
+        if (definition->var_node == var_node)
+            return definition->value;
+    }
+
+    return lower_read_variable_recursive(var_node, block);
+}
+
+static void lower_seal_block(struct ir_block *block)
+{
+    if (block->ssa.sealed)
+        return;
+
+    for (int i = 0; i < vector_count(block->ssa.incomplete_phis); i++)
+    {
+        struct ir_variable_definition *incomplete = vector_at(block->ssa.incomplete_phis, i);
+        lower_add_phi_operands(incomplete->var_node, incomplete->value);
+    }
+    vector_clear(block->ssa.incomplete_phis);
+    block->ssa.sealed = true;
+}
+
+static void lower_scope_new()
+{
+    struct vector *scope = vector_create(sizeof(struct node *));
+    vector_push(lower.scopes, &scope);
+}
+
+static void lower_scope_finish()
+{
+    struct vector *scope = vector_back_ptr(lower.scopes);
+    vector_free(scope);
+    vector_pop(lower.scopes);
+}
+
+static void lower_scope_push_variable(struct node *var_node)
+{
+    struct vector *scope = vector_back_ptr(lower.scopes);
+    vector_push(scope, &var_node);
+}
+
+static struct node *lower_scope_find_variable(const char *name)
+{
+    for (int i = vector_count(lower.scopes) - 1; i >= 0; i--)
+    {
+        struct vector *scope = vector_peek_ptr_at(lower.scopes, i);
+        for (int b = vector_count(scope) - 1; b >= 0; b--)
+        {
+            struct node *var_node = vector_peek_ptr_at(scope, b);
+            if (S_EQ(var_node->var.name, name))
+                return var_node;
+        }
+    }
+
+    return NULL;
+}
+
+static bool lower_variable_is_address_taken(struct node *var_node)
+{
+    for (int i = 0; i < vector_count(lower.address_taken); i++)
+    {
+        const char *name = vector_peek_ptr_at(lower.address_taken, i);
+        if (S_EQ(name, var_node->var.name))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * Returns true if the variable must live on the stack frame rather than in virtual registers
+ */
+static bool lower_variable_in_memory(struct node *var_node)
+{
+    struct datatype *dtype = &var_node->var.type;
+    return dtype->flags & DATATYPE_FLAG_IS_ARRAY ||
+           lower_mem_type(dtype) == IR_TYPE_VOID ||
+           lower_variable_is_address_taken(var_node);
+}
+
+static struct ir_frame_slot *lower_memory_variable_slot(struct node *var_node, int flags)
+{
+    for (int i = 0; i < vector_count(lower.memory_variables); i++)
+    {
+        struct ir_memory_variable *variable = vector_at(lower.memory_variables, i);
+        if (variable->var_node == var_node)
+            return variable->slot;
+    }
+
+    struct ir_memory_variable variable;
+    variable.var_node = var_node;
+    variable.slot = ir_frame_slot_create(lower.function, var_node->var.name, variable_size(var_node), var_node->var.aoffset, flags);
+    vector_push(lower.memory_variables, &variable);
+    return variable.slot;
+}
+
+static struct ir_instruction *lower_frame_address(struct ir_frame_slot *slot)
+{
+    struct ir_instruction *instruction = lower_emit(IR_OP_FRAME_ADDRESS, IR_TYPE_PTR);
+    instruction->slot = slot;
+    return instruction;
+}
+
+static struct ir_instruction *lower_global_address(const char *symbol)
+{
+    struct ir_instruction *instruction = lower_emit(IR_OP_GLOBAL_ADDRESS, IR_TYPE_PTR);
+    instruction->symbol = symbol;
+    return instruction;
+}
+
+static struct ir_instruction *lower_address_offset(struct ir_instruction *address, long offset)
+{
+    if (offset == 0)
+        return address;
+
+    // Frame and global addresses can hold the offset directly
+    if (address->op == IR_OP_FRAME_ADDRESS || address->op == IR_OP_GLOBAL_ADDRESS)
+    {
+        struct ir_instruction *instruction = lower_emit(address->op, IR_TYPE_PTR);
+        instruction->slot = address->slot;
+        instruction->symbol = address->symbol;
+        instruction->value = address->value + offset;
+        return instruction;
+    }
+
+    return lower_emit_binary(IR_OP_ADD, IR_TYPE_PTR, address, lower_const(offset));
+}
+
+static struct ir_instruction *lower_address_index(struct ir_instruction *address, struct ir_instruction *index, size_t stride)
+{
+    if (index->op == IR_OP_CONST)
+        return lower_address_offset(address, index->value * (long)stride);
+
+    struct ir_instruction *scaled = index;
+    if (stride != 1)
+    {
+        scaled = lower_emit_binary(IR_OP_MUL, IR_TYPE_I32, index, lower_const(stride));
+    }
+    return lower_emit_binary(IR_OP_ADD, IR_TYPE_PTR, address, scaled);
+}
+
+static struct ir_value lower_lvalue_load(struct ir_lvalue *lvalue)
+{
+    struct ir_value value = {};
+    if (lower_datatype_is_array(&lvalue->dtype, lvalue->array_index))
+    {
+        // Arrays decay into a pointer to the first element
+        if (array_total_indexes(&lvalue->dtype) - lvalue->array_index > 1)
+            return lower_fail();
+
+        struct datatype element = lower_datatype_array_element(&lvalue->dtype);
+        value.ins = lvalue->address;
+        value.dtype = lower_datatype_address_of(&element);
+        return value;
+    }
+
+    int mem_type = lower_mem_type(&lvalue->dtype);
+    if (mem_type == IR_TYPE_VOID)
+        return lower_fail();
+
+    value.dtype = lvalue->dtype;
+    if (lvalue->type == IR_LVALUE_TYPE_VARIABLE)
+    {
+        value.ins = lower_read_variable(lvalue->var_node, lower_current_block());
+        return value;
+    }
+
+    value.ins = lower_emit_unary(IR_OP_LOAD, lower_value_type(&lvalue->dtype), lvalue->address);
+    value.ins->mem_type = mem_type;
+    if (lower_datatype_is_signed(&lvalue->dtype))
+    {
+        value.ins->flags |= IR_INSTRUCTION_FLAG_SIGNED;
+    }
+    return value;
+}
+
+static struct ir_instruction *lower_lvalue_store(struct ir_lvalue *lvalue, struct ir_instruction *value)
+{
+    int mem_type = lower_mem_type(&lvalue->dtype);
+    if (mem_type == IR_TYPE_VOID || lower_datatype_is_array(&lvalue->dtype, lvalue->array_index))
+    {
+        lower_fail();
+        return value;
+    }
+
+    if (lvalue->type == IR_LVALUE_TYPE_VARIABLE)
+    {
+        value = lower_convert(value, &lvalue->dtype);
+        lower_write_variable(lvalue->var_node, lower_current_block(), value);
+        return value;
+    }
+
+    struct ir_instruction *store = lower_emit(IR_OP_STORE, IR_TYPE_VOID);
+    store->mem_type = mem_type;
+    ir_instruction_add_operand(store, lvalue->address);
+    ir_instruction_add_operand(store, value);
+    return value;
+}
+
+static bool lower_lvalue_for_variable(struct node *var_node, struct ir_lvalue *lvalue_out)
+{
+    lvalue_out->dtype = var_node->var.type;
+    lvalue_out->var_node = var_node;
+    lvalue_out->array_index = 0;
+    if (!lower_variable_in_memory(var_node))
+    {
+        lvalue_out->type = IR_LVALUE_TYPE_VARIABLE;
+        return true;
+    }
+
+    lvalue_out->type = IR_LVALUE_TYPE_MEMORY;
+    lvalue_out->address = lower_frame_address(lower_memory_variable_slot(var_node, 0));
+    return true;
+}
+
+/**
+ * Finds the global node for the given name, returns NULL if the name is unknown
+ * or refers to a native function.
+ */
+static struct node *lower_global_node(const char *name)
+{
+    struct symbol *sym = symresolver_get_symbol(lower.process, name);
+    if (!sym || sym->type != SYMBOL_TYPE_NODE)
+        return NULL;
+
+    struct node *node = sym->data;
+    if (node->type == NODE_TYPE_FUNCTION && node->func.flags & FUNCTION_NODE_FLAG_IS_NATIVE)
+        return NULL;
+
+    if (node->type != NODE_TYPE_VARIABLE && node->type != NODE_TYPE_FUNCTION)
+        return NULL;
+
+    return node;
+}
+
+static bool lower_lvalue_for_identifier(struct node *node, struct ir_lvalue *lvalue_out)
+{
+    struct node *var_node = lower_scope_find_variable(node->sval);
+    if (var_node)
+        return lower_lvalue_for_variable(var_node, lvalue_out);
+
+    struct node *global_node = lower_global_node(node->sval);
+    if (!global_node || global_node->type != NODE_TYPE_VARIABLE)
+        return false;
+
+    // Thread local variables are found through the thread pointer, only the stack code generator does that
+    if (global_node->var.type.flags & DATATYPE_FLAG_IS_THREAD_LOCAL)
+        return false;
+
+    lvalue_out->type = IR_LVALUE_TYPE_MEMORY;
+    lvalue_out->var_node = global_node;
+    lvalue_out->dtype = global_node->var.type;
+    lvalue_out->array_index = 0;
+    lvalue_out->address = lower_global_address(global_node->var.name);
+    return true;
+}
+
+static void lower_flatten_access(struct node *node, const char *op, struct vector *parts)
+{
+    if (is_access_node(node))
+    {
+        lower_flatten_access(node->exp.left, op, parts);
+        lower_flatten_access(node->exp.right, node->exp.op, parts);
+        return;
+    }
+
+    if (is_array_node(node) || is_parentheses_node(node))
+    {
+        lower_flatten_access(node->exp.left, op, parts);
+        struct ir_access_part part = {.op = node->exp.op, .node = node->exp.right};
+        vector_push(parts, &part);
+        return;
+    }
+
+    struct ir_access_part part = {.op = op, .node = node};
+    vector_push(parts, &part);
+}
+
+static void lower_flatten_arguments(struct node *node, struct vector *arguments)
+{
+    if (is_argument_node(node))
+    {
+        lower_flatten_arguments(node->exp.left, arguments);
+        lower_flatten_arguments(node->exp.right, arguments);
+    }
+    else if (node->type == NODE_TYPE_EXPRESSION_PARENTHESIS)
+    {
+        lower_flatten_arguments(node->parenthesis.exp, arguments);
+    }
+    else if (node_valid(node))
+    {
+        vector_push(arguments, &node);
+    }
+}
+
+/**
+ * __builtin_expect(value, expected) is the value, the expectation is read by lower_if_chain
+ */
+static struct ir_value lower_expect(struct node *arguments_node)
+{
+    struct vector *arguments = vector_create(sizeof(struct node *));
+    lower_flatten_arguments(arguments_node, arguments);
+    struct ir_value value = vector_count(arguments) == 2 ? lower_rvalue(vector_peek_ptr_at(arguments, 0)) : lower_fail();
+    vector_free(arguments);
+    return value;
+}
+
+static bool lower_constant_argument(struct node *node, long *value_out)
+{
+    while (node->type == NODE_TYPE_EXPRESSION_PARENTHESIS)
+    {
+        node = node->parenthesis.exp;
+    }
+
+    if (node->type != NODE_TYPE_NUMBER)
+        return false;
+
+    *value_out = node->llnum;
+    return true;
+}
+
+static int lower_chunk_mem_type(long remaining, int *size_out)
+{
+    if (remaining >= DATA_SIZE_DWORD)
+    {
+        *size_out = DATA_SIZE_DWORD;
+        return IR_TYPE_I32;
+    }
+
+    if (remaining >= DATA_SIZE_WORD)
+    {
+        *size_out = DATA_SIZE_WORD;
+        return IR_TYPE_I16;
+    }
+
+    *size_out = DATA_SIZE_BYTE;
+    return IR_TYPE_I8;
+}
+
+/**
+ * memcpy and memset of a small constant size become loads and stores of the largest chunks that fit
+ */
+static struct ir_value lower_memory_builtin(const char *name, struct vector *arguments, long size)
+{
+    struct ir_value result = {};
+    struct ir_value dest = lower_rvalue(vector_peek_ptr_at(arguments, 0));
+    struct ir_value source = lower_rvalue(vector_peek_ptr_at(arguments, 1));
+    struct ir_instruction *pattern = source.ins;
+    if (S_EQ(name, "memset"))
+    {
+        pattern = pattern->op == IR_OP_CONST ? lower_const((pattern->value & 0xff) * 0x01010101)
+                                             : lower_emit_binary(IR_OP_MUL, IR_TYPE_I32, lower_emit_binary(IR_OP_AND, IR_TYPE_I32, pattern, lower_const(0xff)), lower_const(0x01010101));
+    }
+
+    int chunk = 0;
+    for (long offset = 0; offset < size; offset += chunk)
+    {
+        int mem_type = lower_chunk_mem_type(size - offset, &chunk);
+        struct ir_instruction *value = pattern;
+        if (S_EQ(name, "memcpy"))
+        {
+            value = lower_emit_unary(IR_OP_LOAD, IR_TYPE_I32, lower_address_offset(source.ins, offset));
+            value->mem_type = mem_type;
+        }
+
+        struct ir_instruction *address = lower_address_offset(dest.ins, offset);
+        struct ir_instruction *store = lower_emit(IR_OP_STORE, IR_TYPE_VOID);
+        store->mem_type = mem_type;
+        ir_instruction_add_operand(store, address);
+        ir_instruction_add_operand(store, value);
+    }
+
+    result.ins = dest.ins;
+    result.dtype = lower_datatype_void_pointer();
+    return result;
+}
+
+/**
+ * The bit manipulation builtins are single IR instructions, constant arguments fold right away
+ */
+static struct ir_value lower_bit_builtin(const char *name, int op, struct vector *arguments)
+{
+    bool rotate = !ir_op_is_bit_operation(op);
+    if (vector_count(arguments) != (rotate ? 2 : 1))
+        return lower_fail();
+
+    struct ir_value result = lower_rvalue(vector_peek_ptr_at(arguments, 0));
+    struct ir_instruction *value = result.ins;
+    if (rotate)
+    {
+        struct ir_instruction *count = lower_rvalue(vector_peek_ptr_at(arguments, 1)).ins;
+        long folded = 0;
+        result.ins = value->op == IR_OP_CONST && count->op == IR_OP_CONST && ir_fold_constant(op, value->value, count->value, &folded)
+                         ? lower_const(folded)
+                         : lower_emit_binary(op, IR_TYPE_I32, value, count);
+    }
+    else
+    {
+        result.ins = value->op == IR_OP_CONST ? lower_const(ir_fold_bit_operation(op, value->value)) : lower_emit_unary(op, IR_TYPE_I32, value);
+    }
+
+    if (S_EQ(name, "__builtin_bswap16"))
+    {
+        result.ins = result.ins->op == IR_OP_CONST ? lower_const((uint32_t)result.ins->value >> 16)
+                                                   : lower_emit_binary(IR_OP_SHR, IR_TYPE_I32, result.ins, lower_const(16));
+    }
+
+    // The bit counts return int, the byte swaps and rotates return unsigned values
+    result.dtype = datatype_for_numeric();
+    result.dtype.flags = ir_op_is_bit_operation(op) && op != IR_OP_BSWAP ? DATATYPE_FLAG_IS_SIGNED : 0;
+    return result;
+}
+
+static struct ir_instruction *lower_atomic(int kind, int type, struct ir_instruction *address, struct ir_instruction *value, struct ir_instruction *desired)
+{
+    struct ir_instruction *atomic = lower_emit(IR_OP_ATOMIC, type);
+    atomic->value = kind;
+    atomic->flags |= IR_INSTRUCTION_FLAG_VOLATILE;
+    ir_instruction_add_operand(atomic, address);
+    ir_instruction_add_operand(atomic, value);
+    if (desired)
+    {
+        ir_instruction_add_operand(atomic, desired);
+    }
+    return atomic;
+}
+
+static struct ir_instruction *lower_volatile_access(int op, struct ir_instruction *address, struct ir_instruction *value)
+{
+    struct ir_instruction *access = lower_emit(op, op == IR_OP_LOAD ? IR_TYPE_I32 : IR_TYPE_VOID);
+    access->mem_type = IR_TYPE_I32;
+    access->flags |= IR_INSTRUCTION_FLAG_VOLATILE;
+    ir_instruction_add_operand(access, address);
+    if (value)
+    {
+        ir_instruction_add_operand(access, value);
+    }
+    return access;
+}
+
+static bool lower_atomic_order_is_weak(struct node *order_node)
+{
+    long order = NATIVE_ATOMIC_SEQ_CST;
+    return lower_constant_argument(order_node, &order) && order != NATIVE_ATOMIC_SEQ_CST;
+}
+
+/**
+ * The __sync and __atomic builtins of 32 bit values, see the handlers in native.c for what each one means
+ */
+static struct ir_value lower_atomic_builtin(const char *name, struct vector *arguments)
+{
+    int total = vector_count(arguments);
+    struct ir_value result = {};
+    result.dtype = datatype_for_numeric();
+    result.dtype.flags = DATATYPE_FLAG_IS_SIGNED;
+    if (S_EQ(name, "__sync_synchronize") || S_EQ(name, "__atomic_thread_fence"))
+    {
+        if (total != (S_EQ(name, "__sync_synchronize") ? 0 : 1))
+            return lower_fail();
+
+        // Weaker fences only stop memory accesses being moved across them
+        result.ins = lower_emit(IR_OP_ATOMIC, IR_TYPE_VOID);
+        result.ins->value = total == 0 || !lower_atomic_order_is_weak(vector_peek_ptr_at(arguments, 0)) ? IR_ATOMIC_FENCE : IR_ATOMIC_BARRIER;
+        result.ins->flags |= IR_INSTRUCTION_FLAG_VOLATILE;
+        datatype_set_void(&result.dtype);
+        return result;
+    }
+
+    if (total == 0)
+        return lower_fail();
+
+    struct ir_instruction *address = lower_rvalue(vector_peek_ptr_at(arguments, 0)).ins;
+    if (S_EQ(name, "__atomic_load_n") && total == 2)
+    {
+        result.ins = lower_volatile_access(IR_OP_LOAD, address, NULL);
+        return result;
+    }
+
+    if (S_EQ(name, "__sync_lock_release") && total == 1)
+    {
+        result.ins = lower_volatile_access(IR_OP_STORE, address, lower_const(0));
+        datatype_set_void(&result.dtype);
+        return result;
+    }
+
+    if (total < 2)
+        return lower_fail();
+
+    struct ir_instruction *value = lower_rvalue(vector_peek_ptr_at(arguments, 1)).ins;
+    bool sync = strncmp(name, "__sync_", 7) == 0;
+    if ((S_EQ(name, "__sync_fetch_and_add") || S_EQ(name, "__sync_fetch_and_sub") || S_EQ(name, "__atomic_fetch_add") ||
+         S_EQ(name, "__atomic_fetch_sub")) &&
+        total == (sync ? 2 : 3))
+    {
+        if (S_EQ(name + strlen(name) - 3, "sub"))
+        {
+            value = value->op == IR_OP_CONST ? lower_const(-value->value) : lower_emit_unary(IR_OP_NEG, IR_TYPE_I32, value);
+        }
+        result.ins = lower_atomic(IR_ATOMIC_FETCH_ADD, IR_TYPE_I32, address, value, NULL);
+    }
+    else if ((S_EQ(name, "__sync_lock_test_and_set") && total == 2) || (S_EQ(name, "__atomic_exchange_n") && total == 3))
+    {
+        result.ins = lower_atomic(IR_ATOMIC_EXCHANGE, IR_TYPE_I32, address, value, NULL);
+    }
+    else if (S_EQ(name, "__atomic_store_n") && total == 3)
+    {
+        result.ins = lower_atomic_order_is_weak(vector_peek_ptr_at(arguments, 2)) ? lower_volatile_access(IR_OP_STORE, address, value)
+                                                                                  : lower_atomic(IR_ATOMIC_EXCHANGE, IR_TYPE_VOID, address, value, NULL);
+        datatype_set_void(&result.dtype);
+    }
+    else if ((S_EQ(name, "__sync_val_compare_and_swap") || S_EQ(name, "__sync_bool_compare_and_swap")) && total == 3)
+    {
+        struct ir_instruction *desired = lower_rvalue(vector_peek_ptr_at(arguments, 2)).ins;
+        result.ins = lower_atomic(IR_ATOMIC_COMPARE_EXCHANGE, IR_TYPE_I32, address, value, desired);
+        if (S_EQ(name, "__sync_bool_compare_and_swap"))
+        {
+            result.ins = lower_emit_binary(IR_OP_EQ, IR_TYPE_I32, result.ins, value);
+        }
+    }
+    else if (S_EQ(name, "__atomic_compare_exchange_n") && total == 6)
+    {
+        // The value found is written back to "expected" which held it already when the exchange succeeded
+        struct ir_instruction *desired = lower_rvalue(vector_peek_ptr_at(arguments, 2)).ins;
+        struct ir_instruction *expected = lower_volatile_access(IR_OP_LOAD, value, NULL);
+        struct ir_instruction *found = lower_atomic(IR_ATOMIC_COMPARE_EXCHANGE, IR_TYPE_I32, address, expected, desired);
+        lower_volatile_access(IR_OP_STORE, value, found);
+        result.ins = lower_emit_binary(IR_OP_EQ, IR_TYPE_I32, found, expected);
+    }
+    else
+    {
+        return lower_fail();
+    }
+
+    return result;
+}
+
+/**
+ * Calls to the builtins of native.c, those that cannot be expanded here call the C library
+ */
+static struct ir_value lower_native_call(struct node *name_node, struct node *arguments_node)
+{
+    const char *name = name_node->sval;
+    if (S_EQ(name, PREDICT_EXPECT_FUNCTION))
+        return lower_expect(arguments_node);
+
+    struct vector *arguments = vector_create(sizeof(struct node *));
+    lower_flatten_arguments(arguments_node, arguments);
+    struct ir_value result = {};
+    int bit_op = native_bit_builtin_op(name);
+    bool memory = S_EQ(name, "memcpy") || S_EQ(name, "memset");
+    struct node *first = vector_count(arguments) == 1 ? vector_peek_ptr_at(arguments, 0) : NULL;
+    long size = 0;
+    if (bit_op != -1)
+    {
+        result = lower_bit_builtin(name, bit_op, arguments);
+    }
+    else if (strncmp(name, "__sync_", 7) == 0 || strncmp(name, "__atomic_", 9) == 0)
+    {
+        result = lower_atomic_builtin(name, arguments);
+    }
+    else if (memory && vector_count(arguments) == 3 && lower_constant_argument(vector_peek_ptr_at(arguments, 2), &size) && size >= 0 &&
+        size <= NATIVE_MEMORY_UNROLL_LIMIT)
+    {
+        result = lower_memory_builtin(name, arguments, size);
+    }
+    else if (S_EQ(name, "strlen") && first && first->type == NODE_TYPE_STRING)
+    {
+        result.ins = lower_const(strlen(first->sval));
+        result.dtype = datatype_for_numeric();
+    }
+    else if (memory || S_EQ(name, "memcmp") || S_EQ(name, "strlen"))
+    {
+        struct vector *argument_values = vector_create(sizeof(struct ir_instruction *));
+        for (int i = 0; i < vector_count(arguments); i++)
+        {
+            struct ir_value argument = lower_rvalue(vector_peek_ptr_at(arguments, i));
+            vector_push(argument_values, &argument.ins);
+        }
+
+        struct ir_instruction *callee = lower_global_address(name);
+        result.ins = lower_emit(IR_OP_CALL, memory ? IR_TYPE_PTR : IR_TYPE_I32);
+        result.ins->node = name_node;
+        ir_instruction_add_operand(result.ins, callee);
+        for (int i = 0; i < vector_count(argument_values); i++)
+        {
+            ir_instruction_add_operand(result.ins, vector_peek_ptr_at(argument_values, i));
+        }
+        vector_free(argument_values);
+
+        result.dtype = datatype_for_numeric();
+        result.dtype.flags = S_EQ(name, "memcmp") ? DATATYPE_FLAG_IS_SIGNED : 0;
+        if (memory)
+        {
+            result.dtype = lower_datatype_void_pointer();
+        }
+    }
+    else
+    {
+        result = lower_fail();
+    }
+
+    vector_free(arguments);
+    return result;
+}
+
+static struct ir_value lower_call(struct node *name_node, struct node *arguments_node)
+{
+    if (!lower_scope_find_variable(name_node->sval) && symresolver_get_symbol_for_native_function(lower.process, name_node->sval))
+        return lower_native_call(name_node, arguments_node);
+
+    struct ir_value result = {};
+    struct ir_instruction *callee = NULL;
+    struct node *var_node = lower_scope_find_variable(name_node->sval);
+    struct node *global_node = var_node ? NULL : lower_global_node(name_node->sval);
+    if (var_node || (global_node && global_node->type == NODE_TYPE_VARIABLE))
+    {
+        // Function pointer call
+        struct ir_value pointer = lower_rvalue(name_node);
+        callee = pointer.ins;
+        result.dtype = pointer.dtype;
+    }
+    else if (global_node)
+    {
+        callee = lower_global_address(global_node->func.name);
+        result.dtype = global_node->func.rtype;
+    }
+    else
+    {
+        return lower_fail();
+    }
+
+    if (lower_datatype_is_struct_value(&result.dtype) || lower_datatype_is_float(&result.dtype))
+        return lower_fail();
+
+    struct vector *arguments = vector_create(sizeof(struct node *));
+    lower_flatten_arguments(arguments_node, arguments);
+    struct vector *argument_values = vector_create(sizeof(struct ir_instruction *));
+    for (int i = 0; i < vector_count(arguments); i++)
+    {
+        struct ir_value argument = lower_rvalue(vector_peek_ptr_at(arguments, i));
+        vector_push(argument_values, &argument.ins);
+    }
+
+    int type = datatype_is_void_no_ptr(&result.dtype) ? IR_TYPE_VOID : lower_value_type(&result.dtype);
+    result.ins = lower_emit(IR_OP_CALL, type);
+    result.ins->node = name_node;
+    ir_instruction_add_operand(result.ins, callee);
+    for (int i = 0; i < vector_count(argument_values); i++)
+    {
+        ir_instruction_add_operand(result.ins, vector_peek_ptr_at(argument_values, i));
+    }
+
+    vector_free(arguments);
+    vector_free(argument_values);
+    return result;
+}
+
+static bool lower_node_is_lvalue(struct node *node)
+{
+    switch (node->type)
+    {
+    case NODE_TYPE_IDENTIFIER:
+        return true;
+    case NODE_TYPE_EXPRESSION_PARENTHESIS:
+        return lower_node_is_lvalue(node->parenthesis.exp);
+    case NODE_TYPE_UNARY:
+        return op_is_indirection(node->unary.op);
+    case NODE_TYPE_EXPRESSION:
+        return is_access_node(node) || is_array_node(node);
+    }
+
+    return false;
+}
+
+static bool lower_struct_member(struct datatype *struct_dtype, struct node *member_node, int *offset_out, struct datatype *dtype_out)
+{
+    if (member_node->type != NODE_TYPE_IDENTIFIER || !datatype_is_struct_or_union(struct_dtype))
+        return false;
+
+    struct node *var_node = NULL;
+    int offset = struct_offset(lower.process, struct_dtype->type_str, member_node->sval, &var_node, 0, 0);
+    if (!var_node || !S_EQ(var_node->var.name, member_node->sval))
+        return false;
+
+    if (struct_dtype->type == DATA_TYPE_UNION)
+    {
+        // Every member of a union starts at the beginning.
+        offset = 0;
+    }
+
+    *offset_out = offset;
+    *dtype_out = var_node->var.type;
+    return true;
+}
+
+/**
+ * Lowers an access expression such as a.b->c[5] producing an lvalue
+ * returns false if the result is only a value i.e a function call
+ */
+static bool lower_access(struct node *node, struct ir_lvalue *lvalue_out, struct ir_value *value_out)
+{
+    struct vector *parts = vector_create(sizeof(struct ir_access_part));
+    lower_flatten_access(node, NULL, parts);
+
+    bool is_lvalue = false;
+    struct ir_lvalue lvalue = {};
+    struct ir_value value = {};
+    int index = 1;
+    bool get_address = false;
+    struct ir_access_part *first = vector_at(parts, 0);
+    struct ir_access_part *second = vector_count(parts) > 1 ? vector_at(parts, 1) : NULL;
+    if (first->node->type == NODE_TYPE_UNARY)
+    {
+        // The parser binds a unary operator to the start of the access i.e &a[5] becomes (&a)[5]
+        // the resolver applies the address to the entire access, so must we.
+        if (!op_is_address(first->node->unary.op))
+        {
+            value = lower_fail();
+        }
+        else
+        {
+            get_address = true;
+            is_lvalue = lower_lvalue(first->node->unary.operand, &lvalue);
+        }
+    }
+    else if (second && S_EQ(second->op, "()"))
+    {
+        if (first->node->type != NODE_TYPE_IDENTIFIER)
+        {
+            value = lower_fail();
+        }
+        else
+        {
+            value = lower_call(first->node, second->node);
+        }
+        index = 2;
+    }
+    else if (lower_node_is_lvalue(first->node))
+    {
+        is_lvalue = lower_lvalue(first->node, &lvalue);
+    }
+    else
+    {
+        value = lower_rvalue(first->node);
+    }
+
+    for (; index < vector_count(parts) && !lower.failed; index++)
+    {
+        struct ir_access_part *part = vector_at(parts, index);
+        int offset = 0;
+        struct datatype member_dtype;
+        if (S_EQ(part->op, "."))
+        {
+            if (!is_lvalue || lvalue.type != IR_LVALUE_TYPE_MEMORY || lower_datatype_is_pointer(&lvalue.dtype) ||
+                !lower_struct_member(&lvalue.dtype, part->node, &offset, &member_dtype))
+            {
+                lower_fail();
+                break;
+            }
+
+            lvalue.address = lower_address_offset(lvalue.address, offset);
+            lvalue.dtype = member_dtype;
+            lvalue.array_index = 0;
+        }
+        else if (S_EQ(part->op, "->"))
+        {
+            if (is_lvalue)
+            {
+                value = lower_lvalue_load(&lvalue);
+            }
+
+            if (value.dtype.pointer_depth != 1 || !lower_struct_member(&value.dtype, part->node, &offset, &member_dtype))
+            {
+                lower_fail();
+                break;
+            }
+
+            is_lvalue = true;
+            lvalue.type = IR_LVALUE_TYPE_MEMORY;
+            lvalue.address = lower_address_offset(value.ins, offset);
+            lvalue.dtype = member_dtype;
+            lvalue.array_index = 0;
+        }
+        else if (S_EQ(part->op, "[]"))
+        {
+            struct ir_value index_value = lower_rvalue(part->node->bracket.inner);
+            if (is_lvalue && lvalue.type == IR_LVALUE_TYPE_MEMORY && lower_datatype_is_array(&lvalue.dtype, lvalue.array_index))
+            {
+                size_t stride = 0;
+                if (!lower_array_stride(&lvalue.dtype, lvalue.array_index, &stride))
+                {
+                    lower_fail();
+                    break;
+                }
+
+                lvalue.address = lower_address_index(lvalue.address, index_value.ins, stride);
+                lvalue.array_index++;
+                if (!lower_datatype_is_array(&lvalue.dtype, lvalue.array_index))
+                {
+                    lvalue.dtype = lower_datatype_array_element(&lvalue.dtype);
+                    lvalue.array_index = 0;
+                }
+                continue;
+            }
+
+            if (is_lvalue)
+            {
+                value = lower_lvalue_load(&lvalue);
+            }
+
+            if (!lower_datatype_is_pointer(&value.dtype))
+            {
+                lower_fail();
+                break;
+            }
+
+            struct datatype *pointee = datatype_pointer_reduce(&value.dtype, 1);
+            is_lvalue = true;
+            lvalue.type = IR_LVALUE_TYPE_MEMORY;
+            lvalue.address = lower_address_index(value.ins, index_value.ins, lower_pointee_size(&value.dtype));
+            lvalue.dtype = *pointee;
+            lvalue.array_index = 0;
+            free(pointee);
+        }
+        else
+        {
+            // Function calls are only supported on identifiers
+            lower_fail();
+            break;
+        }
+    }
+
+    vector_free(parts);
+    if (lower.failed)
+        return false;
+
+    if (get_address)
+    {
+        if (!is_lvalue || lvalue.type != IR_LVALUE_TYPE_MEMORY)
+        {
+            lower_fail();
+            return false;
+        }
+
+        struct datatype dtype = lvalue.dtype;
+        if (lower_datatype_is_array(&dtype, lvalue.array_index))
+        {
+            dtype = lower_datatype_array_element(&dtype);
+        }
+        value.ins = lvalue.address;
+        value.dtype = lower_datatype_address_of(&dtype);
+        is_lvalue = false;
+    }
+
+    *lvalue_out = lvalue;
+    *value_out = value;
+    return is_lvalue;
+}
+
+static bool lower_lvalue(struct node *node, struct ir_lvalue *lvalue_out)
+{
+    switch (node->type)
+    {
+    case NODE_TYPE_IDENTIFIER:
+        return lower_lvalue_for_identifier(node, lvalue_out);
+
+    case NODE_TYPE_EXPRESSION_PARENTHESIS:
+        return lower_lvalue(node->parenthesis.exp, lvalue_out);
+
+    case NODE_TYPE_UNARY:
+        if (op_is_indirection(node->unary.op))
+        {
+            struct ir_value pointer = lower_rvalue(node->unary.operand);
+            int depth = node->unary.indirection.depth;
+            if (pointer.dtype.pointer_depth < depth)
+                return false;
+
+            struct ir_instruction *address = pointer.ins;
+            for (int i = 1; i < depth; i++)
+            {
+                address = lower_emit_unary(IR_OP_LOAD, IR_TYPE_PTR, address);
+                address->mem_type = IR_TYPE_PTR;
+            }
+
+            struct datatype *pointee = datatype_pointer_reduce(&pointer.dtype, depth);
+            lvalue_out->type = IR_LVALUE_TYPE_MEMORY;
+            lvalue_out->address = address;
+            lvalue_out->dtype = *pointee;
+            lvalue_out->array_index = 0;
+            free(pointee);
+            return true;
+        }
+        break;
+
+    case NODE_TYPE_EXPRESSION:
+        if (is_access_node(node) || is_array_node(node))
+        {
+            struct ir_value value;
+            return lower_access(node, lvalue_out, &value);
+        }
+        break;
+    }
+
+    return false;
+}
+
+static bool lower_op_is_assignment(const char *op)
+{
+    size_t len = strlen(op);
+    return op[len - 1] == '=' && !S_EQ(op, "==") && !S_EQ(op, "!=") && !S_EQ(op, "<=") && !S_EQ(op, ">=");
+}
+
+static int lower_op_for_operator(const char *op, bool is_signed)
+{
+    if (S_EQ(op, "+"))
+        return IR_OP_ADD;
+    if (S_EQ(op, "-"))
+        return IR_OP_SUB;
+    if (S_EQ(op, "*"))
+        return IR_OP_MUL;
+    if (S_EQ(op, "/"))
+        return is_signed ? IR_OP_SDIV : IR_OP_UDIV;
+    if (S_EQ(op, "%"))
+        return is_signed ? IR_OP_SREM : IR_OP_UREM;
+    if (S_EQ(op, "&"))
+        return IR_OP_AND;
+    if (S_EQ(op, "|"))
+        return IR_OP_OR;
+    if (S_EQ(op, "^"))
+        return IR_OP_XOR;
+    if (S_EQ(op, "<<"))
+        return IR_OP_SHL;
+    if (S_EQ(op, ">>"))
+        return is_signed ? IR_OP_SAR : IR_OP_SHR;
+    if (S_EQ(op, "=="))
+        return IR_OP_EQ;
+    if (S_EQ(op, "!="))
+        return IR_OP_NE;
+    if (S_EQ(op, "<"))
+        return is_signed ? IR_OP_SLT : IR_OP_ULT;
+    if (S_EQ(op, "<="))
+        return is_signed ? IR_OP_SLE : IR_OP_ULE;
+    if (S_EQ(op, ">"))
+        return is_signed ? IR_OP_SGT : IR_OP_UGT;
+    if (S_EQ(op, ">="))
+        return is_signed ? IR_OP_SGE : IR_OP_UGE;
+
+    return -1;
+}
+
+static bool lower_datatype_is_unsigned_int(struct datatype *dtype)
+{
+    return !(dtype->flags & DATATYPE_FLAG_IS_LITERAL) && !lower_datatype_is_signed(dtype) &&
+           datatype_size(dtype) >= DATA_SIZE_DWORD;
+}
+
+static struct datatype lower_arithmetic_datatype(struct ir_value *left, struct ir_value *right)
+{
+    struct datatype *dtype = &left->dtype;
+    if (left->dtype.flags & DATATYPE_FLAG_IS_LITERAL)
+    {
+        dtype = &right->dtype;
+    }
+
+    // Unsigned integers win over signed ones of the same rank, literals are always signed
+    if (lower_datatype_is_unsigned_int(&right->dtype))
+    {
+        dtype = &right->dtype;
+    }
+    if (lower_datatype_is_unsigned_int(&left->dtype))
+    {
+        dtype = &left->dtype;
+    }
+
+    struct datatype result = *dtype;
+    if (datatype_size(&result) < DATA_SIZE_DWORD)
+    {
+        // Integer promotion, anything smaller than an int becomes an int
+        result = datatype_for_numeric();
+        result.flags &= ~DATATYPE_FLAG_IS_LITERAL;
+        result.flags |= DATATYPE_FLAG_IS_SIGNED;
+    }
+    return result;
+}
+
+static struct ir_value lower_arithmetic(const char *op, struct ir_value left, struct ir_value right)
+{
+    struct ir_value result = {};
+    bool left_pointer = lower_datatype_is_pointer(&left.dtype);
+    bool right_pointer = lower_datatype_is_pointer(&right.dtype);
+    if ((S_EQ(op, "+") || S_EQ(op, "-")) && (left_pointer || right_pointer))
+    {
+        if (left_pointer && right_pointer)
+        {
+            if (!S_EQ(op, "-"))
+                return lower_fail();
+
+            // Pointer difference is in elements
+            struct ir_instruction *difference = lower_emit_binary(IR_OP_SUB, IR_TYPE_I32, left.ins, right.ins);
+            size_t size = lower_pointee_size(&left.dtype);
+            result.ins = size == 1 ? difference : lower_emit_binary(IR_OP_SDIV, IR_TYPE_I32, difference, lower_const(size));
+            result.dtype = datatype_for_numeric();
+            return result;
+        }
+
+        struct ir_value *pointer = left_pointer ? &left : &right;
+        struct ir_value *integer = left_pointer ? &right : &left;
+        if (S_EQ(op, "-"))
+        {
+            if (!left_pointer)
+                return lower_fail();
+
+            struct ir_instruction *negated = integer->ins->op == IR_OP_CONST ? lower_const(-integer->ins->value) : lower_emit_unary(IR_OP_NEG, IR_TYPE_I32, integer->ins);
+            integer->ins = negated;
+        }
+
+        result.ins = lower_address_index(pointer->ins, integer->ins, lower_pointee_size(&pointer->dtype));
+        result.dtype = pointer->dtype;
+        result.dtype.flags &= ~DATATYPE_FLAG_IS_ARRAY;
+        return result;
+    }
+
+    result.dtype = lower_arithmetic_datatype(&left, &right);
+    bool is_signed = lower_datatype_is_signed(&result.dtype);
+    if (S_EQ(op, ">>"))
+    {
+        // The type of a shift is the type of the left operand
+        is_signed = lower_datatype_is_signed(&left.dtype) || datatype_size(&left.dtype) < DATA_SIZE_DWORD;
+    }
+
+    int ir_op = lower_op_for_operator(op, is_signed);
+    if (ir_op == -1)
+        return lower_fail();
+
+    if (ir_op_is_compare(ir_op))
+    {
+        result.dtype = datatype_for_numeric();
+        result.dtype.flags &= ~DATATYPE_FLAG_IS_LITERAL;
+        result.dtype.flags |= DATATYPE_FLAG_IS_SIGNED;
+    }
+
+    long folded = 0;
+    if (left.ins->op == IR_OP_CONST && right.ins->op == IR_OP_CONST && ir_fold_constant(ir_op, left.ins->value, right.ins->value, &folded))
+    {
+        result.ins = lower_const(folded);
+        return result;
+    }
+
+    int type = (left_pointer || right_pointer) && !ir_op_is_compare(ir_op) ? IR_TYPE_PTR : IR_TYPE_I32;
+    result.ins = lower_emit_binary(ir_op, type, left.ins, right.ins);
+    return result;
+}
+
+/**
+ * Produces 1 if the value is non zero, 0 otherwise
+ */
+static struct ir_instruction *lower_truth(struct ir_instruction *value)
+{
+    if (ir_op_is_compare(value->op))
+        return value;
+
+    if (value->op == IR_OP_CONST)
+        return lower_const(value->value != 0);
+
+    return lower_emit_binary(IR_OP_NE, IR_TYPE_I32, value, lower_const(0));
+}
+
+static struct ir_value lower_logical(struct node *node)
+{
+    bool is_and = S_EQ(node->exp.op, "&&");
+    struct ir_block *right_block = ir_block_create(lower.function);
+    struct ir_block *end_block = ir_block_create(lower.function);
+
+    struct ir_value left = lower_rvalue(node->exp.left);
+    struct ir_instruction *short_circuit = lower_const(is_and ? 0 : 1);
+    struct ir_block *left_block = lower_current_block();
+    if (is_and)
+    {
+        lower_branch(left.ins, right_block, end_block);
+    }
+    else
+    {
+        lower_branch(left.ins, end_block, right_block);
+    }
+
+    lower_seal_block(right_block);
+    lower_set_block(right_block);
+    struct ir_value right = lower_rvalue(node->exp.right);
+    struct ir_instruction *right_truth = lower_truth(right.ins);
+    struct ir_block *right_end_block = lower_current_block();
+    lower_jump(end_block);
+
+    lower_seal_block(end_block);
+    lower_set_block(end_block);
+    struct ir_value result = {};
+    result.dtype = datatype_for_numeric();
+    result.ins = ir_instruction_create(lower.function, IR_OP_PHI, IR_TYPE_I32);
+    ir_block_prepend(end_block, result.ins);
+    ir_phi_add_incoming(result.ins, short_circuit, left_block);
+    ir_phi_add_incoming(result.ins, right_truth, right_end_block);
+    return result;
+}
+
+static struct ir_value lower_tenary(struct node *node)
+{
+    struct node *tenary_node = node->exp.right;
+    struct ir_block *true_block = ir_block_create(lower.function);
+    struct ir_block *false_block = ir_block_create(lower.function);
+    struct ir_block *end_block = ir_block_create(lower.function);
+
+    struct ir_value cond = lower_rvalue(node->exp.left);
+    lower_branch(cond.ins, true_block, false_block);
+    lower_seal_block(true_block);
+    lower_seal_block(false_block);
+
+    lower_set_block(true_block);
+    struct ir_value true_value = lower_rvalue(tenary_node->tenary.true_node);
+    struct ir_block *true_end_block = lower_current_block();
+    lower_jump(end_block);
+
+    lower_set_block(false_block);
+    struct ir_value false_value = lower_rvalue(tenary_node->tenary.false_node);
+    struct ir_block *false_end_block = lower_current_block();
+    lower_jump(end_block);
+
+    lower_seal_block(end_block);
+    lower_set_block(end_block);
+
+    struct ir_value result = {};
+    result.dtype = true_value.dtype.flags & DATATYPE_FLAG_IS_LITERAL ? false_value.dtype : true_value.dtype;
+    int type = true_value.ins->type == IR_TYPE_PTR || false_value.ins->type == IR_TYPE_PTR ? IR_TYPE_PTR : IR_TYPE_I32;
+    result.ins = ir_instruction_create(lower.function, IR_OP_PHI, type);
+    ir_block_prepend(end_block, result.ins);
+    ir_phi_add_incoming(result.ins, true_value.ins, true_end_block);
+    ir_phi_add_incoming(result.ins, false_value.ins, false_end_block);
+    return result;
+}
+
+static struct ir_value lower_assignment(struct node *node, bool discard)
+{
+    struct ir_lvalue lvalue = {};
+    if (!lower_lvalue(node->exp.left, &lvalue))
+        return lower_fail();
+
+    struct ir_value right = lower_rvalue(node->exp.right);
+    struct ir_value value = right;
+    if (!S_EQ(node->exp.op, "="))
+    {
+        // Compound assignment i.e "+=" the operator is everything before the "="
+        char op[4] = {};
+        strncpy(op, node->exp.op, strlen(node->exp.op) - 1);
+        value = lower_arithmetic(op, lower_lvalue_load(&lvalue), right);
+    }
+
+    struct ir_value result = {};
+    result.dtype = lvalue.dtype;
+    result.ins = lower_lvalue_store(&lvalue, value.ins);
+    if (!discard)
+    {
+        result.ins = lower_convert(result.ins, &lvalue.dtype);
+    }
+    return result;
+}
+
+static struct ir_value lower_expression(struct node *node, bool discard)
+{
+    const char *op = node->exp.op;
+    if (is_access_node(node) || is_array_node(node) || is_parentheses_node(node))
+    {
+        struct ir_lvalue lvalue;
+        struct ir_value value;
+        if (lower_access(node, &lvalue, &value))
+        {
+            return lower_lvalue_load(&lvalue);
+        }
+        return lower.failed ? lower_fail() : value;
+    }
+
+    if (lower_op_is_assignment(op))
+        return lower_assignment(node, discard);
+
+    if (S_EQ(op, "&&") || S_EQ(op, "||"))
+        return lower_logical(node);
+
+    if (S_EQ(op, "?"))
+        return lower_tenary(node);
+
+    if (is_argument_operator(op))
+        return lower_fail();
+
+    struct ir_value left = lower_rvalue(node->exp.left);
+    struct ir_value right = lower_rvalue(node->exp.right);
+    return lower_arithmetic(op, left, right);
+}
+
+static struct ir_value lower_increment(struct node *node, bool discard)
+{
+    struct ir_lvalue lvalue = {};
+    if (!lower_lvalue(node->unary.operand, &lvalue))
+        return lower_fail();
+
+    struct ir_value old_value = lower_lvalue_load(&lvalue);
+    long amount = lower_datatype_is_pointer(&lvalue.dtype) ? lower_pointee_size(&lvalue.dtype) : 1;
+    if (S_EQ(node->unary.op, "--"))
+    {
+        amount = -amount;
+    }
+
+    struct ir_value result = {};
+    result.dtype = lvalue.dtype;
+    struct ir_instruction *new_value = lower_emit_binary(IR_OP_ADD, old_value.ins->type, old_value.ins, lower_const(amount));
+    new_value = lower_lvalue_store(&lvalue, new_value);
+    if (node->unary.flags & UNARY_FLAG_IS_RIGHT_OPERANDED_UNARY)
+    {
+        // i++ gives the value before the increment
+        result.ins = old_value.ins;
+        return result;
+    }
+
+    result.ins = discard ? new_value : lower_convert(new_value, &lvalue.dtype);
+    return result;
+}
+
+static struct ir_value lower_unary(struct node *node, bool discard)
+{
+    const char *op = node->unary.op;
+    if (op_is_indirection(op))
+    {
+        struct ir_lvalue lvalue = {};
+        if (!lower_lvalue(node, &lvalue))
+            return lower_fail();
+
+        return lower_lvalue_load(&lvalue);
+    }
+
+    if (op_is_address(op))
+    {
+        struct node *operand = node->unary.operand;
+        while (operand->type == NODE_TYPE_EXPRESSION_PARENTHESIS)
+        {
+            operand = operand->parenthesis.exp;
+        }
+
+        struct ir_value result = {};
+        if (operand->type == NODE_TYPE_IDENTIFIER && !lower_scope_find_variable(operand->sval))
+        {
+            // Taking the address of a function
+            struct node *global_node = lower_global_node(operand->sval);
+            if (global_node && global_node->type == NODE_TYPE_FUNCTION)
+            {
+                result.ins = lower_global_address(global_node->func.name);
+                result.dtype = lower_datatype_address_of(&global_node->func.rtype);
+                return result;
+            }
+        }
+
+        struct ir_lvalue lvalue = {};
+        if (!lower_lvalue(operand, &lvalue) || lvalue.type != IR_LVALUE_TYPE_MEMORY)
+            return lower_fail();
+
+        struct datatype dtype = lvalue.dtype;
+        if (lower_datatype_is_array(&dtype, lvalue.array_index))
+        {
+            dtype = lower_datatype_array_element(&dtype);
+        }
+        result.ins = lvalue.address;
+        result.dtype = lower_datatype_address_of(&dtype);
+        return result;
+    }
+
+    if (S_EQ(op, "++") || S_EQ(op, "--"))
+        return lower_increment(node, discard);
+
+    struct ir_value operand = lower_rvalue(node->unary.operand);
+    struct ir_value result = {};
+    result.dtype = operand.dtype;
+    if (S_EQ(op, "-"))
+    {
+        result.ins = operand.ins->op == IR_OP_CONST ? lower_const(-operand.ins->value) : lower_emit_unary(IR_OP_NEG, IR_TYPE_I32, operand.ins);
+    }
+    else if (S_EQ(op, "~"))
+    {
+        result.ins = operand.ins->op == IR_OP_CONST ? lower_const(~operand.ins->value) : lower_emit_unary(IR_OP_NOT, IR_TYPE_I32, operand.ins);
+    }
+    else if (S_EQ(op, "!"))
+    {
+        result.ins = operand.ins->op == IR_OP_CONST ? lower_const(!operand.ins->value) : lower_emit_binary(IR_OP_EQ, IR_TYPE_I32, operand.ins, lower_const(0));
+        result.dtype = datatype_for_numeric();
+    }
+    else
+    {
+        return lower_fail();
+    }
+
+    return result;
+}
+
+static struct ir_value lower_identifier(struct node *node)
+{
+    struct ir_value result = {};
+    struct ir_lvalue lvalue = {};
+    if (lower_lvalue_for_identifier(node, &lvalue))
+        return lower_lvalue_load(&lvalue);
+
+    struct node *global_node = lower_global_node(node->sval);
+    if (!global_node || global_node->type != NODE_TYPE_FUNCTION)
+        return lower_fail();
+
+    // Functions used as values are their address
+    result.ins = lower_global_address(global_node->func.name);
+    result.dtype = lower_datatype_address_of(&global_node->func.rtype);
+    return result;
+}
+
+static struct ir_value lower_cast(struct node *node)
+{
+    struct ir_value operand = lower_rvalue(node->cast.operand);
+    struct datatype *dtype = &node->cast.dtype;
+    if (lower_mem_type(dtype) == IR_TYPE_VOID && !datatype_is_void_no_ptr(dtype))
+        return lower_fail();
+
+    struct ir_value result = {};
+    result.ins = lower_convert(operand.ins, dtype);
+    result.dtype = *dtype;
+    return result;
+}
+
+static struct ir_value _lower_rvalue(struct node *node)
+{
+    bool discard = lower.discard_result;
+    lower.discard_result = false;
+    lower.line = node->pos.line;
+
+    struct ir_value result = {};
+    switch (node->type)
+    {
+    case NODE_TYPE_NUMBER:
+        if (node->num.type == NUMBER_TYPE_FLOAT || node->num.type == NUMBER_TYPE_DOUBLE)
+            return lower_fail();
+
+        result.ins = lower_const((int32_t)node->llnum);
+        result.dtype = datatype_for_numeric();
+        break;
+
+    case NODE_TYPE_STRING:
+        result.ins = lower_global_address(codegen_register_string(node->sval));
+        result.dtype = datatype_for_string();
+        break;
+
+    case NODE_TYPE_IDENTIFIER:
+        result = lower_identifier(node);
+        break;
+
+    case NODE_TYPE_EXPRESSION:
+        result = lower_expression(node, discard);
+        break;
+
+    case NODE_TYPE_EXPRESSION_PARENTHESIS:
+        lower.discard_result = discard;
+        result = _lower_rvalue(node->parenthesis.exp);
+        break;
+
+    case NODE_TYPE_UNARY:
+        result = lower_unary(node, discard);
+        break;
+
+    case NODE_TYPE_CAST:
+        result = lower_cast(node);
+        break;
+
+    default:
+        result = lower_fail();
+    }
+
+    return result;
+}
+
+static struct ir_value lower_rvalue(struct node *node)
+{
+    struct ir_value value = _lower_rvalue(node);
+    if (value.ins->type == IR_TYPE_VOID)
+    {
+        // A void function call cannot be used as a value
+        return lower_fail();
+    }
+
+    if (lower_datatype_is_float(&value.dtype))
+        return lower_fail();
+
+    return value;
+}
+
+static void lower_discarded_expression(struct node *node)
+{
+    lower.discard_result = true;
+    _lower_rvalue(node);
+    lower.discard_result = false;
+}
+
+static void lower_variable_declaration(struct node *var_node)
+{
+    struct datatype *dtype = &var_node->var.type;
+    if (dtype->flags & (DATATYPE_FLAG_IS_STATIC | DATATYPE_FLAG_IS_EXTERN | DATATYPE_FLAG_IS_THREAD_LOCAL) || lower_datatype_is_float(dtype))
+    {
+        lower_fail();
+        return;
+    }
+
+    struct ir_value value = {};
+    if (var_node->var.val)
+    {
+        value = lower_rvalue(var_node->var.val);
+    }
+
+    // The variable comes into scope after its initializer
+    lower_scope_push_variable(var_node);
+    if (!var_node->var.val)
+        return;
+
+    struct ir_lvalue lvalue = {};
+    lower_lvalue_for_variable(var_node, &lvalue);
+    lower_lvalue_store(&lvalue, value.ins);
+}
+
+static void lower_body(struct node *node)
+{
+    lower_scope_new();
+    for (int i = 0; i < vector_count(node->body.statements); i++)
+    {
+        lower_statement(vector_peek_ptr_at(node->body.statements, i));
+    }
+    lower_scope_finish();
+}
+
+static void lower_return(struct node *node)
+{
+    struct node *func_node = lower.function->node;
+    struct ir_instruction *value = NULL;
+    if (node->stmt.ret.exp)
+    {
+        if (datatype_is_void_no_ptr(&func_node->func.rtype))
+        {
+            lower_discarded_expression(node->stmt.ret.exp);
+        }
+        else
+        {
+            value = lower_convert(lower_rvalue(node->stmt.ret.exp).ins, &func_node->func.rtype);
+        }
+    }
+
+    struct ir_instruction *instruction = lower_emit(IR_OP_RETURN, IR_TYPE_VOID);
+    if (value)
+    {
+        ir_instruction_add_operand(instruction, value);
+    }
+    lower.block = NULL;
+}
+
+/**
+ * Returns true if the condition is a pointer compared with zero i.e "ptr == NULL"
+ */
+static bool lower_is_null_pointer_check(struct ir_instruction *cond)
+{
+    if (cond->op != IR_OP_EQ)
+        return false;
+
+    struct ir_instruction *left = ir_instruction_operand(cond, 0);
+    struct ir_instruction *right = ir_instruction_operand(cond, 1);
+    return (left->type == IR_TYPE_PTR && right->op == IR_OP_CONST && right->value == 0) ||
+           (right->type == IR_TYPE_PTR && left->op == IR_OP_CONST && left->value == 0);
+}
+
+static bool lower_if_body_is_unlikely(struct node *node, struct ir_instruction *cond)
+{
+    int prediction = predict_if_stmt(node);
+    if (prediction != PREDICT_UNKNOWN)
+        return prediction == PREDICT_NOT_TAKEN;
+
+    return lower_is_null_pointer_check(cond);
+}
+
+static void lower_if_chain(struct node *node, struct ir_block *end_block)
+{
+    struct ir_block *then_block = ir_block_create(lower.function);
+    struct ir_block *else_block = node->stmt._if.next ? ir_block_create(lower.function) : end_block;
+
+    struct ir_value cond = lower_rvalue(node->stmt._if.cond_node);
+    lower_branch(cond.ins, then_block, else_block);
+    lower_seal_block(then_block);
+    if (lower_if_body_is_unlikely(node, cond.ins))
+    {
+        then_block->flags |= IR_BLOCK_FLAG_UNLIKELY;
+    }
+
+    lower_set_block(then_block);
+    lower_statement(node->stmt._if.body_node);
+    lower_jump(end_block);
+
+    struct node *next = node->stmt._if.next;
+    if (!next)
+        return;
+
+    lower_seal_block(else_block);
+    lower_set_block(else_block);
+    if (next->type == NODE_TYPE_STATEMENT_IF)
+    {
+        lower_if_chain(next, end_block);
+        return;
+    }
+
+    lower_statement(next->stmt._else.body_node);
+    lower_jump(end_block);
+}
+
+static void lower_if(struct node *node)
+{
+    struct ir_block *end_block = ir_block_create(lower.function);
+    lower_if_chain(node, end_block);
+    lower_seal_block(end_block);
+    lower_set_block(end_block);
+}
+
+static void lower_loop_push(struct ir_block *break_block, struct ir_block *continue_block)
+{
+    vector_push(lower.break_blocks, &break_block);
+    vector_push(lower.continue_blocks, &continue_block);
+}
+
+static void lower_loop_pop()
+{
+    vector_pop(lower.break_blocks);
+    vector_pop(lower.continue_blocks);
+}
+
+static void lower_while(struct node *node)
+{
+    struct ir_block *header_block = ir_block_create(lower.function);
+    struct ir_block *body_block = ir_block_create(lower.function);
+    struct ir_block *exit_block = ir_block_create(lower.function);
+
+    lower_jump(header_block);
+    lower_set_block(header_block);
+    struct ir_value cond = lower_rvalue(node->stmt._while.cond);
+    lower_branch(cond.ins, body_block, exit_block);
+    lower_seal_block(body_block);
+
+    lower_set_block(body_block);
+    lower_loop_push(exit_block, header_block);
+    lower_statement(node->stmt._while.body);
+    lower_loop_pop();
+    lower_jump(header_block);
+
+    lower_seal_block(header_block);
+    lower_seal_block(exit_block);
+    lower_set_block(exit_block);
+}
+
+static void lower_do_while(struct node *node)
+{
+    struct ir_block *body_block = ir_block_create(lower.function);
+    struct ir_block *cond_block = ir_block_create(lower.function);
+    struct ir_block *exit_block = ir_block_create(lower.function);
+
+    lower_jump(body_block);
+    lower_set_block(body_block);
+    lower_loop_push(exit_block, cond_block);
+    lower_statement(node->stmt._do_while.body);
+    lower_loop_pop();
+    lower_jump(cond_block);
+
+    lower_seal_block(cond_block);
+    lower_set_block(cond_block);
+    struct ir_value cond = lower_rvalue(node->stmt._do_while.cond);
+    lower_branch(cond.ins, body_block, exit_block);
+
+    lower_seal_block(body_block);
+    lower_seal_block(exit_block);
+    lower_set_block(exit_block);
+}
+
+static void lower_for(struct node *node)
+{
+    struct ir_block *header_block = ir_block_create(lower.function);
+    struct ir_block *body_block = ir_block_create(lower.function);
+    struct ir_block *latch_block = ir_block_create(lower.function);
+    struct ir_block *exit_block = ir_block_create(lower.function);
+
+    lower_scope_new();
+    if (node->stmt._for.init)
+    {
+        lower_statement(node->stmt._for.init);
+    }
+
+    lower_jump(header_block);
+    lower_set_block(header_block);
+    if (node->stmt._for.cond)
+    {
+        struct ir_value cond = lower_rvalue(node->stmt._for.cond);
+        lower_branch(cond.ins, body_block, exit_block);
+    }
+    else
+    {
+        lower_jump(body_block);
+    }
+    lower_seal_block(body_block);
+
+    lower_set_block(body_block);
+    lower_loop_push(exit_block, latch_block);
+    lower_statement(node->stmt._for.body);
+    lower_loop_pop();
+    lower_jump(latch_block);
+
+    lower_seal_block(latch_block);
+    lower_set_block(latch_block);
+    if (node->stmt._for.loop)
+    {
+        lower_discarded_expression(node->stmt._for.loop);
+    }
+    lower_jump(header_block);
+
+    lower_seal_block(header_block);
+    lower_seal_block(exit_block);
+    lower_set_block(exit_block);
+    lower_scope_finish();
+}
+
+static void lower_switch(struct node *node)
+{
+    struct vector *saved_cases = lower.switch_cases;
+    struct ir_block *saved_default = lower.switch_default;
+    lower.switch_cases = vector_create(sizeof(struct ir_switch_case));
+    lower.switch_default = NULL;
+
+    struct ir_value value = lower_rvalue(node->stmt._switch.exp);
+    struct ir_block *dispatch_block = lower_current_block();
+    int dispatch_line = lower.line;
+    struct ir_block *exit_block = ir_block_create(lower.function);
+
+    // The body is lowered first so we know every case, the comparisons are added
+    // to the dispatch block afterwards.
+    lower.block = NULL;
+    vector_push(lower.break_blocks, &exit_block);
+    lower_statement(node->stmt._switch.body);
+    vector_pop(lower.break_blocks);
+    lower_jump(exit_block);
+
+    lower.block = dispatch_block;
+    lower.line = dispatch_line;
+    for (int i = 0; i < vector_count(lower.switch_cases); i++)
+    {
+        struct ir_switch_case *_case = vector_at(lower.switch_cases, i);
+        struct ir_block *next_block = ir_block_create(lower.function);
+        struct ir_instruction *cond = lower_emit_binary(IR_OP_EQ, IR_TYPE_I32, value.ins, lower_const(_case->value));
+        lower_branch(cond, _case->block, next_block);
+        lower_seal_block(next_block);
+        lower_set_block(next_block);
+    }
+    lower_jump(lower.switch_default ? lower.switch_default : exit_block);
+
+    for (int i = 0; i < vector_count(lower.switch_cases); i++)
+    {
+        struct ir_switch_case *_case = vector_at(lower.switch_cases, i);
+        lower_seal_block(_case->block);
+    }
+    if (lower.switch_default)
+    {
+        lower_seal_block(lower.switch_default);
+    }
+
+    vector_free(lower.switch_cases);
+    lower.switch_cases = saved_cases;
+    lower.switch_default = saved_default;
+
+    lower_seal_block(exit_block);
+    lower_set_block(exit_block);
+}
+
+static void lower_case(struct node *node)
+{
+    struct node *exp = node->stmt._case.exp;
+    if (!lower.switch_cases || exp->type != NODE_TYPE_NUMBER)
+    {
+        lower_fail();
+        return;
+    }
+
+    struct ir_switch_case _case = {.value = (int32_t)exp->llnum, .block = ir_block_create(lower.function)};
+    vector_push(lower.switch_cases, &_case);
+
+    // Falling through from the previous case
+    lower_jump(_case.block);
+    lower_set_block(_case.block);
+}
+
+static void lower_default(struct node *node)
+{
+    if (!lower.switch_cases)
+    {
+        lower_fail();
+        return;
+    }
+
+    lower.switch_default = ir_block_create(lower.function);
+    lower_jump(lower.switch_default);
+    lower_set_block(lower.switch_default);
+}
+
+static void lower_break_or_continue(struct vector *targets)
+{
+    if (vector_count(targets) == 0)
+    {
+        lower_fail();
+        return;
+    }
+
+    lower_jump(vector_back_ptr(targets));
+}
+
+static struct ir_block *lower_label_block(const char *name)
+{
+    for (int i = 0; i < vector_count(lower.labels); i++)
+    {
+        struct ir_label *label = vector_at(lower.labels, i);
+        if (S_EQ(label->name, name))
+            return label->block;
+    }
+
+    struct ir_label label = {.name = name, .block = ir_block_create(lower.function)};
+    vector_push(lower.labels, &label);
+    return label.block;
+}
+
+static bool lower_statement_is_compound(struct node *node)
+{
+    return node->type == NODE_TYPE_BODY || node->type == NODE_TYPE_STATEMENT_IF || node->type == NODE_TYPE_STATEMENT_WHILE ||
+           node->type == NODE_TYPE_STATEMENT_DO_WHILE || node->type == NODE_TYPE_STATEMENT_FOR || node->type == NODE_TYPE_STATEMENT_SWITCH;
+}
+
+static void lower_statement(struct node *node)
+{
+    // Compound statements are positioned where they end, their lines come from the code inside them instead
+    if (!lower_statement_is_compound(node))
+    {
+        lower.line = node->pos.line;
+    }
+
+    switch (node->type)
+    {
+    case NODE_TYPE_VARIABLE:
+        lower_variable_declaration(node);
+        break;
+
+    case NODE_TYPE_VARIABLE_LIST:
+        for (int i = 0; i < vector_count(node->var_list.list); i++)
+        {
+            lower_variable_declaration(vector_peek_ptr_at(node->var_list.list, i));
+        }
+        break;
+
+    case NODE_TYPE_BODY:
+        lower_body(node);
+        break;
+
+    case NODE_TYPE_STATEMENT_RETURN:
+        lower_return(node);
+        break;
+
+    case NODE_TYPE_STATEMENT_IF:
+        lower_if(node);
+        break;
+
+    case NODE_TYPE_STATEMENT_WHILE:
+        lower_while(node);
+        break;
+
+    case NODE_TYPE_STATEMENT_DO_WHILE:
+        lower_do_while(node);
+        break;
+
+    case NODE_TYPE_STATEMENT_FOR:
+        lower_for(node);
+        break;
+
+    case NODE_TYPE_STATEMENT_SWITCH:
+        lower_switch(node);
+        break;
+
+    case NODE_TYPE_STATEMENT_CASE:
+        lower_case(node);
+        break;
+
+    case NODE_TYPE_STATEMENT_DEFAULT:
+        lower_default(node);
+        break;
+
+    case NODE_TYPE_STATEMENT_BREAK:
+        lower_break_or_continue(lower.break_blocks);
+        break;
+
+    case NODE_TYPE_STATEMENT_CONTINUE:
+        lower_break_or_continue(lower.continue_blocks);
+        break;
+
+    case NODE_TYPE_STATEMENT_GOTO:
+        lower_jump(lower_label_block(node->stmt._goto.label->sval));
+        break;
+
+    case NODE_TYPE_LABEL:
+    {
+        struct ir_block *block = lower_label_block(node->label.name->sval);
+        lower_jump(block);
+        lower_set_block(block);
+    }
+    break;
+
+    case NODE_TYPE_STRUCT:
+    case NODE_TYPE_UNION:
+        // Declaring a structure inside a function is fine, declaring a variable with it is not supported.
+        if (node->flags & NODE_FLAG_HAS_VARIABLE_COMBINED)
+        {
+            lower_fail();
+        }
+        break;
+
+    case NODE_TYPE_BLANK:
+        break;
+
+    case NODE_TYPE_STATEMENT_ASM:
+        // The operands are bound to physical registers, the function is generated without the IR
+        lower_fail();
+        break;
+
+    case NODE_TYPE_NUMBER:
+    case NODE_TYPE_IDENTIFIER:
+    case NODE_TYPE_STRING:
+    case NODE_TYPE_EXPRESSION:
+    case NODE_TYPE_EXPRESSION_PARENTHESIS:
+    case NODE_TYPE_UNARY:
+    case NODE_TYPE_CAST:
+        lower_discarded_expression(node);
+        break;
+
+    default:
+        lower_fail();
+    }
+}
+
+/**
+ * Records the names of all variables that have their address taken with the "&" operator
+ * these variables cannot be promoted into virtual registers.
+ */
+static void lower_find_address_taken(struct node *node)
+{
+    if (!node)
+        return;
+
+    switch (node->type)
+    {
+    case NODE_TYPE_EXPRESSION:
+        lower_find_address_taken(node->exp.left);
+        lower_find_address_taken(node->exp.right);
+        break;
+    case NODE_TYPE_EXPRESSION_PARENTHESIS:
+        lower_find_address_taken(node->parenthesis.exp);
+        break;
+    case NODE_TYPE_UNARY:
+        if (op_is_address(node->unary.op))
+        {
+            struct node *operand = node->unary.operand;
+            while (operand->type == NODE_TYPE_EXPRESSION_PARENTHESIS)
+            {
+                operand = operand->parenthesis.exp;
+            }
+
+            if (operand->type == NODE_TYPE_IDENTIFIER)
+            {
+                vector_push(lower.address_taken, &operand->sval);
+            }
+        }
+        lower_find_address_taken(node->unary.operand);
+        break;
+    case NODE_TYPE_CAST:
+        lower_find_address_taken(node->cast.operand);
+        break;
+    case NODE_TYPE_TENARY:
+        lower_find_address_taken(node->tenary.true_node);
+        lower_find_address_taken(node->tenary.false_node);
+        break;
+    case NODE_TYPE_BRACKET:
+        lower_find_address_taken(node->bracket.inner);
+        break;
+    case NODE_TYPE_VARIABLE:
+        lower_find_address_taken(node->var.val);
+        break;
+    case NODE_TYPE_VARIABLE_LIST:
+        for (int i = 0; i < vector_count(node->var_list.list); i++)
+        {
+            lower_find_address_taken(vector_peek_ptr_at(node->var_list.list, i));
+        }
+        break;
+    case NODE_TYPE_BODY:
+        for (int i = 0; i < vector_count(node->body.statements); i++)
+        {
+            lower_find_address_taken(vector_peek_ptr_at(node->body.statements, i));
+        }
+        break;
+    case NODE_TYPE_STATEMENT_RETURN:
+        lower_find_address_taken(node->stmt.ret.exp);
+        break;
+    case NODE_TYPE_STATEMENT_IF:
+        lower_find_address_taken(node->stmt._if.cond_node);
+        lower_find_address_taken(node->stmt._if.body_node);
+        lower_find_address_taken(node->stmt._if.next);
+        break;
+    case NODE_TYPE_STATEMENT_ELSE:
+        lower_find_address_taken(node->stmt._else.body_node);
+        break;
+    case NODE_TYPE_STATEMENT_WHILE:
+        lower_find_address_taken(node->stmt._while.cond);
+        lower_find_address_taken(node->stmt._while.body);
+        break;
+    case NODE_TYPE_STATEMENT_DO_WHILE:
+        lower_find_address_taken(node->stmt._do_while.body);
+        lower_find_address_taken(node->stmt._do_while.cond);
+        break;
+    case NODE_TYPE_STATEMENT_FOR:
+        lower_find_address_taken(node->stmt._for.init);
+        lower_find_address_taken(node->stmt._for.cond);
+        lower_find_address_taken(node->stmt._for.loop);
+        lower_find_address_taken(node->stmt._for.body);
+        break;
+    case NODE_TYPE_STATEMENT_SWITCH:
+        lower_find_address_taken(node->stmt._switch.exp);
+        lower_find_address_taken(node->stmt._switch.body);
+        break;
+    }
+}
+
+static bool lower_function_supported(struct node *func_node)
+{
+    struct datatype *rtype = &func_node->func.rtype;
+    if (func_node->func.flags & (FUNCTION_NODE_FLAG_IS_NATIVE | FUNCTION_NODE_FLAG_IS_VARIADIC))
+        return false;
+
+    if (lower_datatype_is_struct_value(rtype) || lower_datatype_is_float(rtype))
+        return false;
+
+    return true;
+}
+
+static void lower_function_arguments(struct node *func_node)
+{
+    struct vector *arguments = function_node_argument_vec(func_node);
+    for (int i = 0; i < vector_count(arguments); i++)
+    {
+        struct node *var_node = vector_peek_ptr_at(arguments, i);
+        lower_scope_push_variable(var_node);
+        if (lower_datatype_is_float(&var_node->var.type))
+        {
+            lower_fail();
+            return;
+        }
+
+        struct ir_frame_slot *slot = lower_memory_variable_slot(var_node, IR_FRAME_SLOT_FLAG_IS_ARGUMENT);
+        if (lower_variable_in_memory(var_node))
+            continue;
+
+        struct ir_instruction *param = lower_emit(IR_OP_PARAM, lower_value_type(&var_node->var.type));
+        param->slot = slot;
+        param->mem_type = lower_mem_type(&var_node->var.type);
+        param->node = var_node;
+        if (lower_datatype_is_signed(&var_node->var.type))
+        {
+            param->flags |= IR_INSTRUCTION_FLAG_SIGNED;
+        }
+        lower_write_variable(var_node, lower_current_block(), param);
+    }
+}
+
+static void lower_finish_layout()
+{
+    struct ir_function *function = lower.function;
+    struct vector *blocks = vector_create(sizeof(struct ir_block *));
+    for (int i = 0; i < vector_count(lower.block_order); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(lower.block_order, i);
+        vector_push(blocks, &block);
+    }
+
+    // Blocks that were never started are never jumped to from reachable code
+    // give them a terminator so they remain valid until they are removed.
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        if (!ir_block_terminator(block))
+        {
+            struct ir_instruction *instruction = ir_instruction_create(function, IR_OP_RETURN, IR_TYPE_VOID);
+            ir_block_append(block, instruction);
+        }
+
+        bool started = false;
+        for (int b = 0; b < vector_count(lower.block_order); b++)
+        {
+            if (vector_peek_ptr_at(lower.block_order, b) == block)
+            {
+                started = true;
+                break;
+            }
+        }
+
+        if (!started)
+        {
+            vector_push(blocks, &block);
+        }
+    }
+
+    vector_free(function->blocks);
+    function->blocks = blocks;
+}
+
+struct ir_function *ir_lower_function(struct compile_process *process, struct node *func_node)
+{
+    if (!lower_function_supported(func_node))
+        return NULL;
+
+    memset(&lower, 0, sizeof(lower));
+    lower.process = process;
+    lower.function = ir_function_create(func_node);
+    lower.scopes = vector_create(sizeof(struct vector *));
+    lower.memory_variables = vector_create(sizeof(struct ir_memory_variable));
+    lower.address_taken = vector_create(sizeof(const char *));
+    lower.break_blocks = vector_create(sizeof(struct ir_block *));
+    lower.continue_blocks = vector_create(sizeof(struct ir_block *));
+    lower.labels = vector_create(sizeof(struct ir_label));
+    lower.block_order = vector_create(sizeof(struct ir_block *));
+
+    lower_find_address_taken(func_node->func.body_n);
+
+    struct ir_block *entry_block = ir_block_create(lower.function);
+    entry_block->ssa.sealed = true;
+    lower_set_block(entry_block);
+
+    lower_scope_new();
+    lower_function_arguments(func_node);
+    lower_body(func_node->func.body_n);
+    lower_scope_finish();
+
+    if (lower.block)
+    {
+        // Falling off the end of the function
+        lower_emit(IR_OP_RETURN, IR_TYPE_VOID);
+        lower.block = NULL;
+    }
+
+    // Labels can be jumped to from anywhere in the function, so their predecessors
+    // are only known now.
+    for (int i = 0; i < vector_count(lower.labels); i++)
+    {
+        struct ir_label *label = vector_at(lower.labels, i);
+        lower_seal_block(label->block);
+    }
+
+    struct ir_function *function = lower.function;
+    if (lower.failed)
+        return NULL;
+
+    lower_finish_layout();
+    ir_function_remove_unreachable_blocks(function);
+    ir_function_remove_trivial_phis(function);
+    if (ir_verify_function(function) != IR_VERIFY_ALL_OK)
+    {
+        compiler_error(process, "The intermediate representation for the function %s is invalid", function->name);
+    }
+
+    return function;
+}
@@ -0,0 +1,35 @@
+#include "compiler.h"
+
+void ir_optimize_function(struct compile_process *process, struct ir_function *function)
+{
+    ir_eliminate_dead_code(process, function);
+    ir_hoist_loop_invariants(process, function);
+    if (process->flags & COMPILE_PROCESS_VECTORIZE_LOOPS)
+    {
+        ir_vectorize_loops(process, function);
+    }
+    // The profile picks out the loops worth unrolling even when unrolling was not asked for,
+    // samples cannot tell how many times a loop iterates so they never turn it on.
+    bool unroll = process->flags & COMPILE_PROCESS_UNROLL_LOOPS || (function->profiled && !function->sampled);
+    if (unroll && ir_unroll_loops(process, function))
+    {
+        // The copies of the loop tests and induction variables fold away
+        ir_eliminate_dead_code(process, function);
+    }
+    if (ir_reduce_induction_variables(process, function))
+    {
+        // The multiplications and counters the pointers replaced are no longer used
+        ir_eliminate_dead_code(process, function);
+    }
+    if (ir_eliminate_common_subexpressions(process, function))
+    {
+        // Values that were only used by the eliminated instructions are now dead
+        ir_eliminate_dead_code(process, function);
+    }
+    if (ir_verify_function(function) != IR_VERIFY_ALL_OK)
+    {
+        compiler_error(process, "The optimized intermediate representation for the function %s is invalid", function->name);
+    }
+
+    ir_layout_blocks(process, function);
+}
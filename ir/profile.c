@@ -0,0 +1,216 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Block counters for profile guided optimization. The counters are added right after lowering so
+ * the blocks are numbered the same way when the program is compiled again with the profile,
+ * every block id gets its own counter in the record named after the function.
+ *
+ * The counter updates are volatile so that the optimizer keeps one update per block that runs,
+ * copies of a block made by loop unrolling update the counter of the block they were copied from.
+ */
+
+static struct ir_instruction *ir_profile_prepend(struct ir_block *block, int op, int type)
+{
+    struct ir_instruction *instruction = ir_instruction_create(block->function, op, type);
+    ir_block_prepend(block, instruction);
+    return instruction;
+}
+
+static void ir_profile_count_block(struct ir_block *block, const char *counters, int index)
+{
+    // Prepended in reverse, each instruction goes in front of the one before it
+    struct ir_instruction *store = ir_profile_prepend(block, IR_OP_STORE, IR_TYPE_VOID);
+    struct ir_instruction *next = ir_profile_prepend(block, IR_OP_ADD, IR_TYPE_I32);
+    struct ir_instruction *one = ir_profile_prepend(block, IR_OP_CONST, IR_TYPE_I32);
+    struct ir_instruction *count = ir_profile_prepend(block, IR_OP_LOAD, IR_TYPE_I32);
+    struct ir_instruction *address = ir_profile_prepend(block, IR_OP_GLOBAL_ADDRESS, IR_TYPE_PTR);
+
+    address->symbol = counters;
+    address->value = index * DATA_SIZE_DWORD;
+    count->mem_type = IR_TYPE_I32;
+    count->flags |= IR_INSTRUCTION_FLAG_VOLATILE;
+    ir_instruction_add_operand(count, address);
+    one->value = 1;
+    ir_instruction_add_operand(next, count);
+    ir_instruction_add_operand(next, one);
+    store->mem_type = IR_TYPE_I32;
+    store->flags |= IR_INSTRUCTION_FLAG_VOLATILE;
+    ir_instruction_add_operand(store, address);
+    ir_instruction_add_operand(store, next);
+}
+
+void ir_profile_instrument(struct compile_process *process, struct ir_function *function)
+{
+    struct profile_record *record = profile_record_create(process, function->name, function->total_blocks);
+    char *symbol = malloc(64);
+    sprintf(symbol, "__profile_counters_%i", record->id);
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        ir_profile_count_block(block, symbol, block->id);
+    }
+}
+
+bool ir_profile_annotate(struct compile_process *process, struct ir_function *function)
+{
+    struct profile_record *record = profile_record_find(process, function->name, function->total_blocks);
+    if (!record)
+        return false;
+
+    function->profiled = true;
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        block->count = record->counts[block->id];
+        // What ran replaces the static guesses
+        block->flags &= ~IR_BLOCK_FLAG_UNLIKELY;
+        if (block->count == 0)
+        {
+            block->flags |= IR_BLOCK_FLAG_COLD;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Returns the most samples taken on any of the source lines of the block, -1 if no code of the
+ * block came from a source line.
+ */
+static long ir_profile_block_samples(struct ir_block *block, struct profile_record *record)
+{
+    long samples = -1;
+    for (int i = 0; i < vector_count(block->lines); i++)
+    {
+        int line = *(int *)vector_at(block->lines, i);
+        long count = line < record->total_counters ? record->counts[line] : 0;
+        if (count > samples)
+        {
+            samples = count;
+        }
+    }
+
+    return samples;
+}
+
+/**
+ * Blocks without source lines i.e the joins after an if statement take the most samples
+ * of the blocks they are connected to, returns true if any block was given samples.
+ */
+static bool ir_profile_spread_samples(struct ir_function *function, long *samples)
+{
+    bool changed = false;
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        if (samples[block->index] >= 0)
+            continue;
+
+        long most = -1;
+        for (int p = 0; p < vector_count(block->predecessors); p++)
+        {
+            struct ir_block *predecessor = vector_peek_ptr_at(block->predecessors, p);
+            most = samples[predecessor->index] > most ? samples[predecessor->index] : most;
+        }
+        for (int s = 0; s < ir_block_total_successors(block); s++)
+        {
+            struct ir_block *successor = ir_block_successor(block, s);
+            most = samples[successor->index] > most ? samples[successor->index] : most;
+        }
+
+        if (most >= 0)
+        {
+            samples[block->index] = most;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+/**
+ * A block that dominates a block that was sampled ran as well, even if it was too short to be sampled itself
+ */
+static void ir_profile_warm_dominators(struct ir_function *function, long *samples)
+{
+    struct ir_dominators *dominators = ir_dominators(function);
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        if (samples[block->index] <= 0)
+            continue;
+
+        for (struct ir_block *dominator = dominators->idom[block->index]; dominator; dominator = dominators->idom[dominator->index])
+        {
+            if (samples[dominator->index] <= 0)
+            {
+                samples[dominator->index] = 1;
+            }
+        }
+    }
+
+    ir_dominators_free(dominators);
+}
+
+static bool ir_profile_block_returns(struct ir_block *block)
+{
+    struct ir_instruction *terminator = ir_block_terminator(block);
+    return terminator && terminator->op == IR_OP_RETURN;
+}
+
+bool ir_profile_annotate_samples(struct compile_process *process, struct ir_function *function)
+{
+    struct profile_record *record = profile_samples_find(process, function->name);
+    if (!record)
+        return false;
+
+    ir_function_number_blocks(function);
+    long *samples = calloc(vector_count(function->blocks), sizeof(long));
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        samples[block->index] = ir_profile_block_samples(block, record);
+    }
+
+    // The function ran so it returned, a return that is too short to be sampled is still warm
+    bool sampled_return = false;
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        sampled_return |= ir_profile_block_returns(block) && samples[block->index] > 0;
+    }
+    for (int i = 0; i < vector_count(function->blocks) && !sampled_return; i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        if (ir_profile_block_returns(block) && samples[block->index] == 0)
+        {
+            samples[block->index] = 1;
+        }
+    }
+
+    while (ir_profile_spread_samples(function, samples))
+    {
+    }
+    ir_profile_warm_dominators(function, samples);
+
+    function->profiled = true;
+    function->sampled = true;
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        block->count = samples[block->index] > 0 ? samples[block->index] : 0;
+        block->flags &= ~IR_BLOCK_FLAG_UNLIKELY;
+
+        // The function was sampled so it did run, its entry can never be cold
+        if (samples[block->index] == 0 && i != 0)
+        {
+            block->flags |= IR_BLOCK_FLAG_COLD;
+        }
+    }
+
+    free(samples);
+    return true;
+}
@@ -0,0 +1,421 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+
+/**
+ * Induction variable strength reduction. An array walked by a counted loop computes
+ * base + i * size on every iteration, the address is itself an induction variable that
+ * grows by step * size. Such addresses are replaced by a pointer that is bumped at the end
+ * of every iteration.
+ *
+ * When the loop counter is then only needed for the loop test, the test compares the
+ * pointer against the address of the element the loop stops at instead and the counter goes away.
+ */
+
+// Larger scales or offsets are left alone rather than risk overflowing the address
+#define IR_STRENGTH_MAX_FACTOR 0x10000
+
+/**
+ * A value that is scale * iv + offset
+ */
+struct ir_linear
+{
+    long scale;
+    long offset;
+};
+
+struct ir_pointer_iv
+{
+    // The loop invariant address the pointer starts from when the counter is zero
+    struct ir_instruction *base;
+    struct ir_instruction *iv;
+    long scale;
+    // The phi in the loop header, base + iv * scale
+    struct ir_instruction *phi;
+};
+
+struct ir_strength
+{
+    struct compile_process *process;
+    struct ir_function *function;
+    struct ir_loop *loop;
+    struct ir_block *preheader;
+    struct ir_block *latch;
+
+    // Vector of struct ir_pointer_iv
+    struct vector *pointers;
+    int total_reduced;
+};
+
+static bool ir_strength_in_loop(struct ir_strength *strength, struct ir_instruction *value)
+{
+    return strength->loop->contains[value->block->index];
+}
+
+static bool ir_strength_factor_fits(long value)
+{
+    return value > -IR_STRENGTH_MAX_FACTOR && value < IR_STRENGTH_MAX_FACTOR;
+}
+
+/**
+ * Works out if the value is linear in the induction variable, only following arithmetic inside the loop
+ */
+static bool ir_linear_of(struct ir_strength *strength, struct ir_instruction *iv, struct ir_instruction *value, struct ir_linear *linear_out)
+{
+    if (value == iv)
+    {
+        linear_out->scale = 1;
+        linear_out->offset = 0;
+        return true;
+    }
+
+    if (value->type != IR_TYPE_I32 || !ir_strength_in_loop(strength, value) || ir_instruction_total_operands(value) != 2)
+        return false;
+
+    struct ir_instruction *left = ir_instruction_operand(value, 0);
+    struct ir_instruction *right = ir_instruction_operand(value, 1);
+    if (left->op == IR_OP_CONST && (value->op == IR_OP_ADD || value->op == IR_OP_MUL))
+    {
+        struct ir_instruction *tmp = left;
+        left = right;
+        right = tmp;
+    }
+
+    if (right->op != IR_OP_CONST || !ir_linear_of(strength, iv, left, linear_out))
+        return false;
+
+    long constant = right->value;
+    switch (value->op)
+    {
+    case IR_OP_ADD:
+        linear_out->offset += constant;
+        break;
+
+    case IR_OP_SUB:
+        linear_out->offset -= constant;
+        break;
+
+    case IR_OP_MUL:
+        linear_out->scale *= constant;
+        linear_out->offset *= constant;
+        break;
+
+    case IR_OP_SHL:
+        if (constant < 0 || constant > 16)
+            return false;
+        linear_out->scale <<= constant;
+        linear_out->offset <<= constant;
+        break;
+
+    default:
+        return false;
+    }
+
+    return ir_strength_factor_fits(linear_out->scale) && ir_strength_factor_fits(linear_out->offset);
+}
+
+/**
+ * Returns the step if the header phi is a counter that the latch moves by a constant
+ */
+static bool ir_strength_basic_iv(struct ir_strength *strength, struct ir_instruction *phi, long *step_out)
+{
+    if (phi->op != IR_OP_PHI || phi->type != IR_TYPE_I32 || ir_instruction_total_operands(phi) != 2)
+        return false;
+
+    struct ir_instruction *next = ir_phi_incoming_for_block(phi, strength->latch);
+    struct ir_linear linear;
+    if (!next || !ir_phi_incoming_for_block(phi, strength->preheader) ||
+        !ir_linear_of(strength, phi, next, &linear) || linear.scale != 1 || linear.offset == 0)
+        return false;
+
+    *step_out = linear.offset;
+    return true;
+}
+
+static struct ir_instruction *ir_strength_const(struct ir_strength *strength, long value)
+{
+    struct ir_instruction *constant = ir_instruction_create(strength->function, IR_OP_CONST, IR_TYPE_I32);
+    constant->value = value;
+    ir_block_insert_before_terminator(strength->preheader, constant);
+    return constant;
+}
+
+/**
+ * Emits value * scale in the preheader
+ */
+static struct ir_instruction *ir_strength_scale(struct ir_strength *strength, struct ir_instruction *value, long scale)
+{
+    if (value->op == IR_OP_CONST)
+        return ir_strength_const(strength, (long)(int32_t)((uint32_t)value->value * (uint32_t)scale));
+
+    if (scale == 1)
+        return value;
+
+    struct ir_instruction *product = ir_instruction_create(strength->function, IR_OP_MUL, IR_TYPE_I32);
+    ir_instruction_add_operand(product, value);
+    ir_instruction_add_operand(product, ir_strength_const(strength, scale));
+    ir_block_insert_before_terminator(strength->preheader, product);
+    return product;
+}
+
+/**
+ * Emits base + value * scale in the preheader
+ */
+static struct ir_instruction *ir_strength_address(struct ir_strength *strength, struct ir_instruction *base, struct ir_instruction *value, long scale)
+{
+    if (value->op == IR_OP_CONST && value->value == 0)
+        return base;
+
+    struct ir_instruction *address = ir_instruction_create(strength->function, IR_OP_ADD, IR_TYPE_PTR);
+    ir_instruction_add_operand(address, base);
+    ir_instruction_add_operand(address, ir_strength_scale(strength, value, scale));
+    ir_block_insert_before_terminator(strength->preheader, address);
+    return address;
+}
+
+static bool ir_strength_same_base(struct ir_instruction *a, struct ir_instruction *b)
+{
+    if (a == b)
+        return true;
+
+    if (a->op != b->op)
+        return false;
+
+    if (a->op == IR_OP_GLOBAL_ADDRESS)
+        return S_EQ(a->symbol, b->symbol);
+
+    return a->op == IR_OP_FRAME_ADDRESS && a->slot == b->slot && a->value == b->value;
+}
+
+static struct ir_pointer_iv *ir_strength_pointer(struct ir_strength *strength, struct ir_instruction *base, struct ir_instruction *iv, long step, long scale)
+{
+    for (int i = 0; i < vector_count(strength->pointers); i++)
+    {
+        struct ir_pointer_iv *pointer = vector_at(strength->pointers, i);
+        if (pointer->iv == iv && pointer->scale == scale && ir_strength_same_base(pointer->base, base))
+            return pointer;
+    }
+
+    struct ir_pointer_iv pointer = {.base = base, .iv = iv, .scale = scale};
+    pointer.phi = ir_instruction_create(strength->function, IR_OP_PHI, IR_TYPE_PTR);
+    ir_block_prepend(strength->loop->header, pointer.phi);
+    struct ir_instruction *start = ir_strength_address(strength, base, ir_phi_incoming_for_block(iv, strength->preheader), scale);
+
+    struct ir_instruction *next = ir_instruction_create(strength->function, IR_OP_ADD, IR_TYPE_PTR);
+    ir_instruction_add_operand(next, pointer.phi);
+    ir_instruction_add_operand(next, ir_strength_const(strength, step * scale));
+    ir_block_insert_before_terminator(strength->latch, next);
+
+    ir_phi_add_incoming(pointer.phi, start, strength->preheader);
+    ir_phi_add_incoming(pointer.phi, next, strength->latch);
+    vector_push(strength->pointers, &pointer);
+    return vector_back(strength->pointers);
+}
+
+/**
+ * Replaces base + f(iv) with the pointer induction variable plus a constant
+ */
+static bool ir_strength_reduce_address(struct ir_strength *strength, struct ir_instruction *address, struct ir_instruction *iv, long step)
+{
+    struct ir_instruction *base = ir_instruction_operand(address, 0);
+    struct ir_instruction *index = ir_instruction_operand(address, 1);
+    struct ir_linear linear;
+    if (ir_strength_in_loop(strength, base) || !ir_linear_of(strength, iv, index, &linear) || linear.scale == 0 ||
+        !ir_strength_factor_fits(step * linear.scale))
+        return false;
+
+    struct ir_pointer_iv *pointer = ir_strength_pointer(strength, base, iv, step, linear.scale);
+    if (linear.offset == 0)
+    {
+        ir_instruction_replace_uses(strength->function, address, pointer->phi);
+        ir_block_remove_instruction(address->block, address);
+    }
+    else
+    {
+        vector_clear(address->operands);
+        ir_instruction_add_operand(address, pointer->phi);
+        ir_instruction_add_operand(address, ir_strength_const(strength, linear.offset));
+    }
+
+    if (strength->process->flags & COMPILE_PROCESS_PRINT_STATISTICS)
+    {
+        printf("%s: replaced an address of %%%i with a pointer induction variable in the loop at block%i\n",
+               strength->function->name, iv->id, strength->loop->header->id);
+    }
+    return true;
+}
+
+static void ir_strength_mark_live(struct ir_instruction *instruction, bool *live)
+{
+    if (instruction->id >= 0)
+    {
+        if (live[instruction->id])
+            return;
+
+        live[instruction->id] = true;
+    }
+
+    for (int i = 0; i < ir_instruction_total_operands(instruction); i++)
+    {
+        ir_strength_mark_live(ir_instruction_operand(instruction, i), live);
+    }
+}
+
+/**
+ * Returns true if anything other than the compare needs the counter
+ */
+static bool ir_strength_counter_is_needed(struct ir_strength *strength, struct ir_instruction *iv, struct ir_instruction *compare)
+{
+    struct ir_function *function = strength->function;
+    bool *live = calloc(function->total_registers + 1, sizeof(bool));
+    live[compare->id] = true;
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            if (ir_instruction_has_side_effects(instruction))
+            {
+                ir_strength_mark_live(instruction, live);
+            }
+        }
+    }
+
+    bool needed = live[iv->id];
+    free(live);
+    return needed;
+}
+
+/**
+ * Makes the loop test compare a pointer induction variable against the address the loop ends at
+ */
+static void ir_strength_replace_test(struct ir_strength *strength)
+{
+    struct ir_block *header = strength->loop->header;
+    struct ir_instruction *branch = ir_block_terminator(header);
+    if (branch->op != IR_OP_BRANCH)
+        return;
+
+    struct ir_instruction *compare = ir_instruction_operand(branch, 0);
+    int op = compare->op;
+    if (compare->block != header || (op != IR_OP_SLT && op != IR_OP_SLE && op != IR_OP_ULT && op != IR_OP_ULE))
+        return;
+
+    struct ir_instruction *iv = ir_instruction_operand(compare, 0);
+    struct ir_instruction *bound = ir_instruction_operand(compare, 1);
+    if (ir_strength_in_loop(strength, bound))
+        return;
+
+    struct ir_pointer_iv *pointer = NULL;
+    for (int i = 0; i < vector_count(strength->pointers) && !pointer; i++)
+    {
+        struct ir_pointer_iv *candidate = vector_at(strength->pointers, i);
+        if (candidate->iv == iv && candidate->scale > 0)
+        {
+            pointer = candidate;
+        }
+    }
+
+    if (!pointer || ir_strength_counter_is_needed(strength, iv, compare))
+        return;
+
+    // Addresses are unsigned, the scale being positive keeps the order of the counters
+    compare->op = op == IR_OP_SLT || op == IR_OP_ULT ? IR_OP_ULT : IR_OP_ULE;
+    vector_clear(compare->operands);
+    ir_instruction_add_operand(compare, pointer->phi);
+    ir_instruction_add_operand(compare, ir_strength_address(strength, pointer->base, bound, pointer->scale));
+    if (strength->process->flags & COMPILE_PROCESS_PRINT_STATISTICS)
+    {
+        printf("%s: the loop at block%i now tests the pointer %%%i instead of the counter %%%i\n",
+               strength->function->name, header->id, pointer->phi->id, iv->id);
+    }
+}
+
+static bool ir_strength_find_latch(struct ir_strength *strength)
+{
+    struct ir_block *header = strength->loop->header;
+    strength->latch = NULL;
+    for (int i = 0; i < vector_count(header->predecessors); i++)
+    {
+        struct ir_block *predecessor = vector_peek_ptr_at(header->predecessors, i);
+        if (!strength->loop->contains[predecessor->index])
+            continue;
+
+        if (strength->latch)
+            return false;
+        strength->latch = predecessor;
+    }
+
+    return strength->latch != NULL;
+}
+
+static void ir_strength_reduce_loop(struct ir_strength *strength)
+{
+    struct ir_loop *loop = strength->loop;
+    strength->preheader = ir_loop_preheader(loop);
+    if (!strength->preheader || !ir_strength_find_latch(strength))
+        return;
+
+    // New phis go in front of the header, only look at the ones that were there to begin with
+    struct vector *counters = vector_create(sizeof(struct ir_instruction *));
+    for (int i = 0; i < vector_count(loop->header->instructions); i++)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(loop->header->instructions, i);
+        if (phi->op != IR_OP_PHI)
+            break;
+        vector_push(counters, &phi);
+    }
+
+    for (int i = 0; i < vector_count(counters); i++)
+    {
+        struct ir_instruction *iv = vector_peek_ptr_at(counters, i);
+        long step = 0;
+        if (!ir_strength_basic_iv(strength, iv, &step))
+            continue;
+
+        for (int b = 0; b < vector_count(loop->blocks); b++)
+        {
+            struct ir_block *block = vector_peek_ptr_at(loop->blocks, b);
+            for (int c = 0; c < vector_count(block->instructions); c++)
+            {
+                struct ir_instruction *address = vector_peek_ptr_at(block->instructions, c);
+                if (address->op != IR_OP_ADD || address->type != IR_TYPE_PTR ||
+                    !ir_strength_reduce_address(strength, address, iv, step))
+                    continue;
+
+                strength->total_reduced++;
+                if (vector_count(block->instructions) <= c || vector_peek_ptr_at(block->instructions, c) != address)
+                {
+                    c--;
+                }
+            }
+        }
+    }
+
+    ir_strength_replace_test(strength);
+    vector_free(counters);
+}
+
+int ir_reduce_induction_variables(struct compile_process *process, struct ir_function *function)
+{
+    if (vector_count(function->blocks) == 0)
+        return 0;
+
+    struct ir_dominators *dominators = NULL;
+    struct vector *loops = ir_function_loops(function, &dominators);
+    struct ir_strength strength = {.process = process, .function = function};
+    strength.pointers = vector_create(sizeof(struct ir_pointer_iv));
+    for (int i = 0; i < vector_count(loops); i++)
+    {
+        strength.loop = vector_peek_ptr_at(loops, i);
+        vector_clear(strength.pointers);
+        ir_strength_reduce_loop(&strength);
+    }
+
+    vector_free(strength.pointers);
+    ir_free_loops(loops);
+    ir_dominators_free(dominators);
+    process->statistics.reduced_induction_variables += strength.total_reduced;
+    return strength.total_reduced;
+}
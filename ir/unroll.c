@@ -0,0 +1,665 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Loop unrolling for counted loops, loops whose header compares an induction variable that
+ * grows by a constant step against a bound that does not change inside the loop.
+ *
+ * Loops with a constant trip count small enough for the size budget are replaced by that many
+ * copies of their body. Other counted loops are partially unrolled, a new header checks that
+ * at least unroll_factor iterations remain and runs that many copies of the body without
+ * testing in between. The original loop stays behind to run the iterations that are left over.
+ */
+
+struct ir_counted_loop
+{
+    struct ir_loop *loop;
+    struct ir_block *preheader;
+    // The only block in the loop that jumps back to the header
+    struct ir_block *latch;
+    // The block the header branches to when the loop is finished
+    struct ir_block *exit;
+    // The loop blocks in the order they appear in the function, the header is always first
+    struct vector *blocks;
+
+    // The header phi compared against the bound
+    struct ir_instruction *induction;
+    struct ir_instruction *compare;
+    struct ir_instruction *bound;
+    long step;
+
+    // Total instructions in the loop blocks
+    int size;
+};
+
+struct ir_loop_copy
+{
+    // The copy of each loop block, in the same order as ir_counted_loop blocks
+    struct ir_block **blocks;
+    int total_blocks;
+    // The copy of each instruction indexed by the original register id, NULL for values from outside the loop
+    struct ir_instruction **values;
+    int total_values;
+};
+
+static struct ir_instruction *ir_header_phi_from(struct ir_block *header, struct ir_instruction *value)
+{
+    return value->op == IR_OP_PHI && value->block == header ? value : NULL;
+}
+
+/**
+ * Returns the constant step if the value is the induction phi plus a positive constant
+ */
+static bool ir_induction_step(struct ir_instruction *induction, struct ir_instruction *next, long *step_out)
+{
+    if (next->op != IR_OP_ADD || next->type != IR_TYPE_I32)
+        return false;
+
+    struct ir_instruction *left = ir_instruction_operand(next, 0);
+    struct ir_instruction *right = ir_instruction_operand(next, 1);
+    if (left != induction)
+    {
+        struct ir_instruction *tmp = left;
+        left = right;
+        right = tmp;
+    }
+
+    if (left != induction || right->op != IR_OP_CONST || right->value <= 0 || right->value > 0xffff)
+        return false;
+
+    *step_out = right->value;
+    return true;
+}
+
+static bool ir_block_id_in(struct vector *ids, int id)
+{
+    for (int i = 0; i < vector_count(ids); i++)
+    {
+        if (*(int *)vector_at(ids, i) == id)
+            return true;
+    }
+
+    return false;
+}
+
+static bool ir_loop_is_innermost(struct vector *loops, struct ir_loop *loop)
+{
+    for (int i = 0; i < vector_count(loops); i++)
+    {
+        struct ir_loop *other = vector_peek_ptr_at(loops, i);
+        if (other != loop && loop->contains[other->header->index])
+            return false;
+    }
+
+    return true;
+}
+
+static bool ir_counted_loop_find(struct ir_function *function, struct ir_loop *loop, struct ir_counted_loop *counted)
+{
+    struct ir_block *header = loop->header;
+    memset(counted, 0, sizeof(struct ir_counted_loop));
+    counted->loop = loop;
+    counted->preheader = ir_loop_preheader(loop);
+    if (!counted->preheader)
+        return false;
+
+    for (int i = 0; i < vector_count(header->predecessors); i++)
+    {
+        struct ir_block *predecessor = vector_peek_ptr_at(header->predecessors, i);
+        if (!loop->contains[predecessor->index])
+            continue;
+
+        if (counted->latch)
+            return false;
+        counted->latch = predecessor;
+    }
+
+    if (!counted->latch || counted->latch == header || ir_block_terminator(counted->latch)->op != IR_OP_JUMP)
+        return false;
+
+    // The header must be the only way out of the loop
+    for (int i = 0; i < vector_count(loop->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(loop->blocks, i);
+        for (int b = 0; block != header && b < ir_block_total_successors(block); b++)
+        {
+            if (!loop->contains[ir_block_successor(block, b)->index])
+                return false;
+        }
+    }
+
+    struct ir_instruction *branch = ir_block_terminator(header);
+    if (branch->op != IR_OP_BRANCH || !loop->contains[ir_instruction_target(branch, 0)->index] ||
+        loop->contains[ir_instruction_target(branch, 1)->index])
+        return false;
+    counted->exit = ir_instruction_target(branch, 1);
+
+    struct ir_instruction *compare = ir_instruction_operand(branch, 0);
+    int op = compare->op;
+    if (compare->block != header || (op != IR_OP_SLT && op != IR_OP_SLE && op != IR_OP_ULT && op != IR_OP_ULE))
+        return false;
+
+    counted->compare = compare;
+    counted->induction = ir_header_phi_from(header, ir_instruction_operand(compare, 0));
+    counted->bound = ir_instruction_operand(compare, 1);
+    if (!counted->induction || counted->induction->type != IR_TYPE_I32 || loop->contains[counted->bound->block->index])
+        return false;
+
+    struct ir_instruction *next = ir_phi_incoming_for_block(counted->induction, counted->latch);
+    if (!next || !ir_induction_step(counted->induction, next, &counted->step))
+        return false;
+
+    counted->blocks = vector_create(sizeof(struct ir_block *));
+    vector_push(counted->blocks, &header);
+    counted->size = vector_count(header->instructions);
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        if (block == header || !loop->contains[block->index])
+            continue;
+
+        vector_push(counted->blocks, &block);
+        counted->size += vector_count(block->instructions);
+    }
+
+    return true;
+}
+
+/**
+ * Returns the times the loop body runs, -1 if it cannot be known or is more than the limit
+ */
+static long ir_counted_loop_trip_count(struct ir_counted_loop *counted, long limit)
+{
+    struct ir_instruction *start = ir_phi_incoming_for_block(counted->induction, counted->preheader);
+    if (!start || start->op != IR_OP_CONST || counted->bound->op != IR_OP_CONST)
+        return -1;
+
+    long value = start->value;
+    long trips = 0;
+    long result = 0;
+    while (ir_fold_constant(counted->compare->op, value, counted->bound->value, &result) && result)
+    {
+        if (++trips > limit)
+            return -1;
+
+        ir_fold_constant(IR_OP_ADD, value, counted->step, &value);
+    }
+
+    return trips;
+}
+
+/**
+ * Returns true if the profile shows the loop is worth unrolling, it must have run and to be partially
+ * unrolled it must iterate at least "factor" times on average each time it is entered.
+ */
+static bool ir_counted_loop_is_hot(struct ir_counted_loop *counted, long trips, int factor)
+{
+    long runs = counted->loop->header->count;
+    if (runs == 0)
+        return false;
+
+    // Samples show the loop is hot but not how many times it iterates
+    if (trips > 0 || counted->loop->header->function->sampled)
+        return true;
+
+    // The header runs once more than the body every time the loop is entered
+    long entries = counted->preheader->count ? counted->preheader->count : 1;
+    return (runs - entries) / entries >= factor;
+}
+
+static struct ir_block *ir_loop_copy_block(struct ir_counted_loop *counted, struct ir_loop_copy *copy, struct ir_block *block)
+{
+    for (int i = 0; i < copy->total_blocks; i++)
+    {
+        if (vector_peek_ptr_at(counted->blocks, i) == block)
+            return copy->blocks[i];
+    }
+
+    return block;
+}
+
+static struct ir_instruction *ir_loop_copy_value(struct ir_loop_copy *copy, struct ir_instruction *value)
+{
+    if (value->id >= 0 && value->id < copy->total_values && copy->values[value->id])
+        return copy->values[value->id];
+
+    return value;
+}
+
+/**
+ * Copies the loop blocks, or only the header when "header_only" is set, in front of "before".
+ * Operands and jump targets inside the loop refer to the copies, everything else is shared.
+ */
+static struct ir_loop_copy *ir_loop_copy_create(struct ir_function *function, struct ir_counted_loop *counted, struct ir_block *before, bool header_only)
+{
+    struct ir_loop_copy *copy = calloc(1, sizeof(struct ir_loop_copy));
+    copy->total_blocks = header_only ? 1 : vector_count(counted->blocks);
+    copy->blocks = calloc(copy->total_blocks, sizeof(struct ir_block *));
+    copy->total_values = function->total_registers;
+    copy->values = calloc(copy->total_values, sizeof(struct ir_instruction *));
+
+    struct vector *copied = vector_create(sizeof(struct ir_instruction *));
+    for (int i = 0; i < copy->total_blocks; i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(counted->blocks, i);
+        copy->blocks[i] = ir_block_create(function);
+        copy->blocks[i]->flags = block->flags;
+        copy->blocks[i]->count = block->count;
+        ir_function_move_block_before(function, copy->blocks[i], before);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            struct ir_instruction *clone = ir_instruction_create(function, instruction->op, instruction->type);
+            clone->flags = instruction->flags;
+            clone->value = instruction->value;
+            clone->symbol = instruction->symbol;
+            clone->slot = instruction->slot;
+            clone->mem_type = instruction->mem_type;
+            clone->node = instruction->node;
+            ir_block_append(copy->blocks[i], clone);
+            vector_push(copied, &instruction);
+            if (instruction->id >= 0)
+            {
+                copy->values[instruction->id] = clone;
+            }
+        }
+    }
+
+    int total_copied = 0;
+    for (int i = 0; i < copy->total_blocks; i++)
+    {
+        struct ir_block *block = copy->blocks[i];
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(copied, total_copied++);
+            struct ir_instruction *clone = vector_peek_ptr_at(block->instructions, b);
+            for (int c = 0; c < ir_instruction_total_operands(instruction); c++)
+            {
+                ir_instruction_add_operand(clone, ir_loop_copy_value(copy, ir_instruction_operand(instruction, c)));
+            }
+
+            for (int c = 0; c < vector_count(instruction->blocks); c++)
+            {
+                struct ir_block *target = ir_loop_copy_block(counted, copy, ir_instruction_target(instruction, c));
+                vector_push(clone->blocks, &target);
+                if (ir_op_is_terminator(clone->op))
+                {
+                    ir_block_add_predecessor(target, block);
+                }
+            }
+        }
+    }
+
+    vector_free(copied);
+    return copy;
+}
+
+static void ir_loop_copy_free(struct ir_loop_copy *copy)
+{
+    free(copy->blocks);
+    free(copy->values);
+    free(copy);
+}
+
+static struct ir_instruction *ir_counted_loop_latch_value(struct ir_counted_loop *counted, struct ir_instruction *phi)
+{
+    return ir_phi_incoming_for_block(phi, counted->latch);
+}
+
+/**
+ * Replaces the header phis of the copy with the values the loop enters the copy with.
+ * "previous" is the copy that runs before this one, NULL to take "entry" values instead.
+ */
+static void ir_loop_copy_enter(struct ir_function *function, struct ir_counted_loop *counted, struct ir_loop_copy *copy,
+                               struct ir_loop_copy *previous, struct ir_instruction **entry)
+{
+    struct ir_block *header = counted->loop->header;
+    for (int i = 0; i < vector_count(header->instructions); i++)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(header->instructions, i);
+        if (phi->op != IR_OP_PHI)
+            break;
+
+        struct ir_instruction *value = previous ? ir_loop_copy_value(previous, ir_counted_loop_latch_value(counted, phi)) : entry[i];
+        struct ir_instruction *clone = copy->values[phi->id];
+        ir_instruction_replace_uses(function, clone, value);
+        ir_block_remove_instruction(clone->block, clone);
+        copy->values[phi->id] = value;
+    }
+}
+
+/**
+ * Makes the block end in a jump to the target, removing its other edges
+ */
+static void ir_block_set_jump(struct ir_block *block, struct ir_block *target)
+{
+    struct ir_instruction *terminator = ir_block_terminator(block);
+    for (int i = 0; i < vector_count(terminator->blocks); i++)
+    {
+        ir_block_remove_predecessor(ir_instruction_target(terminator, i), block);
+    }
+
+    terminator->op = IR_OP_JUMP;
+    vector_clear(terminator->operands);
+    vector_clear(terminator->blocks);
+    vector_push(terminator->blocks, &target);
+    ir_block_add_predecessor(target, block);
+}
+
+/**
+ * Turns the header of a body copy into a jump straight into the body and sends its latch to "next"
+ */
+static void ir_loop_copy_chain(struct ir_counted_loop *counted, struct ir_loop_copy *copy, struct ir_block *next)
+{
+    struct ir_block *body = ir_instruction_target(ir_block_terminator(counted->loop->header), 0);
+    ir_block_set_jump(copy->blocks[0], ir_loop_copy_block(counted, copy, body));
+    ir_block_replace_successor(ir_loop_copy_block(counted, copy, counted->latch), copy->blocks[0], next);
+}
+
+static int ir_header_total_phis(struct ir_block *header)
+{
+    int total = 0;
+    while (total < vector_count(header->instructions) && ((struct ir_instruction *)vector_peek_ptr_at(header->instructions, total))->op == IR_OP_PHI)
+    {
+        total++;
+    }
+
+    return total;
+}
+
+/**
+ * Values of the header that are used after the loop are merged by a phi in the exit block,
+ * once the header is copied the uses then have a single value to refer to.
+ */
+static void ir_counted_loop_close_exit(struct ir_function *function, struct ir_counted_loop *counted)
+{
+    struct ir_block *header = counted->loop->header;
+    for (int i = 0; i < vector_count(header->instructions); i++)
+    {
+        struct ir_instruction *value = vector_peek_ptr_at(header->instructions, i);
+        if (value->type == IR_TYPE_VOID)
+            continue;
+
+        struct ir_instruction *merged = NULL;
+        for (int b = 0; b < vector_count(function->blocks); b++)
+        {
+            struct ir_block *block = vector_peek_ptr_at(function->blocks, b);
+            if (counted->loop->contains[block->index])
+                continue;
+
+            for (int c = 0; c < vector_count(block->instructions); c++)
+            {
+                struct ir_instruction *user = vector_peek_ptr_at(block->instructions, c);
+                if (user == merged || (block == counted->exit && user->op == IR_OP_PHI))
+                    continue;
+
+                for (int d = 0; d < ir_instruction_total_operands(user); d++)
+                {
+                    if (ir_instruction_operand(user, d) != value)
+                        continue;
+
+                    if (!merged)
+                    {
+                        merged = ir_instruction_create(function, IR_OP_PHI, value->type);
+                        ir_phi_add_incoming(merged, value, header);
+                        ir_block_prepend(counted->exit, merged);
+                    }
+                    *(struct ir_instruction **)vector_at(user->operands, d) = merged;
+                }
+            }
+        }
+    }
+}
+
+static void ir_counted_loop_unroll_fully(struct ir_function *function, struct ir_counted_loop *counted, long trips)
+{
+    struct ir_block *header = counted->loop->header;
+    int total_phis = ir_header_total_phis(header);
+    struct ir_instruction **entry = calloc(total_phis + 1, sizeof(struct ir_instruction *));
+    for (int i = 0; i < total_phis; i++)
+    {
+        entry[i] = ir_phi_incoming_for_block(vector_peek_ptr_at(header->instructions, i), counted->preheader);
+    }
+
+    ir_counted_loop_close_exit(function, counted);
+
+    struct ir_loop_copy *previous = NULL;
+    struct ir_block *first = NULL;
+    for (long i = 0; i <= trips; i++)
+    {
+        // The last copy is only the header, it leaves the loop
+        bool is_last = i == trips;
+        struct ir_loop_copy *copy = ir_loop_copy_create(function, counted, header, is_last);
+        ir_loop_copy_enter(function, counted, copy, previous, entry);
+        if (previous)
+        {
+            ir_loop_copy_chain(counted, previous, copy->blocks[0]);
+            ir_loop_copy_free(previous);
+        }
+        else
+        {
+            first = copy->blocks[0];
+        }
+
+        if (is_last)
+        {
+            ir_block_set_jump(copy->blocks[0], counted->exit);
+            for (int b = 0; b < vector_count(counted->exit->instructions); b++)
+            {
+                struct ir_instruction *phi = vector_peek_ptr_at(counted->exit->instructions, b);
+                if (phi->op != IR_OP_PHI)
+                    break;
+
+                ir_phi_add_incoming(phi, ir_loop_copy_value(copy, ir_phi_incoming_for_block(phi, header)), copy->blocks[0]);
+            }
+            ir_loop_copy_free(copy);
+            break;
+        }
+        previous = copy;
+    }
+
+    // The original loop is no longer reachable
+    ir_block_replace_successor(counted->preheader, header, first);
+    free(entry);
+}
+
+/**
+ * Builds the unrolled loop in front of the original one:
+ *
+ *   unrolled:  i = phi [start, preheader], [next, last copy]
+ *              if (i < n) goto guard else goto header
+ *   guard:     if (n - i > (factor - 1) * step) goto copy 1 else goto header
+ *   copy 1..factor, without the test in between
+ *
+ * The original header becomes the remainder loop, it starts from the unrolled induction values.
+ */
+static void ir_counted_loop_unroll_partially(struct ir_function *function, struct ir_counted_loop *counted, int factor)
+{
+    struct ir_block *header = counted->loop->header;
+    int total_phis = ir_header_total_phis(header);
+    struct ir_instruction **entry = calloc(total_phis + 1, sizeof(struct ir_instruction *));
+
+    struct ir_block *unrolled = ir_block_create(function);
+    ir_function_move_block_before(function, unrolled, header);
+    struct ir_block *guard = ir_block_create(function);
+    ir_function_move_block_before(function, guard, header);
+    unrolled->count = counted->preheader->count;
+    guard->count = counted->preheader->count;
+    for (int i = 0; i < total_phis; i++)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(header->instructions, i);
+        entry[i] = ir_instruction_create(function, IR_OP_PHI, phi->type);
+        ir_phi_add_incoming(entry[i], ir_phi_incoming_for_block(phi, counted->preheader), counted->preheader);
+        ir_block_append(unrolled, entry[i]);
+    }
+
+    struct ir_instruction *induction = NULL;
+    for (int i = 0; i < total_phis; i++)
+    {
+        if (vector_peek_ptr_at(header->instructions, i) == counted->induction)
+        {
+            induction = entry[i];
+        }
+    }
+
+    struct ir_instruction *compare = ir_instruction_create(function, counted->compare->op, counted->compare->type);
+    ir_instruction_add_operand(compare, induction);
+    ir_instruction_add_operand(compare, counted->bound);
+    ir_block_append(unrolled, compare);
+    struct ir_instruction *branch = ir_instruction_create(function, IR_OP_BRANCH, IR_TYPE_VOID);
+    ir_instruction_add_operand(branch, compare);
+    vector_push(branch->blocks, &guard);
+    vector_push(branch->blocks, &header);
+    ir_block_append(unrolled, branch);
+    ir_block_add_predecessor(guard, unrolled);
+
+    // The induction variable is below the bound so the distance to it cannot overflow
+    struct ir_instruction *distance = ir_instruction_create(function, IR_OP_SUB, IR_TYPE_I32);
+    ir_instruction_add_operand(distance, counted->bound);
+    ir_instruction_add_operand(distance, induction);
+    ir_block_append(guard, distance);
+    struct ir_instruction *span = ir_instruction_create(function, IR_OP_CONST, IR_TYPE_I32);
+    span->value = (factor - 1) * counted->step;
+    ir_block_append(guard, span);
+    int op = counted->compare->op == IR_OP_SLT || counted->compare->op == IR_OP_ULT ? IR_OP_UGT : IR_OP_UGE;
+    struct ir_instruction *enough = ir_instruction_create(function, op, IR_TYPE_I32);
+    ir_instruction_add_operand(enough, distance);
+    ir_instruction_add_operand(enough, span);
+    ir_block_append(guard, enough);
+    struct ir_instruction *guard_branch = ir_instruction_create(function, IR_OP_BRANCH, IR_TYPE_VOID);
+    ir_instruction_add_operand(guard_branch, enough);
+    ir_block_append(guard, guard_branch);
+
+    struct ir_loop_copy *previous = NULL;
+    for (int i = 0; i < factor; i++)
+    {
+        struct ir_loop_copy *copy = ir_loop_copy_create(function, counted, header, false);
+        ir_loop_copy_enter(function, counted, copy, previous, entry);
+        if (previous)
+        {
+            ir_loop_copy_chain(counted, previous, copy->blocks[0]);
+            ir_loop_copy_free(previous);
+        }
+        else
+        {
+            vector_push(guard_branch->blocks, &copy->blocks[0]);
+            vector_push(guard_branch->blocks, &header);
+            ir_block_add_predecessor(copy->blocks[0], guard);
+        }
+        previous = copy;
+    }
+
+    struct ir_block *last_latch = ir_loop_copy_block(counted, previous, counted->latch);
+    for (int i = 0; i < total_phis; i++)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(header->instructions, i);
+        ir_phi_add_incoming(entry[i], ir_loop_copy_value(previous, ir_counted_loop_latch_value(counted, phi)), last_latch);
+    }
+    ir_loop_copy_chain(counted, previous, unrolled);
+    ir_loop_copy_free(previous);
+
+    // The remainder loop is entered from the unrolled header or the guard instead of the preheader
+    for (int i = 0; i < total_phis; i++)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(header->instructions, i);
+        ir_phi_remove_incoming(phi, counted->preheader);
+        ir_phi_add_incoming(phi, entry[i], unrolled);
+        ir_phi_add_incoming(phi, entry[i], guard);
+    }
+    ir_block_replace_successor(counted->preheader, header, unrolled);
+    ir_block_add_predecessor(header, unrolled);
+    ir_block_add_predecessor(header, guard);
+    free(entry);
+}
+
+/**
+ * Unrolls the first loop it can, returns false when there is nothing left to unroll.
+ * Headers of loops that were already looked at are in "handled" by block id.
+ */
+static bool ir_unroll_next_loop(struct compile_process *process, struct ir_function *function, struct vector *handled)
+{
+    struct ir_dominators *dominators = NULL;
+    struct vector *loops = ir_function_loops(function, &dominators);
+    bool unrolled = false;
+    for (int i = 0; i < vector_count(loops) && !unrolled; i++)
+    {
+        struct ir_loop *loop = vector_peek_ptr_at(loops, i);
+        int header_id = loop->header->id;
+        if (ir_block_id_in(handled, header_id) || !ir_loop_is_innermost(loops, loop))
+            continue;
+
+        vector_push(handled, &header_id);
+        struct ir_counted_loop counted;
+        if (!ir_counted_loop_find(function, loop, &counted))
+        {
+            if (counted.blocks)
+                vector_free(counted.blocks);
+            continue;
+        }
+
+        int budget = process->options.unroll_budget;
+        long trips = ir_counted_loop_trip_count(&counted, budget / counted.size);
+        int factor = process->options.unroll_factor;
+        if (factor * counted.size > budget)
+        {
+            factor = budget / counted.size;
+        }
+
+        if (function->profiled && !ir_counted_loop_is_hot(&counted, trips, factor))
+        {
+            vector_free(counted.blocks);
+            continue;
+        }
+
+        // The exit block merges the header values, it can only do that with the header as the only way in
+        if (trips > 0 && vector_count(counted.exit->predecessors) == 1)
+        {
+            ir_counted_loop_unroll_fully(function, &counted, trips);
+            unrolled = true;
+            if (process->flags & COMPILE_PROCESS_PRINT_STATISTICS)
+            {
+                printf("%s: fully unrolled the loop at block%i %li times\n", function->name, header_id, trips);
+            }
+        }
+        else if (trips < 0 && factor >= 2)
+        {
+            int unrolled_header_id = function->total_blocks;
+            ir_counted_loop_unroll_partially(function, &counted, factor);
+            vector_push(handled, &unrolled_header_id);
+            unrolled = true;
+            if (process->flags & COMPILE_PROCESS_PRINT_STATISTICS)
+            {
+                printf("%s: unrolled the loop at block%i by %i\n", function->name, header_id, factor);
+            }
+        }
+        vector_free(counted.blocks);
+    }
+
+    ir_free_loops(loops);
+    ir_dominators_free(dominators);
+    if (unrolled)
+    {
+        ir_function_remove_unreachable_blocks(function);
+        ir_function_remove_trivial_phis(function);
+    }
+    return unrolled;
+}
+
+int ir_unroll_loops(struct compile_process *process, struct ir_function *function)
+{
+    if (vector_count(function->blocks) == 0)
+        return 0;
+
+    struct vector *handled = vector_create(sizeof(int));
+    int total_unrolled = 0;
+    while (ir_unroll_next_loop(process, function, handled))
+    {
+        total_unrolled++;
+    }
+
+    vector_free(handled);
+    process->statistics.unrolled_loops += total_unrolled;
+    return total_unrolled;
+}
@@ -0,0 +1,951 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Loop vectorization with SSE2. A counted loop that walks int, short or char arrays one element
+ * at a time is given a vector loop in front of it that handles sixteen bytes of every array
+ * per iteration, the original loop stays behind to run the iterations that are left over.
+ *
+ * The body may load and store the arrays, combine their elements with add, sub, and, or and xor,
+ * accumulate int elements into a scalar and leave the loop when an element compares equal
+ * (or not equal) to a value or another element, like memchr and memcmp do. A vector iteration
+ * that contains the element the loop leaves on is not run, the original loop starts at it instead.
+ *
+ * Vectors are loaded and stored unaligned so the vector loop needs no scalar prologue. Arrays that
+ * could overlap by less than a vector are checked for when entering the loop, the vector loop is
+ * skipped when they do.
+ */
+
+#define IR_VECTOR_SIZE 16
+
+// What the instructions of the loop body become in the vector loop
+enum
+{
+    IR_VECTOR_KIND_NONE,
+    // The counter scaled to an offset into the arrays
+    IR_VECTOR_KIND_INDEX,
+    // A loop invariant base plus an index
+    IR_VECTOR_KIND_ADDRESS,
+    // A value computed lane by lane, loads and arithmetic on loaded values
+    IR_VECTOR_KIND_LANES,
+    IR_VECTOR_KIND_STORE,
+    // The comparison the body leaves the loop on
+    IR_VECTOR_KIND_EXIT_COMPARE,
+    // The new value of an accumulator
+    IR_VECTOR_KIND_REDUCTION,
+    IR_VECTOR_KIND_INCREMENT,
+    IR_VECTOR_KIND_LOOP_TEST
+};
+
+struct ir_vector_splat
+{
+    struct ir_instruction *value;
+    struct ir_instruction *splat;
+};
+
+struct ir_vector_loop
+{
+    struct compile_process *process;
+    struct ir_function *function;
+    struct ir_loop *loop;
+    struct ir_block *preheader;
+    // The only block in the loop that jumps back to the header
+    struct ir_block *latch;
+    // Vector of struct ir_block*, the loop blocks after the header in the order they run
+    struct vector *body;
+
+    // The header phi compared against the bound, it grows by one every iteration
+    struct ir_instruction *induction;
+    struct ir_instruction *compare;
+    struct ir_instruction *bound;
+    struct ir_instruction *increment;
+
+    // The type of every array element accessed and how many of them fit in a vector
+    int lane_type;
+    int lanes;
+
+    // The branch that leaves the loop from the body, NULL if there is none
+    struct ir_instruction *exit_branch;
+    // True if the body leaves the loop for an element that compares equal
+    bool exit_on_equal;
+
+    // Vector of struct ir_instruction* header phis that accumulate the elements
+    struct vector *reductions;
+    // Vector of struct ir_instruction* loads and stores in the order they run
+    struct vector *accesses;
+
+    // The kind of every register indexed by id
+    int *kinds;
+    // The value each register has in the vector loop indexed by id
+    struct ir_instruction **values;
+    // Vector of struct ir_vector_splat, loop invariants as vectors
+    struct vector *splats;
+};
+
+static bool ir_vector_is_rematerialized(struct ir_instruction *value)
+{
+    return value->op == IR_OP_CONST || value->op == IR_OP_GLOBAL_ADDRESS || value->op == IR_OP_FRAME_ADDRESS;
+}
+
+/**
+ * Returns true if the value is computed by the loop, constants and addresses are the same everywhere
+ */
+static bool ir_vector_in_loop(struct ir_vector_loop *vl, struct ir_instruction *value)
+{
+    return !ir_vector_is_rematerialized(value) && vl->loop->contains[value->block->index];
+}
+
+static int ir_vector_kind(struct ir_vector_loop *vl, struct ir_instruction *value)
+{
+    if (value->id < 0)
+    {
+        // Stores have no register, every store left in the loop body is one that can be vectorized
+        return value->op == IR_OP_STORE ? IR_VECTOR_KIND_STORE : IR_VECTOR_KIND_NONE;
+    }
+
+    return vl->kinds[value->id];
+}
+
+static int ir_vector_lane_size(int lane_type)
+{
+    switch (lane_type)
+    {
+    case IR_TYPE_I8:
+        return 1;
+    case IR_TYPE_I16:
+        return 2;
+    }
+
+    return 4;
+}
+
+static struct ir_instruction *ir_vector_reduction_update(struct ir_vector_loop *vl, struct ir_instruction *phi)
+{
+    return ir_phi_incoming_for_block(phi, vl->latch);
+}
+
+static bool ir_vector_is_reduction(struct ir_vector_loop *vl, struct ir_instruction *value)
+{
+    for (int i = 0; i < vector_count(vl->reductions); i++)
+    {
+        if (vector_peek_ptr_at(vl->reductions, i) == value)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * Returns the element the accumulator phi is combined with, NULL if the phi is not one
+ */
+static struct ir_instruction *ir_vector_reduction_operand(struct ir_vector_loop *vl, struct ir_instruction *phi)
+{
+    struct ir_instruction *update = ir_vector_reduction_update(vl, phi);
+    if (phi->type != IR_TYPE_I32 || ir_instruction_total_operands(phi) != 2 || !update || !ir_vector_in_loop(vl, update) ||
+        update->type != IR_TYPE_I32)
+        return NULL;
+
+    int op = update->op;
+    if (op != IR_OP_ADD && op != IR_OP_SUB && op != IR_OP_AND && op != IR_OP_OR && op != IR_OP_XOR)
+        return NULL;
+
+    struct ir_instruction *left = ir_instruction_operand(update, 0);
+    struct ir_instruction *right = ir_instruction_operand(update, 1);
+    if (left == phi && right != phi)
+        return right;
+
+    // Subtraction only accumulates when the phi is on the left
+    return op != IR_OP_SUB && right == phi && left != phi ? left : NULL;
+}
+
+/**
+ * Returns true if the value is the counter plus one
+ */
+static bool ir_vector_is_increment(struct ir_vector_loop *vl, struct ir_instruction *value)
+{
+    if (value->op != IR_OP_ADD || value->type != IR_TYPE_I32)
+        return false;
+
+    struct ir_instruction *left = ir_instruction_operand(value, 0);
+    struct ir_instruction *right = ir_instruction_operand(value, 1);
+    if (left != vl->induction)
+    {
+        struct ir_instruction *tmp = left;
+        left = right;
+        right = tmp;
+    }
+
+    return left == vl->induction && right->op == IR_OP_CONST && right->value == 1;
+}
+
+/**
+ * Finds the loop test, the latch and the body blocks in the order they run
+ */
+static bool ir_vector_loop_shape(struct ir_vector_loop *vl)
+{
+    struct ir_loop *loop = vl->loop;
+    struct ir_block *header = loop->header;
+    vl->preheader = ir_loop_preheader(loop);
+    if (!vl->preheader || ir_block_terminator(vl->preheader)->op != IR_OP_JUMP)
+        return false;
+
+    for (int i = 0; i < vector_count(header->predecessors); i++)
+    {
+        struct ir_block *predecessor = vector_peek_ptr_at(header->predecessors, i);
+        if (!loop->contains[predecessor->index])
+            continue;
+
+        if (vl->latch)
+            return false;
+        vl->latch = predecessor;
+    }
+
+    if (!vl->latch || vl->latch == header || ir_block_terminator(vl->latch)->op != IR_OP_JUMP)
+        return false;
+
+    struct ir_instruction *branch = ir_block_terminator(header);
+    if (branch->op != IR_OP_BRANCH || !loop->contains[ir_instruction_target(branch, 0)->index] ||
+        loop->contains[ir_instruction_target(branch, 1)->index])
+        return false;
+
+    // The header only tests the counter
+    vl->compare = ir_instruction_operand(branch, 0);
+    int total_instructions = vector_count(header->instructions);
+    if (vl->compare->block != header || vector_peek_ptr_at(header->instructions, total_instructions - 2) != vl->compare)
+        return false;
+
+    for (int i = 0; i < total_instructions - 2; i++)
+    {
+        if (((struct ir_instruction *)vector_peek_ptr_at(header->instructions, i))->op != IR_OP_PHI)
+            return false;
+    }
+
+    int op = vl->compare->op;
+    if (op != IR_OP_SLT && op != IR_OP_ULT && op != IR_OP_NE)
+        return false;
+
+    vl->induction = ir_instruction_operand(vl->compare, 0);
+    vl->bound = ir_instruction_operand(vl->compare, 1);
+    if (vl->induction->op != IR_OP_PHI || vl->induction->block != header || vl->induction->type != IR_TYPE_I32 ||
+        ir_vector_in_loop(vl, vl->bound))
+        return false;
+
+    vl->increment = ir_phi_incoming_for_block(vl->induction, vl->latch);
+    if (!vl->increment || !ir_vector_in_loop(vl, vl->increment) || !ir_vector_is_increment(vl, vl->increment))
+        return false;
+
+    // The body is a straight line of blocks that may leave the loop once
+    struct ir_block *block = ir_instruction_target(branch, 0);
+    struct ir_block *previous = header;
+    while (block != header)
+    {
+        if (vector_count(vl->body) >= vector_count(loop->blocks) || vector_count(block->predecessors) != 1 ||
+            vector_peek_ptr_at(block->predecessors, 0) != previous)
+            return false;
+
+        vector_push(vl->body, &block);
+        struct ir_instruction *terminator = ir_block_terminator(block);
+        previous = block;
+        if (terminator->op == IR_OP_JUMP)
+        {
+            block = ir_instruction_target(terminator, 0);
+            continue;
+        }
+
+        if (terminator->op != IR_OP_BRANCH || vl->exit_branch)
+            return false;
+
+        struct ir_block *true_block = ir_instruction_target(terminator, 0);
+        struct ir_block *false_block = ir_instruction_target(terminator, 1);
+        if (loop->contains[true_block->index] == loop->contains[false_block->index])
+            return false;
+
+        vl->exit_branch = terminator;
+        block = loop->contains[true_block->index] ? true_block : false_block;
+    }
+
+    return previous == vl->latch && vector_count(vl->body) + 1 == vector_count(loop->blocks);
+}
+
+/**
+ * Records the type of an array element accessed through the address, the loop can only
+ * be vectorized when every element has the same type
+ */
+static bool ir_vector_access(struct ir_vector_loop *vl, struct ir_instruction *access)
+{
+    struct ir_instruction *address = ir_instruction_operand(access, 0);
+    int lane_type = access->mem_type;
+    if (ir_vector_kind(vl, address) != IR_VECTOR_KIND_ADDRESS || access->flags & IR_INSTRUCTION_FLAG_VOLATILE ||
+        (lane_type != IR_TYPE_I8 && lane_type != IR_TYPE_I16 && lane_type != IR_TYPE_I32))
+        return false;
+
+    if (vl->lane_type != IR_TYPE_VOID && vl->lane_type != lane_type)
+        return false;
+
+    // The element must be the one the counter is at, the address scale is the element size
+    struct ir_instruction *index = ir_instruction_operand(address, 1);
+    long scale = 1;
+    if (index != vl->induction)
+    {
+        struct ir_instruction *factor = ir_instruction_operand(index, 1);
+        scale = index->op == IR_OP_SHL ? 1L << factor->value : factor->value;
+    }
+
+    if (scale != ir_vector_lane_size(lane_type))
+        return false;
+
+    vl->lane_type = lane_type;
+    vector_push(vl->accesses, &access);
+    return true;
+}
+
+static bool ir_vector_is_invariant_or_lanes(struct ir_vector_loop *vl, struct ir_instruction *value)
+{
+    return !ir_vector_in_loop(vl, value) || ir_vector_kind(vl, value) == IR_VECTOR_KIND_LANES;
+}
+
+/**
+ * The operands of the exit comparison must be elements loaded as they are or loop invariants,
+ * narrow elements compare equal only if their extended values do.
+ */
+static bool ir_vector_exit_compare(struct ir_vector_loop *vl, struct ir_instruction *compare)
+{
+    struct ir_instruction *load = NULL;
+    for (int i = 0; i < 2; i++)
+    {
+        struct ir_instruction *operand = ir_instruction_operand(compare, i);
+        if (!ir_vector_in_loop(vl, operand))
+            continue;
+
+        if (ir_vector_kind(vl, operand) != IR_VECTOR_KIND_LANES || operand->op != IR_OP_LOAD)
+            return false;
+
+        if (load && (load->flags & IR_INSTRUCTION_FLAG_SIGNED) != (operand->flags & IR_INSTRUCTION_FLAG_SIGNED))
+            return false;
+        load = operand;
+    }
+
+    return load != NULL;
+}
+
+static int ir_vector_classify(struct ir_vector_loop *vl, struct ir_instruction *instruction)
+{
+    int op = instruction->op;
+    struct ir_instruction *left = ir_instruction_total_operands(instruction) > 0 ? ir_instruction_operand(instruction, 0) : NULL;
+    struct ir_instruction *right = ir_instruction_total_operands(instruction) > 1 ? ir_instruction_operand(instruction, 1) : NULL;
+    if (instruction == vl->increment)
+        return IR_VECTOR_KIND_INCREMENT;
+
+    for (int i = 0; i < vector_count(vl->reductions); i++)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(vl->reductions, i);
+        if (ir_vector_reduction_update(vl, phi) == instruction)
+            return ir_vector_is_invariant_or_lanes(vl, ir_vector_reduction_operand(vl, phi)) ? IR_VECTOR_KIND_REDUCTION : IR_VECTOR_KIND_NONE;
+    }
+
+    switch (op)
+    {
+    case IR_OP_MUL:
+    case IR_OP_SHL:
+        if (instruction->type == IR_TYPE_I32 && left == vl->induction && right->op == IR_OP_CONST &&
+            right->value > 0 && right->value <= 4)
+            return IR_VECTOR_KIND_INDEX;
+        break;
+
+    case IR_OP_LOAD:
+        return ir_vector_access(vl, instruction) ? IR_VECTOR_KIND_LANES : IR_VECTOR_KIND_NONE;
+
+    case IR_OP_STORE:
+        return ir_vector_is_invariant_or_lanes(vl, right) && ir_vector_access(vl, instruction) ? IR_VECTOR_KIND_STORE : IR_VECTOR_KIND_NONE;
+
+    case IR_OP_EQ:
+    case IR_OP_NE:
+        if (vl->exit_branch && ir_instruction_operand(vl->exit_branch, 0) == instruction && ir_vector_exit_compare(vl, instruction))
+            return IR_VECTOR_KIND_EXIT_COMPARE;
+        break;
+    }
+
+    if (op == IR_OP_ADD && instruction->type == IR_TYPE_PTR && !ir_vector_in_loop(vl, left) &&
+        (right == vl->induction || ir_vector_kind(vl, right) == IR_VECTOR_KIND_INDEX))
+        return IR_VECTOR_KIND_ADDRESS;
+
+    if ((op == IR_OP_ADD || op == IR_OP_SUB || op == IR_OP_AND || op == IR_OP_OR || op == IR_OP_XOR) &&
+        instruction->type == IR_TYPE_I32 && ir_vector_is_invariant_or_lanes(vl, left) &&
+        ir_vector_is_invariant_or_lanes(vl, right) && (ir_vector_in_loop(vl, left) || ir_vector_in_loop(vl, right)))
+        return IR_VECTOR_KIND_LANES;
+
+    return IR_VECTOR_KIND_NONE;
+}
+
+/**
+ * Returns true if the loop still computes the same thing with "user" reading "value" when
+ * the lanes are computed together
+ */
+static bool ir_vector_use_is_allowed(struct ir_vector_loop *vl, struct ir_instruction *user, int index, struct ir_instruction *value)
+{
+    int user_kind = ir_vector_kind(vl, user);
+    if (!ir_vector_in_loop(vl, user))
+    {
+        // Only the header values are known once the loop is left
+        return value->block == vl->loop->header && value->op == IR_OP_PHI;
+    }
+
+    if (value == vl->induction)
+        return user == vl->compare || user_kind == IR_VECTOR_KIND_INCREMENT || user_kind == IR_VECTOR_KIND_INDEX ||
+               user_kind == IR_VECTOR_KIND_ADDRESS;
+
+    if (ir_vector_is_reduction(vl, value))
+        return ir_vector_reduction_update(vl, value) == user;
+
+    switch (ir_vector_kind(vl, value))
+    {
+    case IR_VECTOR_KIND_INDEX:
+        return user_kind == IR_VECTOR_KIND_ADDRESS;
+
+    case IR_VECTOR_KIND_ADDRESS:
+        return index == 0 && (user->op == IR_OP_LOAD || user->op == IR_OP_STORE);
+
+    case IR_VECTOR_KIND_LANES:
+        return user_kind == IR_VECTOR_KIND_LANES || user_kind == IR_VECTOR_KIND_EXIT_COMPARE ||
+               user_kind == IR_VECTOR_KIND_REDUCTION || (user_kind == IR_VECTOR_KIND_STORE && index == 1);
+
+    case IR_VECTOR_KIND_EXIT_COMPARE:
+        return user == vl->exit_branch;
+
+    case IR_VECTOR_KIND_REDUCTION:
+        return user->op == IR_OP_PHI && ir_vector_is_reduction(vl, user);
+
+    case IR_VECTOR_KIND_INCREMENT:
+        return user == vl->induction;
+
+    case IR_VECTOR_KIND_LOOP_TEST:
+        return user == ir_block_terminator(vl->loop->header);
+    }
+
+    return false;
+}
+
+static bool ir_vector_uses_are_allowed(struct ir_vector_loop *vl)
+{
+    for (int i = 0; i < vector_count(vl->function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(vl->function->blocks, i);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *user = vector_peek_ptr_at(block->instructions, b);
+            for (int c = 0; c < ir_instruction_total_operands(user); c++)
+            {
+                struct ir_instruction *value = ir_instruction_operand(user, c);
+                if (ir_vector_in_loop(vl, value) && !ir_vector_use_is_allowed(vl, user, c, value))
+                    return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Returns true if the constant can be compared against the narrow elements of the loop
+ */
+static bool ir_vector_constant_fits(struct ir_vector_loop *vl, struct ir_instruction *compare, struct ir_instruction *constant)
+{
+    struct ir_instruction *load = ir_instruction_operand(compare, ir_instruction_operand(compare, 0) == constant ? 1 : 0);
+    long value = constant->value;
+    if (vl->lane_type == IR_TYPE_I32)
+        return true;
+
+    if (load->flags & IR_INSTRUCTION_FLAG_SIGNED)
+        return vl->lane_type == IR_TYPE_I8 ? value == (int8_t)value : value == (int16_t)value;
+
+    return vl->lane_type == IR_TYPE_I8 ? value == (uint8_t)value : value == (uint16_t)value;
+}
+
+static bool ir_vector_loop_find(struct ir_vector_loop *vl)
+{
+    if (!ir_vector_loop_shape(vl))
+        return false;
+
+    struct ir_block *header = vl->loop->header;
+    vl->kinds[vl->compare->id] = IR_VECTOR_KIND_LOOP_TEST;
+    for (int i = 0; i < vector_count(header->instructions); i++)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(header->instructions, i);
+        if (phi->op != IR_OP_PHI || phi == vl->induction)
+            continue;
+
+        if (!ir_vector_reduction_operand(vl, phi))
+            return false;
+        vector_push(vl->reductions, &phi);
+    }
+
+    bool left_loop = false;
+    for (int i = 0; i < vector_count(vl->body); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(vl->body, i);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            if (instruction == vl->exit_branch)
+            {
+                left_loop = true;
+                continue;
+            }
+
+            if (instruction->op == IR_OP_JUMP || instruction->op == IR_OP_CONST)
+                continue;
+
+            int kind = ir_vector_classify(vl, instruction);
+            // Stores before the loop is left would also be made for the elements after the one it leaves on
+            if (kind == IR_VECTOR_KIND_NONE || (kind == IR_VECTOR_KIND_STORE && vl->exit_branch && !left_loop))
+                return false;
+            if (instruction->id >= 0)
+            {
+                vl->kinds[instruction->id] = kind;
+            }
+        }
+    }
+
+    if (vl->lane_type == IR_TYPE_VOID || (vector_count(vl->reductions) && vl->lane_type != IR_TYPE_I32))
+        return false;
+
+    if (vl->exit_branch)
+    {
+        struct ir_instruction *compare = ir_instruction_operand(vl->exit_branch, 0);
+        if (ir_vector_kind(vl, compare) != IR_VECTOR_KIND_EXIT_COMPARE)
+            return false;
+
+        for (int i = 0; i < 2; i++)
+        {
+            struct ir_instruction *operand = ir_instruction_operand(compare, i);
+            if (operand->op == IR_OP_CONST && !ir_vector_constant_fits(vl, compare, operand))
+                return false;
+        }
+
+        bool leaves_when_true = !vl->loop->contains[ir_instruction_target(vl->exit_branch, 0)->index];
+        vl->exit_on_equal = leaves_when_true == (compare->op == IR_OP_EQ);
+    }
+
+    vl->lanes = IR_VECTOR_SIZE / ir_vector_lane_size(vl->lane_type);
+    struct ir_instruction *start = ir_phi_incoming_for_block(vl->induction, vl->preheader);
+    if (start->op == IR_OP_CONST && vl->bound->op == IR_OP_CONST && vl->compare->op == IR_OP_SLT &&
+        vl->bound->value - start->value < vl->lanes)
+    {
+        // The vector loop would never run
+        return false;
+    }
+
+    return ir_vector_uses_are_allowed(vl);
+}
+
+static struct ir_instruction *ir_vector_emit(struct ir_vector_loop *vl, struct ir_block *block, int op, int type,
+                                             struct ir_instruction *left, struct ir_instruction *right)
+{
+    struct ir_instruction *instruction = ir_instruction_create(vl->function, op, type);
+    instruction->mem_type = type == IR_TYPE_V128 ? vl->lane_type : IR_TYPE_I32;
+    if (left)
+    {
+        ir_instruction_add_operand(instruction, left);
+    }
+    if (right)
+    {
+        ir_instruction_add_operand(instruction, right);
+    }
+    ir_block_insert_before_terminator(block, instruction);
+    return instruction;
+}
+
+static struct ir_instruction *ir_vector_const(struct ir_vector_loop *vl, long value)
+{
+    struct ir_instruction *constant = ir_vector_emit(vl, vl->preheader, IR_OP_CONST, IR_TYPE_I32, NULL, NULL);
+    constant->value = value;
+    return constant;
+}
+
+/**
+ * Returns the loop invariant value for use outside of the loop, constants and addresses
+ * defined inside the loop are copied into the preheader
+ */
+static struct ir_instruction *ir_vector_invariant(struct ir_vector_loop *vl, struct ir_instruction *value)
+{
+    if (!ir_vector_is_rematerialized(value) || !vl->loop->contains[value->block->index])
+        return value;
+
+    struct ir_instruction *copy = ir_vector_emit(vl, vl->preheader, value->op, value->type, NULL, NULL);
+    copy->value = value->value;
+    copy->symbol = value->symbol;
+    copy->slot = value->slot;
+    return copy;
+}
+
+static struct ir_instruction *ir_vector_splat(struct ir_vector_loop *vl, struct ir_instruction *value)
+{
+    for (int i = 0; i < vector_count(vl->splats); i++)
+    {
+        struct ir_vector_splat *splat = vector_at(vl->splats, i);
+        if (splat->value == value)
+            return splat->splat;
+    }
+
+    struct ir_vector_splat splat = {.value = value};
+    splat.splat = ir_vector_emit(vl, vl->preheader, IR_OP_VECTOR_SPLAT, IR_TYPE_V128, ir_vector_invariant(vl, value), NULL);
+    splat.splat->mem_type = vl->lane_type;
+    vector_push(vl->splats, &splat);
+    return splat.splat;
+}
+
+/**
+ * Returns the vector of the value, loop invariants have the same value in every lane
+ */
+static struct ir_instruction *ir_vector_value(struct ir_vector_loop *vl, struct ir_instruction *value)
+{
+    if (!ir_vector_in_loop(vl, value))
+        return ir_vector_splat(vl, value);
+
+    return vl->values[value->id];
+}
+
+static struct ir_instruction *ir_vector_and(struct ir_vector_loop *vl, struct ir_block *block, struct ir_instruction *left, struct ir_instruction *right)
+{
+    return left ? ir_vector_emit(vl, block, IR_OP_AND, IR_TYPE_I32, left, right) : right;
+}
+
+/**
+ * Returns true if the addresses are of different variables and so can never overlap
+ */
+static bool ir_vector_bases_are_distinct(struct ir_instruction *a, struct ir_instruction *b)
+{
+    bool a_is_variable = a->op == IR_OP_FRAME_ADDRESS || a->op == IR_OP_GLOBAL_ADDRESS;
+    bool b_is_variable = b->op == IR_OP_FRAME_ADDRESS || b->op == IR_OP_GLOBAL_ADDRESS;
+    if (!a_is_variable || !b_is_variable)
+        return false;
+
+    if (a->op != b->op)
+        return true;
+
+    return a->op == IR_OP_FRAME_ADDRESS ? a->slot != b->slot : !S_EQ(a->symbol, b->symbol);
+}
+
+static bool ir_vector_bases_are_same(struct ir_instruction *a, struct ir_instruction *b)
+{
+    if (a == b)
+        return true;
+
+    if (a->op != b->op || a->value != b->value)
+        return false;
+
+    return (a->op == IR_OP_FRAME_ADDRESS && a->slot == b->slot) || (a->op == IR_OP_GLOBAL_ADDRESS && S_EQ(a->symbol, b->symbol));
+}
+
+/**
+ * Computes in the preheader whether the vector loop gives the same result as the original one.
+ * Returns NULL when it always does.
+ *
+ * An element written less than a vector after an element accessed before it in the body would
+ * be read or written again by a later iteration, the vector loop accesses both before that happens.
+ * Narrow elements are compared against the low bits of the loop invariants, they must fit.
+ */
+static struct ir_instruction *ir_vector_loop_guard(struct ir_vector_loop *vl)
+{
+    struct ir_instruction *ok = NULL;
+    for (int i = 0; i < vector_count(vl->accesses); i++)
+    {
+        struct ir_instruction *first = vector_peek_ptr_at(vl->accesses, i);
+        for (int b = i + 1; b < vector_count(vl->accesses); b++)
+        {
+            struct ir_instruction *second = vector_peek_ptr_at(vl->accesses, b);
+            struct ir_instruction *first_base = ir_instruction_operand(ir_instruction_operand(first, 0), 0);
+            struct ir_instruction *second_base = ir_instruction_operand(ir_instruction_operand(second, 0), 0);
+            if ((first->op == IR_OP_LOAD && second->op == IR_OP_LOAD) || ir_vector_bases_are_same(first_base, second_base) ||
+                ir_vector_bases_are_distinct(first_base, second_base))
+                continue;
+
+            first_base = ir_vector_invariant(vl, first_base);
+            second_base = ir_vector_invariant(vl, second_base);
+            struct ir_instruction *distance = ir_vector_emit(vl, vl->preheader, IR_OP_SUB, IR_TYPE_I32, second_base, first_base);
+            struct ir_instruction *before = ir_vector_emit(vl, vl->preheader, IR_OP_SUB, IR_TYPE_I32, distance, ir_vector_const(vl, 1));
+            struct ir_instruction *apart = ir_vector_emit(vl, vl->preheader, IR_OP_UGE, IR_TYPE_I32, before, ir_vector_const(vl, IR_VECTOR_SIZE - 1));
+            ok = ir_vector_and(vl, vl->preheader, ok, apart);
+        }
+    }
+
+    if (!vl->exit_branch || vl->lane_type == IR_TYPE_I32)
+        return ok;
+
+    struct ir_instruction *compare = ir_instruction_operand(vl->exit_branch, 0);
+    for (int i = 0; i < 2; i++)
+    {
+        struct ir_instruction *operand = ir_instruction_operand(compare, i);
+        if (ir_vector_in_loop(vl, operand) || operand->op == IR_OP_CONST)
+            continue;
+
+        struct ir_instruction *load = ir_instruction_operand(compare, 1 - i);
+        bool is_signed = load->flags & IR_INSTRUCTION_FLAG_SIGNED;
+        struct ir_instruction *narrow = ir_vector_emit(vl, vl->preheader, is_signed ? IR_OP_SEXT : IR_OP_ZEXT, IR_TYPE_I32, operand, NULL);
+        narrow->mem_type = vl->lane_type;
+        struct ir_instruction *fits = ir_vector_emit(vl, vl->preheader, IR_OP_EQ, IR_TYPE_I32, narrow, operand);
+        ok = ir_vector_and(vl, vl->preheader, ok, fits);
+    }
+
+    return ok;
+}
+
+static int ir_vector_identity(int op)
+{
+    return op == IR_OP_AND ? -1 : 0;
+}
+
+/**
+ * Builds the vector loop body into "block", returns the block the body ends in
+ */
+static struct ir_block *ir_vector_loop_body(struct ir_vector_loop *vl, struct ir_block *block, struct ir_instruction *counter,
+                                            struct ir_block *vector_exit)
+{
+    for (int i = 0; i < vector_count(vl->body); i++)
+    {
+        struct ir_block *original = vector_peek_ptr_at(vl->body, i);
+        for (int b = 0; b < vector_count(original->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(original->instructions, b);
+            struct ir_instruction *left = ir_instruction_total_operands(instruction) > 0 ? ir_instruction_operand(instruction, 0) : NULL;
+            struct ir_instruction *right = ir_instruction_total_operands(instruction) > 1 ? ir_instruction_operand(instruction, 1) : NULL;
+            struct ir_instruction *value = NULL;
+            switch (ir_vector_kind(vl, instruction))
+            {
+            case IR_VECTOR_KIND_INDEX:
+                value = ir_vector_emit(vl, block, instruction->op, IR_TYPE_I32, counter, ir_vector_invariant(vl, right));
+                break;
+
+            case IR_VECTOR_KIND_ADDRESS:
+                value = ir_vector_emit(vl, block, IR_OP_ADD, IR_TYPE_PTR, ir_vector_invariant(vl, left),
+                                       right == vl->induction ? counter : vl->values[right->id]);
+                break;
+
+            case IR_VECTOR_KIND_LANES:
+                if (instruction->op == IR_OP_LOAD)
+                {
+                    value = ir_vector_emit(vl, block, IR_OP_VECTOR_LOAD, IR_TYPE_V128, vl->values[left->id], NULL);
+                    break;
+                }
+                value = ir_vector_emit(vl, block, instruction->op, IR_TYPE_V128, ir_vector_value(vl, left), ir_vector_value(vl, right));
+                break;
+
+            case IR_VECTOR_KIND_STORE:
+                value = ir_vector_emit(vl, block, IR_OP_VECTOR_STORE, IR_TYPE_VOID, vl->values[left->id], ir_vector_value(vl, right));
+                value->mem_type = vl->lane_type;
+                break;
+
+            case IR_VECTOR_KIND_EXIT_COMPARE:
+            {
+                struct ir_instruction *equal = ir_vector_emit(vl, block, IR_OP_EQ, IR_TYPE_V128, ir_vector_value(vl, left), ir_vector_value(vl, right));
+                struct ir_instruction *mask = ir_vector_emit(vl, block, IR_OP_VECTOR_MASK, IR_TYPE_I32, equal, NULL);
+                value = ir_vector_emit(vl, block, IR_OP_NE, IR_TYPE_I32, mask, ir_vector_const(vl, vl->exit_on_equal ? 0 : 0xffff));
+            }
+            break;
+
+            case IR_VECTOR_KIND_REDUCTION:
+            {
+                struct ir_instruction *phi = ir_vector_is_reduction(vl, left) ? left : right;
+                struct ir_instruction *element = phi == left ? right : left;
+                value = ir_vector_emit(vl, block, instruction->op, IR_TYPE_V128, vl->values[phi->id], ir_vector_value(vl, element));
+            }
+            break;
+            }
+
+            if (value && instruction->id >= 0)
+            {
+                vl->values[instruction->id] = value;
+            }
+
+            if (instruction != vl->exit_branch)
+                continue;
+
+            // A vector with an element the loop leaves on is run by the original loop
+            struct ir_block *next = ir_block_create(vl->function);
+            ir_function_move_block_before(vl->function, next, vector_exit);
+            next->count = block->count;
+            struct ir_instruction *branch = ir_vector_emit(vl, block, IR_OP_BRANCH, IR_TYPE_VOID, vl->values[left->id], NULL);
+            vector_push(branch->blocks, &vector_exit);
+            vector_push(branch->blocks, &next);
+            ir_block_add_predecessor(vector_exit, block);
+            ir_block_add_predecessor(next, block);
+            block = next;
+        }
+    }
+
+    return block;
+}
+
+/**
+ * Builds the vector loop in front of the original one:
+ *
+ *   vector header:  vi = phi [start, preheader], [vi + lanes, vector body]
+ *                   if (ok && vi < n && n - vi >= lanes) goto vector body else goto vector exit
+ *   vector body:    the body on whole vectors, leaving for the vector exit on any element the loop leaves on
+ *   vector exit:    combines the lanes of the accumulators and enters the original loop at vi
+ */
+static void ir_vector_loop_build(struct ir_vector_loop *vl)
+{
+    struct ir_function *function = vl->function;
+    struct ir_block *header = vl->loop->header;
+    struct ir_instruction *ok = ir_vector_loop_guard(vl);
+
+    struct ir_block *vector_header = ir_block_create(function);
+    ir_function_move_block_before(function, vector_header, header);
+    struct ir_block *vector_body = ir_block_create(function);
+    ir_function_move_block_before(function, vector_body, header);
+    struct ir_block *vector_exit = ir_block_create(function);
+    ir_function_move_block_before(function, vector_exit, header);
+    vector_header->count = header->count;
+    vector_body->count = header->count;
+    vector_exit->count = vl->preheader->count;
+
+    struct ir_instruction *counter = ir_instruction_create(function, IR_OP_PHI, IR_TYPE_I32);
+    ir_phi_add_incoming(counter, ir_phi_incoming_for_block(vl->induction, vl->preheader), vl->preheader);
+    ir_block_append(vector_header, counter);
+    for (int i = 0; i < vector_count(vl->reductions); i++)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(vl->reductions, i);
+        struct ir_instruction *accumulator = ir_instruction_create(function, IR_OP_PHI, IR_TYPE_V128);
+        accumulator->mem_type = vl->lane_type;
+        int op = ir_vector_reduction_update(vl, phi)->op;
+        ir_phi_add_incoming(accumulator, ir_vector_splat(vl, ir_vector_const(vl, ir_vector_identity(op))), vl->preheader);
+        ir_block_append(vector_header, accumulator);
+        vl->values[phi->id] = accumulator;
+    }
+
+    struct ir_instruction *bound = ir_vector_invariant(vl, vl->bound);
+    struct ir_instruction *in_range = ir_vector_emit(vl, vector_header, vl->compare->op, IR_TYPE_I32, counter, bound);
+    struct ir_instruction *remaining = ir_vector_emit(vl, vector_header, IR_OP_SUB, IR_TYPE_I32, bound, counter);
+    struct ir_instruction *enough = ir_vector_emit(vl, vector_header, IR_OP_UGE, IR_TYPE_I32, remaining, ir_vector_const(vl, vl->lanes));
+    struct ir_instruction *condition = ir_vector_emit(vl, vector_header, IR_OP_AND, IR_TYPE_I32, in_range, enough);
+    condition = ir_vector_and(vl, vector_header, ok, condition);
+    struct ir_instruction *branch = ir_vector_emit(vl, vector_header, IR_OP_BRANCH, IR_TYPE_VOID, condition, NULL);
+    vector_push(branch->blocks, &vector_body);
+    vector_push(branch->blocks, &vector_exit);
+    ir_block_add_predecessor(vector_body, vector_header);
+    ir_block_add_predecessor(vector_exit, vector_header);
+
+    struct ir_block *vector_latch = ir_vector_loop_body(vl, vector_body, counter, vector_exit);
+    struct ir_instruction *next = ir_vector_emit(vl, vector_latch, IR_OP_ADD, IR_TYPE_I32, counter, ir_vector_const(vl, vl->lanes));
+    struct ir_instruction *jump = ir_vector_emit(vl, vector_latch, IR_OP_JUMP, IR_TYPE_VOID, NULL, NULL);
+    vector_push(jump->blocks, &vector_header);
+    ir_block_add_predecessor(vector_header, vector_latch);
+    ir_phi_add_incoming(counter, next, vector_latch);
+
+    // The original loop carries on from where the vector loop stopped
+    ir_phi_remove_incoming(vl->induction, vl->preheader);
+    ir_phi_add_incoming(vl->induction, counter, vector_exit);
+    for (int i = 0; i < vector_count(vl->reductions); i++)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(vl->reductions, i);
+        struct ir_instruction *update = ir_vector_reduction_update(vl, phi);
+        struct ir_instruction *accumulator = vl->values[phi->id];
+        ir_phi_add_incoming(accumulator, vl->values[update->id], vector_latch);
+
+        // Subtracted elements were accumulated as negative values
+        int op = update->op == IR_OP_SUB ? IR_OP_ADD : update->op;
+        struct ir_instruction *lanes = ir_vector_emit(vl, vector_exit, IR_OP_VECTOR_REDUCE, IR_TYPE_I32, accumulator, NULL);
+        lanes->mem_type = vl->lane_type;
+        lanes->value = op;
+        struct ir_instruction *total = ir_vector_emit(vl, vector_exit, op, IR_TYPE_I32, ir_phi_incoming_for_block(phi, vl->preheader), lanes);
+        ir_phi_remove_incoming(phi, vl->preheader);
+        ir_phi_add_incoming(phi, total, vector_exit);
+    }
+
+    jump = ir_vector_emit(vl, vector_exit, IR_OP_JUMP, IR_TYPE_VOID, NULL, NULL);
+    vector_push(jump->blocks, &header);
+    ir_block_add_predecessor(header, vector_exit);
+    ir_block_replace_successor(vl->preheader, header, vector_header);
+}
+
+static bool ir_vector_loop_is_innermost(struct vector *loops, struct ir_loop *loop)
+{
+    for (int i = 0; i < vector_count(loops); i++)
+    {
+        struct ir_loop *other = vector_peek_ptr_at(loops, i);
+        if (other != loop && loop->contains[other->header->index])
+            return false;
+    }
+
+    return true;
+}
+
+static bool ir_vector_id_in(struct vector *ids, int id)
+{
+    for (int i = 0; i < vector_count(ids); i++)
+    {
+        if (*(int *)vector_at(ids, i) == id)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * Vectorizes the first loop it can, returns false when there is nothing left to vectorize.
+ * Headers of loops that were already looked at are in "handled" by block id.
+ */
+static bool ir_vectorize_next_loop(struct compile_process *process, struct ir_function *function, struct vector *handled)
+{
+    struct ir_dominators *dominators = NULL;
+    struct vector *loops = ir_function_loops(function, &dominators);
+    bool vectorized = false;
+    for (int i = 0; i < vector_count(loops) && !vectorized; i++)
+    {
+        struct ir_loop *loop = vector_peek_ptr_at(loops, i);
+        int header_id = loop->header->id;
+        if (ir_vector_id_in(handled, header_id) || !ir_vector_loop_is_innermost(loops, loop))
+            continue;
+
+        vector_push(handled, &header_id);
+        struct ir_vector_loop vl = {.process = process, .function = function, .loop = loop, .lane_type = IR_TYPE_VOID};
+        vl.body = vector_create(sizeof(struct ir_block *));
+        vl.reductions = vector_create(sizeof(struct ir_instruction *));
+        vl.accesses = vector_create(sizeof(struct ir_instruction *));
+        vl.splats = vector_create(sizeof(struct ir_vector_splat));
+        vl.kinds = calloc(function->total_registers + 1, sizeof(int));
+        vl.values = calloc(function->total_registers + 1, sizeof(struct ir_instruction *));
+        if (ir_vector_loop_find(&vl))
+        {
+            int vector_header_id = function->total_blocks;
+            ir_vector_loop_build(&vl);
+            vector_push(handled, &vector_header_id);
+            vectorized = true;
+            if (process->flags & COMPILE_PROCESS_PRINT_STATISTICS)
+            {
+                printf("%s: vectorized the loop at block%i with %i lanes\n", function->name, header_id, vl.lanes);
+            }
+        }
+
+        vector_free(vl.body);
+        vector_free(vl.reductions);
+        vector_free(vl.accesses);
+        vector_free(vl.splats);
+        free(vl.kinds);
+        free(vl.values);
+    }
+
+    ir_free_loops(loops);
+    ir_dominators_free(dominators);
+    return vectorized;
+}
+
+int ir_vectorize_loops(struct compile_process *process, struct ir_function *function)
+{
+    if (vector_count(function->blocks) == 0)
+        return 0;
+
+    struct vector *handled = vector_create(sizeof(int));
+    int total_vectorized = 0;
+    while (ir_vectorize_next_loop(process, function, handled))
+    {
+        total_vectorized++;
+    }
+
+    vector_free(handled);
+    process->statistics.vectorized_loops += total_vectorized;
+    return total_vectorized;
+}
@@ -0,0 +1,1022 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <assert.h>
+#include <stdlib.h>
+
+/**
+ * Generates 32 bit x86 assembly from the intermediate representation.
+ *
+ * Every virtual register has a home on the stack frame below the local variables of the function,
+ * constants and addresses are rematerialized at each use instead. Phi instructions are resolved by
+ * copying the incoming values into the home of the phi on each edge.
+ */
+
+static struct ir_codegen
+{
+    struct compile_process *process;
+    struct ir_function *function;
+
+    // The size of the local variables of the function, virtual registers live below them.
+    size_t locals_size;
+
+    // Label id for each block indexed by the block id.
+    int *block_labels;
+
+    // Total uses of each virtual register indexed by the register id.
+    int *uses;
+
+    // Stack home of each virtual register indexed by the register id, values that are
+    // never live at the same time share a home.
+    int *homes;
+    int total_homes;
+} ir_x86;
+
+static bool ir_x86_is_rematerialized(struct ir_instruction *value)
+{
+    switch (value->op)
+    {
+    case IR_OP_CONST:
+    case IR_OP_UNDEF:
+    case IR_OP_GLOBAL_ADDRESS:
+    case IR_OP_FRAME_ADDRESS:
+        return true;
+    }
+
+    return false;
+}
+
+static int ir_x86_home(struct ir_instruction *value)
+{
+    assert(value->id >= 0 && ir_x86.homes[value->id] >= 0);
+    return ir_x86.locals_size + ir_x86.homes[value->id] * DATA_SIZE_DWORD + DATA_SIZE_DWORD;
+}
+
+/**
+ * V128 registers take four homes, returns the offset of the lowest of them
+ */
+static int ir_x86_vector_home(struct ir_instruction *value)
+{
+    return ir_x86_home(value) + 16 - DATA_SIZE_DWORD;
+}
+
+static int ir_x86_frame_offset(struct ir_instruction *value)
+{
+    return value->slot->offset + value->value;
+}
+
+static const char *ir_x86_size_keyword(int mem_type)
+{
+    switch (mem_type)
+    {
+    case IR_TYPE_I8:
+        return "byte";
+    case IR_TYPE_I16:
+        return "word";
+    }
+
+    return "dword";
+}
+
+static const char *ir_x86_eax_for_type(int mem_type)
+{
+    switch (mem_type)
+    {
+    case IR_TYPE_I8:
+        return "al";
+    case IR_TYPE_I16:
+        return "ax";
+    }
+
+    return "eax";
+}
+
+static void ir_x86_block_label(struct ir_block *block, char *out)
+{
+    sprintf(out, ".block_%i", ir_x86.block_labels[block->id]);
+}
+
+/**
+ * Writes the value as an immediate or memory operand, returns false if the
+ * value must be loaded into a register first i.e an address.
+ */
+static bool ir_x86_operand(struct ir_instruction *value, char *out)
+{
+    switch (value->op)
+    {
+    case IR_OP_CONST:
+        sprintf(out, "%li", value->value);
+        return true;
+
+    case IR_OP_UNDEF:
+        sprintf(out, "0");
+        return true;
+
+    case IR_OP_GLOBAL_ADDRESS:
+    case IR_OP_FRAME_ADDRESS:
+        return false;
+    }
+
+    sprintf(out, "dword [ebp-%i]", ir_x86_home(value));
+    return true;
+}
+
+static void ir_x86_load(const char *reg, struct ir_instruction *value)
+{
+    if (value->op == IR_OP_FRAME_ADDRESS)
+    {
+        asm_push("lea %s, [ebp%+i]", reg, ir_x86_frame_offset(value));
+        return;
+    }
+
+    if (value->op == IR_OP_GLOBAL_ADDRESS)
+    {
+        asm_push("lea %s, [%s+%li]", reg, value->symbol, value->value);
+        return;
+    }
+
+    char operand[256];
+    ir_x86_operand(value, operand);
+    asm_push("mov %s, %s", reg, operand);
+}
+
+static void ir_x86_push(struct ir_instruction *value)
+{
+    char operand[256];
+    if (!ir_x86_operand(value, operand))
+    {
+        ir_x86_load("eax", value);
+        asm_push("push eax");
+        return;
+    }
+
+    // Virtual register homes already carry their size
+    asm_push("push %s%s", ir_x86_is_rematerialized(value) ? "dword " : "", operand);
+}
+
+static void ir_x86_store_result(struct ir_instruction *instruction, const char *reg)
+{
+    asm_push("mov dword [ebp-%i], %s", ir_x86_home(instruction), reg);
+}
+
+/**
+ * Writes the memory operand for the given address, registers are loaded into "reg" when needed
+ */
+static void ir_x86_address(struct ir_instruction *address, const char *reg, char *out)
+{
+    if (address->op == IR_OP_FRAME_ADDRESS)
+    {
+        sprintf(out, "[ebp%+i]", ir_x86_frame_offset(address));
+        return;
+    }
+
+    if (address->op == IR_OP_GLOBAL_ADDRESS)
+    {
+        sprintf(out, "[%s+%li]", address->symbol, address->value);
+        return;
+    }
+
+    ir_x86_load(reg, address);
+    sprintf(out, "[%s]", reg);
+}
+
+static void ir_x86_load_memory(const char *address, int mem_type, bool is_signed)
+{
+    if (mem_type == IR_TYPE_I32 || mem_type == IR_TYPE_PTR)
+    {
+        asm_push("mov eax, dword %s", address);
+        return;
+    }
+
+    asm_push("%s eax, %s %s", is_signed ? "movsx" : "movzx", ir_x86_size_keyword(mem_type), address);
+}
+
+static const char *ir_x86_condition(int op)
+{
+    switch (op)
+    {
+    case IR_OP_EQ:
+        return "e";
+    case IR_OP_NE:
+        return "ne";
+    case IR_OP_SLT:
+        return "l";
+    case IR_OP_SLE:
+        return "le";
+    case IR_OP_SGT:
+        return "g";
+    case IR_OP_SGE:
+        return "ge";
+    case IR_OP_ULT:
+        return "b";
+    case IR_OP_ULE:
+        return "be";
+    case IR_OP_UGT:
+        return "a";
+    case IR_OP_UGE:
+        return "ae";
+    }
+
+    assert(0 && "Not a comparison");
+    return NULL;
+}
+
+static const char *ir_x86_arithmetic_instruction(int op)
+{
+    switch (op)
+    {
+    case IR_OP_ADD:
+        return "add";
+    case IR_OP_SUB:
+        return "sub";
+    case IR_OP_MUL:
+        return "imul";
+    case IR_OP_AND:
+        return "and";
+    case IR_OP_OR:
+        return "or";
+    case IR_OP_XOR:
+        return "xor";
+    case IR_OP_SHL:
+        return "shl";
+    case IR_OP_SAR:
+        return "sar";
+    case IR_OP_SHR:
+        return "shr";
+    case IR_OP_ROTL:
+        return "rol";
+    case IR_OP_ROTR:
+        return "ror";
+    }
+
+    return NULL;
+}
+
+/**
+ * Counts the set bits of EAX in parallel, pairs of bits then nibbles then the bytes are added with a multiply
+ */
+static void ir_x86_software_popcount()
+{
+    asm_push("mov ecx, eax");
+    asm_push("shr ecx, 1");
+    asm_push("and ecx, 0x55555555");
+    asm_push("sub eax, ecx");
+    asm_push("mov ecx, eax");
+    asm_push("and eax, 0x33333333");
+    asm_push("shr ecx, 2");
+    asm_push("and ecx, 0x33333333");
+    asm_push("add eax, ecx");
+    asm_push("mov ecx, eax");
+    asm_push("shr ecx, 4");
+    asm_push("add eax, ecx");
+    asm_push("and eax, 0x0f0f0f0f");
+    asm_push("imul eax, eax, 0x01010101");
+    asm_push("shr eax, 24");
+}
+
+void ir_x86_bit_operation(struct compile_process *process, int op)
+{
+    switch (op)
+    {
+    case IR_OP_POPCOUNT:
+        if (process->flags & COMPILE_PROCESS_TARGET_POPCNT)
+        {
+            asm_push("popcnt eax, eax");
+            break;
+        }
+        ir_x86_software_popcount();
+        break;
+
+    case IR_OP_CLZ:
+        // The index of the highest set bit counted from the top
+        asm_push("bsr eax, eax");
+        asm_push("xor eax, 31");
+        break;
+
+    case IR_OP_CTZ:
+        asm_push("bsf eax, eax");
+        break;
+
+    case IR_OP_BSWAP:
+        asm_push("bswap eax");
+        break;
+    }
+}
+
+static void ir_x86_compare(struct ir_instruction *instruction)
+{
+    ir_x86_load("eax", ir_instruction_operand(instruction, 0));
+    struct ir_instruction *right = ir_instruction_operand(instruction, 1);
+    if (right->op == IR_OP_CONST)
+    {
+        asm_push("cmp eax, %li", right->value);
+        return;
+    }
+
+    ir_x86_load("ecx", right);
+    asm_push("cmp eax, ecx");
+}
+
+static void ir_x86_binary(struct ir_instruction *instruction)
+{
+    int op = instruction->op;
+    struct ir_instruction *left = ir_instruction_operand(instruction, 0);
+    struct ir_instruction *right = ir_instruction_operand(instruction, 1);
+    if (ir_op_is_compare(op))
+    {
+        ir_x86_compare(instruction);
+        asm_push("set%s al", ir_x86_condition(op));
+        asm_push("movzx eax, al");
+        ir_x86_store_result(instruction, "eax");
+        return;
+    }
+
+    if (op == IR_OP_SDIV || op == IR_OP_SREM || op == IR_OP_UDIV || op == IR_OP_UREM)
+    {
+        ir_x86_load("eax", left);
+        ir_x86_load("ecx", right);
+        if (op == IR_OP_SDIV || op == IR_OP_SREM)
+        {
+            asm_push("cdq");
+            asm_push("idiv ecx");
+        }
+        else
+        {
+            asm_push("xor edx, edx");
+            asm_push("div ecx");
+        }
+        ir_x86_store_result(instruction, op == IR_OP_SDIV || op == IR_OP_UDIV ? "eax" : "edx");
+        return;
+    }
+
+    const char *ins = ir_x86_arithmetic_instruction(op);
+    ir_x86_load("eax", left);
+    if (right->op == IR_OP_CONST)
+    {
+        asm_push("%s eax, %li", ins, right->value);
+    }
+    else if (op == IR_OP_SHL || op == IR_OP_SAR || op == IR_OP_SHR || op == IR_OP_ROTL || op == IR_OP_ROTR)
+    {
+        ir_x86_load("ecx", right);
+        asm_push("%s eax, cl", ins);
+    }
+    else
+    {
+        ir_x86_load("ecx", right);
+        asm_push("%s eax, ecx", ins);
+    }
+    ir_x86_store_result(instruction, "eax");
+}
+
+static const char *ir_x86_lane_suffix(int mem_type)
+{
+    switch (mem_type)
+    {
+    case IR_TYPE_I8:
+        return "b";
+    case IR_TYPE_I16:
+        return "w";
+    }
+
+    return "d";
+}
+
+static void ir_x86_vector_load(const char *reg, struct ir_instruction *value)
+{
+    asm_push("movdqu %s, [ebp-%i]", reg, ir_x86_vector_home(value));
+}
+
+static void ir_x86_vector_store_result(struct ir_instruction *instruction, const char *reg)
+{
+    asm_push("movdqu [ebp-%i], %s", ir_x86_vector_home(instruction), reg);
+}
+
+/**
+ * Writes the SSE2 instruction for a lane by lane operation on the lane type
+ */
+static void ir_x86_vector_operation(int op, int mem_type, char *out)
+{
+    switch (op)
+    {
+    case IR_OP_ADD:
+        sprintf(out, "padd%s", ir_x86_lane_suffix(mem_type));
+        return;
+    case IR_OP_SUB:
+        sprintf(out, "psub%s", ir_x86_lane_suffix(mem_type));
+        return;
+    case IR_OP_EQ:
+        sprintf(out, "pcmpeq%s", ir_x86_lane_suffix(mem_type));
+        return;
+    case IR_OP_AND:
+        sprintf(out, "pand");
+        return;
+    case IR_OP_OR:
+        sprintf(out, "por");
+        return;
+    case IR_OP_XOR:
+        sprintf(out, "pxor");
+        return;
+    }
+
+    compiler_error(ir_x86.process, "Cannot generate code for the vector operation %s", ir_op_name(op));
+}
+
+static void ir_x86_vector(struct ir_instruction *instruction)
+{
+    char address[256];
+    char operation[16];
+    switch (instruction->op)
+    {
+    case IR_OP_VECTOR_LOAD:
+        ir_x86_address(ir_instruction_operand(instruction, 0), "ebx", address);
+        asm_push("movdqu xmm0, %s", address);
+        ir_x86_vector_store_result(instruction, "xmm0");
+        break;
+
+    case IR_OP_VECTOR_STORE:
+        ir_x86_vector_load("xmm0", ir_instruction_operand(instruction, 1));
+        ir_x86_address(ir_instruction_operand(instruction, 0), "ebx", address);
+        asm_push("movdqu %s, xmm0", address);
+        break;
+
+    case IR_OP_VECTOR_SPLAT:
+        ir_x86_load("eax", ir_instruction_operand(instruction, 0));
+        asm_push("movd xmm0, eax");
+        if (instruction->mem_type == IR_TYPE_I8)
+        {
+            asm_push("punpcklbw xmm0, xmm0");
+        }
+        if (instruction->mem_type == IR_TYPE_I8 || instruction->mem_type == IR_TYPE_I16)
+        {
+            asm_push("punpcklwd xmm0, xmm0");
+        }
+        asm_push("pshufd xmm0, xmm0, 0");
+        ir_x86_vector_store_result(instruction, "xmm0");
+        break;
+
+    case IR_OP_VECTOR_MASK:
+        ir_x86_vector_load("xmm0", ir_instruction_operand(instruction, 0));
+        asm_push("pmovmskb eax, xmm0");
+        ir_x86_store_result(instruction, "eax");
+        break;
+
+    case IR_OP_VECTOR_REDUCE:
+        if (instruction->mem_type != IR_TYPE_I32)
+        {
+            compiler_error(ir_x86.process, "Only vectors of 32 bit lanes can be reduced");
+        }
+
+        // Combine the high half with the low half then the two lanes that are left
+        ir_x86_vector_operation(instruction->value, instruction->mem_type, operation);
+        ir_x86_vector_load("xmm0", ir_instruction_operand(instruction, 0));
+        asm_push("pshufd xmm1, xmm0, 0x4e");
+        asm_push("%s xmm0, xmm1", operation);
+        asm_push("pshufd xmm1, xmm0, 0xb1");
+        asm_push("%s xmm0, xmm1", operation);
+        asm_push("movd eax, xmm0");
+        ir_x86_store_result(instruction, "eax");
+        break;
+
+    default:
+        ir_x86_vector_operation(instruction->op, instruction->mem_type, operation);
+        ir_x86_vector_load("xmm0", ir_instruction_operand(instruction, 0));
+        ir_x86_vector_load("xmm1", ir_instruction_operand(instruction, 1));
+        asm_push("%s xmm0, xmm1", operation);
+        ir_x86_vector_store_result(instruction, "xmm0");
+    }
+}
+
+/**
+ * Returns the amount of leading arguments of the call that are passed in registers
+ */
+static int ir_x86_register_arguments(struct ir_instruction *instruction)
+{
+    struct ir_instruction *callee = ir_instruction_operand(instruction, 0);
+    if (callee->op != IR_OP_GLOBAL_ADDRESS || callee->value != 0)
+        return 0;
+
+    struct symbol *sym = symresolver_get_symbol(ir_x86.process, callee->symbol);
+    if (!sym || sym->type != SYMBOL_TYPE_NODE || ((struct node *)sym->data)->type != NODE_TYPE_FUNCTION)
+        return 0;
+
+    int total_registers = function_node_register_arguments(sym->data);
+    int total_arguments = ir_instruction_total_operands(instruction) - 1;
+    return total_arguments < total_registers ? total_arguments : total_registers;
+}
+
+/**
+ * Builtins that could not be expanded inline call the C library function of the same name
+ */
+static void ir_x86_extern_builtin(struct ir_instruction *callee)
+{
+    if (symresolver_get_symbol_for_native_function(ir_x86.process, callee->symbol))
+    {
+        asm_push("extern %s", callee->symbol);
+    }
+}
+
+/**
+ * Exchanges and compare exchanges keep the value found in EAX, the desired value of a compare exchange is in ECX
+ */
+static void ir_x86_atomic(struct ir_instruction *instruction)
+{
+    char address[64];
+    switch (instruction->value)
+    {
+    case IR_ATOMIC_EXCHANGE:
+    case IR_ATOMIC_FETCH_ADD:
+        ir_x86_load("eax", ir_instruction_operand(instruction, 1));
+        ir_x86_address(ir_instruction_operand(instruction, 0), "ebx", address);
+        asm_push("%s dword %s, eax", instruction->value == IR_ATOMIC_EXCHANGE ? "xchg" : "lock xadd", address);
+        break;
+
+    case IR_ATOMIC_COMPARE_EXCHANGE:
+        ir_x86_load("eax", ir_instruction_operand(instruction, 1));
+        ir_x86_load("ecx", ir_instruction_operand(instruction, 2));
+        ir_x86_address(ir_instruction_operand(instruction, 0), "ebx", address);
+        asm_push("lock cmpxchg dword %s, ecx", address);
+        break;
+
+    case IR_ATOMIC_FENCE:
+        asm_push("mfence");
+        return;
+
+    case IR_ATOMIC_BARRIER:
+        return;
+    }
+
+    // A sequentially consistent store is an exchange whose result is not needed
+    if (instruction->type != IR_TYPE_VOID)
+    {
+        ir_x86_store_result(instruction, "eax");
+    }
+}
+
+static void ir_x86_call(struct ir_instruction *instruction)
+{
+    int total_arguments = ir_instruction_total_operands(instruction) - 1;
+    int total_registers = ir_x86_register_arguments(instruction);
+    for (int i = total_arguments; i > total_registers; i--)
+    {
+        ir_x86_push(ir_instruction_operand(instruction, i));
+    }
+
+    // Loading a value never touches another register so the arguments can go straight in
+    for (int i = 1; i <= total_registers; i++)
+    {
+        ir_x86_load(function_node_argument_register(i - 1), ir_instruction_operand(instruction, i));
+    }
+
+    struct ir_instruction *callee = ir_instruction_operand(instruction, 0);
+    if (callee->op == IR_OP_GLOBAL_ADDRESS && callee->value == 0)
+    {
+        ir_x86_extern_builtin(callee);
+        asm_push("call %s", callee->symbol);
+    }
+    else
+    {
+        ir_x86_load("eax", callee);
+        asm_push("call eax");
+    }
+
+    if (total_arguments > total_registers)
+    {
+        asm_push("add esp, %i", (total_arguments - total_registers) * DATA_SIZE_DWORD);
+    }
+
+    if (instruction->type != IR_TYPE_VOID)
+    {
+        ir_x86_store_result(instruction, "eax");
+    }
+}
+
+/**
+ * Returns true if the call is immediately returned and can reuse our stack frame i.e "return abc(50);"
+ */
+static bool ir_x86_is_tail_call(struct ir_instruction *instruction, struct ir_instruction *next)
+{
+    struct node *func_node = ir_x86.function->node;
+    if (instruction->op != IR_OP_CALL || !next || next->op != IR_OP_RETURN)
+        return false;
+
+    if (ir_instruction_total_operands(next) && ir_instruction_operand(next, 0) != instruction)
+        return false;
+
+    if (func_node->func.flags & (FUNCTION_NODE_FLAG_IS_VARIADIC | FUNCTION_NODE_FLAG_ADDRESS_TAKEN))
+    {
+        // Our arguments or locals may still be referenced by the callee.
+        return false;
+    }
+
+    struct ir_instruction *callee = ir_instruction_operand(instruction, 0);
+    if (callee->op != IR_OP_GLOBAL_ADDRESS || callee->value != 0)
+        return false;
+
+    // The arguments must fit in the argument area our caller pushed for us
+    int total_arguments = ir_instruction_total_operands(instruction) - 1 - ir_x86_register_arguments(instruction);
+    return total_arguments * DATA_SIZE_DWORD <= function_node_argument_stack_size(func_node);
+}
+
+static void ir_x86_tail_call(struct ir_instruction *instruction)
+{
+    struct node *func_node = ir_x86.function->node;
+    struct ir_instruction *callee = ir_instruction_operand(instruction, 0);
+    asm_push("; TAIL CALL %s", callee->symbol);
+
+    // All arguments must be computed before we overwrite our own arguments
+    int total_arguments = ir_instruction_total_operands(instruction) - 1;
+    for (int i = total_arguments; i >= 1; i--)
+    {
+        ir_x86_push(ir_instruction_operand(instruction, i));
+    }
+
+    // Register arguments are popped first, calling ourselves they go straight to where we stored ours
+    bool self = S_EQ(callee->symbol, ir_x86.function->name);
+    int total_registers = ir_x86_register_arguments(instruction);
+    struct vector *arguments = function_node_argument_vec(func_node);
+    for (int i = 0; i < total_registers; i++)
+    {
+        if (self)
+        {
+            asm_push("pop dword [ebp%i]", variable_node(vector_peek_ptr_at(arguments, i))->var.aoffset);
+            continue;
+        }
+
+        asm_push("pop %s", function_node_argument_register(i));
+    }
+
+    size_t argument_offset = function_node_argument_stack_addition(func_node);
+    for (int i = total_registers; i < total_arguments; i++)
+    {
+        asm_push("pop dword [ebp+%i]", (int)(argument_offset + (i - total_registers) * DATA_SIZE_DWORD));
+    }
+
+    if (self)
+    {
+        // The entry block reads the arguments again
+        char label[64];
+        ir_x86_block_label(vector_peek_ptr_at(ir_x86.function->blocks, 0), label);
+        asm_push("jmp %s", label);
+        return;
+    }
+
+    ir_x86_extern_builtin(callee);
+    asm_push("mov esp, ebp");
+    asm_push("pop ebp");
+    asm_push("jmp %s", callee->symbol);
+}
+
+/**
+ * Copies the incoming values for the edge from "from" into the phis of "to"
+ * The copies happen in parallel as a phi may use the result of another phi in the same block.
+ */
+static void ir_x86_phi_copies(struct ir_block *from, struct ir_block *to)
+{
+    int total_phis = 0;
+    for (int i = 0; i < vector_count(to->instructions); i++)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(to->instructions, i);
+        if (phi->op != IR_OP_PHI)
+            break;
+
+        struct ir_instruction *incoming = ir_phi_incoming_for_block(phi, from);
+        if (phi->type == IR_TYPE_V128)
+        {
+            // Pushed from the top so the lowest dword is popped first
+            for (int offset = 16 - DATA_SIZE_DWORD; offset >= 0; offset -= DATA_SIZE_DWORD)
+            {
+                asm_push("push dword [ebp-%i]", ir_x86_vector_home(incoming) - offset);
+            }
+        }
+        else
+        {
+            ir_x86_push(incoming);
+        }
+        total_phis++;
+    }
+
+    for (int i = total_phis - 1; i >= 0; i--)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(to->instructions, i);
+        if (phi->type != IR_TYPE_V128)
+        {
+            asm_push("pop dword [ebp-%i]", ir_x86_home(phi));
+            continue;
+        }
+
+        for (int offset = 0; offset < 16; offset += DATA_SIZE_DWORD)
+        {
+            asm_push("pop dword [ebp-%i]", ir_x86_vector_home(phi) - offset);
+        }
+    }
+}
+
+static bool ir_x86_block_has_phis(struct ir_block *block)
+{
+    if (vector_count(block->instructions) == 0)
+        return false;
+
+    struct ir_instruction *first = vector_peek_ptr_at(block->instructions, 0);
+    return first->op == IR_OP_PHI;
+}
+
+static void ir_x86_jump(struct ir_block *from, struct ir_block *to, struct ir_block *next_block)
+{
+    ir_x86_phi_copies(from, to);
+    if (to == next_block)
+        return;
+
+    char label[64];
+    ir_x86_block_label(to, label);
+    asm_push("jmp %s", label);
+}
+
+static void ir_x86_branch(struct ir_instruction *instruction, struct ir_instruction *fused_compare, struct ir_block *next_block)
+{
+    struct ir_block *block = instruction->block;
+    struct ir_block *true_block = ir_instruction_target(instruction, 0);
+    struct ir_block *false_block = ir_instruction_target(instruction, 1);
+
+    // Jump on the opposite condition when the true block follows so that it is fallen through to
+    bool inverted = true_block == next_block && false_block != next_block;
+    if (inverted)
+    {
+        true_block = false_block;
+        false_block = next_block;
+    }
+
+    const char *condition = inverted ? "e" : "ne";
+    if (fused_compare)
+    {
+        ir_x86_compare(fused_compare);
+        condition = ir_x86_condition(inverted ? ir_op_inverse_compare(fused_compare->op) : fused_compare->op);
+    }
+    else
+    {
+        ir_x86_load("eax", ir_instruction_operand(instruction, 0));
+        asm_push("test eax, eax");
+    }
+
+    // Edges into blocks with phis need their own code to copy the values
+    char true_label[64];
+    int stub_id = 0;
+    if (ir_x86_block_has_phis(true_block))
+    {
+        stub_id = codegen_label_count();
+        sprintf(true_label, ".edge_%i", stub_id);
+    }
+    else
+    {
+        ir_x86_block_label(true_block, true_label);
+    }
+
+    asm_push("j%s %s", condition, true_label);
+    ir_x86_jump(block, false_block, stub_id ? NULL : next_block);
+    if (stub_id)
+    {
+        asm_push("%s:", true_label);
+        ir_x86_jump(block, true_block, next_block);
+    }
+}
+
+static void ir_x86_return(struct ir_instruction *instruction)
+{
+    if (ir_instruction_total_operands(instruction))
+    {
+        ir_x86_load("eax", ir_instruction_operand(instruction, 0));
+    }
+
+    asm_push("mov esp, ebp");
+    asm_push("pop ebp");
+    asm_push("ret");
+}
+
+/**
+ * Returns true if the comparison is used only by the branch that follows it
+ * the flags can then be used by the branch directly
+ */
+static bool ir_x86_is_fused_compare(struct ir_instruction *instruction, struct ir_instruction *next)
+{
+    return ir_op_is_compare(instruction->op) && next && next->op == IR_OP_BRANCH &&
+           ir_instruction_operand(next, 0) == instruction && ir_x86.uses[instruction->id] == 1;
+}
+
+static void ir_x86_instruction(struct ir_instruction *instruction, struct ir_instruction *fused_compare, struct ir_block *next_block)
+{
+    char address[256];
+    switch (instruction->op)
+    {
+    case IR_OP_CONST:
+    case IR_OP_UNDEF:
+    case IR_OP_GLOBAL_ADDRESS:
+    case IR_OP_FRAME_ADDRESS:
+    case IR_OP_PHI:
+        // Nothing to generate, constants are rematerialized at each use
+        // and phis are written to by their predecessors.
+        break;
+
+    case IR_OP_PARAM:
+        sprintf(address, "[ebp%+i]", instruction->slot->offset);
+        ir_x86_load_memory(address, instruction->mem_type, instruction->flags & IR_INSTRUCTION_FLAG_SIGNED);
+        ir_x86_store_result(instruction, "eax");
+        break;
+
+    case IR_OP_LOAD:
+        ir_x86_address(ir_instruction_operand(instruction, 0), "ebx", address);
+        ir_x86_load_memory(address, instruction->mem_type, instruction->flags & IR_INSTRUCTION_FLAG_SIGNED);
+        ir_x86_store_result(instruction, "eax");
+        break;
+
+    case IR_OP_STORE:
+        ir_x86_load("eax", ir_instruction_operand(instruction, 1));
+        ir_x86_address(ir_instruction_operand(instruction, 0), "ebx", address);
+        asm_push("mov %s %s, %s", ir_x86_size_keyword(instruction->mem_type), address, ir_x86_eax_for_type(instruction->mem_type));
+        break;
+
+    case IR_OP_NEG:
+    case IR_OP_NOT:
+        ir_x86_load("eax", ir_instruction_operand(instruction, 0));
+        asm_push("%s eax", instruction->op == IR_OP_NEG ? "neg" : "not");
+        ir_x86_store_result(instruction, "eax");
+        break;
+
+    case IR_OP_POPCOUNT:
+    case IR_OP_CLZ:
+    case IR_OP_CTZ:
+    case IR_OP_BSWAP:
+        ir_x86_load("eax", ir_instruction_operand(instruction, 0));
+        ir_x86_bit_operation(ir_x86.process, instruction->op);
+        ir_x86_store_result(instruction, "eax");
+        break;
+
+    case IR_OP_SEXT:
+    case IR_OP_ZEXT:
+        ir_x86_load("eax", ir_instruction_operand(instruction, 0));
+        asm_push("%s eax, %s", instruction->op == IR_OP_SEXT ? "movsx" : "movzx", ir_x86_eax_for_type(instruction->mem_type));
+        ir_x86_store_result(instruction, "eax");
+        break;
+
+    case IR_OP_COPY:
+        ir_x86_load("eax", ir_instruction_operand(instruction, 0));
+        ir_x86_store_result(instruction, "eax");
+        break;
+
+    case IR_OP_CALL:
+        ir_x86_call(instruction);
+        break;
+
+    case IR_OP_ATOMIC:
+        ir_x86_atomic(instruction);
+        break;
+
+    case IR_OP_JUMP:
+        ir_x86_jump(instruction->block, ir_instruction_target(instruction, 0), next_block);
+        break;
+
+    case IR_OP_BRANCH:
+        ir_x86_branch(instruction, fused_compare, next_block);
+        break;
+
+    case IR_OP_RETURN:
+        ir_x86_return(instruction);
+        break;
+
+    case IR_OP_VECTOR_LOAD:
+    case IR_OP_VECTOR_STORE:
+    case IR_OP_VECTOR_SPLAT:
+    case IR_OP_VECTOR_MASK:
+    case IR_OP_VECTOR_REDUCE:
+        ir_x86_vector(instruction);
+        break;
+
+    default:
+        if (instruction->type == IR_TYPE_V128)
+        {
+            ir_x86_vector(instruction);
+            break;
+        }
+
+        if (ir_op_is_binary(instruction->op) || ir_op_is_compare(instruction->op))
+        {
+            ir_x86_binary(instruction);
+            break;
+        }
+        compiler_error(ir_x86.process, "Cannot generate code for the IR instruction %s", ir_op_name(instruction->op));
+    }
+}
+
+static void ir_x86_count_uses(struct ir_function *function)
+{
+    ir_x86.uses = calloc(function->total_registers + 1, sizeof(int));
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            for (int o = 0; o < ir_instruction_total_operands(instruction); o++)
+            {
+                struct ir_instruction *operand = ir_instruction_operand(instruction, o);
+                if (operand->id >= 0)
+                {
+                    ir_x86.uses[operand->id]++;
+                }
+            }
+        }
+    }
+}
+
+void ir_codegen_function(struct compile_process *process, struct ir_function *function)
+{
+    struct node *func_node = function->node;
+    memset(&ir_x86, 0, sizeof(ir_x86));
+    ir_x86.process = process;
+    ir_x86.function = function;
+    ir_x86.locals_size = function_node_stack_size(func_node);
+    ir_x86.block_labels = calloc(function->total_blocks + 1, sizeof(int));
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        ir_x86.block_labels[block->id] = codegen_label_count();
+    }
+    ir_x86_count_uses(function);
+    ir_x86.homes = calloc(function->total_registers + 1, sizeof(int));
+    ir_x86.total_homes = ir_assign_homes(function, ir_x86.homes, DATA_SIZE_DWORD);
+
+    // Cold blocks are laid out last, once in the unlikely section the rest of the function stays there.
+    // A function whose entry is cold never ran in the profile and is generated there entirely.
+    bool cold = ((struct ir_block *)vector_peek_ptr_at(function->blocks, 0))->flags & IR_BLOCK_FLAG_COLD;
+    if (cold)
+    {
+        asm_push("section .text.unlikely progbits alloc exec nowrite align=16");
+    }
+
+    asm_push("global %s", function->name);
+    asm_push("; %s function", function->name);
+    asm_push("align 16");
+    asm_push("%s:", function->name);
+    asm_push("push ebp");
+    asm_push("mov ebp, esp");
+
+    size_t frame_size = ir_x86.locals_size + ir_x86.total_homes * DATA_SIZE_DWORD;
+    frame_size = C_ALIGN(frame_size);
+    if (frame_size)
+    {
+        asm_push("sub esp, %i", (int)frame_size);
+    }
+    codegen_store_register_arguments(func_node);
+
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        struct ir_block *next_block = i + 1 < vector_count(function->blocks) ? vector_peek_ptr_at(function->blocks, i + 1) : NULL;
+        if (next_block && (next_block->flags & IR_BLOCK_FLAG_COLD) != (block->flags & IR_BLOCK_FLAG_COLD))
+        {
+            // The next block is in the other section, it cannot be fallen through to
+            next_block = NULL;
+        }
+        if (block->flags & IR_BLOCK_FLAG_COLD && !cold)
+        {
+            asm_push("section .text.unlikely progbits alloc exec nowrite align=16");
+            cold = true;
+        }
+        if (block->flags & IR_BLOCK_FLAG_LOOP_HEADER)
+        {
+            asm_push("align 16");
+        }
+
+        char label[64];
+        ir_x86_block_label(block, label);
+        asm_push("%s:", label);
+
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            struct ir_instruction *next = b + 1 < vector_count(block->instructions) ? vector_peek_ptr_at(block->instructions, b + 1) : NULL;
+            if (ir_x86_is_tail_call(instruction, next))
+            {
+                ir_x86_tail_call(instruction);
+                b++;
+                continue;
+            }
+
+            if (ir_x86_is_fused_compare(instruction, next))
+            {
+                // The branch performs the comparison.
+                ir_x86_instruction(next, instruction, next_block);
+                b++;
+                continue;
+            }
+
+            ir_x86_instruction(instruction, NULL, next_block);
+        }
+    }
+
+    if (cold)
+    {
+        asm_push("section .text");
+    }
+
+    free(ir_x86.block_labels);
+    free(ir_x86.uses);
+    free(ir_x86.homes);
+}
@@ -0,0 +1,1012 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <assert.h>
+#include <stdlib.h>
+
+/**
+ * Generates x86-64 assembly for the System V ABI from the intermediate representation.
+ *
+ * The layout follows the 32 bit generator. Every virtual register has an eight byte home on the
+ * stack frame below the local variables, constants and addresses are rematerialized at each use.
+ * Pointers are 64 bits wide and are computed with 64 bit instructions, every other value is
+ * 32 bits wide and is sign extended whenever it is combined with a pointer.
+ *
+ * The first six arguments arrive in registers and are stored below the local variables
+ * on entry, the rest are on the stack above the return address.
+ */
+
+#define IR_X86_64_REGISTER_ARGUMENTS 6
+#define IR_X86_64_SLOT_SIZE 8
+
+static const char *ir_x86_64_argument_registers[IR_X86_64_REGISTER_ARGUMENTS] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+
+static struct ir_codegen_x86_64
+{
+    struct compile_process *process;
+    struct ir_function *function;
+
+    // The size of the local variables of the function, the register arguments live below them
+    // followed by the virtual registers.
+    size_t locals_size;
+
+    // Label id for each block indexed by the block id.
+    int *block_labels;
+
+    // Total uses of each virtual register indexed by the register id.
+    int *uses;
+
+    // Stack home of each virtual register indexed by the register id.
+    int *homes;
+    int total_homes;
+} ir_x86_64;
+
+static bool ir_x86_64_is_wide(struct ir_instruction *value)
+{
+    return value->type == IR_TYPE_PTR;
+}
+
+static int ir_x86_64_home(struct ir_instruction *value)
+{
+    assert(value->id >= 0 && ir_x86_64.homes[value->id] >= 0);
+    return ir_x86_64.locals_size + (IR_X86_64_REGISTER_ARGUMENTS + ir_x86_64.homes[value->id] + 1) * IR_X86_64_SLOT_SIZE;
+}
+
+/**
+ * V128 registers take two homes, returns the offset of the lower of them
+ */
+static int ir_x86_64_vector_home(struct ir_instruction *value)
+{
+    return ir_x86_64_home(value) + 16 - IR_X86_64_SLOT_SIZE;
+}
+
+/**
+ * Returns the position of the argument with the given name, -1 if there is none
+ */
+static int ir_x86_64_argument_index(const char *name)
+{
+    struct vector *arguments = function_node_argument_vec(ir_x86_64.function->node);
+    for (int i = 0; i < vector_count(arguments); i++)
+    {
+        struct node *var_node = vector_peek_ptr_at(arguments, i);
+        if (S_EQ(var_node->var.name, name))
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+ * Returns the offset from RBP of the frame slot, the parser lays arguments out for
+ * the 32 bit calling convention so they are moved to where this ABI puts them.
+ */
+static int ir_x86_64_slot_offset(struct ir_frame_slot *slot)
+{
+    if (!(slot->flags & IR_FRAME_SLOT_FLAG_IS_ARGUMENT))
+        return slot->offset;
+
+    int index = ir_x86_64_argument_index(slot->name);
+    assert(index >= 0);
+    if (index < IR_X86_64_REGISTER_ARGUMENTS)
+        return -(int)(ir_x86_64.locals_size + (index + 1) * IR_X86_64_SLOT_SIZE);
+
+    // Above the saved RBP and the return address
+    return 16 + (index - IR_X86_64_REGISTER_ARGUMENTS) * IR_X86_64_SLOT_SIZE;
+}
+
+static int ir_x86_64_frame_offset(struct ir_instruction *value)
+{
+    return ir_x86_64_slot_offset(value->slot) + value->value;
+}
+
+static const char *ir_x86_64_size_keyword(int mem_type)
+{
+    switch (mem_type)
+    {
+    case IR_TYPE_I8:
+        return "byte";
+    case IR_TYPE_I16:
+        return "word";
+    case IR_TYPE_PTR:
+        return "qword";
+    }
+
+    return "dword";
+}
+
+static const char *ir_x86_64_rax_for_type(int mem_type)
+{
+    switch (mem_type)
+    {
+    case IR_TYPE_I8:
+        return "al";
+    case IR_TYPE_I16:
+        return "ax";
+    case IR_TYPE_PTR:
+        return "rax";
+    }
+
+    return "eax";
+}
+
+/**
+ * Returns the 32 bit name of one of the scratch registers
+ */
+static const char *ir_x86_64_low_register(const char *reg)
+{
+    if (S_EQ(reg, "rax"))
+        return "eax";
+    if (S_EQ(reg, "rcx"))
+        return "ecx";
+    if (S_EQ(reg, "rdx"))
+        return "edx";
+
+    assert(0 && "Not a scratch register");
+    return NULL;
+}
+
+static void ir_x86_64_block_label(struct ir_block *block, char *out)
+{
+    sprintf(out, ".block_%i", ir_x86_64.block_labels[block->id]);
+}
+
+/**
+ * Loads the value into the 64 bit register, values that are not pointers are sign extended
+ */
+static void ir_x86_64_load(const char *reg, struct ir_instruction *value)
+{
+    switch (value->op)
+    {
+    case IR_OP_FRAME_ADDRESS:
+        asm_push("lea %s, [rbp%+i]", reg, ir_x86_64_frame_offset(value));
+        return;
+
+    case IR_OP_GLOBAL_ADDRESS:
+        asm_push("lea %s, [rel %s+%li]", reg, value->symbol, value->value);
+        return;
+
+    case IR_OP_CONST:
+        asm_push("mov %s, %li", reg, ir_x86_64_is_wide(value) ? value->value : (long)(int)value->value);
+        return;
+
+    case IR_OP_UNDEF:
+        asm_push("xor %s, %s", reg, reg);
+        return;
+    }
+
+    if (ir_x86_64_is_wide(value))
+    {
+        asm_push("mov %s, qword [rbp-%i]", reg, ir_x86_64_home(value));
+        return;
+    }
+
+    asm_push("movsxd %s, dword [rbp-%i]", reg, ir_x86_64_home(value));
+}
+
+static void ir_x86_64_push(struct ir_instruction *value)
+{
+    if (value->op == IR_OP_CONST)
+    {
+        asm_push("push %li", (long)(int)value->value);
+        return;
+    }
+
+    ir_x86_64_load("rax", value);
+    asm_push("push rax");
+}
+
+static void ir_x86_64_store_result(struct ir_instruction *instruction, const char *reg)
+{
+    if (ir_x86_64_is_wide(instruction))
+    {
+        asm_push("mov qword [rbp-%i], %s", ir_x86_64_home(instruction), reg);
+        return;
+    }
+
+    asm_push("mov dword [rbp-%i], %s", ir_x86_64_home(instruction), ir_x86_64_low_register(reg));
+}
+
+/**
+ * Writes the memory operand for the given address, registers are loaded into "reg" when needed
+ */
+static void ir_x86_64_address(struct ir_instruction *address, const char *reg, char *out)
+{
+    if (address->op == IR_OP_FRAME_ADDRESS)
+    {
+        sprintf(out, "[rbp%+i]", ir_x86_64_frame_offset(address));
+        return;
+    }
+
+    if (address->op == IR_OP_GLOBAL_ADDRESS)
+    {
+        sprintf(out, "[rel %s+%li]", address->symbol, address->value);
+        return;
+    }
+
+    ir_x86_64_load(reg, address);
+    sprintf(out, "[%s]", reg);
+}
+
+static void ir_x86_64_load_memory(const char *address, int mem_type, bool is_signed)
+{
+    if (mem_type == IR_TYPE_PTR)
+    {
+        asm_push("mov rax, qword %s", address);
+        return;
+    }
+
+    if (mem_type == IR_TYPE_I32)
+    {
+        asm_push("mov eax, dword %s", address);
+        return;
+    }
+
+    asm_push("%s eax, %s %s", is_signed ? "movsx" : "movzx", ir_x86_64_size_keyword(mem_type), address);
+}
+
+static const char *ir_x86_64_condition(int op)
+{
+    switch (op)
+    {
+    case IR_OP_EQ:
+        return "e";
+    case IR_OP_NE:
+        return "ne";
+    case IR_OP_SLT:
+        return "l";
+    case IR_OP_SLE:
+        return "le";
+    case IR_OP_SGT:
+        return "g";
+    case IR_OP_SGE:
+        return "ge";
+    case IR_OP_ULT:
+        return "b";
+    case IR_OP_ULE:
+        return "be";
+    case IR_OP_UGT:
+        return "a";
+    case IR_OP_UGE:
+        return "ae";
+    }
+
+    assert(0 && "Not a comparison");
+    return NULL;
+}
+
+static const char *ir_x86_64_arithmetic_instruction(int op)
+{
+    switch (op)
+    {
+    case IR_OP_ADD:
+        return "add";
+    case IR_OP_SUB:
+        return "sub";
+    case IR_OP_MUL:
+        return "imul";
+    case IR_OP_AND:
+        return "and";
+    case IR_OP_OR:
+        return "or";
+    case IR_OP_XOR:
+        return "xor";
+    case IR_OP_SHL:
+        return "shl";
+    case IR_OP_SAR:
+        return "sar";
+    case IR_OP_SHR:
+        return "shr";
+    case IR_OP_ROTL:
+        return "rol";
+    case IR_OP_ROTR:
+        return "ror";
+    }
+
+    return NULL;
+}
+
+static void ir_x86_64_compare(struct ir_instruction *instruction)
+{
+    struct ir_instruction *left = ir_instruction_operand(instruction, 0);
+    struct ir_instruction *right = ir_instruction_operand(instruction, 1);
+    bool wide = ir_x86_64_is_wide(left) || ir_x86_64_is_wide(right);
+    ir_x86_64_load("rax", left);
+    if (right->op == IR_OP_CONST && !wide)
+    {
+        asm_push("cmp eax, %li", right->value);
+        return;
+    }
+
+    ir_x86_64_load("rcx", right);
+    asm_push(wide ? "cmp rax, rcx" : "cmp eax, ecx");
+}
+
+static void ir_x86_64_binary(struct ir_instruction *instruction)
+{
+    int op = instruction->op;
+    struct ir_instruction *left = ir_instruction_operand(instruction, 0);
+    struct ir_instruction *right = ir_instruction_operand(instruction, 1);
+    if (ir_op_is_compare(op))
+    {
+        ir_x86_64_compare(instruction);
+        asm_push("set%s al", ir_x86_64_condition(op));
+        asm_push("movzx eax, al");
+        ir_x86_64_store_result(instruction, "rax");
+        return;
+    }
+
+    if (op == IR_OP_SDIV || op == IR_OP_SREM || op == IR_OP_UDIV || op == IR_OP_UREM)
+    {
+        ir_x86_64_load("rax", left);
+        ir_x86_64_load("rcx", right);
+        if (op == IR_OP_SDIV || op == IR_OP_SREM)
+        {
+            asm_push("cdq");
+            asm_push("idiv ecx");
+        }
+        else
+        {
+            asm_push("xor edx, edx");
+            asm_push("div ecx");
+        }
+        ir_x86_64_store_result(instruction, op == IR_OP_SDIV || op == IR_OP_UDIV ? "rax" : "rdx");
+        return;
+    }
+
+    // Pointer arithmetic is done on all 64 bits with the other operand sign extended
+    bool wide = ir_x86_64_is_wide(instruction);
+    const char *ins = ir_x86_64_arithmetic_instruction(op);
+    const char *rax = wide ? "rax" : "eax";
+    ir_x86_64_load("rax", left);
+    if (right->op == IR_OP_CONST && right->value == (int)right->value)
+    {
+        asm_push("%s %s, %li", ins, rax, right->value);
+    }
+    else if (op == IR_OP_SHL || op == IR_OP_SAR || op == IR_OP_SHR || op == IR_OP_ROTL || op == IR_OP_ROTR)
+    {
+        ir_x86_64_load("rcx", right);
+        asm_push("%s %s, cl", ins, rax);
+    }
+    else
+    {
+        ir_x86_64_load("rcx", right);
+        asm_push("%s %s, %s", ins, rax, wide ? "rcx" : "ecx");
+    }
+    ir_x86_64_store_result(instruction, "rax");
+}
+
+static const char *ir_x86_64_lane_suffix(int mem_type)
+{
+    switch (mem_type)
+    {
+    case IR_TYPE_I8:
+        return "b";
+    case IR_TYPE_I16:
+        return "w";
+    }
+
+    return "d";
+}
+
+static void ir_x86_64_vector_load(const char *reg, struct ir_instruction *value)
+{
+    asm_push("movdqu %s, [rbp-%i]", reg, ir_x86_64_vector_home(value));
+}
+
+static void ir_x86_64_vector_store_result(struct ir_instruction *instruction, const char *reg)
+{
+    asm_push("movdqu [rbp-%i], %s", ir_x86_64_vector_home(instruction), reg);
+}
+
+/**
+ * Writes the SSE2 instruction for a lane by lane operation on the lane type
+ */
+static void ir_x86_64_vector_operation(int op, int mem_type, char *out)
+{
+    switch (op)
+    {
+    case IR_OP_ADD:
+        sprintf(out, "padd%s", ir_x86_64_lane_suffix(mem_type));
+        return;
+    case IR_OP_SUB:
+        sprintf(out, "psub%s", ir_x86_64_lane_suffix(mem_type));
+        return;
+    case IR_OP_EQ:
+        sprintf(out, "pcmpeq%s", ir_x86_64_lane_suffix(mem_type));
+        return;
+    case IR_OP_AND:
+        sprintf(out, "pand");
+        return;
+    case IR_OP_OR:
+        sprintf(out, "por");
+        return;
+    case IR_OP_XOR:
+        sprintf(out, "pxor");
+        return;
+    }
+
+    compiler_error(ir_x86_64.process, "Cannot generate code for the vector operation %s", ir_op_name(op));
+}
+
+static void ir_x86_64_vector(struct ir_instruction *instruction)
+{
+    char address[256];
+    char operation[16];
+    switch (instruction->op)
+    {
+    case IR_OP_VECTOR_LOAD:
+        ir_x86_64_address(ir_instruction_operand(instruction, 0), "rcx", address);
+        asm_push("movdqu xmm0, %s", address);
+        ir_x86_64_vector_store_result(instruction, "xmm0");
+        break;
+
+    case IR_OP_VECTOR_STORE:
+        ir_x86_64_vector_load("xmm0", ir_instruction_operand(instruction, 1));
+        ir_x86_64_address(ir_instruction_operand(instruction, 0), "rcx", address);
+        asm_push("movdqu %s, xmm0", address);
+        break;
+
+    case IR_OP_VECTOR_SPLAT:
+        ir_x86_64_load("rax", ir_instruction_operand(instruction, 0));
+        asm_push("movd xmm0, eax");
+        if (instruction->mem_type == IR_TYPE_I8)
+        {
+            asm_push("punpcklbw xmm0, xmm0");
+        }
+        if (instruction->mem_type == IR_TYPE_I8 || instruction->mem_type == IR_TYPE_I16)
+        {
+            asm_push("punpcklwd xmm0, xmm0");
+        }
+        asm_push("pshufd xmm0, xmm0, 0");
+        ir_x86_64_vector_store_result(instruction, "xmm0");
+        break;
+
+    case IR_OP_VECTOR_MASK:
+        ir_x86_64_vector_load("xmm0", ir_instruction_operand(instruction, 0));
+        asm_push("pmovmskb eax, xmm0");
+        ir_x86_64_store_result(instruction, "rax");
+        break;
+
+    case IR_OP_VECTOR_REDUCE:
+        if (instruction->mem_type != IR_TYPE_I32)
+        {
+            compiler_error(ir_x86_64.process, "Only vectors of 32 bit lanes can be reduced");
+        }
+
+        ir_x86_64_vector_operation(instruction->value, instruction->mem_type, operation);
+        ir_x86_64_vector_load("xmm0", ir_instruction_operand(instruction, 0));
+        asm_push("pshufd xmm1, xmm0, 0x4e");
+        asm_push("%s xmm0, xmm1", operation);
+        asm_push("pshufd xmm1, xmm0, 0xb1");
+        asm_push("%s xmm0, xmm1", operation);
+        asm_push("movd eax, xmm0");
+        ir_x86_64_store_result(instruction, "rax");
+        break;
+
+    default:
+        ir_x86_64_vector_operation(instruction->op, instruction->mem_type, operation);
+        ir_x86_64_vector_load("xmm0", ir_instruction_operand(instruction, 0));
+        ir_x86_64_vector_load("xmm1", ir_instruction_operand(instruction, 1));
+        asm_push("%s xmm0, xmm1", operation);
+        ir_x86_64_vector_store_result(instruction, "xmm0");
+    }
+}
+
+/**
+ * Exchanges and compare exchanges keep the value found in EAX, the desired value of a compare exchange is in EDX
+ */
+static void ir_x86_64_atomic(struct ir_instruction *instruction)
+{
+    char address[64];
+    switch (instruction->value)
+    {
+    case IR_ATOMIC_EXCHANGE:
+    case IR_ATOMIC_FETCH_ADD:
+        ir_x86_64_load("rax", ir_instruction_operand(instruction, 1));
+        ir_x86_64_address(ir_instruction_operand(instruction, 0), "rcx", address);
+        asm_push("%s dword %s, eax", instruction->value == IR_ATOMIC_EXCHANGE ? "xchg" : "lock xadd", address);
+        break;
+
+    case IR_ATOMIC_COMPARE_EXCHANGE:
+        ir_x86_64_load("rax", ir_instruction_operand(instruction, 1));
+        ir_x86_64_load("rdx", ir_instruction_operand(instruction, 2));
+        ir_x86_64_address(ir_instruction_operand(instruction, 0), "rcx", address);
+        asm_push("lock cmpxchg dword %s, edx", address);
+        break;
+
+    case IR_ATOMIC_FENCE:
+        asm_push("mfence");
+        return;
+
+    case IR_ATOMIC_BARRIER:
+        return;
+    }
+
+    // A sequentially consistent store is an exchange whose result is not needed
+    if (instruction->type != IR_TYPE_VOID)
+    {
+        ir_x86_64_store_result(instruction, "rax");
+    }
+}
+
+/**
+ * Builtins that could not be expanded inline call the C library function of the same name
+ */
+static void ir_x86_64_extern_builtin(struct ir_instruction *callee)
+{
+    if (symresolver_get_symbol_for_native_function(ir_x86_64.process, callee->symbol))
+    {
+        asm_push("extern %s", callee->symbol);
+    }
+}
+
+static void ir_x86_64_call(struct ir_instruction *instruction)
+{
+    int total_arguments = ir_instruction_total_operands(instruction) - 1;
+    int stack_arguments = total_arguments > IR_X86_64_REGISTER_ARGUMENTS ? total_arguments - IR_X86_64_REGISTER_ARGUMENTS : 0;
+
+    // The stack must be 16 byte aligned at the call, the frame itself always is
+    int stack_size = stack_arguments * IR_X86_64_SLOT_SIZE;
+    if (stack_size % 16)
+    {
+        asm_push("sub rsp, 8");
+        stack_size += 8;
+    }
+
+    for (int i = total_arguments; i > IR_X86_64_REGISTER_ARGUMENTS; i--)
+    {
+        ir_x86_64_push(ir_instruction_operand(instruction, i));
+    }
+
+    // Loading a value never touches another register so the arguments can go straight in
+    for (int i = 1; i <= total_arguments && i <= IR_X86_64_REGISTER_ARGUMENTS; i++)
+    {
+        ir_x86_64_load(ir_x86_64_argument_registers[i - 1], ir_instruction_operand(instruction, i));
+    }
+
+    struct ir_instruction *callee = ir_instruction_operand(instruction, 0);
+    bool direct = callee->op == IR_OP_GLOBAL_ADDRESS && callee->value == 0;
+    if (!direct)
+    {
+        ir_x86_64_load("r11", callee);
+    }
+
+    // Variadic functions expect the number of vector registers used in AL
+    asm_push("xor eax, eax");
+    if (direct)
+    {
+        ir_x86_64_extern_builtin(callee);
+        asm_push("call %s wrt ..plt", callee->symbol);
+    }
+    else
+    {
+        asm_push("call r11");
+    }
+
+    if (stack_size)
+    {
+        asm_push("add rsp, %i", stack_size);
+    }
+
+    if (instruction->type != IR_TYPE_VOID)
+    {
+        ir_x86_64_store_result(instruction, "rax");
+    }
+}
+
+/**
+ * Returns true if the call is immediately returned and can reuse our stack frame i.e "return abc(50);"
+ */
+static bool ir_x86_64_is_tail_call(struct ir_instruction *instruction, struct ir_instruction *next)
+{
+    struct node *func_node = ir_x86_64.function->node;
+    if (instruction->op != IR_OP_CALL || !next || next->op != IR_OP_RETURN)
+        return false;
+
+    if (ir_instruction_total_operands(next) && ir_instruction_operand(next, 0) != instruction)
+        return false;
+
+    if (func_node->func.flags & (FUNCTION_NODE_FLAG_IS_VARIADIC | FUNCTION_NODE_FLAG_ADDRESS_TAKEN))
+    {
+        // Our arguments or locals may still be referenced by the callee.
+        return false;
+    }
+
+    struct ir_instruction *callee = ir_instruction_operand(instruction, 0);
+    if (callee->op != IR_OP_GLOBAL_ADDRESS || callee->value != 0)
+        return false;
+
+    // Only arguments passed in registers, the stack above us belongs to our caller
+    return ir_instruction_total_operands(instruction) - 1 <= IR_X86_64_REGISTER_ARGUMENTS;
+}
+
+static void ir_x86_64_tail_call(struct ir_instruction *instruction)
+{
+    struct ir_instruction *callee = ir_instruction_operand(instruction, 0);
+    asm_push("; TAIL CALL %s", callee->symbol);
+
+    int total_arguments = ir_instruction_total_operands(instruction) - 1;
+    if (S_EQ(callee->symbol, ir_x86_64.function->name))
+    {
+        // All arguments must be computed before we overwrite our own arguments
+        for (int i = total_arguments; i >= 1; i--)
+        {
+            ir_x86_64_push(ir_instruction_operand(instruction, i));
+        }
+
+        for (int i = 0; i < total_arguments; i++)
+        {
+            asm_push("pop qword [rbp-%i]", (int)(ir_x86_64.locals_size + (i + 1) * IR_X86_64_SLOT_SIZE));
+        }
+
+        // The entry block reads the arguments again
+        char label[64];
+        ir_x86_64_block_label(vector_peek_ptr_at(ir_x86_64.function->blocks, 0), label);
+        asm_push("jmp %s", label);
+        return;
+    }
+
+    for (int i = 1; i <= total_arguments; i++)
+    {
+        ir_x86_64_load(ir_x86_64_argument_registers[i - 1], ir_instruction_operand(instruction, i));
+    }
+
+    asm_push("xor eax, eax");
+    asm_push("mov rsp, rbp");
+    asm_push("pop rbp");
+    ir_x86_64_extern_builtin(callee);
+    asm_push("jmp %s wrt ..plt", callee->symbol);
+}
+
+/**
+ * Copies the incoming values for the edge from "from" into the phis of "to"
+ * The copies happen in parallel as a phi may use the result of another phi in the same block.
+ */
+static void ir_x86_64_phi_copies(struct ir_block *from, struct ir_block *to)
+{
+    int total_phis = 0;
+    for (int i = 0; i < vector_count(to->instructions); i++)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(to->instructions, i);
+        if (phi->op != IR_OP_PHI)
+            break;
+
+        struct ir_instruction *incoming = ir_phi_incoming_for_block(phi, from);
+        if (phi->type == IR_TYPE_V128)
+        {
+            // Pushed from the top so the lower half is popped first
+            asm_push("push qword [rbp-%i]", ir_x86_64_vector_home(incoming) - IR_X86_64_SLOT_SIZE);
+            asm_push("push qword [rbp-%i]", ir_x86_64_vector_home(incoming));
+        }
+        else
+        {
+            ir_x86_64_push(incoming);
+        }
+        total_phis++;
+    }
+
+    for (int i = total_phis - 1; i >= 0; i--)
+    {
+        struct ir_instruction *phi = vector_peek_ptr_at(to->instructions, i);
+        if (phi->type != IR_TYPE_V128)
+        {
+            asm_push("pop qword [rbp-%i]", ir_x86_64_home(phi));
+            continue;
+        }
+
+        asm_push("pop qword [rbp-%i]", ir_x86_64_vector_home(phi));
+        asm_push("pop qword [rbp-%i]", ir_x86_64_vector_home(phi) - IR_X86_64_SLOT_SIZE);
+    }
+}
+
+static bool ir_x86_64_block_has_phis(struct ir_block *block)
+{
+    if (vector_count(block->instructions) == 0)
+        return false;
+
+    struct ir_instruction *first = vector_peek_ptr_at(block->instructions, 0);
+    return first->op == IR_OP_PHI;
+}
+
+static void ir_x86_64_jump(struct ir_block *from, struct ir_block *to, struct ir_block *next_block)
+{
+    ir_x86_64_phi_copies(from, to);
+    if (to == next_block)
+        return;
+
+    char label[64];
+    ir_x86_64_block_label(to, label);
+    asm_push("jmp %s", label);
+}
+
+static void ir_x86_64_branch(struct ir_instruction *instruction, struct ir_instruction *fused_compare, struct ir_block *next_block)
+{
+    struct ir_block *block = instruction->block;
+    struct ir_block *true_block = ir_instruction_target(instruction, 0);
+    struct ir_block *false_block = ir_instruction_target(instruction, 1);
+
+    // Jump on the opposite condition when the true block follows so that it is fallen through to
+    bool inverted = true_block == next_block && false_block != next_block;
+    if (inverted)
+    {
+        true_block = false_block;
+        false_block = next_block;
+    }
+
+    const char *condition = inverted ? "e" : "ne";
+    if (fused_compare)
+    {
+        ir_x86_64_compare(fused_compare);
+        condition = ir_x86_64_condition(inverted ? ir_op_inverse_compare(fused_compare->op) : fused_compare->op);
+    }
+    else
+    {
+        struct ir_instruction *value = ir_instruction_operand(instruction, 0);
+        ir_x86_64_load("rax", value);
+        asm_push(ir_x86_64_is_wide(value) ? "test rax, rax" : "test eax, eax");
+    }
+
+    // Edges into blocks with phis need their own code to copy the values
+    char true_label[64];
+    int stub_id = 0;
+    if (ir_x86_64_block_has_phis(true_block))
+    {
+        stub_id = codegen_label_count();
+        sprintf(true_label, ".edge_%i", stub_id);
+    }
+    else
+    {
+        ir_x86_64_block_label(true_block, true_label);
+    }
+
+    asm_push("j%s %s", condition, true_label);
+    ir_x86_64_jump(block, false_block, stub_id ? NULL : next_block);
+    if (stub_id)
+    {
+        asm_push("%s:", true_label);
+        ir_x86_64_jump(block, true_block, next_block);
+    }
+}
+
+static void ir_x86_64_return(struct ir_instruction *instruction)
+{
+    if (ir_instruction_total_operands(instruction))
+    {
+        ir_x86_64_load("rax", ir_instruction_operand(instruction, 0));
+    }
+
+    asm_push("mov rsp, rbp");
+    asm_push("pop rbp");
+    asm_push("ret");
+}
+
+/**
+ * Returns true if the comparison is used only by the branch that follows it
+ * the flags can then be used by the branch directly
+ */
+static bool ir_x86_64_is_fused_compare(struct ir_instruction *instruction, struct ir_instruction *next)
+{
+    return ir_op_is_compare(instruction->op) && next && next->op == IR_OP_BRANCH &&
+           ir_instruction_operand(next, 0) == instruction && ir_x86_64.uses[instruction->id] == 1;
+}
+
+static void ir_x86_64_instruction(struct ir_instruction *instruction, struct ir_instruction *fused_compare, struct ir_block *next_block)
+{
+    char address[256];
+    switch (instruction->op)
+    {
+    case IR_OP_CONST:
+    case IR_OP_UNDEF:
+    case IR_OP_GLOBAL_ADDRESS:
+    case IR_OP_FRAME_ADDRESS:
+    case IR_OP_PHI:
+        // Nothing to generate, constants are rematerialized at each use
+        // and phis are written to by their predecessors.
+        break;
+
+    case IR_OP_PARAM:
+        sprintf(address, "[rbp%+i]", ir_x86_64_slot_offset(instruction->slot));
+        ir_x86_64_load_memory(address, instruction->mem_type, instruction->flags & IR_INSTRUCTION_FLAG_SIGNED);
+        ir_x86_64_store_result(instruction, "rax");
+        break;
+
+    case IR_OP_LOAD:
+        ir_x86_64_address(ir_instruction_operand(instruction, 0), "rcx", address);
+        ir_x86_64_load_memory(address, instruction->mem_type, instruction->flags & IR_INSTRUCTION_FLAG_SIGNED);
+        ir_x86_64_store_result(instruction, "rax");
+        break;
+
+    case IR_OP_STORE:
+        ir_x86_64_load("rax", ir_instruction_operand(instruction, 1));
+        ir_x86_64_address(ir_instruction_operand(instruction, 0), "rcx", address);
+        asm_push("mov %s %s, %s", ir_x86_64_size_keyword(instruction->mem_type), address, ir_x86_64_rax_for_type(instruction->mem_type));
+        break;
+
+    case IR_OP_NEG:
+    case IR_OP_NOT:
+        ir_x86_64_load("rax", ir_instruction_operand(instruction, 0));
+        asm_push("%s %s", instruction->op == IR_OP_NEG ? "neg" : "not", ir_x86_64_is_wide(instruction) ? "rax" : "eax");
+        ir_x86_64_store_result(instruction, "rax");
+        break;
+
+    case IR_OP_POPCOUNT:
+    case IR_OP_CLZ:
+    case IR_OP_CTZ:
+    case IR_OP_BSWAP:
+        // The 32 bit instructions clear the top of RAX
+        ir_x86_64_load("rax", ir_instruction_operand(instruction, 0));
+        ir_x86_bit_operation(ir_x86_64.process, instruction->op);
+        ir_x86_64_store_result(instruction, "rax");
+        break;
+
+    case IR_OP_SEXT:
+    case IR_OP_ZEXT:
+        ir_x86_64_load("rax", ir_instruction_operand(instruction, 0));
+        asm_push("%s eax, %s", instruction->op == IR_OP_SEXT ? "movsx" : "movzx", ir_x86_64_rax_for_type(instruction->mem_type));
+        ir_x86_64_store_result(instruction, "rax");
+        break;
+
+    case IR_OP_COPY:
+        ir_x86_64_load("rax", ir_instruction_operand(instruction, 0));
+        ir_x86_64_store_result(instruction, "rax");
+        break;
+
+    case IR_OP_CALL:
+        ir_x86_64_call(instruction);
+        break;
+
+    case IR_OP_ATOMIC:
+        ir_x86_64_atomic(instruction);
+        break;
+
+    case IR_OP_JUMP:
+        ir_x86_64_jump(instruction->block, ir_instruction_target(instruction, 0), next_block);
+        break;
+
+    case IR_OP_BRANCH:
+        ir_x86_64_branch(instruction, fused_compare, next_block);
+        break;
+
+    case IR_OP_RETURN:
+        ir_x86_64_return(instruction);
+        break;
+
+    case IR_OP_VECTOR_LOAD:
+    case IR_OP_VECTOR_STORE:
+    case IR_OP_VECTOR_SPLAT:
+    case IR_OP_VECTOR_MASK:
+    case IR_OP_VECTOR_REDUCE:
+        ir_x86_64_vector(instruction);
+        break;
+
+    default:
+        if (instruction->type == IR_TYPE_V128)
+        {
+            ir_x86_64_vector(instruction);
+            break;
+        }
+        if (ir_op_is_binary(instruction->op) || ir_op_is_compare(instruction->op))
+        {
+            ir_x86_64_binary(instruction);
+            break;
+        }
+        compiler_error(ir_x86_64.process, "Cannot generate code for the IR instruction %s", ir_op_name(instruction->op));
+    }
+}
+
+static void ir_x86_64_count_uses(struct ir_function *function)
+{
+    ir_x86_64.uses = calloc(function->total_registers + 1, sizeof(int));
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            for (int o = 0; o < ir_instruction_total_operands(instruction); o++)
+            {
+                struct ir_instruction *operand = ir_instruction_operand(instruction, o);
+                if (operand->id >= 0)
+                {
+                    ir_x86_64.uses[operand->id]++;
+                }
+            }
+        }
+    }
+}
+
+void ir_codegen_function_x86_64(struct compile_process *process, struct ir_function *function)
+{
+    struct node *func_node = function->node;
+    memset(&ir_x86_64, 0, sizeof(ir_x86_64));
+    ir_x86_64.process = process;
+    ir_x86_64.function = function;
+    ir_x86_64.locals_size = align_value(function_node_stack_size(func_node), IR_X86_64_SLOT_SIZE);
+    ir_x86_64.block_labels = calloc(function->total_blocks + 1, sizeof(int));
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        ir_x86_64.block_labels[block->id] = codegen_label_count();
+    }
+    ir_x86_64_count_uses(function);
+    ir_x86_64.homes = calloc(function->total_registers + 1, sizeof(int));
+    ir_x86_64.total_homes = ir_assign_homes(function, ir_x86_64.homes, IR_X86_64_SLOT_SIZE);
+
+    // Cold blocks are laid out last, once in the unlikely section the rest of the function stays there.
+    // A function whose entry is cold never ran in the profile and is generated there entirely.
+    bool cold = ((struct ir_block *)vector_peek_ptr_at(function->blocks, 0))->flags & IR_BLOCK_FLAG_COLD;
+    if (cold)
+    {
+        asm_push("section .text.unlikely progbits alloc exec nowrite align=16");
+    }
+
+    asm_push("global %s", function->name);
+    asm_push("; %s function", function->name);
+    asm_push("align 16");
+    asm_push("%s:", function->name);
+    asm_push("push rbp");
+    asm_push("mov rbp, rsp");
+
+    size_t frame_size = ir_x86_64.locals_size + (IR_X86_64_REGISTER_ARGUMENTS + ir_x86_64.total_homes) * IR_X86_64_SLOT_SIZE;
+    asm_push("sub rsp, %i", (int)align_value(frame_size, 16));
+
+    struct vector *arguments = function_node_argument_vec(func_node);
+    for (int i = 0; i < vector_count(arguments) && i < IR_X86_64_REGISTER_ARGUMENTS; i++)
+    {
+        asm_push("mov qword [rbp-%i], %s", (int)(ir_x86_64.locals_size + (i + 1) * IR_X86_64_SLOT_SIZE), ir_x86_64_argument_registers[i]);
+    }
+
+    for (int i = 0; i < vector_count(function->blocks); i++)
+    {
+        struct ir_block *block = vector_peek_ptr_at(function->blocks, i);
+        struct ir_block *next_block = i + 1 < vector_count(function->blocks) ? vector_peek_ptr_at(function->blocks, i + 1) : NULL;
+        if (next_block && (next_block->flags & IR_BLOCK_FLAG_COLD) != (block->flags & IR_BLOCK_FLAG_COLD))
+        {
+            // The next block is in the other section, it cannot be fallen through to
+            next_block = NULL;
+        }
+        if (block->flags & IR_BLOCK_FLAG_COLD && !cold)
+        {
+            asm_push("section .text.unlikely progbits alloc exec nowrite align=16");
+            cold = true;
+        }
+        if (block->flags & IR_BLOCK_FLAG_LOOP_HEADER)
+        {
+            asm_push("align 16");
+        }
+
+        char label[64];
+        ir_x86_64_block_label(block, label);
+        asm_push("%s:", label);
+
+        for (int b = 0; b < vector_count(block->instructions); b++)
+        {
+            struct ir_instruction *instruction = vector_peek_ptr_at(block->instructions, b);
+            struct ir_instruction *next = b + 1 < vector_count(block->instructions) ? vector_peek_ptr_at(block->instructions, b + 1) : NULL;
+            if (ir_x86_64_is_tail_call(instruction, next))
+            {
+                ir_x86_64_tail_call(instruction);
+                b++;
+                continue;
+            }
+
+            if (ir_x86_64_is_fused_compare(instruction, next))
+            {
+                // The branch performs the comparison.
+                ir_x86_64_instruction(next, instruction, next_block);
+                b++;
+                continue;
+            }
+
+            ir_x86_64_instruction(instruction, NULL, next_block);
+        }
+    }
+
+    if (cold)
+    {
+        asm_push("section .text");
+    }
+
+    free(ir_x86_64.block_labels);
+    free(ir_x86_64.uses);
+    free(ir_x86_64.homes);
+}
@@ -141,6 +141,8 @@ bool is_keyword(const char *str)
            S_EQ(str, "struct") ||
            S_EQ(str, "union") ||
            S_EQ(str, "static") ||
+           S_EQ(str, "__thread") ||
+           S_EQ(str, "_Thread_local") ||
            S_EQ(str, "__ignore_typecheck__") ||
            S_EQ(str, "return") ||
            S_EQ(str, "include") ||
@@ -156,6 +158,8 @@ bool is_keyword(const char *str)
            S_EQ(str, "case") ||
            S_EQ(str, "default") ||
            S_EQ(str, "goto") ||
+           S_EQ(str, "asm") ||
+           S_EQ(str, "__asm__") ||
            S_EQ(str, "typedef") ||
            S_EQ(str, "const") ||
            S_EQ(str, "extern") ||
@@ -539,9 +543,27 @@ static struct token *token_make_number_for_value(unsigned long val)
     return token_create(&(struct token){TOKEN_TYPE_NUMBER, .llnum = val, .num.type = number_type});
 }
 
+static struct token *token_make_floating_number(double val)
+{
+    int number_type = NUMBER_TYPE_DOUBLE;
+    if (peekc() == 'f')
+    {
+        number_type = NUMBER_TYPE_FLOAT;
+        nextc();
+    }
+    return token_create(&(struct token){TOKEN_TYPE_NUMBER, .dnum = val, .num.type = number_type});
+}
+
 static struct token *token_make_number()
 {
-    return token_make_number_for_value(read_number());
+    const char *s = read_number_str();
+    if (strchr(s, '.'))
+    {
+        // A decimal point makes this a floating point literal i.e 1.5 or 1.5f
+        return token_make_floating_number(strtod(s, NULL));
+    }
+
+    return token_make_number_for_value(atoll(s));
 }
 
 static struct token *token_make_identifier_or_keyword()
@@ -7,7 +7,6 @@ int main(int argc, char **argv)
 {
     const char *input_file = "./test.c";
     const char *output_file = "./a.out";
-    const char *option = "exec";
     if (argc > 1)
     {
         input_file = argv[1];
@@ -16,18 +15,84 @@ int main(int argc, char **argv)
     {
         output_file = argv[2];
     }
-    if (argc > 3)
-    {
-        option = argv[3];
-    }
 
     int compile_flags = COMPILE_PROCESS_EXECUTE_NASM;
-    if (S_EQ(option, "object"))
+    struct compile_options options = {
+        .unroll_factor = COMPILE_OPTIONS_DEFAULT_UNROLL_FACTOR,
+        .unroll_budget = COMPILE_OPTIONS_DEFAULT_UNROLL_BUDGET};
+    for (int i = 3; i < argc; i++)
     {
-        compile_flags |= COMPILE_PROCESS_EXPORT_AS_OBJECT;
+        const char *option = argv[i];
+        if (S_EQ(option, "object"))
+        {
+            compile_flags |= COMPILE_PROCESS_EXPORT_AS_OBJECT;
+        }
+        else if (S_EQ(option, "-fir"))
+        {
+            compile_flags |= COMPILE_PROCESS_USE_IR;
+        }
+        else if (S_EQ(option, "-fdump-ir"))
+        {
+            compile_flags |= COMPILE_PROCESS_DUMP_IR;
+        }
+        else if (S_EQ(option, "-fdump-cfg"))
+        {
+            compile_flags |= COMPILE_PROCESS_DUMP_CFG;
+        }
+        else if (S_EQ(option, "-m64"))
+        {
+            compile_flags |= COMPILE_PROCESS_TARGET_X86_64 | COMPILE_PROCESS_USE_IR;
+        }
+        else if (S_EQ(option, "-mpopcnt"))
+        {
+            compile_flags |= COMPILE_PROCESS_TARGET_POPCNT;
+        }
+        else if (S_EQ(option, "-fstats"))
+        {
+            compile_flags |= COMPILE_PROCESS_PRINT_STATISTICS;
+        }
+        else if (S_EQ(option, "-funroll-loops"))
+        {
+            compile_flags |= COMPILE_PROCESS_UNROLL_LOOPS;
+        }
+        else if (S_EQ(option, "-fvectorize"))
+        {
+            compile_flags |= COMPILE_PROCESS_VECTORIZE_LOOPS;
+        }
+        else if (S_EQ(option, "-fprofile-generate"))
+        {
+            compile_flags |= COMPILE_PROCESS_PROFILE_GENERATE;
+        }
+        else if (strncmp(option, "-fprofile-generate=", 19) == 0)
+        {
+            compile_flags |= COMPILE_PROCESS_PROFILE_GENERATE;
+            options.profile_path = option + 19;
+        }
+        else if (S_EQ(option, "-fprofile-use"))
+        {
+            compile_flags |= COMPILE_PROCESS_PROFILE_USE;
+        }
+        else if (strncmp(option, "-fprofile-use=", 14) == 0)
+        {
+            compile_flags |= COMPILE_PROCESS_PROFILE_USE;
+            options.profile_path = option + 14;
+        }
+        else if (strncmp(option, "-fprofile-sample-use=", 21) == 0)
+        {
+            compile_flags |= COMPILE_PROCESS_PROFILE_SAMPLE_USE;
+            options.sample_profile_path = option + 21;
+        }
+        else if (strncmp(option, "-funroll-factor=", 16) == 0)
+        {
+            options.unroll_factor = atoi(option + 16);
+        }
+        else if (strncmp(option, "-funroll-budget=", 16) == 0)
+        {
+            options.unroll_budget = atoi(option + 16);
+        }
     }
 
-    if (compile_file(input_file, output_file, compile_flags) != COMPILER_FILE_COMPILED_OK)
+    if (compile_file(input_file, output_file, compile_flags, &options) != COMPILER_FILE_COMPILED_OK)
     {
         printf("Problem compiling file\n");
     }
@@ -39,13 +104,14 @@ int main(int argc, char **argv)
         char nasm_cmd[512];
         sprintf(nasm_output_file, "%s.o", output_file);
 
+        bool is_64_bit = compile_flags & COMPILE_PROCESS_TARGET_X86_64;
         if (compile_flags & COMPILE_PROCESS_EXPORT_AS_OBJECT)
         {
-            sprintf(nasm_cmd, "nasm -f elf32 %s -o %s", output_file, nasm_output_file);
+            sprintf(nasm_cmd, "nasm -f %s %s -o %s", is_64_bit ? "elf64" : "elf32", output_file, nasm_output_file);
         }
         else
         {
-            sprintf(nasm_cmd, "nasm -f elf32 %s -o %s && gcc -m32 %s -o %s", output_file, nasm_output_file, nasm_output_file, output_file);
+            sprintf(nasm_cmd, "nasm -f %s %s -o %s && gcc %s %s -o %s", is_64_bit ? "elf64" : "elf32", output_file, nasm_output_file, is_64_bit ? "" : "-m32", nasm_output_file, output_file);
         }
 
         printf("%s", nasm_cmd);
@@ -1,11 +1,16 @@
 #include "compiler.h"
 
-struct symbol* native_create_function(struct compile_process* compiler, const char* name, struct native_function_callbacks* callbacks)
+static struct native_function* native_function_new(const char* name, struct native_function_callbacks* callbacks)
 {
     struct native_function* func = calloc(sizeof(struct native_function), 1);
     memcpy(&func->callbacks, callbacks, sizeof(func->callbacks));
     func->name = name;
-    return symresolver_register_symbol(compiler, name, SYMBOL_TYPE_NATIVE_FUNCTION, func);
+    return func;
+}
+
+struct symbol* native_create_function(struct compile_process* compiler, const char* name, struct native_function_callbacks* callbacks)
+{
+    return symresolver_register_symbol(compiler, name, SYMBOL_TYPE_NATIVE_FUNCTION, native_function_new(name, callbacks));
 }
 
 struct native_function* native_function_get(struct compile_process* compiler, const char* name)
@@ -17,4 +22,634 @@ struct native_function* native_function_get(struct compile_process* compiler, co
     }
 
     return sym->data;
-}
\ No newline at end of file
+}
+/**
+ * long __builtin_expect(long value, long expected)
+ *
+ * Returns the value, the expected value only guides how the if statement it is tested in is laid out.
+ */
+void native___builtin_expect(struct generator *generator, struct native_function *func, struct vector *arguments)
+{
+    struct compile_process *compiler = generator->compiler;
+    if (vector_count(arguments) != 2)
+    {
+        compiler_error(compiler, "__builtin_expect expects two arguments %i provided", vector_count(arguments));
+    }
+
+    // The value is left on the stack as the result
+    generator->gen_exp(generator, vector_peek_ptr_at(arguments, 0), 0);
+}
+
+static void native_expect_arguments(struct generator *generator, struct native_function *func, struct vector *arguments, int total)
+{
+    if (vector_count(arguments) != total)
+    {
+        compiler_error(generator->compiler, "%s expects %i arguments %i provided", func->name, total, vector_count(arguments));
+    }
+}
+
+/**
+ * Returns true if the argument is a number i.e the size given to memcpy
+ */
+static bool native_constant_argument(struct node *node, long *value_out)
+{
+    while (node->type == NODE_TYPE_EXPRESSION_PARENTHESIS)
+    {
+        node = node->parenthesis.exp;
+    }
+
+    if (node->type != NODE_TYPE_NUMBER)
+        return false;
+
+    *value_out = node->llnum;
+    return true;
+}
+
+static struct datatype native_void_pointer()
+{
+    struct datatype dtype = {};
+    datatype_set_void(&dtype);
+    dtype.pointer_depth++;
+    dtype.flags |= DATATYPE_FLAG_IS_POINTER;
+    return dtype;
+}
+
+/**
+ * The "int" returned by memcmp, the "size_t" returned by strlen is the same without a sign
+ */
+static struct datatype native_int(bool is_signed)
+{
+    struct datatype dtype = datatype_for_numeric();
+    dtype.flags = is_signed ? DATATYPE_FLAG_IS_SIGNED : 0;
+    return dtype;
+}
+
+/**
+ * Calls the C library function of the same name when the call cannot be expanded inline
+ */
+static void native_call_library(struct generator *generator, struct native_function *func, struct vector *arguments, struct datatype *return_dtype)
+{
+    for (int i = vector_count(arguments) - 1; i >= 0; i--)
+    {
+        generator->gen_exp(generator, vector_peek_ptr_at(arguments, i), EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS);
+    }
+
+    generator->asm_push("extern %s", func->name);
+    generator->asm_push("call %s", func->name);
+    codegen_stack_add(vector_count(arguments) * DATA_SIZE_DWORD);
+    generator->ret(return_dtype, "eax");
+}
+
+/**
+ * Returns the size of the largest move that fits in the remaining bytes along with the part of EAX it uses
+ */
+static int native_chunk(long remaining, const char **reg_out, const char **keyword_out)
+{
+    if (remaining >= DATA_SIZE_DWORD)
+    {
+        *reg_out = "eax";
+        *keyword_out = "dword";
+        return DATA_SIZE_DWORD;
+    }
+
+    if (remaining >= DATA_SIZE_WORD)
+    {
+        *reg_out = "ax";
+        *keyword_out = "word";
+        return DATA_SIZE_WORD;
+    }
+
+    *reg_out = "al";
+    *keyword_out = "byte";
+    return DATA_SIZE_BYTE;
+}
+
+/**
+ * Moves or stores the bytes a "rep movsd" or "rep stosd" left over i.e "movsw" then "movsb"
+ */
+static void native_string_tail(struct generator *generator, const char *instruction, long size)
+{
+    if (size % DATA_SIZE_DWORD >= DATA_SIZE_WORD)
+    {
+        generator->asm_push("%sw", instruction);
+    }
+
+    if (size % DATA_SIZE_WORD)
+    {
+        generator->asm_push("%sb", instruction);
+    }
+}
+
+/**
+ * void* memcpy(void* dest, const void* src, size_t n)
+ */
+void native_memcpy(struct generator *generator, struct native_function *func, struct vector *arguments)
+{
+    native_expect_arguments(generator, func, arguments, 3);
+    struct datatype dtype = native_void_pointer();
+    long size = 0;
+    if (!native_constant_argument(vector_peek_ptr_at(arguments, 2), &size) || size < 0)
+    {
+        native_call_library(generator, func, arguments, &dtype);
+        return;
+    }
+
+    generator->gen_exp(generator, vector_peek_ptr_at(arguments, 0), EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS);
+    generator->gen_exp(generator, vector_peek_ptr_at(arguments, 1), EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS);
+    generator->pop("ecx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    generator->pop("edx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    if (size <= NATIVE_MEMORY_UNROLL_LIMIT)
+    {
+        const char *reg = NULL;
+        const char *keyword = NULL;
+        int chunk = 0;
+        for (long offset = 0; offset < size; offset += chunk)
+        {
+            chunk = native_chunk(size - offset, &reg, &keyword);
+            generator->asm_push("mov %s, [ecx+%li]", reg, offset);
+            generator->asm_push("mov %s [edx+%li], %s", keyword, offset, reg);
+        }
+    }
+    else
+    {
+        // ESI and EDI must be preserved for our caller
+        generator->asm_push("push esi");
+        generator->asm_push("push edi");
+        generator->asm_push("mov esi, ecx");
+        generator->asm_push("mov edi, edx");
+        generator->asm_push("mov ecx, %li", size / DATA_SIZE_DWORD);
+        generator->asm_push("rep movsd");
+        native_string_tail(generator, "movs", size);
+        generator->asm_push("pop edi");
+        generator->asm_push("pop esi");
+    }
+
+    generator->ret(&dtype, "edx");
+}
+
+/**
+ * void* memset(void* dest, int c, size_t n)
+ */
+void native_memset(struct generator *generator, struct native_function *func, struct vector *arguments)
+{
+    native_expect_arguments(generator, func, arguments, 3);
+    struct datatype dtype = native_void_pointer();
+    long size = 0;
+    if (!native_constant_argument(vector_peek_ptr_at(arguments, 2), &size) || size < 0)
+    {
+        native_call_library(generator, func, arguments, &dtype);
+        return;
+    }
+
+    generator->gen_exp(generator, vector_peek_ptr_at(arguments, 0), EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS);
+    long value = 0;
+    if (native_constant_argument(vector_peek_ptr_at(arguments, 1), &value))
+    {
+        generator->pop("edx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        generator->asm_push("mov eax, %li", (value & 0xff) * 0x01010101);
+    }
+    else
+    {
+        // The byte is repeated in every byte of EAX
+        generator->gen_exp(generator, vector_peek_ptr_at(arguments, 1), EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS);
+        generator->pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        generator->pop("edx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        generator->asm_push("movzx eax, al");
+        generator->asm_push("imul eax, eax, 0x01010101");
+    }
+
+    if (size <= NATIVE_MEMORY_UNROLL_LIMIT)
+    {
+        const char *reg = NULL;
+        const char *keyword = NULL;
+        int chunk = 0;
+        for (long offset = 0; offset < size; offset += chunk)
+        {
+            chunk = native_chunk(size - offset, &reg, &keyword);
+            generator->asm_push("mov %s [edx+%li], %s", keyword, offset, reg);
+        }
+    }
+    else
+    {
+        generator->asm_push("push edi");
+        generator->asm_push("mov edi, edx");
+        generator->asm_push("mov ecx, %li", size / DATA_SIZE_DWORD);
+        generator->asm_push("rep stosd");
+        native_string_tail(generator, "stos", size);
+        generator->asm_push("pop edi");
+    }
+
+    generator->ret(&dtype, "edx");
+}
+
+/**
+ * int memcmp(const void* s1, const void* s2, size_t n)
+ *
+ * Compares a dword at a time, the first that differs is byte swapped so that its first byte
+ * is the most significant and the sign of the result comes from an unsigned comparison.
+ */
+void native_memcmp(struct generator *generator, struct native_function *func, struct vector *arguments)
+{
+    native_expect_arguments(generator, func, arguments, 3);
+    struct datatype dtype = native_int(true);
+    long size = 0;
+    if (!native_constant_argument(vector_peek_ptr_at(arguments, 2), &size) || size < 0 || size > NATIVE_MEMORY_UNROLL_LIMIT)
+    {
+        native_call_library(generator, func, arguments, &dtype);
+        return;
+    }
+
+    generator->gen_exp(generator, vector_peek_ptr_at(arguments, 0), EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS);
+    generator->gen_exp(generator, vector_peek_ptr_at(arguments, 1), EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS);
+    generator->pop("edx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    generator->pop("ecx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+
+    int label_id = codegen_label_count();
+    const char *reg = NULL;
+    const char *keyword = NULL;
+    int chunk = 0;
+    for (long offset = 0; offset < size; offset += chunk)
+    {
+        chunk = native_chunk(size - offset, &reg, &keyword);
+        const char *move = chunk == DATA_SIZE_DWORD ? "mov" : "movzx";
+        generator->asm_push("%s eax, %s [ecx+%li]", move, keyword, offset);
+        generator->asm_push("%s ebx, %s [edx+%li]", move, keyword, offset);
+        generator->asm_push("cmp eax, ebx");
+        generator->asm_push("jne .memcmp_differs_%i", label_id);
+    }
+    generator->asm_push("xor eax, eax");
+    generator->asm_push("jmp .memcmp_end_%i", label_id);
+    generator->asm_push(".memcmp_differs_%i:", label_id);
+    generator->asm_push("bswap eax");
+    generator->asm_push("bswap ebx");
+    generator->asm_push("cmp eax, ebx");
+    generator->asm_push("sbb eax, eax");
+    generator->asm_push("or eax, 1");
+    generator->asm_push(".memcmp_end_%i:", label_id);
+    generator->ret(&dtype, "eax");
+}
+
+/**
+ * size_t strlen(const char* s)
+ */
+void native_strlen(struct generator *generator, struct native_function *func, struct vector *arguments)
+{
+    native_expect_arguments(generator, func, arguments, 1);
+    struct datatype dtype = native_int(false);
+    struct node *string_node = vector_peek_ptr_at(arguments, 0);
+    if (string_node->type != NODE_TYPE_STRING)
+    {
+        native_call_library(generator, func, arguments, &dtype);
+        return;
+    }
+
+    // The length of a string literal is known
+    generator->ret(&dtype, "dword %i", (int)strlen(string_node->sval));
+}
+
+static struct native_bit_builtin
+{
+    const char *name;
+    int op;
+} native_bit_builtins[] = {
+    {"__builtin_popcount", IR_OP_POPCOUNT},
+    {"__builtin_clz", IR_OP_CLZ},
+    {"__builtin_ctz", IR_OP_CTZ},
+    {"__builtin_bswap32", IR_OP_BSWAP},
+    {"__builtin_bswap16", IR_OP_BSWAP},
+    {"__builtin_rotateleft32", IR_OP_ROTL},
+    {"__builtin_rotateright32", IR_OP_ROTR},
+    {NULL, 0}};
+
+int native_bit_builtin_op(const char *name)
+{
+    for (int i = 0; native_bit_builtins[i].name; i++)
+    {
+        if (S_EQ(name, native_bit_builtins[i].name))
+            return native_bit_builtins[i].op;
+    }
+
+    return -1;
+}
+
+/**
+ * The bit counts return int, the byte swaps and rotates return unsigned values
+ */
+static struct datatype native_bit_builtin_datatype(int op)
+{
+    return native_int(ir_op_is_bit_operation(op) && op != IR_OP_BSWAP);
+}
+
+/**
+ * int __builtin_popcount(unsigned int x), int __builtin_clz(unsigned int x), int __builtin_ctz(unsigned int x),
+ * unsigned int __builtin_bswap32(unsigned int x), unsigned short __builtin_bswap16(unsigned short x),
+ * unsigned int __builtin_rotateleft32(unsigned int x, unsigned int n) and __builtin_rotateright32
+ *
+ * Each is a single instruction, the result is computed here when the arguments are constant.
+ */
+void native_bit_builtin(struct generator *generator, struct native_function *func, struct vector *arguments)
+{
+    int op = native_bit_builtin_op(func->name);
+    bool rotate = !ir_op_is_bit_operation(op);
+    bool swap16 = S_EQ(func->name, "__builtin_bswap16");
+    native_expect_arguments(generator, func, arguments, rotate ? 2 : 1);
+    struct datatype dtype = native_bit_builtin_datatype(op);
+
+    long value = 0;
+    long count = 0;
+    bool constant_value = native_constant_argument(vector_peek_ptr_at(arguments, 0), &value);
+    bool constant_count = rotate && native_constant_argument(vector_peek_ptr_at(arguments, 1), &count);
+    if (constant_value && (!rotate || constant_count))
+    {
+        long result = 0;
+        if (rotate)
+        {
+            ir_fold_constant(op, value, count, &result);
+        }
+        else
+        {
+            result = ir_fold_bit_operation(op, value);
+        }
+        if (swap16)
+        {
+            result = (uint32_t)result >> 16;
+        }
+        generator->ret(&dtype, "dword %li", result);
+        return;
+    }
+
+    generator->gen_exp(generator, vector_peek_ptr_at(arguments, 0), EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS);
+    if (rotate && constant_count)
+    {
+        generator->pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        generator->asm_push("%s eax, %li", op == IR_OP_ROTL ? "rol" : "ror", count & 31);
+    }
+    else if (rotate)
+    {
+        generator->gen_exp(generator, vector_peek_ptr_at(arguments, 1), EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS);
+        generator->pop("ecx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        generator->pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        generator->asm_push("%s eax, cl", op == IR_OP_ROTL ? "rol" : "ror");
+    }
+    else
+    {
+        generator->pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        ir_x86_bit_operation(generator->compiler, op);
+        if (swap16)
+        {
+            generator->asm_push("shr eax, 16");
+        }
+    }
+
+    generator->ret(&dtype, "eax");
+}
+
+/**
+ * Returns true if the memory order argument is a constant weaker than __ATOMIC_SEQ_CST,
+ * orders that are not constant are treated as the strongest.
+ */
+static bool native_atomic_order_is_weak(struct node *order_node)
+{
+    long order = NATIVE_ATOMIC_SEQ_CST;
+    return native_constant_argument(order_node, &order) && order != NATIVE_ATOMIC_SEQ_CST;
+}
+
+/**
+ * Generates the first arguments and pops them into the given registers, the first argument into the first register
+ */
+static void native_arguments_to_registers(struct generator *generator, struct vector *arguments, const char **registers, int total)
+{
+    for (int i = 0; i < total; i++)
+    {
+        generator->gen_exp(generator, vector_peek_ptr_at(arguments, i), EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS);
+    }
+
+    for (int i = total - 1; i >= 0; i--)
+    {
+        generator->pop(registers[i], STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+    }
+}
+
+/**
+ * int __sync_fetch_and_add(int* ptr, int value), __sync_fetch_and_sub(int* ptr, int value)
+ * int __atomic_fetch_add(int* ptr, int value, int order), __atomic_fetch_sub(int* ptr, int value, int order)
+ */
+void native_atomic_fetch_add(struct generator *generator, struct native_function *func, struct vector *arguments)
+{
+    native_expect_arguments(generator, func, arguments, strncmp(func->name, "__sync", 6) == 0 ? 2 : 3);
+    struct datatype dtype = native_int(true);
+    native_arguments_to_registers(generator, arguments, (const char *[]){"edx", "eax"}, 2);
+    if (S_EQ(func->name + strlen(func->name) - 3, "sub"))
+    {
+        generator->asm_push("neg eax");
+    }
+    generator->asm_push("lock xadd dword [edx], eax");
+    generator->ret(&dtype, "eax");
+}
+
+/**
+ * int __sync_lock_test_and_set(int* ptr, int value), int __atomic_exchange_n(int* ptr, int value, int order)
+ *
+ * "xchg" with memory is always locked
+ */
+void native_atomic_exchange(struct generator *generator, struct native_function *func, struct vector *arguments)
+{
+    native_expect_arguments(generator, func, arguments, S_EQ(func->name, "__sync_lock_test_and_set") ? 2 : 3);
+    struct datatype dtype = native_int(true);
+    native_arguments_to_registers(generator, arguments, (const char *[]){"edx", "eax"}, 2);
+    generator->asm_push("xchg dword [edx], eax");
+    generator->ret(&dtype, "eax");
+}
+
+/**
+ * int __sync_val_compare_and_swap(int* ptr, int old, int new) returns the value before the swap,
+ * bool __sync_bool_compare_and_swap(int* ptr, int old, int new) returns true if it was swapped
+ */
+void native_atomic_compare_and_swap(struct generator *generator, struct native_function *func, struct vector *arguments)
+{
+    native_expect_arguments(generator, func, arguments, 3);
+    struct datatype dtype = native_int(true);
+    native_arguments_to_registers(generator, arguments, (const char *[]){"edx", "eax", "ecx"}, 3);
+    generator->asm_push("lock cmpxchg dword [edx], ecx");
+    if (S_EQ(func->name, "__sync_bool_compare_and_swap"))
+    {
+        generator->asm_push("sete al");
+        generator->asm_push("movzx eax, al");
+    }
+    generator->ret(&dtype, "eax");
+}
+
+/**
+ * bool __atomic_compare_exchange_n(int* ptr, int* expected, int desired, bool weak, int success_order, int failure_order)
+ *
+ * The value found is written to "expected", when the exchange succeeded it already held that value.
+ */
+void native_atomic_compare_exchange(struct generator *generator, struct native_function *func, struct vector *arguments)
+{
+    native_expect_arguments(generator, func, arguments, 6);
+    struct datatype dtype = native_int(true);
+    native_arguments_to_registers(generator, arguments, (const char *[]){"edx", "ebx", "ecx"}, 3);
+    generator->asm_push("mov eax, [ebx]");
+    generator->asm_push("lock cmpxchg dword [edx], ecx");
+    generator->asm_push("mov [ebx], eax");
+    generator->asm_push("sete al");
+    generator->asm_push("movzx eax, al");
+    generator->ret(&dtype, "eax");
+}
+
+/**
+ * int __atomic_load_n(int* ptr, int order)
+ *
+ * Aligned loads are atomic and x86 never moves a load before an earlier one, every order is a plain load.
+ */
+void native_atomic_load(struct generator *generator, struct native_function *func, struct vector *arguments)
+{
+    native_expect_arguments(generator, func, arguments, 2);
+    struct datatype dtype = native_int(true);
+    native_arguments_to_registers(generator, arguments, (const char *[]){"edx"}, 1);
+    generator->asm_push("mov eax, [edx]");
+    generator->ret(&dtype, "eax");
+}
+
+/**
+ * void __atomic_store_n(int* ptr, int value, int order), void __sync_lock_release(int* ptr)
+ *
+ * A sequentially consistent store must not pass a later load so it is made with "xchg",
+ * weaker orders are plain stores.
+ */
+void native_atomic_store(struct generator *generator, struct native_function *func, struct vector *arguments)
+{
+    bool release = S_EQ(func->name, "__sync_lock_release");
+    native_expect_arguments(generator, func, arguments, release ? 1 : 3);
+    struct datatype dtype = {};
+    datatype_set_void(&dtype);
+    if (release)
+    {
+        native_arguments_to_registers(generator, arguments, (const char *[]){"edx"}, 1);
+        generator->asm_push("mov dword [edx], 0");
+        generator->ret(&dtype, "eax");
+        return;
+    }
+
+    native_arguments_to_registers(generator, arguments, (const char *[]){"edx", "eax"}, 2);
+    generator->asm_push("%s dword [edx], eax", native_atomic_order_is_weak(vector_peek_ptr_at(arguments, 2)) ? "mov" : "xchg");
+    generator->ret(&dtype, "eax");
+}
+
+/**
+ * void __sync_synchronize(), void __atomic_thread_fence(int order)
+ *
+ * Only a sequentially consistent fence needs an instruction, x86 keeps every other order by its self
+ */
+void native_atomic_fence(struct generator *generator, struct native_function *func, struct vector *arguments)
+{
+    bool sync = S_EQ(func->name, "__sync_synchronize");
+    native_expect_arguments(generator, func, arguments, sync ? 0 : 1);
+    struct datatype dtype = {};
+    datatype_set_void(&dtype);
+    if (sync || !native_atomic_order_is_weak(vector_peek_ptr_at(arguments, 0)))
+    {
+        generator->asm_push("mfence");
+    }
+    generator->ret(&dtype, "eax");
+}
+
+static struct native_atomic_builtin
+{
+    const char *name;
+    NATIVE_FUNCTION_CALL call;
+} native_atomic_builtins[] = {
+    {"__sync_fetch_and_add", native_atomic_fetch_add},
+    {"__sync_fetch_and_sub", native_atomic_fetch_add},
+    {"__sync_val_compare_and_swap", native_atomic_compare_and_swap},
+    {"__sync_bool_compare_and_swap", native_atomic_compare_and_swap},
+    {"__sync_lock_test_and_set", native_atomic_exchange},
+    {"__sync_lock_release", native_atomic_store},
+    {"__sync_synchronize", native_atomic_fence},
+    {"__atomic_load_n", native_atomic_load},
+    {"__atomic_store_n", native_atomic_store},
+    {"__atomic_exchange_n", native_atomic_exchange},
+    {"__atomic_compare_exchange_n", native_atomic_compare_exchange},
+    {"__atomic_fetch_add", native_atomic_fetch_add},
+    {"__atomic_fetch_sub", native_atomic_fetch_add},
+    {"__atomic_thread_fence", native_atomic_fence},
+    {NULL, NULL}};
+
+void native_create_builtin_functions(struct compile_process *compiler)
+{
+    native_create_function(compiler, PREDICT_EXPECT_FUNCTION, &(struct native_function_callbacks){.call = native___builtin_expect});
+    for (int i = 0; native_bit_builtins[i].name; i++)
+    {
+        native_create_function(compiler, native_bit_builtins[i].name, &(struct native_function_callbacks){.call = native_bit_builtin});
+    }
+    for (int i = 0; native_atomic_builtins[i].name; i++)
+    {
+        native_create_function(compiler, native_atomic_builtins[i].name, &(struct native_function_callbacks){.call = native_atomic_builtins[i].call});
+    }
+}
+
+static struct native_library_function
+{
+    const char *name;
+    NATIVE_FUNCTION_CALL call;
+} native_library_functions[] = {
+    {"memcpy", native_memcpy},
+    {"memset", native_memset},
+    {"memcmp", native_memcmp},
+    {"strlen", native_strlen},
+    {NULL, NULL}};
+
+static bool native_library_function_is_defined(struct compile_process *compiler, const char *name)
+{
+    for (int i = 0; i < vector_count(compiler->node_tree_vec); i++)
+    {
+        struct node *node = vector_peek_ptr_at(compiler->node_tree_vec, i);
+        if (node->type == NODE_TYPE_FUNCTION && S_EQ(node->func.name, name) && !function_node_is_prototype(node))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void native_create_library_functions(struct compile_process *compiler)
+{
+    for (int i = 0; native_library_functions[i].name; i++)
+    {
+        const char *name = native_library_functions[i].name;
+        if (native_library_function_is_defined(compiler, name))
+        {
+            // The file provides its own version, calls must reach it
+            continue;
+        }
+
+        struct native_function_callbacks callbacks = {.call = native_library_functions[i].call};
+        struct symbol *sym = symresolver_get_symbol(compiler, name);
+        if (!sym)
+        {
+            native_create_function(compiler, name, &callbacks);
+        }
+        else if (symresolver_node(sym) && symresolver_node(sym)->type == NODE_TYPE_FUNCTION)
+        {
+            // The parser registered a prototype for this name, the native function takes its symbol
+            sym->type = SYMBOL_TYPE_NATIVE_FUNCTION;
+            sym->data = native_function_new(name, &callbacks);
+        }
+        else
+        {
+            // The name belongs to something else such as a global variable
+            continue;
+        }
+
+        for (int j = 0; j < vector_count(compiler->node_tree_vec); j++)
+        {
+            struct node *node = vector_peek_ptr_at(compiler->node_tree_vec, j);
+            if (node->type == NODE_TYPE_FUNCTION && S_EQ(node->func.name, name))
+            {
+                // Prototypes such as ones from a header must not hide the native function
+                node->func.flags |= FUNCTION_NODE_FLAG_IS_NATIVE;
+            }
+        }
+    }
+}
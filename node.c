@@ -140,6 +140,11 @@ void make_goto_node(struct node *label_node)
     node_create(&(struct node){NODE_TYPE_STATEMENT_GOTO, .stmt._goto.label = label_node});
 }
 
+void make_asm_node(const char *template, struct vector *outputs, struct vector *inputs, struct vector *clobbers)
+{
+    node_create(&(struct node){NODE_TYPE_STATEMENT_ASM, .stmt._asm.template = template, .stmt._asm.outputs = outputs, .stmt._asm.inputs = inputs, .stmt._asm.clobbers = clobbers});
+}
+
 void make_tenary_node(struct node *true_result_node, struct node *false_result_node)
 {
     node_create(&(struct node){NODE_TYPE_TENARY, .tenary.true_node = true_result_node, .tenary.false_node = false_result_node});
@@ -281,7 +286,7 @@ bool node_is_constant(struct resolver_process *process, struct node *node)
         {
             entity = resolver_result_entity(result);
             struct variable *var = &variable_node(entity->node)->var;
-            if (var->type.flags & DATATYPE_FLAG_IS_CONST)
+            if (var->type.flags & DATATYPE_FLAG_IS_CONST && !datatype_is_floating(&var->type))
             {
                 // Okay its constant
                 return true;
@@ -292,7 +297,8 @@ bool node_is_constant(struct resolver_process *process, struct node *node)
         return false;
     }
 
-    return true;
+    // Floating point literals are never folded as integers
+    return node->num.type != NUMBER_TYPE_FLOAT && node->num.type != NUMBER_TYPE_DOUBLE;
 }
 
 long node_pull_literal(struct resolver_process *process, struct node *node)
@@ -612,6 +618,39 @@ struct vector* function_node_argument_vec(struct node* node)
     return node->func.args.vector;
 }
 
+size_t function_node_argument_stack_size(struct node* node)
+{
+    size_t size = 0;
+    struct vector* arguments = function_node_argument_vec(node);
+    vector_set_peek_pointer(arguments, 0);
+    struct node* current = vector_peek_ptr(arguments);
+    while(current)
+    {
+        size += align_value(variable_size(current), DATA_SIZE_DWORD);
+        current = vector_peek_ptr(arguments);
+    }
+
+    // Register arguments are always a DWORD
+    return size - function_node_register_arguments(node) * DATA_SIZE_DWORD;
+}
+
+int function_node_register_arguments(struct node* node)
+{
+    assert(node->type == NODE_TYPE_FUNCTION);
+    if (!(node->func.flags & FUNCTION_NODE_FLAG_REGISTER_ARGUMENTS))
+        return 0;
+
+    int total_arguments = vector_count(function_node_argument_vec(node));
+    return total_arguments < C_TOTAL_REGISTER_ARGUMENTS ? total_arguments : C_TOTAL_REGISTER_ARGUMENTS;
+}
+
+const char* function_node_argument_register(int index)
+{
+    static const char* registers[C_TOTAL_REGISTER_ARGUMENTS] = {"eax", "edx", "ecx"};
+    assert(index >= 0 && index < C_TOTAL_REGISTER_ARGUMENTS);
+    return registers[index];
+}
+
 bool is_node_assignment(struct node *node)
 {
     return S_EQ(node->exp.op, "=") ||
@@ -245,6 +245,11 @@ void parser_scope_offset_for_stack(struct node *node, struct history *history)
     struct parser_scope_entity *last_entity = parser_scope_last_entity_stop_global_scope();
     bool upward_stack = history->flags & HISTORY_FLAG_IS_UPWARD_STACK;
     int offset = -variable_size(node);
+    if (parser_current_function && (node->var.type.flags & DATATYPE_FLAG_IS_ARRAY || datatype_is_struct_or_union_non_pointer(&node->var.type)))
+    {
+        // Arrays decay into pointers and structures may contain them, treat them as address taken
+        parser_current_function->func.flags |= FUNCTION_NODE_FLAG_ADDRESS_TAKEN;
+    }
     if (upward_stack)
     {
         // Do not use the variable size for the offset on an upward stack.
@@ -266,7 +271,9 @@ void parser_scope_offset_for_stack(struct node *node, struct history *history)
         offset += variable_node(last_entity->node)->var.aoffset;
         if (variable_node_is_primative(node))
         {
-            variable_node(node)->var.padding = padding(upward_stack ? offset : -offset, node->var.type.size);
+            // Arguments are pushed a dword at a time so they are never aligned further than that
+            size_t alignment = upward_stack && node->var.type.size > DATA_SIZE_DWORD ? DATA_SIZE_DWORD : node->var.type.size;
+            variable_node(node)->var.padding = padding(upward_stack ? offset : -offset, alignment);
             variable_node(last_entity->node)->var.padding_after = node->var.padding;
         }
     }
@@ -281,6 +288,15 @@ void parser_scope_offset_for_stack(struct node *node, struct history *history)
         variable_node(node)->var.padding = padding(upward_stack ? offset : -offset, DATA_SIZE_DWORD);
     }
     variable_node(node)->var.aoffset = offset + (upward_stack ? variable_node(node)->var.padding : -variable_node(node)->var.padding);
+    if (!upward_stack && parser_current_function)
+    {
+        // Sibling scopes start from the same offset, the frame only has to reach the deepest variable
+        size_t extent = -variable_node(node)->var.aoffset;
+        if (extent > parser_current_function->func.stack_size)
+        {
+            parser_current_function->func.stack_size = extent;
+        }
+    }
 }
 
 void parser_scope_offset_for_structure(struct node *node, struct history *history)
@@ -497,6 +513,8 @@ static bool is_keyword_variable_modifier(const char *val)
            S_EQ(val, "static") ||
            S_EQ(val, "const") ||
            S_EQ(val, "extern") ||
+           S_EQ(val, "__thread") ||
+           S_EQ(val, "_Thread_local") ||
            S_EQ(val, "__ignore_typecheck__");
 }
 
@@ -507,7 +525,7 @@ void parse_single_token_to_node()
     switch (token->type)
     {
     case TOKEN_TYPE_NUMBER:
-        node = node_create(&(struct node){NODE_TYPE_NUMBER, .llnum = token->llnum});
+        node = node_create(&(struct node){NODE_TYPE_NUMBER, .llnum = token->llnum, .num.type = token->num.type});
         break;
 
     case TOKEN_TYPE_IDENTIFIER:
@@ -810,16 +828,6 @@ void parse_body(size_t *variable_size, struct history *history)
 
     resolver_default_finish_scope(current_process->resolver);
     parser_scope_finish();
-
-    // If this scope is inside a function lets add the variable size to the stack size
-    // of the given function
-    if (variable_size)
-    {
-        if (history->flags & HISTORY_FLAG_INSIDE_FUNCTION_BODY)
-        {
-            parser_current_function->func.stack_size += *variable_size;
-        }
-    }
 }
 
 /**
@@ -956,6 +964,11 @@ void parse_for_cast()
 void parse_for_normal_unary()
 {
     const char *unary_op = token_next()->sval;
+    if (parser_current_function && op_is_address(unary_op))
+    {
+        // Taking an address inside a function, its stack frame must outlive any calls it makes
+        parser_current_function->func.flags |= FUNCTION_NODE_FLAG_ADDRESS_TAKEN;
+    }
     // Now lets parse the expression after this unary operator
     struct history history;
     parse_expressionable(history_begin(&history, EXPRESSION_IS_UNARY));
@@ -1334,6 +1347,94 @@ void parse_goto(struct history *history)
     make_goto_node(label_node);
 }
 
+/**
+ * Parses the operands of one section of an inline assembly statement i.e "=r"(a), "=d"(b)
+ */
+static void parse_asm_operands(struct vector *operands)
+{
+    struct history history;
+    while (token_peek_next()->type == TOKEN_TYPE_STRING)
+    {
+        struct asm_operand operand = {.constraint = token_next()->sval};
+        expect_op("(");
+        parse_expressionable_root(history_begin(&history, 0));
+        expect_sym(')');
+        operand.exp = node_pop();
+        vector_push(operands, &operand);
+
+        if (!token_next_is_operator(","))
+        {
+            break;
+        }
+        token_next();
+    }
+}
+
+/**
+ * Parses the clobbers of an inline assembly statement i.e "ecx", "memory"
+ */
+static void parse_asm_clobbers(struct vector *clobbers)
+{
+    while (token_peek_next()->type == TOKEN_TYPE_STRING)
+    {
+        vector_push(clobbers, &token_next()->sval);
+        if (!token_next_is_operator(","))
+        {
+            break;
+        }
+        token_next();
+    }
+}
+
+/**
+ * Returns true if the next token begins the given section of an inline assembly statement,
+ * the section separator is consumed.
+ */
+static bool parse_asm_section_begins()
+{
+    if (!token_next_is_symbol(':'))
+    {
+        return false;
+    }
+
+    token_next();
+    return true;
+}
+
+void parse_asm(struct history *history)
+{
+    // "asm" and "__asm__" are the same keyword
+    token_next();
+    struct token *token = token_peek_next();
+    if (token->type == TOKEN_TYPE_IDENTIFIER && (S_EQ(token->sval, "volatile") || S_EQ(token->sval, "__volatile__")))
+    {
+        // Inline assembly is never moved or removed, volatile changes nothing
+        token_next();
+    }
+
+    expect_op("(");
+    const char *template = token_next_expected(TOKEN_TYPE_STRING)->sval;
+    struct vector *outputs = vector_create(sizeof(struct asm_operand));
+    struct vector *inputs = vector_create(sizeof(struct asm_operand));
+    struct vector *clobbers = vector_create(sizeof(const char *));
+    if (parse_asm_section_begins())
+    {
+        parse_asm_operands(outputs);
+        if (parse_asm_section_begins())
+        {
+            parse_asm_operands(inputs);
+            if (parse_asm_section_begins())
+            {
+                parse_asm_clobbers(clobbers);
+            }
+        }
+    }
+    expect_sym(')');
+    expect_sym(';');
+
+    make_asm_node(template, outputs, inputs, clobbers);
+}
+
 void parse_break(struct history *history)
 {
     expect_keyword("break");
@@ -1462,6 +1563,11 @@ void parse_keyword(struct history *history)
         parse_goto(history);
         return;
     }
+    else if (S_EQ(token->sval, "asm") || S_EQ(token->sval, "__asm__"))
+    {
+        parse_asm(history);
+        return;
+    }
 
     parse_err("Unexpected keyword %s\n", token->sval);
 }
@@ -1909,6 +2015,10 @@ void parse_datatype_modifiers(struct datatype *datatype)
         {
             datatype->flags |= DATATYPE_FLAG_IS_EXTERN;
         }
+        else if (S_EQ(token->sval, "__thread") || S_EQ(token->sval, "_Thread_local"))
+        {
+            datatype->flags |= DATATYPE_FLAG_IS_THREAD_LOCAL;
+        }
         else if (S_EQ(token->sval, "__ignore_typecheck__"))
         {
             datatype->flags |= DATATYPE_FLAG_IGNORE_TYPE_CHECKING;
@@ -2020,7 +2130,7 @@ void parser_datatype_init_type_and_size_for_primitive(struct token *datatype_tok
     else if (S_EQ(datatype_token->sval, "double"))
     {
         datatype_out->type = DATA_TYPE_DOUBLE;
-        datatype_out->size = 4;
+        datatype_out->size = DATA_SIZE_DDWORD;
     }
     else
     {
@@ -2244,6 +2354,10 @@ struct vector *parse_function_arguments(struct history *history)
         {
             // Read the 3 dots.
             token_read_dots(3);
+            if (parser_current_function)
+            {
+                parser_current_function->func.flags |= FUNCTION_NODE_FLAG_IS_VARIADIC;
+            }
             // Okay since we have infinite arguments we can't have any more arguments
             // after this, so just return
             parser_scope_finish();
@@ -0,0 +1,132 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+
+/**
+ * Static branch prediction. Without a profile the way a branch goes is guessed from the code,
+ * the guess decides which path falls through and which one is moved out of line.
+ *
+ * "__builtin_expect(x, v)" states that x is most likely v. Without it an if statement whose body
+ * returns a negative error code or calls a function that never returns is assumed not to run.
+ * Null pointer checks are also assumed not to run but only the caller knows the types involved.
+ */
+
+static const char *predict_noreturn_functions[] = {"exit", "_exit", "_Exit", "abort", "__assert_fail", NULL};
+
+bool predict_function_is_noreturn(const char *name)
+{
+    for (int i = 0; predict_noreturn_functions[i]; i++)
+    {
+        if (S_EQ(name, predict_noreturn_functions[i]))
+            return true;
+    }
+
+    return false;
+}
+
+static struct node *predict_skip_parentheses(struct node *node)
+{
+    while (node->type == NODE_TYPE_EXPRESSION_PARENTHESIS)
+    {
+        node = node->parenthesis.exp;
+    }
+
+    return node;
+}
+
+static bool predict_is_call_to(struct node *node, const char *name)
+{
+    return is_parentheses_node(node) && node->exp.left->type == NODE_TYPE_IDENTIFIER && S_EQ(node->exp.left->sval, name);
+}
+
+bool predict_expect_call(struct node *node, struct node **value_out, long *expected_out)
+{
+    node = predict_skip_parentheses(node);
+    if (!predict_is_call_to(node, PREDICT_EXPECT_FUNCTION))
+        return false;
+
+    struct node *arguments = node->exp.right;
+    if (arguments->type == NODE_TYPE_EXPRESSION_PARENTHESIS)
+    {
+        arguments = arguments->parenthesis.exp;
+    }
+    if (!is_argument_node(arguments))
+        return false;
+
+    struct node *expected = predict_skip_parentheses(arguments->exp.right);
+    if (expected->type != NODE_TYPE_NUMBER)
+        return false;
+
+    *value_out = arguments->exp.left;
+    *expected_out = expected->llnum;
+    return true;
+}
+
+/**
+ * Returns true if the statement returns a negative constant or calls a function that never returns
+ */
+static bool predict_statement_is_error(struct node *node)
+{
+    if (node->type == NODE_TYPE_STATEMENT_RETURN)
+    {
+        struct node *exp = node->stmt.ret.exp;
+        if (!exp)
+            return false;
+
+        exp = predict_skip_parentheses(exp);
+        if (exp->type == NODE_TYPE_NUMBER)
+            return false;
+
+        return exp->type == NODE_TYPE_UNARY && S_EQ(exp->unary.op, "-") &&
+               predict_skip_parentheses(exp->unary.operand)->type == NODE_TYPE_NUMBER;
+    }
+
+    return is_parentheses_node(node) && node->exp.left->type == NODE_TYPE_IDENTIFIER &&
+           predict_function_is_noreturn(node->exp.left->sval);
+}
+
+static bool predict_body_is_error_path(struct node *body)
+{
+    if (!body)
+        return false;
+
+    if (body->type != NODE_TYPE_BODY)
+        return predict_statement_is_error(body);
+
+    for (int i = 0; i < vector_count(body->body.statements); i++)
+    {
+        if (predict_statement_is_error(vector_peek_ptr_at(body->body.statements, i)))
+            return true;
+    }
+
+    return false;
+}
+
+int predict_if_stmt(struct node *if_node)
+{
+    struct node *value = NULL;
+    long expected = 0;
+    if (predict_expect_call(if_node->stmt._if.cond_node, &value, &expected))
+        return expected ? PREDICT_TAKEN : PREDICT_NOT_TAKEN;
+
+    if (predict_body_is_error_path(if_node->stmt._if.body_node))
+        return PREDICT_NOT_TAKEN;
+
+    return PREDICT_UNKNOWN;
+}
+
+struct node *predict_null_check_operand(struct node *cond)
+{
+    cond = predict_skip_parentheses(cond);
+    if (cond->type != NODE_TYPE_EXPRESSION || !S_EQ(cond->exp.op, "=="))
+        return NULL;
+
+    struct node *left = predict_skip_parentheses(cond->exp.left);
+    struct node *right = predict_skip_parentheses(cond->exp.right);
+    if (right->type == NODE_TYPE_NUMBER && right->llnum == 0)
+        return left;
+
+    if (left->type == NODE_TYPE_NUMBER && left->llnum == 0)
+        return right;
+
+    return NULL;
+}
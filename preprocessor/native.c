@@ -32,4 +32,11 @@ struct vector *preprocessor_line_macro_value(struct preprocessor_definition *def
 void preprocessor_create_definitions(struct preprocessor *preprocessor)
 {
     preprocessor_definition_create_native("__LINE__", preprocessor_line_macro_evaluate, preprocessor_line_macro_value, preprocessor);
+
+    // Memory orders for the __atomic builtins
+    const char *atomic_orders[] = {"__ATOMIC_RELAXED", "__ATOMIC_CONSUME", "__ATOMIC_ACQUIRE", "__ATOMIC_RELEASE", "__ATOMIC_ACQ_REL", "__ATOMIC_SEQ_CST"};
+    for (int i = NATIVE_ATOMIC_RELAXED; i <= NATIVE_ATOMIC_SEQ_CST; i++)
+    {
+        preprocessor_definition_create(atomic_orders[i], preprocessor_build_value_vector_for_integer(i), vector_create(sizeof(const char *)), preprocessor);
+    }
 }
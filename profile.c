@@ -0,0 +1,314 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/buffer.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/**
+ * The profile file is the image of the counters as they are laid out in the data section of the
+ * instrumented program, the program writes it out in one go with system calls so no C library is needed.
+ *
+ * "DPRF" followed by the 32 bit version then for every record its null terminated name,
+ * the 32 bit total of counters and the 32 bit counters themselves.
+ */
+
+static struct vector *profile_records(struct compile_process *process)
+{
+    if (!process->profile_records)
+    {
+        process->profile_records = vector_create(sizeof(struct profile_record *));
+    }
+
+    return process->profile_records;
+}
+
+static void profile_path(struct compile_process *process, char *out, size_t size)
+{
+    if (process->options.profile_path)
+    {
+        snprintf(out, size, "%s", process->options.profile_path);
+        return;
+    }
+
+    snprintf(out, size, "%s.profile", process->cfile.abs_path);
+}
+
+static bool profile_read_int(FILE *fp, uint32_t *out)
+{
+    return fread(out, sizeof(uint32_t), 1, fp) == 1;
+}
+
+static char *profile_read_name(FILE *fp)
+{
+    struct buffer *buffer = buffer_create();
+    int c = fgetc(fp);
+    while (c != EOF && c != 0)
+    {
+        buffer_write(buffer, c);
+        c = fgetc(fp);
+    }
+    if (c == EOF)
+    {
+        buffer_free(buffer);
+        return NULL;
+    }
+
+    buffer_write(buffer, 0);
+    char *name = strdup(buffer_ptr(buffer));
+    buffer_free(buffer);
+    return name;
+}
+
+static struct profile_record *profile_read_record(FILE *fp)
+{
+    char *name = profile_read_name(fp);
+    if (!name)
+        return NULL;
+
+    uint32_t total = 0;
+    if (!profile_read_int(fp, &total))
+    {
+        free(name);
+        return NULL;
+    }
+
+    struct profile_record *record = calloc(1, sizeof(struct profile_record));
+    record->name = name;
+    record->total_counters = total;
+    record->counts = calloc(total + 1, sizeof(long));
+    for (int i = 0; i < record->total_counters; i++)
+    {
+        uint32_t count = 0;
+        if (!profile_read_int(fp, &count))
+        {
+            free(record->counts);
+            free(record);
+            free(name);
+            return NULL;
+        }
+        record->counts[i] = count;
+    }
+
+    return record;
+}
+
+bool profile_load(struct compile_process *process)
+{
+    char path[PATH_MAX];
+    profile_path(process, path, sizeof(path));
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        compiler_warning(process, "The profile file %s could not be opened, compiling without a profile", path);
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    if (fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, PROFILE_FILE_MAGIC, sizeof(magic)) != 0 ||
+        !profile_read_int(fp, &version) || version != PROFILE_FILE_VERSION)
+    {
+        compiler_warning(process, "The file %s is not a profile file, compiling without a profile", path);
+        fclose(fp);
+        return false;
+    }
+
+    struct vector *records = profile_records(process);
+    struct profile_record *record = NULL;
+    while ((record = profile_read_record(fp)) != NULL)
+    {
+        vector_push(records, &record);
+    }
+
+    fclose(fp);
+    return true;
+}
+
+struct profile_record *profile_record_create(struct compile_process *process, const char *name, int total_counters)
+{
+    struct profile_record *record = calloc(1, sizeof(struct profile_record));
+    record->name = name;
+    record->total_counters = total_counters;
+    record->id = vector_count(profile_records(process));
+    vector_push(profile_records(process), &record);
+    return record;
+}
+
+struct profile_record *profile_record_find(struct compile_process *process, const char *name, int total_counters)
+{
+    struct vector *records = profile_records(process);
+    for (int i = 0; i < vector_count(records); i++)
+    {
+        struct profile_record *record = vector_peek_ptr_at(records, i);
+        if (S_EQ(record->name, name))
+        {
+            return record->total_counters == total_counters ? record : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+static void profile_generate_writer(struct compile_process *process)
+{
+    // open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) then write the image and close it
+    asm_push("__profile_write:");
+    if (process->flags & COMPILE_PROCESS_TARGET_X86_64)
+    {
+        asm_push("mov eax, 2");
+        asm_push("lea rdi, [rel __profile_path]");
+        asm_push("mov esi, 0x241");
+        asm_push("mov edx, 420");
+        asm_push("syscall");
+        asm_push("test eax, eax");
+        asm_push("js .done");
+        asm_push("mov edi, eax");
+        asm_push("mov eax, 1");
+        asm_push("lea rsi, [rel __profile_data]");
+        asm_push("mov edx, __profile_data_end - __profile_data");
+        asm_push("syscall");
+        asm_push("mov eax, 3");
+        asm_push("syscall");
+        asm_push(".done:");
+        asm_push("ret");
+        asm_push("section .fini_array");
+        asm_push("dq __profile_write");
+        return;
+    }
+
+    asm_push("push ebx");
+    asm_push("mov eax, 5");
+    asm_push("mov ebx, __profile_path");
+    asm_push("mov ecx, 0x241");
+    asm_push("mov edx, 420");
+    asm_push("int 0x80");
+    asm_push("test eax, eax");
+    asm_push("js .done");
+    asm_push("mov ebx, eax");
+    asm_push("mov eax, 4");
+    asm_push("mov ecx, __profile_data");
+    asm_push("mov edx, __profile_data_end - __profile_data");
+    asm_push("int 0x80");
+    asm_push("mov eax, 6");
+    asm_push("int 0x80");
+    asm_push(".done:");
+    asm_push("pop ebx");
+    asm_push("ret");
+    asm_push("section .fini_array");
+    asm_push("dd __profile_write");
+}
+
+void profile_generate(struct compile_process *process)
+{
+    if (!(process->flags & COMPILE_PROCESS_PROFILE_GENERATE) || vector_count(profile_records(process)) == 0)
+        return;
+
+    char path[PATH_MAX];
+    profile_path(process, path, sizeof(path));
+
+    asm_push("section .data");
+    asm_push("__profile_data:");
+    asm_push("db '%s'", PROFILE_FILE_MAGIC);
+    asm_push("dd %i", PROFILE_FILE_VERSION);
+    struct vector *records = profile_records(process);
+    for (int i = 0; i < vector_count(records); i++)
+    {
+        struct profile_record *record = vector_peek_ptr_at(records, i);
+        asm_push("db '%s', 0", record->name);
+        asm_push("dd %i", record->total_counters);
+        asm_push("__profile_counters_%i:", record->id);
+        asm_push("times %i dd 0", record->total_counters);
+    }
+    asm_push("__profile_data_end:");
+    asm_push("__profile_path: db '%s', 0", path);
+
+    asm_push("section .text");
+    profile_generate_writer(process);
+}
+
+/**
+ * Sample profiles are text so they can be made from any sampling profiler, i.e by counting the
+ * source lines perf script reports for every sample. Every line is "function:line count", blank
+ * lines and lines starting with '#' are skipped and the counts of a repeated line are added together.
+ */
+
+static struct vector *profile_sample_records(struct compile_process *process)
+{
+    if (!process->sample_records)
+    {
+        process->sample_records = vector_create(sizeof(struct profile_record *));
+    }
+
+    return process->sample_records;
+}
+
+struct profile_record *profile_samples_find(struct compile_process *process, const char *name)
+{
+    struct vector *records = profile_sample_records(process);
+    for (int i = 0; i < vector_count(records); i++)
+    {
+        struct profile_record *record = vector_peek_ptr_at(records, i);
+        if (S_EQ(record->name, name))
+            return record;
+    }
+
+    return NULL;
+}
+
+static void profile_add_samples(struct compile_process *process, const char *name, int line, long count)
+{
+    struct profile_record *record = profile_samples_find(process, name);
+    if (!record)
+    {
+        record = calloc(1, sizeof(struct profile_record));
+        record->name = strdup(name);
+        vector_push(profile_sample_records(process), &record);
+    }
+
+    if (line >= record->total_counters)
+    {
+        record->counts = realloc(record->counts, (line + 1) * sizeof(long));
+        memset(&record->counts[record->total_counters], 0, (line + 1 - record->total_counters) * sizeof(long));
+        record->total_counters = line + 1;
+    }
+
+    record->counts[line] += count;
+}
+
+bool profile_load_samples(struct compile_process *process)
+{
+    const char *path = process->options.sample_profile_path;
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+    {
+        compiler_warning(process, "The sample profile %s could not be opened, compiling without it", path);
+        return false;
+    }
+
+    char text[1024];
+    int text_line = 0;
+    while (fgets(text, sizeof(text), fp))
+    {
+        text_line++;
+        char name[256];
+        int line = 0;
+        long count = 0;
+        char first = 0;
+        if (sscanf(text, " %c", &first) != 1 || first == '#')
+            continue;
+
+        if (sscanf(text, " %255[^: \t]:%d %ld", name, &line, &count) != 3 || line <= 0 || count < 0)
+        {
+            compiler_warning(process, "Line %i of the sample profile %s is not \"function:line count\"", text_line, path);
+            continue;
+        }
+
+        profile_add_samples(process, name, line, count);
+    }
+
+    fclose(fp);
+    return true;
+}
@@ -0,0 +1,469 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+
+/**
+ * Whole file reachability. Everything that is not static can be used from another file
+ * and so is always kept, main included. Static functions and variables are only kept if
+ * something that is kept refers to them. Whatever is removed never reaches code generation,
+ * neither do the string literals and data only they used.
+ *
+ * References are found by name, a local variable with the same name as a static global
+ * keeps the global alive which is never wrong, only less thorough.
+ *
+ * A static function whose name is only ever used to call it cannot be called from anywhere
+ * else, so it does not have to follow the C calling convention and takes its first arguments
+ * in registers.
+ */
+
+struct reachability
+{
+    struct compile_process *process;
+    // Vector of const char* names of definitions that are used
+    struct vector *used;
+    // Vector of struct node* definitions whose bodies still need to be walked
+    struct vector *pending;
+    // Vector of const char* names that are used for anything other than a direct call
+    struct vector *escaped;
+};
+
+static bool reachability_name_in(struct vector *names, const char *name)
+{
+    for (int i = 0; i < vector_count(names); i++)
+    {
+        if (S_EQ((const char *)vector_peek_ptr_at(names, i), name))
+            return true;
+    }
+
+    return false;
+}
+
+static bool reachability_is_used(struct reachability *reachability, const char *name)
+{
+    return reachability_name_in(reachability->used, name);
+}
+
+static void reachability_use_name(struct reachability *reachability, const char *name)
+{
+    if (!name || reachability_is_used(reachability, name))
+        return;
+
+    vector_push(reachability->used, &name);
+
+    // Every definition of the name now needs to be walked, functions can also have prototypes
+    struct vector *tree = reachability->process->node_tree_vec;
+    for (int i = 0; i < vector_count(tree); i++)
+    {
+        struct node *node = vector_peek_ptr_at(tree, i);
+        if (node->type == NODE_TYPE_VARIABLE_LIST)
+        {
+            struct vector *list = node->var_list.list;
+            for (int b = 0; b < vector_count(list); b++)
+            {
+                struct node *var_node = vector_peek_ptr_at(list, b);
+                if (S_EQ(var_node->var.name, name))
+                {
+                    vector_push(reachability->pending, &var_node);
+                }
+            }
+            continue;
+        }
+
+        struct node *var_node = variable_node(node);
+        if ((node->type == NODE_TYPE_FUNCTION && S_EQ(node->func.name, name)) ||
+            (var_node && var_node->type == NODE_TYPE_VARIABLE && S_EQ(var_node->var.name, name)))
+        {
+            vector_push(reachability->pending, &node);
+        }
+    }
+}
+
+static void reachability_visit(struct reachability *reachability, struct node *node);
+
+static void reachability_visit_vector(struct reachability *reachability, struct vector *nodes)
+{
+    for (int i = 0; nodes && i < vector_count(nodes); i++)
+    {
+        reachability_visit(reachability, vector_peek_ptr_at(nodes, i));
+    }
+}
+
+static void reachability_visit_asm_operands(struct reachability *reachability, struct vector *operands)
+{
+    for (int i = 0; i < vector_count(operands); i++)
+    {
+        struct asm_operand *operand = vector_at(operands, i);
+        reachability_visit(reachability, operand->exp);
+    }
+}
+
+static void reachability_visit(struct reachability *reachability, struct node *node)
+{
+    if (!node)
+        return;
+
+    switch (node->type)
+    {
+    case NODE_TYPE_IDENTIFIER:
+        reachability_use_name(reachability, node->sval);
+        if (!reachability_name_in(reachability->escaped, node->sval))
+        {
+            vector_push(reachability->escaped, &node->sval);
+        }
+        break;
+
+    case NODE_TYPE_EXPRESSION:
+        if (is_parentheses_node(node) && node->exp.left->type == NODE_TYPE_IDENTIFIER)
+        {
+            // A direct call, the address of the function does not escape
+            reachability_use_name(reachability, node->exp.left->sval);
+        }
+        else
+        {
+            reachability_visit(reachability, node->exp.left);
+        }
+        reachability_visit(reachability, node->exp.right);
+        break;
+
+    case NODE_TYPE_EXPRESSION_PARENTHESIS:
+        reachability_visit(reachability, node->parenthesis.exp);
+        break;
+
+    case NODE_TYPE_UNARY:
+        reachability_visit(reachability, node->unary.operand);
+        break;
+
+    case NODE_TYPE_CAST:
+        reachability_visit(reachability, node->cast.operand);
+        break;
+
+    case NODE_TYPE_BRACKET:
+        reachability_visit(reachability, node->bracket.inner);
+        break;
+
+    case NODE_TYPE_TENARY:
+        reachability_visit(reachability, node->tenary.true_node);
+        reachability_visit(reachability, node->tenary.false_node);
+        break;
+
+    case NODE_TYPE_VARIABLE:
+        reachability_visit(reachability, node->var.val);
+        break;
+
+    case NODE_TYPE_VARIABLE_LIST:
+        reachability_visit_vector(reachability, node->var_list.list);
+        break;
+
+    case NODE_TYPE_STRUCT:
+        if (node->flags & NODE_FLAG_HAS_VARIABLE_COMBINED)
+        {
+            reachability_visit(reachability, node->_struct.var);
+        }
+        break;
+
+    case NODE_TYPE_UNION:
+        if (node->flags & NODE_FLAG_HAS_VARIABLE_COMBINED)
+        {
+            reachability_visit(reachability, node->_union.var);
+        }
+        break;
+
+    case NODE_TYPE_FUNCTION:
+        reachability_visit(reachability, node->func.body_n);
+        break;
+
+    case NODE_TYPE_BODY:
+        reachability_visit_vector(reachability, node->body.statements);
+        break;
+
+    case NODE_TYPE_STATEMENT_RETURN:
+        reachability_visit(reachability, node->stmt.ret.exp);
+        break;
+
+    case NODE_TYPE_STATEMENT_IF:
+        reachability_visit(reachability, node->stmt._if.cond_node);
+        reachability_visit(reachability, node->stmt._if.body_node);
+        reachability_visit(reachability, node->stmt._if.next);
+        break;
+
+    case NODE_TYPE_STATEMENT_ELSE:
+        reachability_visit(reachability, node->stmt._else.body_node);
+        break;
+
+    case NODE_TYPE_STATEMENT_WHILE:
+        reachability_visit(reachability, node->stmt._while.cond);
+        reachability_visit(reachability, node->stmt._while.body);
+        break;
+
+    case NODE_TYPE_STATEMENT_DO_WHILE:
+        reachability_visit(reachability, node->stmt._do_while.body);
+        reachability_visit(reachability, node->stmt._do_while.cond);
+        break;
+
+    case NODE_TYPE_STATEMENT_FOR:
+        reachability_visit(reachability, node->stmt._for.init);
+        reachability_visit(reachability, node->stmt._for.cond);
+        reachability_visit(reachability, node->stmt._for.loop);
+        reachability_visit(reachability, node->stmt._for.body);
+        break;
+
+    case NODE_TYPE_STATEMENT_SWITCH:
+        reachability_visit(reachability, node->stmt._switch.exp);
+        reachability_visit(reachability, node->stmt._switch.body);
+        break;
+
+    case NODE_TYPE_STATEMENT_CASE:
+        reachability_visit(reachability, node->stmt._case.exp);
+        break;
+
+    case NODE_TYPE_STATEMENT_ASM:
+        reachability_visit_asm_operands(reachability, node->stmt._asm.outputs);
+        reachability_visit_asm_operands(reachability, node->stmt._asm.inputs);
+        break;
+    }
+}
+
+static bool reachability_is_static(struct node *node)
+{
+    if (node->type == NODE_TYPE_FUNCTION)
+        return node->func.rtype.flags & DATATYPE_FLAG_IS_STATIC;
+
+    struct node *var_node = variable_node(node);
+    return var_node && var_node->type == NODE_TYPE_VARIABLE && var_node->var.type.flags & DATATYPE_FLAG_IS_STATIC;
+}
+
+static const char *reachability_definition_name(struct node *node)
+{
+    if (node->type == NODE_TYPE_FUNCTION)
+        return node->func.name;
+
+    struct node *var_node = variable_node(node);
+    if (!var_node || var_node->type != NODE_TYPE_VARIABLE)
+        return NULL;
+
+    return var_node->var.name;
+}
+
+static void reachability_report(struct reachability *reachability, struct node *node, const char *name)
+{
+    struct compile_process *process = reachability->process;
+    if (node->type == NODE_TYPE_FUNCTION)
+    {
+        // Prototypes are not counted, they never generated any code
+        if (!function_node_is_prototype(node))
+        {
+            process->statistics.removed_functions++;
+        }
+    }
+    else
+    {
+        process->statistics.removed_globals++;
+    }
+
+    if (process->flags & COMPILE_PROCESS_PRINT_STATISTICS && (node->type != NODE_TYPE_FUNCTION || !function_node_is_prototype(node)))
+    {
+        printf("removed unused static %s %s\n", node->type == NODE_TYPE_FUNCTION ? "function" : "variable", name);
+    }
+}
+
+/**
+ * Removes the variables of a list that are not used, returns true if the list is now empty
+ */
+static bool reachability_remove_from_list(struct reachability *reachability, struct node *list_node)
+{
+    struct vector *list = list_node->var_list.list;
+    for (int i = 0; i < vector_count(list); i++)
+    {
+        struct node *var_node = vector_peek_ptr_at(list, i);
+        if (!(var_node->var.type.flags & DATATYPE_FLAG_IS_STATIC) || reachability_is_used(reachability, var_node->var.name))
+            continue;
+
+        reachability_report(reachability, var_node, var_node->var.name);
+        vector_pop_at(list, i);
+        i--;
+    }
+
+    return vector_count(list) == 0;
+}
+
+/**
+ * Walks everything that is kept starting from the definitions that are not static
+ */
+static void reachability_walk(struct reachability *reachability, struct compile_process *process)
+{
+    reachability->process = process;
+    reachability->used = vector_create(sizeof(const char *));
+    reachability->pending = vector_create(sizeof(struct node *));
+    reachability->escaped = vector_create(sizeof(const char *));
+
+    struct vector *tree = process->node_tree_vec;
+    reachability_use_name(reachability, "main");
+    for (int i = 0; i < vector_count(tree); i++)
+    {
+        struct node *node = vector_peek_ptr_at(tree, i);
+        if (node->type == NODE_TYPE_VARIABLE_LIST)
+        {
+            struct vector *list = node->var_list.list;
+            for (int b = 0; b < vector_count(list); b++)
+            {
+                struct node *var_node = vector_peek_ptr_at(list, b);
+                if (!(var_node->var.type.flags & DATATYPE_FLAG_IS_STATIC))
+                {
+                    reachability_use_name(reachability, var_node->var.name);
+                }
+            }
+            continue;
+        }
+
+        const char *name = reachability_definition_name(node);
+        if (name && !reachability_is_static(node))
+        {
+            reachability_use_name(reachability, name);
+        }
+    }
+
+    while (vector_count(reachability->pending))
+    {
+        struct node *node = vector_back_ptr(reachability->pending);
+        vector_pop(reachability->pending);
+        reachability_visit(reachability, node);
+    }
+}
+
+void reachability_remove_unused_definitions(struct compile_process *process)
+{
+    struct reachability reachability;
+    reachability_walk(&reachability, process);
+
+    struct vector *tree = process->node_tree_vec;
+    for (int i = 0; i < vector_count(tree); i++)
+    {
+        struct node *node = vector_peek_ptr_at(tree, i);
+        bool removed = false;
+        if (node->type == NODE_TYPE_VARIABLE_LIST)
+        {
+            removed = reachability_remove_from_list(&reachability, node);
+        }
+        else
+        {
+            const char *name = reachability_definition_name(node);
+            removed = name && reachability_is_static(node) && !reachability_is_used(&reachability, name);
+            if (removed)
+            {
+                reachability_report(&reachability, node, name);
+            }
+        }
+
+        if (removed)
+        {
+            vector_pop_at(tree, i);
+            i--;
+        }
+    }
+
+    vector_free(reachability.used);
+    vector_free(reachability.pending);
+    vector_free(reachability.escaped);
+}
+
+static bool reachability_argument_fits_register(struct node *argument)
+{
+    struct node *var_node = variable_node(argument);
+    if (!var_node || var_node->type != NODE_TYPE_VARIABLE)
+        return false;
+
+    struct datatype *dtype = &var_node->var.type;
+    return !datatype_is_floating(dtype) && !datatype_is_struct_or_union_non_pointer(dtype) &&
+           !(dtype->flags & DATATYPE_FLAG_IS_ARRAY) && variable_size(var_node) <= DATA_SIZE_DWORD;
+}
+
+static bool reachability_declaration_takes_register_arguments(struct node *func_node)
+{
+    if (!reachability_is_static(func_node) || func_node->func.flags & (FUNCTION_NODE_FLAG_IS_NATIVE | FUNCTION_NODE_FLAG_IS_VARIADIC))
+        return false;
+
+    // The pointer to a returned structure is an extra argument on the stack
+    if (datatype_is_struct_or_union_non_pointer(&func_node->func.rtype))
+        return false;
+
+    struct vector *arguments = function_node_argument_vec(func_node);
+    for (int i = 0; i < vector_count(arguments); i++)
+    {
+        if (!reachability_argument_fits_register(vector_peek_ptr_at(arguments, i)))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Returns true if every declaration of the function agrees it can take its arguments in registers
+ */
+static bool reachability_takes_register_arguments(struct reachability *reachability, struct node *func_node)
+{
+    if (reachability_name_in(reachability->escaped, func_node->func.name))
+        return false;
+
+    struct vector *tree = reachability->process->node_tree_vec;
+    for (int i = 0; i < vector_count(tree); i++)
+    {
+        struct node *node = vector_peek_ptr_at(tree, i);
+        if (node->type != NODE_TYPE_FUNCTION || !S_EQ(node->func.name, func_node->func.name))
+            continue;
+
+        if (!reachability_declaration_takes_register_arguments(node) ||
+            vector_count(function_node_argument_vec(node)) != vector_count(function_node_argument_vec(func_node)))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Moves the register arguments below the local variables where the function stores them on entry,
+ * the remaining arguments move down the stack in their place.
+ */
+static void reachability_move_register_arguments(struct node *func_node)
+{
+    struct vector *arguments = function_node_argument_vec(func_node);
+    int total_registers = function_node_register_arguments(func_node);
+    size_t offset = align_value(func_node->func.stack_size, DATA_SIZE_DWORD);
+    for (int i = 0; i < vector_count(arguments); i++)
+    {
+        struct node *var_node = variable_node(vector_peek_ptr_at(arguments, i));
+        if (i < total_registers)
+        {
+            offset += DATA_SIZE_DWORD;
+            var_node->var.aoffset = -(int)offset;
+            continue;
+        }
+
+        var_node->var.aoffset -= total_registers * DATA_SIZE_DWORD;
+    }
+
+    func_node->func.stack_size = offset;
+}
+
+void reachability_assign_register_arguments(struct compile_process *process)
+{
+    struct reachability reachability;
+    reachability_walk(&reachability, process);
+
+    struct vector *tree = process->node_tree_vec;
+    for (int i = 0; i < vector_count(tree); i++)
+    {
+        struct node *node = vector_peek_ptr_at(tree, i);
+        if (node->type != NODE_TYPE_FUNCTION || !reachability_takes_register_arguments(&reachability, node))
+            continue;
+
+        node->func.flags |= FUNCTION_NODE_FLAG_REGISTER_ARGUMENTS;
+        if (!function_node_is_prototype(node))
+        {
+            reachability_move_register_arguments(node);
+            process->statistics.register_argument_functions++;
+        }
+    }
+
+    vector_free(reachability.used);
+    vector_free(reachability.pending);
+    vector_free(reachability.escaped);
+}
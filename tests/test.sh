@@ -654,5 +654,291 @@ fi
 
 
 
+echo -e "Tail call test "
+./build/tail_call_test
+if [ $? -ne 202 ]; then
+    echo -e "Tail call test failed"
+    res_code=1
+else
+    echo -e "Tail call test passed"
+fi
+
+
+
+echo -e "IR test "
+./build/ir_test
+if [ $? -ne 13 ]; then
+    echo -e "IR test failed"
+    res_code=1
+else
+    echo -e "IR test passed"
+fi
+
+
+
+echo -e "Dead code elimination test "
+./build/dce_test
+if [ $? -ne 13 ]; then
+    echo -e "Dead code elimination test failed"
+    res_code=1
+else
+    echo -e "Dead code elimination test passed"
+fi
+
+
+
+echo -e "Common subexpression elimination test "
+./build/cse_test
+if [ $? -ne 31 ]; then
+    echo -e "Common subexpression elimination test failed"
+    res_code=1
+else
+    echo -e "Common subexpression elimination test passed"
+fi
+
+
+
+echo -e "Loop invariant code motion test "
+./build/licm_test
+if [ $? -ne 29 ]; then
+    echo -e "Loop invariant code motion test failed"
+    res_code=1
+else
+    echo -e "Loop invariant code motion test passed"
+fi
+
+
+
+echo -e "Loop unrolling test "
+./build/unroll_test
+if [ $? -ne 25 ]; then
+    echo -e "Loop unrolling test failed"
+    res_code=1
+else
+    echo -e "Loop unrolling test passed"
+fi
+
+
+
+echo -e "Strength reduction test "
+./build/strength_reduction_test
+if [ $? -ne 221 ]; then
+    echo -e "Strength reduction test failed"
+    res_code=1
+else
+    echo -e "Strength reduction test passed"
+fi
+
+
+
+echo -e "Dead function elimination test "
+./build/dead_function_test
+if [ $? -ne 31 ]; then
+    echo -e "Dead function elimination test failed"
+    res_code=1
+else
+    echo -e "Dead function elimination test passed"
+fi
+
+
+
+echo -e "Stack sharing test "
+./build/stack_sharing_test
+if [ $? -ne 46 ]; then
+    echo -e "Stack sharing test failed"
+    res_code=1
+else
+    echo -e "Stack sharing test passed"
+fi
+
+
+
+echo -e "Structure return test "
+./build/struct_return_test
+if [ $? -ne 68 ]; then
+    echo -e "Structure return test failed"
+    res_code=1
+else
+    echo -e "Structure return test passed"
+fi
+
+
+
+echo -e "Structure copy test "
+./build/struct_copy_test
+if [ $? -ne 38 ]; then
+    echo -e "Structure copy test failed"
+    res_code=1
+else
+    echo -e "Structure copy test passed"
+fi
+
+
+
+echo -e "x86-64 backend test "
+./build/x86_64_test
+if [ $? -ne 36 ]; then
+    echo -e "x86-64 backend test failed"
+    res_code=1
+else
+    echo -e "x86-64 backend test passed"
+fi
+
+
+
+echo -e "Floating point test "
+./build/float_test
+if [ $? -ne 132 ]; then
+    echo -e "Floating point test failed"
+    res_code=1
+else
+    echo -e "Floating point test passed"
+fi
+
+
+
+echo -e "Loop vectorization test "
+./build/vectorize_test
+if [ $? -ne 32 ]; then
+    echo -e "Loop vectorization test failed"
+    res_code=1
+else
+    echo -e "Loop vectorization test passed"
+fi
+
+
+
+echo -e "Block layout test "
+./build/layout_test
+if [ $? -ne 3 ]; then
+    echo -e "Block layout test failed"
+    res_code=1
+else
+    echo -e "Block layout test passed"
+fi
+
+
+
+echo -e "Profile guided optimization test "
+./build/profile_test
+if [ $? -ne 77 ]; then
+    echo -e "Profile guided optimization test failed"
+    res_code=1
+else
+    echo -e "Profile guided optimization test passed"
+fi
+
+
+
+echo -e "Profile use test "
+./build/profile_use_test
+if [ $? -ne 77 ] || ! diff ./build/profile_use_test.stats ./units/profile_test.stats; then
+    echo -e "Profile use test failed"
+    res_code=1
+else
+    echo -e "Profile use test passed"
+fi
+
+
+
+echo -e "Sample profile test "
+./build/sample_profile_test
+if [ $? -ne 62 ]; then
+    echo -e "Sample profile test failed"
+    res_code=1
+else
+    echo -e "Sample profile test passed"
+fi
+
+
+
+echo -e "Branch prediction test "
+./build/expect_test
+if [ $? -ne 154 ]; then
+    echo -e "Branch prediction test failed"
+    res_code=1
+else
+    echo -e "Branch prediction test passed"
+fi
+
+
+
+echo -e "Register arguments test "
+./build/register_arguments_test
+if [ $? -ne 24 ]; then
+    echo -e "Register arguments test failed"
+    res_code=1
+else
+    echo -e "Register arguments test passed"
+fi
+
+
+
+echo -e "Memory builtins test "
+./build/memory_builtins_test
+if [ $? -ne 15 ]; then
+    echo -e "Memory builtins test failed"
+    res_code=1
+else
+    echo -e "Memory builtins test passed"
+fi
+
+
+
+echo -e "Bit builtins test "
+./build/bit_builtins_test
+if [ $? -ne 255 ]; then
+    echo -e "Bit builtins test failed"
+    res_code=1
+else
+    echo -e "Bit builtins test passed"
+fi
+
+
+
+echo -e "Atomic builtins test "
+./build/atomic_builtins_test
+if [ $? -ne 63 ]; then
+    echo -e "Atomic builtins test failed"
+    res_code=1
+else
+    echo -e "Atomic builtins test passed"
+fi
+
+
+
+echo -e "Inline asm test test "
+./build/inline_asm_test
+if [ $? -ne 63 ]; then
+    echo -e "Inline asm test test failed"
+    res_code=1
+else
+    echo -e "Inline asm test test passed"
+fi
+
+
+
+echo -e "Thread local storage test test "
+./build/thread_local_test
+if [ $? -ne 61 ]; then
+    echo -e "Thread local storage test test failed"
+    res_code=1
+else
+    echo -e "Thread local storage test test passed"
+fi
+
+
+
+echo -e "Library function override test "
+./build/library_override_test
+if [ $? -ne 42 ]; then
+    echo -e "Library function override test failed"
+    res_code=1
+else
+    echo -e "Library function override test passed"
+fi
+
+
+
 echo -e "All tests finished"
 exit $res_code
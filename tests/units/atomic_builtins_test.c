@@ -0,0 +1,41 @@
+int counter;
+int lock;
+
+int increment(int *value)
+{
+    return __sync_fetch_and_add(value, 5);
+}
+
+int main()
+{
+    int total = 0;
+    int expected = 7;
+    counter = 10;
+    if (increment(&counter) == 10)
+        total = total + 1;
+
+    if (__atomic_fetch_sub(&counter, 3, __ATOMIC_SEQ_CST) == 15)
+        total = total + 2;
+
+    if (__sync_val_compare_and_swap(&counter, 12, 20) == 12)
+        total = total + 4;
+
+    if (__atomic_compare_exchange_n(&counter, &expected, 30, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) == 0)
+    {
+        if (expected == 20)
+            total = total + 8;
+    }
+
+    if (__sync_lock_test_and_set(&lock, 1) == 0)
+        total = total + 16;
+
+    __sync_lock_release(&lock);
+    __sync_synchronize();
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    __atomic_store_n(&counter, 40, __ATOMIC_RELEASE);
+    __atomic_store_n(&counter, __atomic_load_n(&counter, __ATOMIC_ACQUIRE) + 2, __ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&counter, lock, __ATOMIC_ACQ_REL) == 42)
+        total = total + 32;
+
+    return total + counter;
+}
@@ -0,0 +1,43 @@
+int bits(unsigned int x)
+{
+    return __builtin_popcount(x);
+}
+
+unsigned int hash(unsigned int x, int n)
+{
+    return __builtin_rotateleft32(x, n) ^ __builtin_bswap32(x);
+}
+
+int main()
+{
+    unsigned int value = 0xf0f00001;
+    int total = 0;
+    if (bits(value) == 9)
+        total = total + 1;
+
+    if (__builtin_popcount(255) == 8)
+        total = total + 2;
+
+    if (__builtin_clz(value >> 8) + __builtin_clz(1) == 39)
+        total = total + 4;
+
+    if (__builtin_ctz(value >> 4) == 16)
+        total = total + 8;
+
+    if (__builtin_bswap32(0x12345678) == 0x78563412)
+        total = total + 16;
+
+    if (__builtin_bswap16(value) == 0x0100)
+        total = total + 32;
+
+    if (__builtin_rotateleft32(value, 4) == 0x0f00001f)
+        total = total + 64;
+
+    if (__builtin_rotateright32(value, 4) == 0x1f0f0000)
+        total = total + 128;
+
+    if (hash(value, 8) == 0xf100f100)
+        return total;
+
+    return 0;
+}
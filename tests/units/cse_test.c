@@ -0,0 +1,62 @@
+struct header
+{
+    int len;
+    int flags;
+};
+
+struct packet
+{
+    struct header hdr;
+    int x;
+    int y;
+};
+
+struct packet packets[3];
+int counter;
+
+int bump()
+{
+    counter = counter + 1;
+    return counter;
+}
+
+int total_length(struct packet *p)
+{
+    int total = p->hdr.len;
+    total = total + p->hdr.len;
+    p->hdr.len = 1;
+    total = total + p->hdr.len;
+    return total;
+}
+
+int sum_points(int i)
+{
+    int x = packets[i].x;
+    int y = packets[i].y;
+    int product = x * packets[i].y;
+    return x + y + product;
+}
+
+int write_through(int *a, int *b)
+{
+    int before = *a;
+    *b = 7;
+    return before + *a;
+}
+
+int main()
+{
+    int value = 3;
+    packets[1].x = 2;
+    packets[1].y = 3;
+    packets[2].hdr.len = 4;
+
+    int result = sum_points(1);
+    result = result + total_length(&packets[2]);
+    result = result + write_through(&value, &value);
+
+    int before = counter;
+    bump();
+    result = result + counter - before;
+    return result;
+}
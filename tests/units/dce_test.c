@@ -0,0 +1,78 @@
+#define DEBUG 0
+
+int calls;
+
+int trace(int value)
+{
+    calls = calls + 1;
+    return value;
+}
+
+int after_return(int n)
+{
+    return n + 1;
+    trace(100);
+    n = 50;
+}
+
+int skip_to_label(int n)
+{
+    int result = 1;
+    goto done;
+    trace(200);
+    result = 50;
+done:
+    return result + n;
+}
+
+int loop_break(int n)
+{
+    int total = 0;
+    while (1)
+    {
+        total = total + n;
+        break;
+        trace(300);
+    }
+    return total;
+}
+
+int main()
+{
+    int unused;
+    int result = 0;
+    unused = trace(1);
+    unused = 7;
+
+    if (DEBUG)
+    {
+        trace(400);
+        result = 100;
+    }
+    else
+    {
+        result = 2;
+    }
+
+    if (1)
+    {
+        result = result + 1;
+    }
+    else
+    {
+        trace(500);
+    }
+
+    while (0)
+    {
+        trace(600);
+    }
+
+    do
+    {
+        result = result + 1;
+    } while (0);
+
+    result = result + after_return(1) + skip_to_label(2) + loop_break(3);
+    return result + calls;
+}
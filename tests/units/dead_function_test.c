@@ -0,0 +1,28 @@
+int missing_function(int x);
+
+static int counter;
+static int unused_table[64];
+static int scale = 3;
+
+// Calls a function that is never defined, the test only links if this is removed
+static int never_called(int x)
+{
+    unused_table[x] = x;
+    return missing_function(x);
+}
+
+static int only_called_by_dead_code()
+{
+    return never_called(2);
+}
+
+static int triple(int x)
+{
+    counter = counter + 1;
+    return x * scale;
+}
+
+int main()
+{
+    return triple(10) + counter;
+}
@@ -0,0 +1,61 @@
+void exit(int status);
+
+int find(int key)
+{
+    int i;
+    int found = -1;
+    if (key > 100)
+    {
+        return -2;
+    }
+    i = 0;
+    while (i < key)
+    {
+        found = found + 1;
+        i = i + 3;
+    }
+    return found;
+}
+
+int read(int *pointer)
+{
+    if (pointer == 0)
+    {
+        return 100;
+    }
+    return *pointer;
+}
+
+int main()
+{
+    int i;
+    int total = 0;
+    int value = 7;
+    int *pointer = &value;
+    total = find(10);
+    if (__builtin_expect(total < 0, 0))
+    {
+        exit(1);
+    }
+    if (__builtin_expect(total == 3, 1))
+    {
+        total = total + 40;
+    }
+    else
+    {
+        total = 0;
+    }
+    i = 0;
+    while (i < 5)
+    {
+        i++;
+        if (i == 2)
+        {
+            continue;
+        }
+        total = total + 1;
+    }
+    total = total + read(pointer);
+    total = total + read(0);
+    return total;
+}
@@ -0,0 +1,76 @@
+struct point
+{
+    double x;
+    float y;
+};
+
+double half(double x)
+{
+    return x / 2;
+}
+
+float scale(float x, int n)
+{
+    return x * n;
+}
+
+double mix(int a, double b, float c)
+{
+    return a + b * c;
+}
+
+int truncate(double x)
+{
+    // Conversions to integers truncate towards zero
+    return x;
+}
+
+double g = 2.5;
+float gf = -1.25;
+
+int main()
+{
+    int result = 0;
+    double a = 1.5;
+    float b = 2.25f;
+    double c = a * b + 3;
+    if (c == 6.375)
+        result = result + 1;
+
+    if ((half(c) == 3.1875) && (scale(b, 4) == 9))
+        result = result + 2;
+
+    if (mix(1, 0.5, 3) == 2.5)
+        result = result + 4;
+
+    a += 2;
+    a = -a;
+    if (a == -3.5 && (truncate(a) == -3))
+        result = result + 8;
+
+    if (g + gf == 1.25 && 0.5 && !(a > b))
+        result = result + 16;
+
+    unsigned int u = 4000000000;
+    double du = u;
+    if (du == 4000000000.0)
+        result = result + 32;
+
+    struct point pt;
+    pt.x = 0.25;
+    pt.y = pt.x * 2;
+    float f = 0.1f;
+    if (pt.y == 0.5 && pt.x < pt.y && f != 0.1)
+        result = result + 64;
+
+    double sum = 0;
+    int i = 0;
+    while (i < 10)
+    {
+        sum = sum + 0.5;
+        i++;
+    }
+
+    // 127 + 5
+    return result + (int)sum;
+}
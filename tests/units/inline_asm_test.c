@@ -0,0 +1,39 @@
+int counter;
+
+int add(int a, int b)
+{
+    int result;
+    asm volatile("mov %0, %1\n\tadd %0, %2" : "=r"(result) : "r"(a), "r"(b));
+    return result;
+}
+
+int main()
+{
+    int x = 0;
+    int low;
+    int high;
+    asm volatile("pause");
+    asm("mov %0, 42" : "=r"(x));
+    if (x != 42)
+        return 1;
+
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    asm volatile("add %0, %1" : "+r"(x) : "i"(8));
+    if (x != 50)
+        return 2;
+
+    asm volatile("mov esi, %1; add esi, 5; mov %0, esi" : "=r"(x) : "r"(x) : "esi");
+    if (x != 55)
+        return 3;
+
+    counter = 3;
+    asm volatile("add %0, %1" : "+m"(counter) : "r"(x) : "memory");
+    if (counter != 58)
+        return 4;
+
+    asm volatile("inc %0" : "=a"(x) : "0"(add(10, 5)));
+    if (x != 16)
+        return 5;
+
+    return 63;
+}
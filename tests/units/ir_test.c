@@ -0,0 +1,58 @@
+struct point
+{
+    int x;
+    int y;
+};
+
+struct point points[4];
+
+int sum(int *values, int total)
+{
+    int result = 0;
+    int i;
+    for (i = 0; i < total; i++)
+    {
+        result += values[i];
+    }
+    return result;
+}
+
+int classify(int n)
+{
+    switch (n)
+    {
+    case 1:
+        return 10;
+    case 2:
+    case 3:
+        return 20;
+    default:
+        break;
+    }
+    return 30;
+}
+
+int main()
+{
+    int values[5];
+    int i = 0;
+    while (i < 5)
+    {
+        values[i] = i * 2;
+        i++;
+    }
+
+    char c = 250;
+    c = c + 10;
+
+    struct point *p = &points[2];
+    p->x = 3;
+    points[2].y = 4;
+
+    int total = sum(values, 5);
+    if ((total == 20) && (c == 4) && (classify(3) == 20) && (classify(7) == 30))
+    {
+        return p->x * p->y + (i > 4 ? 1 : 0);
+    }
+    return 0;
+}
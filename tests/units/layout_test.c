@@ -0,0 +1,57 @@
+void exit(int code);
+void abort();
+
+int table[16];
+
+int checked(int index)
+{
+    if (index < 0)
+    {
+        exit(3);
+    }
+    if (index >= 16)
+    {
+        abort();
+    }
+    return table[index];
+}
+
+int count_odd(int n)
+{
+    int total = 0;
+    int i = 0;
+    while (i < n)
+    {
+        if (checked(i) & 1)
+        {
+            total = total + 1;
+        }
+        i = i + 1;
+    }
+    return total;
+}
+
+int main()
+{
+    int i;
+    for (i = 0; i < 16; i++)
+    {
+        table[i] = i * 3;
+    }
+
+    int sum = 0;
+    for (i = 0; i < 16; i++)
+    {
+        sum = sum + checked(i);
+    }
+
+    int odd = count_odd(16);
+    if (sum != 360)
+    {
+        return 1;
+    }
+
+    // The error path leaves through exit from the unlikely executed section
+    checked(odd - 9);
+    return 2;
+}
@@ -0,0 +1,16 @@
+int strlen(const char *s);
+
+int calls;
+
+int main()
+{
+    // The builtin would fold this to 3
+    int len = strlen("abc");
+    return len + calls + 1;
+}
+
+int strlen(const char *s)
+{
+    calls = calls + 1;
+    return 40;
+}
@@ -0,0 +1,59 @@
+struct config
+{
+    int count;
+    int stride;
+};
+
+struct config settings;
+int table[16];
+
+int sum_strided(int *values, int n, int stride)
+{
+    int total = 0;
+    int i = 0;
+    while (i < n * stride)
+    {
+        total = total + values[i];
+        i = i + stride;
+    }
+    return total;
+}
+
+int count_up()
+{
+    int total = 0;
+    int i;
+    for (i = 0; i < settings.count; i++)
+    {
+        total = total + settings.stride * 2;
+    }
+    return total;
+}
+
+int fill(int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        // The store means the bound must be loaded again every iteration
+        table[i] = settings.count;
+        settings.count = settings.count - 1;
+    }
+    return table[0] + table[1];
+}
+
+int main()
+{
+    int values[8];
+    int i = 0;
+    do
+    {
+        values[i] = i;
+        i++;
+    } while (i < 8);
+
+    settings.count = 3;
+    settings.stride = 2;
+    int result = sum_strided(values, 4, 2) + count_up();
+    return result + fill(2);
+}
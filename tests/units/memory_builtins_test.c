@@ -0,0 +1,40 @@
+struct point
+{
+    int x;
+    int y;
+    char tag;
+};
+
+struct point a;
+struct point b;
+char buffer[100];
+char other[100];
+
+int main()
+{
+    int total = 0;
+    int n = 7;
+    int c = 'a';
+    a.x = 5;
+    a.y = 9;
+    a.tag = 3;
+    memset(&b, 0, sizeof(struct point));
+    memcpy(&b, &a, sizeof(struct point));
+    if (b.x + b.y + b.tag == 17)
+        total = total + 1;
+
+    memset(&buffer, c, 100);
+    memset(&other, 'a', n);
+    memcpy(&other, &buffer, 95);
+    if (memcmp(&buffer, &other, 95) == 0 && other[94] == 'a')
+        total = total + 2;
+
+    other[10] = 'b';
+    if (memcmp(&buffer, &other, 11) < 0)
+        total = total + 4;
+
+    if (strlen("hello") == 5)
+        total = total + 8;
+
+    return total;
+}
@@ -0,0 +1,39 @@
+int weight(int kind)
+{
+    switch (kind)
+    {
+    case 0:
+        return 1;
+    case 1:
+        return 2;
+    case 2:
+        return 5;
+    }
+    return 0;
+}
+
+int never_called(int x)
+{
+    return x * 3;
+}
+
+int main()
+{
+    int i;
+    int kind;
+    int total = 0;
+    for (i = 0; i < 16; i++)
+    {
+        kind = 2;
+        if (i == 3)
+        {
+            kind = 1;
+        }
+        total = total + weight(kind);
+    }
+    if (total == 0)
+    {
+        total = never_called(total);
+    }
+    return total;
+}
@@ -0,0 +1,101 @@
+static int add3(int a, int b, int c)
+{
+    return a * 100 + b * 10 + c;
+}
+
+static int five(int a, int b, int c, int d, int e)
+{
+    return a + b * 2 + c * 3 + d * 4 + e * 5;
+}
+
+static int narrow(char a, short b)
+{
+    return a + b;
+}
+
+static int through(int *pointer, int value)
+{
+    *pointer = value;
+    return value + 1;
+}
+
+static int address(int a, int b)
+{
+    int *p = &a;
+    *p = b;
+    return a + b;
+}
+
+static int count(int n, int total)
+{
+    if (n == 0)
+    {
+        return total;
+    }
+
+    return count(n - 1, total + 1);
+}
+
+static int sibling(int a, int b, int c, int d)
+{
+    return five(d, c, b, a, 1);
+}
+
+static int escapes(int a, int b)
+{
+    return a - b;
+}
+
+int public_sum(int a, int b)
+{
+    return add3(a, b, 0);
+}
+
+int main()
+{
+    int result = 0;
+    int value = 0;
+    void *pointer = escapes;
+    if (add3(1, 2, 3) != 123)
+    {
+        return 1;
+    }
+    if (five(1, 2, 3, 4, 5) != 55)
+    {
+        return 2;
+    }
+    if (narrow(3, 400) != 403)
+    {
+        return 3;
+    }
+    if (through(&value, 9) != 10)
+    {
+        return 4;
+    }
+    if (value != 9)
+    {
+        return 5;
+    }
+    if (address(5, 6) != 12)
+    {
+        return 6;
+    }
+    if (count(2000000, 0) != 2000000)
+    {
+        return 7;
+    }
+    if (sibling(1, 2, 3, 4) != 4 + 6 + 6 + 4 + 5)
+    {
+        return 8;
+    }
+    if (escapes(10, 3) != 7)
+    {
+        return 9;
+    }
+    if (public_sum(4, 5) != 450)
+    {
+        return 10;
+    }
+    result = add3(five(1, 1, 1, 1, 1), narrow(1, 1), add3(0, 0, 4));
+    return result - 1500;
+}
@@ -0,0 +1,23 @@
+int check(int value)
+{
+    if (value < 0)
+    {
+        return 100;
+    }
+    return value & 7;
+}
+
+int main()
+{
+    int i;
+    int total = 0;
+    for (i = 0; i < 20; i++)
+    {
+        total = total + check(i);
+    }
+    if (total > 200)
+    {
+        total = 0;
+    }
+    return total;
+}
@@ -0,0 +1,33 @@
+int sum(int n)
+{
+    int total;
+    total = 0;
+    if (n > 2)
+    {
+        int a[4];
+        a[0] = n;
+        a[3] = n * 2;
+        total = a[0] + a[3];
+    }
+    else
+    {
+        int b[4];
+        b[1] = 7;
+        b[2] = n;
+        total = b[1] - b[2];
+    }
+    if (total)
+    {
+        int c;
+        int d;
+        c = total + 1;
+        d = c * 2;
+        total = d;
+    }
+    return total;
+}
+
+int main()
+{
+    return sum(5) + sum(1);
+}
@@ -0,0 +1,85 @@
+struct point
+{
+    int x;
+    int y;
+};
+
+struct point points[6];
+char text[12];
+int grid[4][5];
+
+int sum_points(int n)
+{
+    int i;
+    int total = 0;
+    for (i = 0; i < n; i++)
+    {
+        total = total + points[i].y;
+    }
+    return total;
+}
+
+int count_chars(char *s, int n)
+{
+    int i;
+    int total = 0;
+    for (i = 0; i < n; i++)
+    {
+        total = total + s[i];
+    }
+    return total + i;
+}
+
+int sum_grid()
+{
+    int total = 0;
+    int r;
+    int c;
+    for (r = 0; r < 4; r++)
+    {
+        for (c = 0; c < 5; c++)
+        {
+            total = total + grid[r][c];
+        }
+    }
+    return total;
+}
+
+int pairs(int *v, int n)
+{
+    int i;
+    int total = 0;
+    for (i = 0; i < n - 1; i++)
+    {
+        total = total + v[i + 1] - v[i];
+    }
+    return total;
+}
+
+int main()
+{
+    int i;
+    int j;
+    for (i = 0; i < 6; i++)
+    {
+        points[i].x = i;
+        points[i].y = i * 3;
+    }
+    for (i = 0; i < 12; i++)
+    {
+        text[i] = i + 1;
+    }
+    for (i = 0; i < 4; i++)
+    {
+        for (j = 0; j < 5; j++)
+        {
+            grid[i][j] = i + j;
+        }
+    }
+    int v[5];
+    for (i = 0; i < 5; i++)
+    {
+        v[i] = i * i;
+    }
+    return sum_points(6) + count_chars(text, 12) + sum_grid() + pairs(v, 5);
+}
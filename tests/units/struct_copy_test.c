@@ -0,0 +1,68 @@
+struct small
+{
+    int a;
+    int b;
+};
+
+struct medium
+{
+    int values[40];
+    int tail;
+};
+
+struct large
+{
+    int values[1030];
+    int tail;
+};
+
+struct large global_large;
+
+int sum_medium(struct medium m)
+{
+    return m.values[0] + m.values[39] + m.tail;
+}
+
+int sum_large(struct large l)
+{
+    return l.values[0] + l.values[1029] + l.tail;
+}
+
+struct medium make_medium(int x)
+{
+    struct medium m;
+    m.values[0] = x;
+    m.values[39] = x * 2;
+    m.tail = 3;
+    return m;
+}
+
+struct large make_large(int x)
+{
+    struct large l;
+    l.values[0] = x;
+    l.values[1029] = x + 1;
+    l.tail = 5;
+    return l;
+}
+
+int main()
+{
+    struct small s1;
+    struct small s2;
+    struct medium m1;
+    struct medium m2;
+    struct large l1;
+    int result;
+    s1.a = 1;
+    s1.b = 2;
+    s2 = s1;
+    m1 = make_medium(4);
+    m2 = m1;
+    l1 = make_large(7);
+    global_large = l1;
+    result = s2.a + s2.b;
+    result = result + sum_medium(m2);
+    result = result + sum_large(global_large);
+    return result;
+}
@@ -0,0 +1,47 @@
+struct span
+{
+    int start;
+    int length;
+    int step;
+};
+
+struct span make_span(int start, int length)
+{
+    struct span s;
+    s.start = start;
+    s.length = length;
+    s.step = 1;
+    return s;
+}
+
+struct span shifted_span(int start, int length)
+{
+    return make_span(start + 1, length);
+}
+
+struct span joined_span(struct span left, struct span right)
+{
+    struct span s;
+    s.start = left.start;
+    s.length = left.length + right.length;
+    s.step = right.step;
+    return s;
+}
+
+int span_end(struct span s)
+{
+    return s.start + s.length;
+}
+
+int main()
+{
+    struct span a = shifted_span(2, 5);
+    struct span b = a;
+    struct span c;
+    int result;
+    c = joined_span(make_span(1, 2), b);
+    a = make_span(a.length, a.start);
+    result = span_end(b) + c.length;
+    result = result + a.start * 10;
+    return result + a.length;
+}
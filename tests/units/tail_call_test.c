@@ -0,0 +1,63 @@
+int count(int n, int total)
+{
+    if (n == 0)
+    {
+        return total;
+    }
+
+    return count(n - 1, total + 1);
+}
+
+int count_from(int n)
+{
+    return count(n, 0);
+}
+
+int is_odd(int n);
+
+// Sibling calls that fit in the callers argument area reuse its frame
+int is_even(int n)
+{
+    if (n == 0)
+    {
+        return 1;
+    }
+
+    return is_odd(n - 1);
+}
+
+int is_odd(int n)
+{
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    return is_even(n - 1);
+}
+
+int swap(int a, int b)
+{
+    if (a > 100)
+    {
+        return a - b;
+    }
+
+    return swap(b + 200, a);
+}
+
+int main()
+{
+    // Deep enough to overflow the stack without tail calls
+    if (count_from(5000000) != 5000000)
+    {
+        return 0;
+    }
+
+    if (is_even(5000000) != 1 || is_odd(5000001) != 1)
+    {
+        return 0;
+    }
+
+    return swap(5, 7);
+}
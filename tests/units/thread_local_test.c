@@ -0,0 +1,40 @@
+__thread int counter;
+_Thread_local int base = 40;
+__thread char flag = 3;
+
+struct cache
+{
+    int hits;
+    int misses;
+};
+
+__thread struct cache cache;
+int shared = 5;
+
+int bump(int amount)
+{
+    counter += amount;
+    return counter;
+}
+
+int main()
+{
+    int *p = &counter;
+    bump(2);
+    bump(3);
+    if (counter != 5)
+        return 1;
+
+    *p = 7;
+    if (counter != 7)
+        return 2;
+
+    cache.hits = 4;
+    cache.misses = cache.hits + 1;
+    if (cache.misses != 5)
+        return 3;
+
+    flag = flag + 1;
+    base = base + flag;
+    return base + counter + shared + cache.misses;
+}
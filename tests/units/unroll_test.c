@@ -0,0 +1,56 @@
+int squares[8];
+
+int sum_to(int n)
+{
+    int total = 0;
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        total = total + i;
+    }
+    return total;
+}
+
+int fill_squares()
+{
+    int i;
+    for (i = 0; i < 8; i++)
+    {
+        squares[i] = i * i;
+    }
+    return i;
+}
+
+int odd_sum(int n)
+{
+    int i = 1;
+    int total = 0;
+    while (i <= n)
+    {
+        total = total + i;
+        i = i + 2;
+    }
+    return total + i;
+}
+
+int grid(int rows)
+{
+    int total = 0;
+    int i;
+    int j;
+    for (i = 0; i < rows; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            total = total + i * j;
+        }
+    }
+    return total;
+}
+
+int main()
+{
+    int last = fill_squares();
+    int result = sum_to(10) + sum_to(3) + sum_to(0) + odd_sum(9) + odd_sum(2) + grid(5);
+    return result + squares[7] + last - 150;
+}
@@ -0,0 +1,72 @@
+int first[40];
+int second[40];
+int result[40];
+char text[48];
+short samples[24];
+
+void add(int *out, int *a, int *b, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        out[i] = a[i] + b[i];
+    }
+}
+
+int sum(int *a, int n)
+{
+    int total = 0;
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        total += a[i];
+    }
+    return total;
+}
+
+int find(char *p, int n, int c)
+{
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        if (p[i] == c)
+            return i;
+    }
+    return -1;
+}
+
+void bump(short *p, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        p[i] = p[i] + 3;
+    }
+}
+
+int main()
+{
+    int i;
+    for (i = 0; i < 40; i++)
+    {
+        first[i] = i;
+        second[i] = i * 2;
+    }
+    for (i = 0; i < 48; i++)
+    {
+        text[i] = i + 1;
+    }
+
+    add(result, first, second, 39);
+    int total = sum(result, 39);
+    int found = find(text, 48, 30);
+    found = found + find(text, 48, 200);
+    found = found + find(text, 10, 9);
+
+    // Overlapping arrays must give the same result as the scalar loop
+    add(first + 1, first, second, 20);
+    bump(samples, 21);
+    int scalars = first[20] + samples[20];
+    scalars = scalars + samples[0];
+    return (total - 2223) + found + (scalars - 390);
+}
@@ -0,0 +1,44 @@
+int add(int a, int b)
+{
+    return a + b;
+}
+
+int seven(int a, int b, int c, int d, int e, int f, int g)
+{
+    // The seventh argument is passed on the stack
+    return g - a;
+}
+
+int count(int n, int total)
+{
+    if (n == 0)
+    {
+        return total;
+    }
+
+    return count(n - 1, total + 1);
+}
+
+char buf[16];
+int len(char *s)
+{
+    int n = 0;
+    while (*s)
+    {
+        s++;
+        n++;
+    }
+    return n;
+}
+
+int main()
+{
+    int x = 10;
+    int *p = &x;
+    int **pp = &p;
+    **pp = 20;
+    buf[0] = 'a';
+    buf[1] = 'b';
+    buf[2] = 0;
+    return add(x, 3) + seven(1, 2, 3, 4, 5, 6, 9) + len(buf) + len("xyz") + count(1000, 0) - 1000;
+}
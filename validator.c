@@ -156,11 +156,21 @@ void validate_function_node(struct node* node)
 {
     current_function = node;
     
-    if (!(node->flags & NODE_FLAG_IS_FORWARD_DECLARATION))
+    // A function may be defined once after any number of prototypes
+    struct symbol* sym = symresolver_get_symbol(validator_current_compile_process, node->func.name);
+    bool after_prototype = sym && sym->type == SYMBOL_TYPE_NODE && ((struct node*)sym->data)->type == NODE_TYPE_FUNCTION &&
+                           function_node_is_prototype(sym->data);
+    if (!function_node_is_prototype(node) && !after_prototype)
     {
         validate_symbol_unique(node->func.name, "function", node);
     }
 
+    if (after_prototype)
+    {
+        // The definition replaces the prototype so a second definition is still caught
+        sym->data = node;
+    }
+
     symresolver_register_symbol(validator_current_compile_process, node->func.name, SYMBOL_TYPE_NODE, node);
 
     // We have a scope shares by arguments and body